@@ -62,30 +62,202 @@
 
 
 //MITM Manager
-static bool flag_security_proc_started = false;
-static bool flag_security_proc_failed = false;
 // settings
 static char keyb_ble_name[_BLE_DEVICE_NAME_LEN + 6];  // Plus 6 for " - channel_number\0", where channel_number is a 2 digits number.
-static uint8_t connected_device_name[_BLE_DEVICE_NAME_LEN];  // Declared as uint8_t * because that is what the SDK uses.
-static uint8_t connected_device_address[BLE_GAP_ADDR_LEN];
+static char keyb_ble_base_name[_BLE_DEVICE_NAME_LEN];  // Name given by set_device_name(), without the channel number.
+static uint8_t connected_device_name[_BLE_DEVICE_NAME_LEN];  // Declared as uint8_t * because that is what the SDK uses. Copy of the active link one.
+static uint8_t connected_device_address[BLE_GAP_ADDR_LEN];    // Copy of the active link one.
 
 static bool active_whitelist_flag = false;
 static uint8_t current_channel = 0xFF;
 
 static bool flag_ble_innited = false;
-static bool flag_ble_connected = false;
-static bool flag_ble_is_adv_mode = false;
-static bool flag_ble_is_idle = false;
-uint16_t m_conn_handle = BLE_CONN_HANDLE_INVALID; /* Handle of the current connection. */
-static pm_peer_id_t m_peer_id;                           /* Device reference handle to the current bonded central. */
+
+/*
+    Link state machine.
+    The state is derived from the advertising state and from the active output link, and stored
+    atomically so it can be read from any interrupt priority. Subscribers are called on every change.
+*/
+typedef enum
+{
+    ADV_STATE_OFF,      /* Never started or stopped by the application. */
+    ADV_STATE_RUNNING,
+    ADV_STATE_IDLE,     /* All advertising modes timed out. */
+} adv_state_t;
+static volatile adv_state_t adv_state = ADV_STATE_OFF;
+static nrf_atomic_u32_t link_state = BLE_LINK_STATE_OFF;
+static BleLinkStateHandler_t link_state_handlers[BLE_LINK_STATE_HANDLERS_MAX];
+
+/* Events latched until the application clears them. */
+#define LINK_FLAG_SECURITY_STARTED      (1U << 0)
+#define LINK_FLAG_SECURITY_FAILED       (1U << 1)
+#define LINK_FLAG_NAME_CHANGED          (1U << 2)
+static nrf_atomic_u32_t link_flags = 0;
+uint16_t m_conn_handle = BLE_CONN_HANDLE_INVALID; /* Handle of the active output link, the one receiving the input reports. */
+static pm_peer_id_t m_peer_id;                           /* Device reference handle to the bonded central of the active output link. */
 static bool flag_peer_deleted = false;
 static bool flag_all_peers_deleted = false;
-static bool flag_connected_device_name_changed = false;
 static ble_uuid_t m_adv_uuids[] = {{BLE_UUID_HUMAN_INTERFACE_DEVICE_SERVICE, BLE_UUID_TYPE_BLE}};
 
+/* Context of each connected central, indexed by ble_conn_state_conn_idx(). */
+typedef struct
+{
+    uint16_t conn_handle;                         /* BLE_CONN_HANDLE_INVALID if the slot is free. */
+    pm_peer_id_t peer_id;
+    bool securing;                                /* Security procedure in progress. */
+    bool secured;                                 /* Security procedure succeeded on this link. */
+    uint16_t att_mtu;                             /* Negotiated ATT MTU. */
+    uint8_t data_length;                          /* Negotiated link layer data length. */
+    uint8_t device_name[_BLE_DEVICE_NAME_LEN];
+    uint8_t device_address[BLE_GAP_ADDR_LEN];
+} ble_link_t;
+static ble_link_t links[NRF_SDH_BLE_TOTAL_LINK_COUNT];
+
+/* Identity of each channel, built once so switching channel does not have to format or measure anything. */
+typedef struct
+{
+    bool valid;                                                 /* Address and name are up to date. */
+    ble_gap_addr_t addr;
+    char name[_BLE_DEVICE_NAME_LEN + 6];                        /* "name - N" */
+    bool name_in_scan_rsp;                                      /* Full name in the scan response, it does not fit in the advertising data. */
+    pm_peer_id_t peers[BLE_GAP_WHITELIST_ADDR_MAX_COUNT];       /* Centrals bonded while on this channel. */
+    uint8_t peer_count;
+} ble_channel_cache_t;
+static ble_channel_cache_t channel_cache[BLE_CHANNELS_COUNT];
+static ble_channel_switch_stats_t channel_switch_stats;
+
+/*
+    Last central connected on each channel, kept in the application data of its peer record so it
+    survives a power cycle. The most recent record of a channel wins.
+*/
+typedef struct
+{
+    uint32_t seq;         /* Increased on every store. */
+    uint8_t channel;
+    uint8_t reserved[3];  /* Peer Manager application data is word sized. */
+} ble_last_peer_record_t;
+static pm_peer_id_t channel_last_peer[BLE_CHANNELS_COUNT];
+static ble_last_peer_record_t last_peer_records[BLE_CHANNELS_COUNT];
+static uint32_t last_peer_seq = 0;
+
+/* Bonded centrals, read once from flash so the advertising events are answered from RAM. */
+typedef struct
+{
+    pm_peer_id_t peer_id;
+    ble_gap_id_key_t id_key;  /* Identity address and IRK. */
+    uint8_t filters;          /* Bit n set when the peer passes bond_cache_filters[n]. */
+} ble_bond_cache_entry_t;
+static const pm_peer_id_list_skip_t bond_cache_filters[] = {PM_PEER_ID_LIST_SKIP_NO_ID_ADDR, PM_PEER_ID_LIST_SKIP_NO_IRK,
+                                                            PM_PEER_ID_LIST_SKIP_ALL};
+static ble_bond_cache_entry_t bond_cache[BLE_BOND_CACHE_SIZE];  /* In peer ID order, as pm_peer_id_list(). */
+static uint8_t bond_cache_count = 0;
+static bool bond_cache_complete = false;                        /* Every bonded central fits in the cache. */
+
+/* Lists last given to the Peer Manager, given again only when they change. */
+static pm_peer_id_t whitelist_peers[BLE_GAP_WHITELIST_ADDR_MAX_COUNT];
+static uint32_t whitelist_peer_count = 0;
+static bool whitelist_applied = false;
+static pm_peer_id_t identity_peers[BLE_GAP_DEVICE_IDENTITIES_MAX_COUNT];
+static uint32_t identity_peer_count = 0;
+static bool identities_applied = false;
+
+/* Fast reconnect timing, from ble_goto_advertising_mode() to the link being usable. */
+static ble_reconnect_stats_t reconnect_stats;
+static uint32_t wake_ticks;
+static bool wake_connect_pending = false;
+static bool wake_encrypt_pending = false;
+static bool adv_directed = false;  /* Directed advertising is running. */
+
+/*
+    SoftDevice configuration profiles, applied by ble_stack_init().
+    The default profile keeps the sdk_config.h values.
+*/
+static const ble_stack_config_t stack_profiles[BLE_STACK_PROFILE_COUNT] =
+{
+    [BLE_STACK_PROFILE_DEFAULT] = {.hvn_tx_queue_size = BLE_GATTS_HVN_TX_QUEUE_SIZE_DEFAULT, .event_length = NRF_SDH_BLE_GAP_EVENT_LENGTH,
+                                   .conn_evt_ext = false, .attr_tab_size = NRF_SDH_BLE_GATTS_ATTR_TAB_SIZE},
+    [BLE_STACK_PROFILE_LOW_POWER] = {.hvn_tx_queue_size = 2, .event_length = 3, .conn_evt_ext = false, .attr_tab_size = BLE_STACK_ATTR_TAB_SIZE},
+    [BLE_STACK_PROFILE_GAMING] = {.hvn_tx_queue_size = 4, .event_length = 6, .conn_evt_ext = true, .attr_tab_size = BLE_STACK_ATTR_TAB_SIZE},
+    [BLE_STACK_PROFILE_BULK] = {.hvn_tx_queue_size = 8, .event_length = 12, .conn_evt_ext = true, .attr_tab_size = BLE_STACK_ATTR_TAB_SIZE},
+};
+static ble_stack_profile_t stack_profile = BLE_STACK_PROFILE;
+static ble_stack_config_t stack_config;
+static bool stack_config_custom = false;  /* Set by ble_stack_config_set() instead of a profile. */
+static bool stack_enabled = false;
+static ble_stack_ram_t stack_ram;
+
+/* Adaptive connection parameters. */
+typedef enum
+{
+    CONN_PARAMS_MODE_NONE,    /* Parameters chosen by the central at connection time. */
+    CONN_PARAMS_MODE_ACTIVE,
+    CONN_PARAMS_MODE_IDLE,
+} conn_params_mode_t;
+
+static conn_params_mode_t conn_params_mode = CONN_PARAMS_MODE_NONE;
+static uint16_t active_conn_interval_min = ACTIVE_CONN_INTERVAL_MIN;  /* Shortest interval not rejected by the current host. */
+static volatile uint32_t last_activity_ticks = 0;
+static volatile bool conn_idle_timer_running = false;
+static uint32_t conn_idle_timeout_ticks = APP_TIMER_TICKS(CONN_IDLE_TIMEOUT_MS);
+static ConnParamsHandler_t conn_params_handler = NULL;
+APP_TIMER_DEF(m_conn_idle_timer);
+
+/* Slave latency is disabled while typing so the first key after a pause is not delayed. */
+static bool slave_latency_auto = true;
+static volatile bool slave_latency_disabled = false;
+static volatile bool latency_quiet_timer_running = false;
+static ble_slave_latency_stats_t slave_latency_stats;
+APP_TIMER_DEF(m_latency_quiet_timer);
+
+/* Asynchronous disconnection and bond deletion, one at a time. */
+static volatile ble_async_op_t async_op = BLE_ASYNC_OP_NONE;
+static uint16_t async_conn_handle = BLE_CONN_HANDLE_INVALID;
+static pm_peer_id_t async_peer_id = PM_PEER_ID_INVALID;
+static AsyncOpHandler_t async_op_handler = NULL;
+APP_TIMER_DEF(m_async_op_timer);
+
+/*
+    Two class event scheduler run from ble_run().
+    Every high priority event runs before any low priority one, and only BLE_SCHED_LOW_EVENTS_PER_RUN
+    low priority events run per call so housekeeping never holds the main loop for long.
+*/
+typedef struct
+{
+    app_sched_event_handler_t handler;
+    uint16_t size;
+    uint8_t data[BLE_SCHED_EVENT_DATA_SIZE];
+} sched_event_t;
+typedef struct
+{
+    sched_event_t *p_events;
+    uint8_t queue_size;
+    uint8_t head;
+    uint8_t count;
+    ble_sched_stats_t stats;
+} sched_queue_t;
+static sched_event_t sched_high_events[BLE_SCHED_HIGH_QUEUE_SIZE];
+static sched_event_t sched_low_events[BLE_SCHED_LOW_QUEUE_SIZE];
+static sched_queue_t sched_queues[BLE_SCHED_PRIO_COUNT] =
+{
+    [BLE_SCHED_PRIO_HIGH] = {.p_events = sched_high_events, .queue_size = BLE_SCHED_HIGH_QUEUE_SIZE},
+    [BLE_SCHED_PRIO_LOW] = {.p_events = sched_low_events, .queue_size = BLE_SCHED_LOW_QUEUE_SIZE},
+};
+
+/*
+    Battery level notifications share the TX buffers with the HID reports.
+    A level is kept pending until the policy allows it and sent on a later call or TX complete event.
+*/
+static ble_battery_policy_t battery_policy = {BLE_BATTERY_HYSTERESIS, BLE_BATTERY_MIN_INTERVAL_MS, BLE_BATTERY_SEND_IDLE};
+static ble_battery_stats_t battery_stats;
+static bool battery_pending = false;
+static uint8_t battery_pending_level;
+static uint8_t battery_level_notified;  /* Last level the host was notified of, the hysteresis reference. */
+static bool battery_notified = false;  /* A notification was sent on this connection, the minimum interval applies. */
+static uint32_t battery_notified_ticks;
+
 BLE_BAS_DEF(m_bas);                 /* Structure used to identify the battery service. */
 NRF_BLE_GATT_DEF(m_gatt);           /* GATT module instance. */
-NRF_BLE_QWR_DEF(m_qwr);             /* Context for the Queued Write module.*/
+NRF_BLE_QWRS_DEF(m_qwr, NRF_SDH_BLE_TOTAL_LINK_COUNT); /* Context for the Queued Write module, one per link.*/
 BLE_ADVERTISING_DEF(m_advertising); /* Advertising module instance. */
 
 
@@ -93,6 +265,7 @@ static void power_management_init(void);
 static void ble_stack_init(void);
 static void scheduler_init(void);
 static void gatt_init(void);
+static void gatt_event_handler(nrf_ble_gatt_t *p_gatt, nrf_ble_gatt_evt_t const *p_evt);
 static void services_init(void);
 static void conn_params_init(void);
 static void peer_manager_init(void);
@@ -100,6 +273,9 @@ static void peer_manager_init(void);
 static void on_adv_evt(ble_adv_evt_t ble_adv_evt);
 static void ble_advertising_error_handler(uint32_t nrf_error);
 static void identities_set(pm_peer_id_list_skip_t skip);
+static void battery_pending_flush(void);
+static void battery_level_apply(uint8_t battery_level);
+static void battery_level_update_scheduled(void *p_event_data, uint16_t event_size);
 
 static void qwr_init(void);
 static void nrf_qwr_error_handler(uint32_t nrf_error);
@@ -108,12 +284,42 @@ static void bas_init(void);
 //static void service_error_handler(uint32_t nrf_error);
 
 static void conn_params_error_handler(uint32_t nrf_error);
+static void conn_params_event_handler(ble_conn_params_evt_t *p_evt);
+static void conn_idle_timeout_handler(void *p_context);
+static void conn_params_request(conn_params_mode_t mode);
+static void latency_quiet_timeout_handler(void *p_context);
 
 static void peer_manager_event_handler(pm_evt_t const *p_evt);
 static void whitelist_set(pm_peer_id_list_skip_t skip);
+static void whitelist_update_scheduled(void *p_event_data, uint16_t event_size);
 
 static void ble_event_handler(ble_evt_t const *ble_event, void *context);
-static void save_connected_device_name(uint8_t *name, uint16_t len);
+static void save_connected_device_name(ble_link_t *p_link, uint8_t *name, uint16_t len);
+static void device_name_update_scheduled(void *p_event_data, uint16_t event_size);
+static void save_connected_device_address(ble_link_t *p_link, ble_gap_addr_t gapAddr);
+static ble_link_t *link_get(uint16_t conn_handle);
+static void active_link_update(void);
+static void adv_state_set(adv_state_t state);
+static void link_state_update(void);
+static void advdata_common_set(ble_advdata_t *p_advdata);
+static void channel_cache_build(uint8_t channel);
+static void channel_peer_add(uint8_t channel, pm_peer_id_t peer_id);
+static void channel_peer_remove(pm_peer_id_t peer_id);
+static uint32_t channel_peers_filter(pm_peer_id_t *p_peer_ids, uint32_t peer_id_count);
+static void bond_cache_load(void);
+static void bond_cache_peer_update(pm_peer_id_t peer_id);
+static void bond_cache_peer_remove(pm_peer_id_t peer_id);
+static uint32_t bond_cache_peer_ids_get(pm_peer_id_t *p_peer_ids, uint32_t max_count, pm_peer_id_list_skip_t skip);
+static bool bond_cache_peer_addr_get(pm_peer_id_t peer_id, ble_gap_addr_t *p_addr);
+static ret_code_t bond_cache_whitelist_get(ble_gap_addr_t *p_addrs, uint32_t *p_addr_cnt, ble_gap_irk_t *p_irks, uint32_t *p_irk_cnt);
+static void last_peers_load(void);
+static void last_peer_store(uint8_t channel, pm_peer_id_t peer_id);
+static void last_peer_write_scheduled(void *p_event_data, uint16_t event_size);
+static void last_peer_forget(pm_peer_id_t peer_id);
+static pm_peer_id_t directed_peer_get(void);
+static uint32_t wake_elapsed_us(void);
+static void async_op_timeout_handler(void *p_context);
+static void async_op_complete(ble_async_op_t op, ble_async_result_t result);
 
 EventHandlerDeviceName_t evenHandlerDeviceName = NULL;
 
@@ -129,6 +335,12 @@ void ble_module_init(void)
     services_init();
     conn_params_init();
     peer_manager_init();
+
+    for (uint8_t channel = 0; channel < BLE_CHANNELS_COUNT; channel++)
+    {
+        channel_cache_build(channel);
+    }
+
     flag_ble_innited = true;
 }
 
@@ -142,6 +354,32 @@ static void power_management_init(void)
     APP_ERROR_CHECK(err_code);
 }
 
+static ret_code_t stack_config_apply(ble_stack_config_t const *p_config, uint32_t ram_start)
+{
+    /*
+        Function for setting the SoftDevice configuration of a profile, before the BLE stack is enabled.
+    */
+    ret_code_t err_code;
+    ble_cfg_t ble_cfg;
+
+    memset(&ble_cfg, 0, sizeof(ble_cfg));
+    ble_cfg.conn_cfg.conn_cfg_tag = APP_BLE_CONN_CFG_TAG;
+    ble_cfg.conn_cfg.params.gap_conn_cfg.conn_count = NRF_SDH_BLE_TOTAL_LINK_COUNT;
+    ble_cfg.conn_cfg.params.gap_conn_cfg.event_length = p_config->event_length;
+    err_code = sd_ble_cfg_set(BLE_CONN_CFG_GAP, &ble_cfg, ram_start);
+    if (err_code != NRF_SUCCESS) return err_code;
+
+    memset(&ble_cfg, 0, sizeof(ble_cfg));
+    ble_cfg.conn_cfg.conn_cfg_tag = APP_BLE_CONN_CFG_TAG;
+    ble_cfg.conn_cfg.params.gatts_conn_cfg.hvn_tx_queue_size = p_config->hvn_tx_queue_size;
+    err_code = sd_ble_cfg_set(BLE_CONN_CFG_GATTS, &ble_cfg, ram_start);
+    if (err_code != NRF_SUCCESS) return err_code;
+
+    memset(&ble_cfg, 0, sizeof(ble_cfg));
+    ble_cfg.gatts_cfg.attr_tab_size.attr_tab_size = p_config->attr_tab_size;
+    return sd_ble_cfg_set(BLE_GATTS_CFG_ATTR_TAB_SIZE, &ble_cfg, ram_start);
+}
+
 static void ble_stack_init(void)
 {
     /*
@@ -154,20 +392,102 @@ static void ble_stack_init(void)
     err_code = nrf_sdh_enable_request();
     APP_ERROR_CHECK(err_code);
 
-    // Configure the BLE stack using the default settings.
+    if (!stack_config_custom)
+    {
+        stack_config = stack_profiles[stack_profile];
+    }
+
+    // Configure the BLE stack using the default settings, then the profile.
     // Fetch the start address of the application RAM.
     uint32_t ram_start_addr = 0;
     err_code = nrf_sdh_ble_default_cfg_set(APP_BLE_CONN_CFG_TAG, &ram_start_addr);
     APP_ERROR_CHECK(err_code);
+    stack_ram.app_ram_start = ram_start_addr;
+
+    err_code = stack_config_apply(&stack_config, ram_start_addr);
+    APP_ERROR_CHECK(err_code);
 
-    // Enable BLE stack.
+    // Enable BLE stack. The SoftDevice returns the application RAM start the configuration needs.
     err_code = nrf_sdh_ble_enable(&ram_start_addr);
+    stack_ram.required_ram_start = ram_start_addr;
+    if ((err_code == NRF_ERROR_NO_MEM) && (memcmp(&stack_config, &stack_profiles[BLE_STACK_PROFILE_DEFAULT], sizeof(stack_config)) != 0))
+    {
+#if (BLUETOOTH_DEBUG_LOG > 0)
+        NRF_LOG_WARNING("BLE: Stack profile needs RAM from 0x%x, application starts at 0x%x", stack_ram.required_ram_start,
+                        stack_ram.app_ram_start);
+#endif
+        // Keep the keyboard working with the sdk_config.h values.
+        stack_config = stack_profiles[BLE_STACK_PROFILE_DEFAULT];
+        stack_ram.fallback = true;
+
+        ram_start_addr = stack_ram.app_ram_start;
+        err_code = stack_config_apply(&stack_config, ram_start_addr);
+        APP_ERROR_CHECK(err_code);
+        err_code = nrf_sdh_ble_enable(&ram_start_addr);
+        stack_ram.required_ram_start = ram_start_addr;
+    }
     APP_ERROR_CHECK(err_code);
+    stack_enabled = true;
+
+    if (stack_config.conn_evt_ext)
+    {
+        ble_opt_t opt;
+        memset(&opt, 0, sizeof(opt));
+        opt.common_opt.conn_evt_ext.enable = 1;
+        err_code = sd_ble_opt_set(BLE_COMMON_OPT_CONN_EVT_EXT, &opt);
+        APP_ERROR_CHECK(err_code);
+    }
+
+    // The HID TX arbiter hands out as many notification credits as the SoftDevice has buffers.
+    ble_hid_tx_credits_set(stack_config.hvn_tx_queue_size);
 
     // Register a handler for BLE events.
     NRF_SDH_BLE_OBSERVER(m_ble_observer, APP_BLE_OBSERVER_PRIO, ble_event_handler, NULL);
 }
 
+/**
+ * @brief Choose the SoftDevice configuration profile.
+ *
+ * @details Must be called before ble_module_init(). A profile that needs more RAM than the application leaves
+ *          to the SoftDevice is replaced by the default one, see ble_stack_ram_get().
+ *
+ * @return NRF_ERROR_INVALID_STATE if the BLE stack is already enabled.
+ */
+ret_code_t ble_stack_profile_set(ble_stack_profile_t profile)
+{
+    if (profile >= BLE_STACK_PROFILE_COUNT) return NRF_ERROR_INVALID_PARAM;
+    if (stack_enabled) return NRF_ERROR_INVALID_STATE;
+
+    stack_profile = profile;
+    stack_config_custom = false;
+    return NRF_SUCCESS;
+}
+
+/**
+ * @brief Use a SoftDevice configuration of its own instead of a profile, i.e. for a SKU.
+ *
+ * @details Must be called before ble_module_init().
+ */
+ret_code_t ble_stack_config_set(ble_stack_config_t const *p_config)
+{
+    if ((p_config->hvn_tx_queue_size == 0) || (p_config->event_length == 0)) return NRF_ERROR_INVALID_PARAM;
+    if (stack_enabled) return NRF_ERROR_INVALID_STATE;
+
+    stack_config = *p_config;
+    stack_config_custom = true;
+    return NRF_SUCCESS;
+}
+
+void ble_stack_config_get(ble_stack_config_t *p_config)
+{
+    *p_config = (stack_config_custom || stack_enabled) ? stack_config : stack_profiles[stack_profile];
+}
+
+void ble_stack_ram_get(ble_stack_ram_t *p_ram)
+{
+    *p_ram = stack_ram;
+}
+
 static void scheduler_init(void)
 {
     /*
@@ -176,6 +496,115 @@ static void scheduler_init(void)
     APP_SCHED_INIT(SCHED_MAX_EVENT_DATA_SIZE, SCHED_QUEUE_SIZE);
 }
 
+/**
+ * @brief Function for scheduling an event in one of the priority classes.
+ *
+ * @details Can be called from any context. The handler runs from ble_run().
+ *          Use BLE_SCHED_PRIO_HIGH for HID and connection work, BLE_SCHED_PRIO_LOW for housekeeping
+ *          (battery, device name, whitelist, flash).
+ *
+ * @param[in]   prio        Priority class.
+ * @param[in]   p_data      Event data, copied. NULL if size is 0.
+ * @param[in]   size        Event data size, up to BLE_SCHED_EVENT_DATA_SIZE.
+ * @param[in]   handler     Handler called with a copy of the data.
+ *
+ * @return      NRF_ERROR_INVALID_LENGTH if the data is too big, NRF_ERROR_NO_MEM if the class queue is full.
+ */
+ret_code_t ble_sched_event_put(ble_sched_prio_t prio, void const *p_data, uint16_t size, app_sched_event_handler_t handler)
+{
+    if ((prio >= BLE_SCHED_PRIO_COUNT) || (handler == NULL)) return NRF_ERROR_INVALID_PARAM;
+    if (size > BLE_SCHED_EVENT_DATA_SIZE) return NRF_ERROR_INVALID_LENGTH;
+
+    sched_queue_t *p_queue = &sched_queues[prio];
+    ret_code_t err_code = NRF_SUCCESS;
+
+    CRITICAL_REGION_ENTER();
+    if (p_queue->count < p_queue->queue_size)
+    {
+        sched_event_t *p_event = &p_queue->p_events[(p_queue->head + p_queue->count) % p_queue->queue_size];
+        p_event->handler = handler;
+        p_event->size = size;
+        if (size > 0)
+        {
+            memcpy(p_event->data, p_data, size);
+        }
+
+        p_queue->count++;
+        if (p_queue->count > p_queue->stats.high_water)
+        {
+            p_queue->stats.high_water = p_queue->count;
+        }
+    }
+    else
+    {
+        p_queue->stats.overflow++;
+        err_code = NRF_ERROR_NO_MEM;
+    }
+    CRITICAL_REGION_EXIT();
+
+    return err_code;
+}
+
+static void sched_queue_execute(sched_queue_t *p_queue, uint8_t max_events)
+{
+    /*
+        Function for running up to max_events events of a class, timing each handler.
+    */
+    sched_event_t event;
+
+    for (uint8_t i = 0; i < max_events; i++)
+    {
+        bool pending = false;
+
+        CRITICAL_REGION_ENTER();
+        if (p_queue->count > 0)
+        {
+            event = p_queue->p_events[p_queue->head];
+            p_queue->head = (p_queue->head + 1) % p_queue->queue_size;
+            p_queue->count--;
+            pending = true;
+        }
+        CRITICAL_REGION_EXIT();
+
+        if (!pending) return;
+
+        uint32_t start_ticks = app_timer_cnt_get();
+        event.handler((event.size > 0) ? event.data : NULL, event.size);
+        uint32_t ticks = app_timer_cnt_diff_compute(app_timer_cnt_get(), start_ticks);
+        uint32_t us = (uint32_t)(((uint64_t)ticks * 1000000 * (APP_TIMER_CONFIG_RTC_FREQUENCY + 1)) / APP_TIMER_CLOCK_FREQ);
+
+        // Same lock as the queue, ble_sched_stats_reset() may run from an interrupt.
+        CRITICAL_REGION_ENTER();
+        p_queue->stats.executed++;
+        if (us > p_queue->stats.max_handler_us)
+        {
+            p_queue->stats.max_handler_us = us;
+        }
+        CRITICAL_REGION_EXIT();
+    }
+}
+
+void ble_sched_stats_get(ble_sched_prio_t prio, ble_sched_stats_t *p_stats)
+{
+    if (prio >= BLE_SCHED_PRIO_COUNT) return;
+
+    CRITICAL_REGION_ENTER();
+    *p_stats = sched_queues[prio].stats;
+    p_stats->depth = sched_queues[prio].count;
+    CRITICAL_REGION_EXIT();
+}
+
+void ble_sched_stats_reset(void)
+{
+    CRITICAL_REGION_ENTER();
+    for (uint8_t prio = 0; prio < BLE_SCHED_PRIO_COUNT; prio++)
+    {
+        memset(&sched_queues[prio].stats, 0, sizeof(ble_sched_stats_t));
+        sched_queues[prio].stats.high_water = sched_queues[prio].count;
+    }
+    CRITICAL_REGION_EXIT();
+}
+
 void gap_params_init(void)
 {
     /*
@@ -211,9 +640,88 @@ static void gatt_init(void)
 {
     /*
         Function for initializing the GATT module.
+        Asks for a large ATT MTU and data length so a raw HID report fits in a single notification
+        and a single link layer packet.
     */
-    ret_code_t err_code = nrf_ble_gatt_init(&m_gatt, NULL);
+    ret_code_t err_code = nrf_ble_gatt_init(&m_gatt, gatt_event_handler);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = nrf_ble_gatt_att_mtu_periph_set(&m_gatt, BLE_GATT_PREFERRED_ATT_MTU);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = nrf_ble_gatt_data_length_set(&m_gatt, BLE_CONN_HANDLE_INVALID, BLE_GAP_PREFERRED_DATA_LENGTH);
     APP_ERROR_CHECK(err_code);
+
+    for (uint8_t i = 0; i < NRF_SDH_BLE_TOTAL_LINK_COUNT; i++)
+    {
+        memset(&links[i], 0, sizeof(ble_link_t));
+        links[i].conn_handle = BLE_CONN_HANDLE_INVALID;
+        links[i].peer_id = PM_PEER_ID_INVALID;
+    }
+}
+
+static void gatt_event_handler(nrf_ble_gatt_t *p_gatt, nrf_ble_gatt_evt_t const *p_evt)
+{
+    /*
+        Function for handling the GATT module events.
+        Records the ATT MTU and data length negotiated on each link.
+    */
+    ble_link_t *p_link = link_get(p_evt->conn_handle);
+    if (p_link == NULL) return;
+
+    switch (p_evt->evt_id)
+    {
+        case NRF_BLE_GATT_EVT_ATT_MTU_UPDATED:
+        {
+            p_link->att_mtu = p_evt->params.att_mtu_effective;
+#if (BLUETOOTH_DEBUG_LOG > 1)
+            NRF_LOG_DEBUG("BLE: ATT MTU set to %d bytes on connection 0x%x", p_evt->params.att_mtu_effective, p_evt->conn_handle);
+#endif
+        }
+        break;
+
+        case NRF_BLE_GATT_EVT_DATA_LENGTH_UPDATED:
+        {
+            p_link->data_length = p_evt->params.data_length;
+#if (BLUETOOTH_DEBUG_LOG > 1)
+            NRF_LOG_DEBUG("BLE: Data length set to %d bytes on connection 0x%x", p_evt->params.data_length, p_evt->conn_handle);
+#endif
+        }
+        break;
+
+        default:
+        break;
+    }
+}
+
+/**
+ * @brief Function for getting the ATT MTU negotiated on a link.
+ *
+ * @param[in]   conn_handle  Connection handle.
+ *
+ * @return      The effective ATT MTU, BLE_GATT_ATT_MTU_DEFAULT if it was not negotiated or the link does not exist.
+ */
+uint16_t ble_gatt_att_mtu_get(uint16_t conn_handle)
+{
+    ble_link_t *p_link = link_get(conn_handle);
+    if (p_link == NULL) return BLE_GATT_ATT_MTU_DEFAULT;
+
+    return p_link->att_mtu;
+}
+
+/**
+ * @brief Function for getting the link layer data length negotiated on a link.
+ *
+ * @param[in]   conn_handle  Connection handle.
+ *
+ * @return      The data length in bytes, BLE_GAP_DATA_LENGTH_DEFAULT if it was not negotiated or the link does not exist.
+ */
+uint8_t ble_gatt_data_length_get(uint16_t conn_handle)
+{
+    ble_link_t *p_link = link_get(conn_handle);
+    if (p_link == NULL) return BLE_GAP_DATA_LENGTH_DEFAULT;
+
+    return p_link->data_length;
 }
 
 void advertising_init(void)
@@ -227,11 +735,8 @@ void advertising_init(void)
 
     memset(&init, 0, sizeof(init));
 
+    advdata_common_set(&init.advdata);
     init.advdata.name_type = BLE_ADVDATA_FULL_NAME;
-    init.advdata.include_appearance = true;
-    init.advdata.flags = BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE;
-    init.advdata.uuids_complete.uuid_cnt = sizeof(m_adv_uuids) / sizeof(m_adv_uuids[0]);
-    init.advdata.uuids_complete.p_uuids = m_adv_uuids;
 
     init.config.ble_adv_whitelist_enabled = active_whitelist_flag;
     init.config.ble_adv_directed_high_duty_enabled = true;
@@ -253,7 +758,21 @@ void advertising_init(void)
 
     ble_advertising_conn_cfg_tag_set(&m_advertising, APP_BLE_CONN_CFG_TAG);
 
-    flag_ble_is_adv_mode = true;
+    adv_state_set(ADV_STATE_RUNNING);
+}
+
+static void advdata_common_set(ble_advdata_t *p_advdata)
+{
+    /*
+        Function for filling the advertising data fields shared by every channel, all but the name.
+    */
+    memset(p_advdata, 0, sizeof(ble_advdata_t));
+
+    p_advdata->name_type = BLE_ADVDATA_NO_NAME;
+    p_advdata->include_appearance = true;
+    p_advdata->flags = BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE;
+    p_advdata->uuids_complete.uuid_cnt = sizeof(m_adv_uuids) / sizeof(m_adv_uuids[0]);
+    p_advdata->uuids_complete.p_uuids = m_adv_uuids;
 }
 
 static void on_adv_evt(ble_adv_evt_t ble_adv_evt)
@@ -271,8 +790,8 @@ static void on_adv_evt(ble_adv_evt_t ble_adv_evt)
     {
         case BLE_ADV_EVT_DIRECTED_HIGH_DUTY:
         {
-            flag_ble_is_adv_mode = true;
-            flag_ble_is_idle = false;
+            adv_directed = true;
+            adv_state_set(ADV_STATE_RUNNING);
 #if (BLUETOOTH_DEBUG_LOG > 0)
             NRF_LOG_INFO("<<< BLE: High Duty Directed advertising. >>>");
 #endif
@@ -281,8 +800,8 @@ static void on_adv_evt(ble_adv_evt_t ble_adv_evt)
 
         case BLE_ADV_EVT_DIRECTED:
         {
-            flag_ble_is_adv_mode = true;
-            flag_ble_is_idle = false;
+            adv_directed = true;
+            adv_state_set(ADV_STATE_RUNNING);
 #if (BLUETOOTH_DEBUG_LOG > 0)
             NRF_LOG_INFO("<<< BLE: Directed advertising. >>>");
 #endif
@@ -291,8 +810,8 @@ static void on_adv_evt(ble_adv_evt_t ble_adv_evt)
 
         case BLE_ADV_EVT_FAST:
         {
-            flag_ble_is_idle = false;
-            flag_ble_is_adv_mode = true;
+            adv_directed = false;
+            adv_state_set(ADV_STATE_RUNNING);
 #if (BLUETOOTH_DEBUG_LOG > 0)
             NRF_LOG_INFO("<<< BLE: Fast advertising. >>>");
 #endif
@@ -301,7 +820,8 @@ static void on_adv_evt(ble_adv_evt_t ble_adv_evt)
 
         case BLE_ADV_EVT_SLOW:
         {
-            flag_ble_is_adv_mode = true;
+            adv_directed = false;
+            adv_state_set(ADV_STATE_RUNNING);
 #if (BLUETOOTH_DEBUG_LOG > 0)
             NRF_LOG_INFO("<<< BLE: Slow advertising. >>>");
 #endif
@@ -310,8 +830,8 @@ static void on_adv_evt(ble_adv_evt_t ble_adv_evt)
 
         case BLE_ADV_EVT_FAST_WHITELIST:
         {
-            flag_ble_is_adv_mode = true;
-            flag_ble_is_idle = false;
+            adv_directed = false;
+            adv_state_set(ADV_STATE_RUNNING);
 #if (BLUETOOTH_DEBUG_LOG > 0)
             NRF_LOG_INFO("<<< BLE: Fast advertising with whitelist. >>>");
 #endif
@@ -320,8 +840,8 @@ static void on_adv_evt(ble_adv_evt_t ble_adv_evt)
 
         case BLE_ADV_EVT_SLOW_WHITELIST:
         {
-            flag_ble_is_adv_mode = true;
-            flag_ble_is_idle = false;
+            adv_directed = false;
+            adv_state_set(ADV_STATE_RUNNING);
 #if (BLUETOOTH_DEBUG_LOG > 0)
             NRF_LOG_INFO("<<< BLE: Slow advertising with whitelist. >>>");
 #endif
@@ -330,8 +850,10 @@ static void on_adv_evt(ble_adv_evt_t ble_adv_evt)
 
         case BLE_ADV_EVT_IDLE:
         {
-            flag_ble_is_adv_mode = false;
-            flag_ble_is_idle = true;
+            adv_directed = false;
+            wake_connect_pending = false;
+            adv_state_set(ADV_STATE_IDLE);
+            ble_hid_preconn_flush();
 #if (BLUETOOTH_DEBUG_LOG > 0)
             NRF_LOG_INFO("<<< BLE: Going to sleep.. >>>");
             NRF_LOG_FINAL_FLUSH();
@@ -341,14 +863,12 @@ static void on_adv_evt(ble_adv_evt_t ble_adv_evt)
 
         case BLE_ADV_EVT_WHITELIST_REQUEST:
         {
-            flag_ble_is_adv_mode = false;
-
             ble_gap_addr_t whitelist_addrs[BLE_GAP_WHITELIST_ADDR_MAX_COUNT];
             ble_gap_irk_t whitelist_irks[BLE_GAP_WHITELIST_ADDR_MAX_COUNT];
             uint32_t addr_cnt = BLE_GAP_WHITELIST_ADDR_MAX_COUNT;
             uint32_t irk_cnt = BLE_GAP_WHITELIST_ADDR_MAX_COUNT;
 
-            err_code = pm_whitelist_get(whitelist_addrs, &addr_cnt, whitelist_irks, &irk_cnt);
+            err_code = bond_cache_whitelist_get(whitelist_addrs, &addr_cnt, whitelist_irks, &irk_cnt);
             if (err_code == NRF_ERROR_NOT_FOUND)
             {
 #if (BLUETOOTH_DEBUG_LOG > 2)
@@ -361,7 +881,7 @@ static void on_adv_evt(ble_adv_evt_t ble_adv_evt)
             }
 
 #if (BLUETOOTH_DEBUG_LOG > 2)
-            NRF_LOG_DEBUG("BLE: pm_whitelist_get() returns %d addr in whitelist and %d irk whitelist.", addr_cnt, irk_cnt);
+            NRF_LOG_DEBUG("BLE: Whitelist of %d addr and %d irk.", addr_cnt, irk_cnt);
 #endif
 
             // Set the correct identities list (no excluding peers with no Central Address Resolution).
@@ -375,32 +895,23 @@ static void on_adv_evt(ble_adv_evt_t ble_adv_evt)
 
         case BLE_ADV_EVT_PEER_ADDR_REQUEST:
         {
-            flag_ble_is_adv_mode = false;
-
-            pm_peer_data_bonding_t peer_bonding_data;
+            ble_gap_addr_t peer_addr;
+            pm_peer_id_t peer_id = directed_peer_get();
 
             // Only Give peer address if we have a handle to the bonded peer.
-            if (m_peer_id != PM_PEER_ID_INVALID)
+            if ((peer_id != PM_PEER_ID_INVALID) && bond_cache_peer_addr_get(peer_id, &peer_addr))
             {
-                err_code = pm_peer_data_bonding_load(m_peer_id, &peer_bonding_data);
-                if (err_code != NRF_ERROR_NOT_FOUND)
-                {
-                    APP_ERROR_CHECK(err_code);
+                // Manipulate identities to exclude peers with no Central Address Resolution.
+                identities_set(PM_PEER_ID_LIST_SKIP_ALL);
 
-                    // Manipulate identities to exclude peers with no Central Address Resolution.
-                    identities_set(PM_PEER_ID_LIST_SKIP_ALL);
-
-                    ble_gap_addr_t *p_peer_addr = &(peer_bonding_data.peer_ble_id.id_addr_info);
-                    err_code = ble_advertising_peer_addr_reply(&m_advertising, p_peer_addr);
-                    APP_ERROR_CHECK(err_code);
-                }
+                err_code = ble_advertising_peer_addr_reply(&m_advertising, &peer_addr);
+                APP_ERROR_CHECK(err_code);
             }
         }
         break;
 
         default:
         {
-            flag_ble_is_adv_mode = false;
         }
         break;
     }
@@ -421,16 +932,24 @@ static void identities_set(pm_peer_id_list_skip_t skip)
     /*
         Function for setting filtered device identities.
         skip: Filter passed to @ref pm_peer_id_list.
+        The Peer Manager reads the keys from flash, so the list is only given when it changed.
     */
 
     pm_peer_id_t peer_ids[BLE_GAP_DEVICE_IDENTITIES_MAX_COUNT];
-    uint32_t peer_id_count = BLE_GAP_DEVICE_IDENTITIES_MAX_COUNT;
+    uint32_t peer_id_count = bond_cache_peer_ids_get(peer_ids, BLE_GAP_DEVICE_IDENTITIES_MAX_COUNT, skip);
 
-    ret_code_t err_code = pm_peer_id_list(peer_ids, &peer_id_count, PM_PEER_ID_INVALID, skip);
-    APP_ERROR_CHECK(err_code);
+    if (identities_applied && (peer_id_count == identity_peer_count) &&
+        (memcmp(peer_ids, identity_peers, peer_id_count * sizeof(pm_peer_id_t)) == 0))
+    {
+        return;
+    }
 
-    err_code = pm_device_identities_list_set(peer_ids, peer_id_count);
+    ret_code_t err_code = pm_device_identities_list_set(peer_ids, peer_id_count);
     APP_ERROR_CHECK(err_code);
+
+    memcpy(identity_peers, peer_ids, peer_id_count * sizeof(pm_peer_id_t));
+    identity_peer_count = peer_id_count;
+    identities_applied = true;
 }
 
 static void services_init(void)
@@ -479,8 +998,11 @@ static void qwr_init(void)
 
     qwr_init_obj.error_handler = nrf_qwr_error_handler;
 
-    err_code = nrf_ble_qwr_init(&m_qwr, &qwr_init_obj);
-    APP_ERROR_CHECK(err_code);
+    for (uint8_t i = 0; i < NRF_SDH_BLE_TOTAL_LINK_COUNT; i++)
+    {
+        err_code = nrf_ble_qwr_init(&m_qwr[i], &qwr_init_obj);
+        APP_ERROR_CHECK(err_code);
+    }
 }
 
 static void nrf_qwr_error_handler(uint32_t nrf_error)
@@ -543,6 +1065,8 @@ static void bas_init(void)
 
     err_code = ble_bas_init(&m_bas, &bas_init_obj);
     APP_ERROR_CHECK(err_code);
+
+    battery_level_notified = bas_init_obj.initial_batt_level;
 }
 
 
@@ -574,97 +1098,369 @@ static void conn_params_init(void)
     cp_init.max_conn_params_update_count = MAX_CONN_PARAMS_UPDATE_COUNT;
     cp_init.start_on_notify_cccd_handle = BLE_GATT_HANDLE_INVALID;
     cp_init.disconnect_on_fail = false;
-    cp_init.evt_handler = NULL;
+    cp_init.evt_handler = conn_params_event_handler;
     cp_init.error_handler = conn_params_error_handler;
 
     err_code = ble_conn_params_init(&cp_init);
     APP_ERROR_CHECK(err_code);
+
+    err_code = app_timer_create(&m_conn_idle_timer, APP_TIMER_MODE_SINGLE_SHOT, conn_idle_timeout_handler);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = app_timer_create(&m_latency_quiet_timer, APP_TIMER_MODE_SINGLE_SHOT, latency_quiet_timeout_handler);
+    APP_ERROR_CHECK(err_code);
 }
 
-static void conn_params_error_handler(uint32_t nrf_error)
+static void conn_params_event_handler(ble_conn_params_evt_t *p_evt)
 {
     /*
-        Function for handling a Connection Parameters error.
-        nrf_error: Error code containing information about what went wrong.
+        Function for handling the Connection Parameters module events.
+        When the host rejects the active parameters, the next request uses a longer minimum interval.
     */
-    APP_ERROR_HANDLER(nrf_error);
+    if (p_evt->conn_handle != m_conn_handle) return;
+
+    if ((p_evt->evt_type == BLE_CONN_PARAMS_EVT_FAILED) && (conn_params_mode == CONN_PARAMS_MODE_ACTIVE))
+    {
+        if (active_conn_interval_min < ACTIVE_CONN_INTERVAL_MAX)
+        {
+            active_conn_interval_min = MIN(active_conn_interval_min + ACTIVE_CONN_INTERVAL_STEP, ACTIVE_CONN_INTERVAL_MAX);
+            conn_params_request(CONN_PARAMS_MODE_ACTIVE);
+        }
+#if (BLUETOOTH_DEBUG_LOG > 1)
+        NRF_LOG_DEBUG("BLE: Active connection parameters rejected, min interval now %d units.", active_conn_interval_min);
+#endif
+    }
 }
 
-static void peer_manager_init(void)
+static void conn_params_request(conn_params_mode_t mode)
 {
     /*
-        Function for the Peer Manager initialization.
+        Function for asking the central for the active or idle connection parameters.
+        If the request can not be sent now (i.e. another negotiation is ongoing) the mode is left
+        unchanged and the next activity or idle timeout tries again.
     */
+    if (m_conn_handle == BLE_CONN_HANDLE_INVALID) return;
 
-    ret_code_t err_code;
-
-    err_code = pm_init();
-    APP_ERROR_CHECK(err_code);
+    ble_gap_conn_params_t conn_params;
 
-    // Set security parameters:
-    ble_gap_sec_params_t sec_param;
-    memset(&sec_param, 0, sizeof(ble_gap_sec_params_t));
-    sec_param.bond = SEC_PARAM_BOND;
-    sec_param.mitm = SEC_PARAM_MITM;
-    sec_param.lesc = SEC_PARAM_LESC;
-    sec_param.keypress = SEC_PARAM_KEYPRESS;
-    sec_param.io_caps = SEC_PARAM_IO_CAPABILITIES;
-    sec_param.oob = SEC_PARAM_OOB;
-    sec_param.min_key_size = SEC_PARAM_MIN_KEY_SIZE;
-    sec_param.max_key_size = SEC_PARAM_MAX_KEY_SIZE;
-    sec_param.kdist_own.enc = 1;
-    sec_param.kdist_own.id = 1;
-    sec_param.kdist_peer.enc = 1;
-    sec_param.kdist_peer.id = 1;
+    if (mode == CONN_PARAMS_MODE_ACTIVE)
+    {
+        conn_params.min_conn_interval = active_conn_interval_min;
+        conn_params.max_conn_interval = ACTIVE_CONN_INTERVAL_MAX;
+        conn_params.slave_latency = ACTIVE_SLAVE_LATENCY;
+    }
+    else
+    {
+        conn_params.min_conn_interval = IDLE_CONN_INTERVAL_MIN;
+        conn_params.max_conn_interval = IDLE_CONN_INTERVAL_MAX;
+        conn_params.slave_latency = IDLE_SLAVE_LATENCY;
+    }
+    conn_params.conn_sup_timeout = CONN_SUP_TIMEOUT;
 
-    err_code = pm_sec_params_set(&sec_param);
-    APP_ERROR_CHECK(err_code);
+    ret_code_t err_code = ble_conn_params_change_conn_params(m_conn_handle, &conn_params);
+    if (err_code == NRF_SUCCESS)
+    {
+        conn_params_mode = mode;
+    }
+#if (BLUETOOTH_DEBUG_LOG > 1)
+    NRF_LOG_DEBUG("BLE: Requesting %s connection parameters, returns %d", (mode == CONN_PARAMS_MODE_ACTIVE) ? "active" : "idle", err_code);
+#endif
+}
 
-    err_code = pm_register(peer_manager_event_handler);
+static void conn_idle_timer_start(uint32_t ticks)
+{
+    conn_idle_timer_running = true;
+    ret_code_t err_code = app_timer_start(m_conn_idle_timer, MAX(ticks, APP_TIMER_MIN_TIMEOUT_TICKS), NULL);
     APP_ERROR_CHECK(err_code);
 }
 
-static void peer_manager_event_handler(pm_evt_t const *p_evt)
+static void conn_idle_timeout_handler(void *p_context)
 {
-    pm_handler_on_pm_evt(p_evt);
-    pm_handler_disconnect_on_sec_failure(p_evt);
-    pm_handler_flash_clean(p_evt);
+    /*
+        The timer is not restarted on every report, instead it is re-armed here with the time
+        left since the last activity.
+    */
+    UNUSED_PARAMETER(p_context);
 
-    switch (p_evt->evt_id)
-    {
-        case PM_EVT_CONN_SEC_START:
-        {
-            flag_security_proc_started = true;
-            flag_security_proc_failed = false;
+    conn_idle_timer_running = false;
+    if (m_conn_handle == BLE_CONN_HANDLE_INVALID) return;
 
-#if DEBUG_BLE_ENCRYPTION
-            NRF_LOG_DEBUG("<<< BLE: Security procedure started. >>>");
-            NRF_LOG_FLUSH();
-#endif
-        }
-        break;
+    uint32_t elapsed = app_timer_cnt_diff_compute(app_timer_cnt_get(), last_activity_ticks);
+    if (elapsed < conn_idle_timeout_ticks)
+    {
+        conn_idle_timer_start(conn_idle_timeout_ticks - elapsed);
+        return;
+    }
 
-        case PM_EVT_CONN_SEC_FAILED:
-        {
-            flag_security_proc_started = false;
-            flag_security_proc_failed = true;
+    if (conn_params_mode != CONN_PARAMS_MODE_IDLE)
+    {
+        conn_params_request(CONN_PARAMS_MODE_IDLE);
+    }
+}
 
-#if DEBUG_BLE_ENCRYPTION
+static bool slave_latency_disable_set(uint16_t conn_handle, bool disable)
+{
+    /*
+        Function for disabling or enabling the slave latency of a link through the SoftDevice
+        GAP option, without renegotiating the connection parameters.
+    */
+    ble_opt_t opt;
+
+    memset(&opt, 0, sizeof(opt));
+    opt.gap_opt.slave_latency_disable.conn_handle = conn_handle;
+    opt.gap_opt.slave_latency_disable.disable = disable ? 1 : 0;
+
+    ret_code_t err_code = sd_ble_opt_set(BLE_GAP_OPT_SLAVE_LATENCY_DISABLE, &opt);
+    if (err_code != NRF_SUCCESS)
+    {
+#if (BLUETOOTH_DEBUG_LOG > 1)
+        NRF_LOG_DEBUG("BLE: Slave latency option returns %d", err_code);
+#endif
+        return false;
+    }
+
+    slave_latency_disabled = disable;
+    if (disable)
+    {
+        slave_latency_stats.disabled_count++;
+    }
+    else
+    {
+        slave_latency_stats.enabled_count++;
+    }
+    return true;
+}
+
+static void latency_quiet_timer_start(uint32_t ticks)
+{
+    latency_quiet_timer_running = true;
+    ret_code_t err_code = app_timer_start(m_latency_quiet_timer, MAX(ticks, APP_TIMER_MIN_TIMEOUT_TICKS), NULL);
+    APP_ERROR_CHECK(err_code);
+}
+
+static void latency_quiet_timeout_handler(void *p_context)
+{
+    UNUSED_PARAMETER(p_context);
+
+    latency_quiet_timer_running = false;
+    if ((m_conn_handle == BLE_CONN_HANDLE_INVALID) || !slave_latency_disabled) return;
+
+    uint32_t quiet_ticks = APP_TIMER_TICKS(SLAVE_LATENCY_QUIET_TIMEOUT_MS);
+    uint32_t elapsed = app_timer_cnt_diff_compute(app_timer_cnt_get(), last_activity_ticks);
+    if (elapsed < quiet_ticks)
+    {
+        latency_quiet_timer_start(quiet_ticks - elapsed);
+        return;
+    }
+
+    slave_latency_disable_set(m_conn_handle, false);
+}
+
+/**
+ * @brief Function for signaling that a report is being sent.
+ *
+ * @details Disables the slave latency on the first report after a quiet period, switches the link to the
+ *          active connection parameters and postpones the idle timeouts.
+ */
+void ble_conn_activity_notify(void)
+{
+    last_activity_ticks = app_timer_cnt_get();
+
+    if (m_conn_handle == BLE_CONN_HANDLE_INVALID) return;
+
+    if (slave_latency_auto && !slave_latency_disabled && slave_latency_disable_set(m_conn_handle, true))
+    {
+        if (!latency_quiet_timer_running)
+        {
+            latency_quiet_timer_start(APP_TIMER_TICKS(SLAVE_LATENCY_QUIET_TIMEOUT_MS));
+        }
+    }
+
+    if (conn_params_mode != CONN_PARAMS_MODE_ACTIVE)
+    {
+        conn_params_request(CONN_PARAMS_MODE_ACTIVE);
+    }
+
+    if (!conn_idle_timer_running)
+    {
+        conn_idle_timer_start(conn_idle_timeout_ticks);
+    }
+}
+
+/**
+ * @brief Function for setting the time without reports before the idle connection parameters are requested.
+ *
+ * @param[in]   timeout_ms  Idle time in milliseconds.
+ */
+void ble_conn_idle_timeout_set(uint32_t timeout_ms)
+{
+    conn_idle_timeout_ticks = APP_TIMER_TICKS(timeout_ms);
+}
+
+/**
+ * @brief Function for enabling or disabling the slave latency toggling on activity.
+ *
+ * @param[in]   enable  true to disable the slave latency while typing (default).
+ */
+void ble_slave_latency_auto_set(bool enable)
+{
+    slave_latency_auto = enable;
+
+    if (!enable && slave_latency_disabled && (m_conn_handle != BLE_CONN_HANDLE_INVALID))
+    {
+        slave_latency_disable_set(m_conn_handle, false);
+    }
+}
+
+void ble_slave_latency_stats_get(ble_slave_latency_stats_t *p_stats)
+{
+    *p_stats = slave_latency_stats;
+}
+
+/**
+ * @brief Function for registering a handler called with every set of connection parameters used by the link.
+ *
+ * @param[in]   handler  Handler, NULL to unregister.
+ */
+void ble_conn_params_handler_set(ConnParamsHandler_t handler)
+{
+    conn_params_handler = handler;
+}
+
+static void conn_params_error_handler(uint32_t nrf_error)
+{
+    /*
+        Function for handling a Connection Parameters error.
+        nrf_error: Error code containing information about what went wrong.
+    */
+    APP_ERROR_HANDLER(nrf_error);
+}
+
+static void peer_manager_init(void)
+{
+    /*
+        Function for the Peer Manager initialization.
+    */
+
+    ret_code_t err_code;
+
+    err_code = pm_init();
+    APP_ERROR_CHECK(err_code);
+
+    // Set security parameters:
+    ble_gap_sec_params_t sec_param;
+    memset(&sec_param, 0, sizeof(ble_gap_sec_params_t));
+    sec_param.bond = SEC_PARAM_BOND;
+    sec_param.mitm = SEC_PARAM_MITM;
+    sec_param.lesc = SEC_PARAM_LESC;
+    sec_param.keypress = SEC_PARAM_KEYPRESS;
+    sec_param.io_caps = SEC_PARAM_IO_CAPABILITIES;
+    sec_param.oob = SEC_PARAM_OOB;
+    sec_param.min_key_size = SEC_PARAM_MIN_KEY_SIZE;
+    sec_param.max_key_size = SEC_PARAM_MAX_KEY_SIZE;
+    sec_param.kdist_own.enc = 1;
+    sec_param.kdist_own.id = 1;
+    sec_param.kdist_peer.enc = 1;
+    sec_param.kdist_peer.id = 1;
+
+    err_code = pm_sec_params_set(&sec_param);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = pm_register(peer_manager_event_handler);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = app_timer_create(&m_async_op_timer, APP_TIMER_MODE_SINGLE_SHOT, async_op_timeout_handler);
+    APP_ERROR_CHECK(err_code);
+
+    bond_cache_load();
+    last_peers_load();
+}
+
+static void peer_manager_event_handler(pm_evt_t const *p_evt)
+{
+    pm_handler_on_pm_evt(p_evt);
+    pm_handler_disconnect_on_sec_failure(p_evt);
+    pm_handler_flash_clean(p_evt);
+
+    switch (p_evt->evt_id)
+    {
+        case PM_EVT_CONN_SEC_START:
+        {
+            nrf_atomic_u32_and(&link_flags, ~LINK_FLAG_SECURITY_FAILED);
+            nrf_atomic_u32_or(&link_flags, LINK_FLAG_SECURITY_STARTED);
+
+            ble_link_t *p_link = link_get(p_evt->conn_handle);
+            if (p_link != NULL)
+            {
+                p_link->securing = true;
+            }
+            link_state_update();
+
+#if DEBUG_BLE_ENCRYPTION
+            NRF_LOG_DEBUG("<<< BLE: Security procedure started. >>>");
+            NRF_LOG_FLUSH();
+#endif
+        }
+        break;
+
+        case PM_EVT_CONN_SEC_FAILED:
+        {
+            nrf_atomic_u32_and(&link_flags, ~LINK_FLAG_SECURITY_STARTED);
+            nrf_atomic_u32_or(&link_flags, LINK_FLAG_SECURITY_FAILED);
+
+            ble_link_t *p_link = link_get(p_evt->conn_handle);
+            if (p_link != NULL)
+            {
+                p_link->securing = false;
+            }
+            link_state_update();
+
+#if DEBUG_BLE_ENCRYPTION
             NRF_LOG_DEBUG("<<< BLE: Security procedure failed. >>>");
             NRF_LOG_FLUSH();
 #endif
         }
         break;
 
+        case PM_EVT_LOCAL_DB_CACHE_APPLIED:
+            // The stored CCCDs of the bonded host are back, so are its report subscriptions.
+            ble_hid_cccd_restore(p_evt->conn_handle);
+            break;
+
         case PM_EVT_CONN_SEC_SUCCEEDED:
         {
 #if DEBUG_BLE_ENCRYPTION
             NRF_LOG_DEBUG("<<< BLE: PM_EVT_CONN_SEC_SUCCEEDED >>>");
             NRF_LOG_FLUSH();
 #endif
-            flag_ble_connected = true;
-            flag_security_proc_failed = false;
-            m_peer_id = p_evt->peer_id;
+            nrf_atomic_u32_and(&link_flags, ~LINK_FLAG_SECURITY_FAILED);
+
+            ble_link_t *p_link = link_get(p_evt->conn_handle);
+            if (p_link != NULL)
+            {
+                p_link->securing = false;
+                p_link->secured = true;
+                p_link->peer_id = p_evt->peer_id;
+            }
+            active_link_update();
+
+            channel_peer_add(current_channel, p_evt->peer_id);
+            last_peer_store(current_channel, p_evt->peer_id);
+
+            if (wake_encrypt_pending)
+            {
+                wake_encrypt_pending = false;
+
+                uint32_t us = wake_elapsed_us();
+                reconnect_stats.wake_to_encrypted_us = us;
+                if (us > reconnect_stats.max_wake_to_encrypted_us)
+                {
+                    reconnect_stats.max_wake_to_encrypted_us = us;
+                }
+#if (BLUETOOTH_DEBUG_LOG > 0)
+                NRF_LOG_INFO("BLE: Encrypted %d us after wake.", us);
+#endif
+            }
         }
         break;
 
@@ -675,7 +1471,24 @@ static void peer_manager_event_handler(pm_evt_t const *p_evt)
             NRF_LOG_FLUSH();
 #endif
 
+            channel_peer_remove(p_evt->peer_id);
+            last_peer_forget(p_evt->peer_id);
+            bond_cache_peer_remove(p_evt->peer_id);
             flag_peer_deleted = true;
+
+            if (p_evt->peer_id == async_peer_id)
+            {
+                async_op_complete(BLE_ASYNC_OP_PEER_DELETE, BLE_ASYNC_DONE);
+            }
+        }
+        break;
+
+        case PM_EVT_PEER_DELETE_FAILED:
+        {
+            if (p_evt->peer_id == async_peer_id)
+            {
+                async_op_complete(BLE_ASYNC_OP_PEER_DELETE, BLE_ASYNC_FAILED);
+            }
         }
         break;
 
@@ -686,13 +1499,44 @@ static void peer_manager_event_handler(pm_evt_t const *p_evt)
             NRF_LOG_FLUSH();
 #endif
 
+            for (uint8_t channel = 0; channel < BLE_CHANNELS_COUNT; channel++)
+            {
+                channel_cache[channel].peer_count = 0;
+                channel_last_peer[channel] = PM_PEER_ID_INVALID;
+            }
+            bond_cache_count = 0;
+            bond_cache_complete = true;
             flag_all_peers_deleted = true;
+
+            async_op_complete(BLE_ASYNC_OP_PEERS_DELETE, BLE_ASYNC_DONE);
+        }
+        break;
+
+        case PM_EVT_PEERS_DELETE_FAILED:
+        {
+            async_op_complete(BLE_ASYNC_OP_PEERS_DELETE, BLE_ASYNC_FAILED);
         }
         break;
 
         case PM_EVT_PEER_DATA_UPDATE_SUCCEEDED:
         {
-            if (p_evt->params.peer_data_update_succeeded.flash_changed && (p_evt->params.peer_data_update_succeeded.data_id == PM_PEER_DATA_ID_BONDING))
+            pm_peer_data_update_succeeded_evt_t const *p_update = &p_evt->params.peer_data_update_succeeded;
+
+            // Keys and Central Address Resolution decide the lists built from the bond cache.
+            if (p_update->flash_changed &&
+                ((p_update->data_id == PM_PEER_DATA_ID_BONDING) || (p_update->data_id == PM_PEER_DATA_ID_CENTRAL_ADDR_RES)))
+            {
+                if ((p_update->data_id == PM_PEER_DATA_ID_BONDING) && (p_update->action == PM_PEER_DATA_OP_DELETE))
+                {
+                    bond_cache_peer_remove(p_evt->peer_id);
+                }
+                else
+                {
+                    bond_cache_peer_update(p_evt->peer_id);
+                }
+            }
+
+            if (p_update->flash_changed && (p_update->data_id == PM_PEER_DATA_ID_BONDING))
             {
 #if (BLUETOOTH_DEBUG_LOG > 2)
                 NRF_LOG_DEBUG("<<< BLE: New Bond, adding peer to the whitelist. >>>");
@@ -705,7 +1549,11 @@ static void peer_manager_event_handler(pm_evt_t const *p_evt)
                     The PM_PEER_ID_LIST_SKIP_NO_ID_ADDR argument specifies that peers that do not have a standard public
                     BLE address (i.e., only have an Identity Resolving Key) should not be included in the peer ID list.
                 */
-                whitelist_set(PM_PEER_ID_LIST_SKIP_NO_ID_ADDR);
+                // Deferred to the low priority class, the flash work must not delay the first keys.
+                if (ble_sched_event_put(BLE_SCHED_PRIO_LOW, NULL, 0, whitelist_update_scheduled) != NRF_SUCCESS)
+                {
+                    whitelist_set(PM_PEER_ID_LIST_SKIP_NO_ID_ADDR);
+                }
             }
         }
         break;
@@ -719,22 +1567,22 @@ static void peer_manager_event_handler(pm_evt_t const *p_evt)
 
 bool get_flag_security_proc_started(void)
 {
-    return flag_security_proc_started;
+    return (link_flags & LINK_FLAG_SECURITY_STARTED) != 0;
 }
 
 void clear_flag_security_proc_started(void)
 {
-    flag_security_proc_started = false;
+    nrf_atomic_u32_and(&link_flags, ~LINK_FLAG_SECURITY_STARTED);
 }
 
 bool get_flag_security_proc_failed(void)
 {
-    return flag_security_proc_failed;
+    return (link_flags & LINK_FLAG_SECURITY_FAILED) != 0;
 }
 
 void clear_flag_security_proc_failed(void)
 {
-    flag_security_proc_failed = false;
+    nrf_atomic_u32_and(&link_flags, ~LINK_FLAG_SECURITY_FAILED);
 }
 
 void ble_send_encryption_pin(char const *pin_number)
@@ -754,8 +1602,23 @@ void ble_goto_advertising_mode(void)
     err_code = sd_ble_gap_tx_power_set( BLE_GAP_TX_POWER_ROLE_ADV, m_advertising.adv_handle, BLE_TX_POWER );
     APP_ERROR_CHECK(err_code);
 
+    /*
+        With a known central on this channel start with high duty directed advertising to it, the
+        advertising module falls back to fast (whitelist) and then slow advertising on its own.
+    */
+    ble_adv_mode_t mode = (directed_peer_get() != PM_PEER_ID_INVALID) ? BLE_ADV_MODE_DIRECTED_HIGH_DUTY : BLE_ADV_MODE_FAST;
+
+    wake_ticks = app_timer_cnt_get();
+    wake_connect_pending = true;
+    wake_encrypt_pending = true;
+    reconnect_stats.wakes++;
+    if (mode == BLE_ADV_MODE_DIRECTED_HIGH_DUTY)
+    {
+        reconnect_stats.directed_wakes++;
+    }
+
     // Start advertising.
-    err_code = ble_advertising_start(&m_advertising, BLE_ADV_MODE_FAST);
+    err_code = ble_advertising_start(&m_advertising, mode);
 
     if (err_code == NRF_ERROR_CONN_COUNT)
     {
@@ -780,7 +1643,8 @@ void ble_adv_stop(void)
         APP_ERROR_CHECK(ret);
     }
 
-    flag_ble_is_adv_mode = false;
+    adv_state_set(ADV_STATE_OFF);
+    ble_hid_preconn_flush();
 }
 
 void ble_goto_white_list_advertising_mode(void)
@@ -794,11 +1658,16 @@ void ble_goto_white_list_advertising_mode(void)
     ble_goto_advertising_mode();
 }
 
+static void whitelist_update_scheduled(void *p_event_data, uint16_t event_size)
+{
+    whitelist_set(PM_PEER_ID_LIST_SKIP_NO_ID_ADDR);
+}
+
 static void whitelist_set(pm_peer_id_list_skip_t skip)
 {
     /*
         Function for setting filtered whitelist.
-        Obtains, from the flash memory, a list of paired devices (peers) that have previously been
+        Obtains, from the bond cache, a list of paired devices (peers) that have previously been
         connected and setting them as a whitelist for future connections.
         The devices on this whitelist are the only ones your device will allow to connect when it is
         in advertising mode.
@@ -835,8 +1704,18 @@ static void whitelist_set(pm_peer_id_list_skip_t skip)
             NRF_ERROR_NULL              If peer_list or list_size was NULL.
             NRF_ERROR_INVALID_STATE     If the Peer Manager is not initialized.
     */
-    ret_code_t err_code = pm_peer_id_list(peer_ids, &peer_id_count, PM_PEER_ID_INVALID, skip);
-    APP_ERROR_CHECK(err_code);
+    // The bond cache gives the same list, pm_peer_id_list() is only called when it does not hold every peer.
+    peer_id_count = bond_cache_peer_ids_get(peer_ids, peer_id_count, skip);
+
+    // Only the centrals of the current channel, when they are known.
+    peer_id_count = channel_peers_filter(peer_ids, peer_id_count);
+
+    // The Peer Manager reads the addresses from flash, nothing to do when the whitelist did not change.
+    if (whitelist_applied && (peer_id_count == whitelist_peer_count) &&
+        (memcmp(peer_ids, whitelist_peers, peer_id_count * sizeof(pm_peer_id_t)) == 0))
+    {
+        return;
+    }
 
 #if (BLUETOOTH_DEBUG_LOG > 1)
     NRF_LOG_INFO("BLE: Peers in whitelist: %d, MAX_PEERS_WLIST: %d", peer_id_count, BLE_GAP_WHITELIST_ADDR_MAX_COUNT);
@@ -864,69 +1743,187 @@ static void whitelist_set(pm_peer_id_list_skip_t skip)
             NRF_ERROR_DATA_SIZE             If peer_cnt is greater than BLE_GAP_WHITELIST_ADDR_MAX_COUNT.
             NRF_ERROR_INVALID_STATE         If the Peer Manager is not initialized.
     */
-    err_code = pm_whitelist_set(peer_ids, peer_id_count);
+    ret_code_t err_code = pm_whitelist_set(peer_ids, peer_id_count);
 #if (BLUETOOTH_DEBUG_LOG > 1)
     NRF_LOG_INFO("BLE: pm_whitelist_set() returns %d", err_code);
 #endif
     APP_ERROR_CHECK(err_code);
+
+    memcpy(whitelist_peers, peer_ids, peer_id_count * sizeof(pm_peer_id_t));
+    whitelist_peer_count = peer_id_count;
+    whitelist_applied = true;
 }
 
 bool ble_is_advertising_mode(void)
 {
-    return flag_ble_is_adv_mode;
+    return adv_state == ADV_STATE_RUNNING;
 }
 
 bool ble_is_idle(void)
 {
-    return flag_ble_is_idle;
-}
-
-void ble_disconnect(void)
-{
-    if (!ble_connected()) return;
-
-    if (m_conn_handle != BLE_CONN_HANDLE_INVALID)
-    {
-        sd_ble_gap_disconnect(m_conn_handle, BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION);
-        while (flag_ble_connected) ble_run(); // Wait until disconnecting procedure ends.
-    }
-}
-
-ble_gap_addr_t gap_addr_get()
-{
-    ble_gap_addr_t gap_addr;
-    sd_ble_gap_addr_get(&gap_addr);
-    return gap_addr;
+    return adv_state == ADV_STATE_IDLE;
 }
 
-bool gap_addr_set(ble_gap_addr_t *gap_addr)
+static void adv_state_set(adv_state_t state)
 {
-    uint32_t addr_set_return_code = sd_ble_gap_addr_set(gap_addr);
-    return addr_set_return_code == 0;
+    adv_state = state;
+    link_state_update();
 }
 
-void delete_peers(void)
+static void link_state_update(void)
 {
     /*
-        Clear bond information from persistent storage.
-        First you need to disconnect BLE.
+        Function for computing the link state and notifying the subscribers when it changes.
+        The active output link decides the state while there is one, the advertising state otherwise.
     */
+    ble_link_t *p_link = link_get(m_conn_handle);
+    ble_link_state_t state;
 
-    ret_code_t err_code;
+    if (p_link != NULL)
+    {
+        if (p_link->secured)
+        {
+            state = BLE_LINK_STATE_SECURED;
+        }
+        else if (p_link->securing)
+        {
+            state = BLE_LINK_STATE_SECURING;
+        }
+        else
+        {
+            state = BLE_LINK_STATE_CONNECTED;
+        }
+    }
+    else if (adv_state == ADV_STATE_RUNNING)
+    {
+        state = BLE_LINK_STATE_ADVERTISING;
+    }
+    else if (adv_state == ADV_STATE_IDLE)
+    {
+        state = BLE_LINK_STATE_IDLE;
+    }
+    else
+    {
+        state = BLE_LINK_STATE_OFF;
+    }
 
-#if (BLUETOOTH_DEBUG_LOG > 2)
-    NRF_LOG_INFO("BLE: Deleting paired devices...");
+    ble_link_state_t previous = (ble_link_state_t)nrf_atomic_u32_fetch_store(&link_state, state);
+    if (previous == state) return;
+
+#if (BLUETOOTH_DEBUG_LOG > 1)
+    NRF_LOG_DEBUG("BLE: Link state %d -> %d", previous, state);
 #endif
 
-    flag_all_peers_deleted = false;
-    err_code = pm_peers_delete();
-    APP_ERROR_CHECK(err_code);
+    for (uint8_t i = 0; i < BLE_LINK_STATE_HANDLERS_MAX; i++)
+    {
+        if (link_state_handlers[i] != NULL)
+        {
+            link_state_handlers[i](previous, state);
+        }
+    }
+}
 
-    while (!flag_all_peers_deleted)
-        ble_run(); // Wait until delet procedure ends.
-#if (BLUETOOTH_DEBUG_LOG > 2)
-    NRF_LOG_INFO("BLE: Done");
-#endif
+ble_link_state_t ble_link_state_get(void)
+{
+    return (ble_link_state_t)link_state;
+}
+
+/**
+ * @brief Function for subscribing to the link state transitions.
+ *
+ * @details The handler runs in the context that caused the transition, usually the SoftDevice
+ *          event handler, so it should only record the new state or schedule work.
+ *
+ * @param[in]   handler  Handler called with the previous and the new state.
+ *
+ * @return      false if BLE_LINK_STATE_HANDLERS_MAX handlers are already subscribed.
+ */
+bool ble_link_state_subscribe(BleLinkStateHandler_t handler)
+{
+    bool subscribed = false;
+
+    CRITICAL_REGION_ENTER();
+    for (uint8_t i = 0; i < BLE_LINK_STATE_HANDLERS_MAX; i++)
+    {
+        if (link_state_handlers[i] == handler)
+        {
+            subscribed = true;
+            break;
+        }
+    }
+    for (uint8_t i = 0; !subscribed && (i < BLE_LINK_STATE_HANDLERS_MAX); i++)
+    {
+        if (link_state_handlers[i] == NULL)
+        {
+            link_state_handlers[i] = handler;
+            subscribed = true;
+        }
+    }
+    CRITICAL_REGION_EXIT();
+
+    return subscribed;
+}
+
+void ble_link_state_unsubscribe(BleLinkStateHandler_t handler)
+{
+    CRITICAL_REGION_ENTER();
+    for (uint8_t i = 0; i < BLE_LINK_STATE_HANDLERS_MAX; i++)
+    {
+        if (link_state_handlers[i] == handler)
+        {
+            link_state_handlers[i] = NULL;
+        }
+    }
+    CRITICAL_REGION_EXIT();
+}
+
+void ble_disconnect(void)
+{
+    if (!ble_connected()) return;
+
+    uint16_t conn_handle = m_conn_handle;
+    if (conn_handle != BLE_CONN_HANDLE_INVALID)
+    {
+        sd_ble_gap_disconnect(conn_handle, BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION);
+        while (link_get(conn_handle) != NULL) ble_run(); // Wait until disconnecting procedure ends.
+    }
+}
+
+ble_gap_addr_t gap_addr_get()
+{
+    ble_gap_addr_t gap_addr;
+    sd_ble_gap_addr_get(&gap_addr);
+    return gap_addr;
+}
+
+bool gap_addr_set(ble_gap_addr_t *gap_addr)
+{
+    uint32_t addr_set_return_code = sd_ble_gap_addr_set(gap_addr);
+    return addr_set_return_code == 0;
+}
+
+void delete_peers(void)
+{
+    /*
+        Clear bond information from persistent storage.
+        First you need to disconnect BLE.
+    */
+
+    ret_code_t err_code;
+
+#if (BLUETOOTH_DEBUG_LOG > 2)
+    NRF_LOG_INFO("BLE: Deleting paired devices...");
+#endif
+
+    flag_all_peers_deleted = false;
+    err_code = pm_peers_delete();
+    APP_ERROR_CHECK(err_code);
+
+    while (!flag_all_peers_deleted)
+        ble_run(); // Wait until delet procedure ends.
+#if (BLUETOOTH_DEBUG_LOG > 2)
+    NRF_LOG_INFO("BLE: Done");
+#endif
 }
 
 /**
@@ -957,6 +1954,172 @@ void delete_peer_by_id(pm_peer_id_t peer_id)
 #endif
 }
 
+/**
+ * @brief Function for registering the handler called when an asynchronous operation ends.
+ *
+ * @details The handler runs in the context that ended the operation: the SoftDevice event
+ *          handler, or the app_timer one on timeout.
+ *
+ * @param[in]   handler  Handler, NULL to unregister.
+ */
+void ble_async_handler_set(AsyncOpHandler_t handler)
+{
+    async_op_handler = handler;
+}
+
+bool ble_async_busy(void)
+{
+    return async_op != BLE_ASYNC_OP_NONE;
+}
+
+static bool async_op_start(ble_async_op_t op, uint32_t timeout_ms)
+{
+    /*
+        Function for claiming the asynchronous operation slot and starting its timeout.
+    */
+    bool started = false;
+
+    CRITICAL_REGION_ENTER();
+    if (async_op == BLE_ASYNC_OP_NONE)
+    {
+        async_op = op;
+        started = true;
+    }
+    CRITICAL_REGION_EXIT();
+
+    if (started)
+    {
+        ret_code_t err_code = app_timer_start(m_async_op_timer, APP_TIMER_TICKS(timeout_ms), NULL);
+        APP_ERROR_CHECK(err_code);
+    }
+
+    return started;
+}
+
+static void async_op_complete(ble_async_op_t op, ble_async_result_t result)
+{
+    /*
+        Function for ending the pending asynchronous operation, if it is op, and reporting the result.
+    */
+    bool completed = false;
+
+    CRITICAL_REGION_ENTER();
+    if ((op != BLE_ASYNC_OP_NONE) && (async_op == op))
+    {
+        async_op = BLE_ASYNC_OP_NONE;
+        async_conn_handle = BLE_CONN_HANDLE_INVALID;
+        async_peer_id = PM_PEER_ID_INVALID;
+        completed = true;
+    }
+    CRITICAL_REGION_EXIT();
+
+    if (!completed) return;
+
+    if (result != BLE_ASYNC_TIMEOUT)
+    {
+        app_timer_stop(m_async_op_timer);
+    }
+
+#if (BLUETOOTH_DEBUG_LOG > 1)
+    NRF_LOG_DEBUG("BLE: Asynchronous operation %d ended with %d", op, result);
+#endif
+
+    if (async_op_handler != NULL)
+    {
+        async_op_handler(op, result);
+    }
+}
+
+static void async_op_timeout_handler(void *p_context)
+{
+    async_op_complete(async_op, BLE_ASYNC_TIMEOUT);
+}
+
+/**
+ * @brief Function for starting the disconnection of the active link without waiting for it.
+ *
+ * @return      NRF_SUCCESS if the handler will be called with BLE_ASYNC_OP_DISCONNECT,
+ *              NRF_ERROR_INVALID_STATE if there is no secured link,
+ *              NRF_ERROR_BUSY if another asynchronous operation is pending.
+ */
+ret_code_t ble_disconnect_async(void)
+{
+    if (!ble_connected()) return NRF_ERROR_INVALID_STATE;
+
+    uint16_t conn_handle = m_conn_handle;
+    if (!async_op_start(BLE_ASYNC_OP_DISCONNECT, BLE_DISCONNECT_TIMEOUT_MS)) return NRF_ERROR_BUSY;
+
+    async_conn_handle = conn_handle;
+
+    ret_code_t err_code = sd_ble_gap_disconnect(conn_handle, BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION);
+    if (err_code != NRF_SUCCESS)
+    {
+        // Already disconnecting, the event is still expected.
+        if (err_code != NRF_ERROR_INVALID_STATE)
+        {
+            async_op_complete(BLE_ASYNC_OP_DISCONNECT, BLE_ASYNC_FAILED);
+        }
+    }
+
+    return NRF_SUCCESS;
+}
+
+/**
+ * @brief Function for starting the deletion of every bond without waiting for it.
+ *
+ * @details As with delete_peers(), BLE has to be disconnected first.
+ *
+ * @return      NRF_SUCCESS if the handler will be called with BLE_ASYNC_OP_PEERS_DELETE,
+ *              NRF_ERROR_BUSY if another asynchronous operation is pending.
+ */
+ret_code_t delete_peers_async(void)
+{
+    if (!async_op_start(BLE_ASYNC_OP_PEERS_DELETE, BLE_PEER_DELETE_TIMEOUT_MS)) return NRF_ERROR_BUSY;
+
+#if (BLUETOOTH_DEBUG_LOG > 2)
+    NRF_LOG_INFO("BLE: Deleting paired devices...");
+#endif
+
+    flag_all_peers_deleted = false;
+    ret_code_t err_code = pm_peers_delete();
+    if (err_code != NRF_SUCCESS)
+    {
+        async_op_complete(BLE_ASYNC_OP_PEERS_DELETE, BLE_ASYNC_FAILED);
+    }
+
+    return NRF_SUCCESS;
+}
+
+/**
+ * @brief Function for starting the deletion of a bond without waiting for it.
+ *
+ * @param[in]   peer_id  The id of the peer whose bond we want to delete.
+ *
+ * @return      NRF_SUCCESS if the handler will be called with BLE_ASYNC_OP_PEER_DELETE,
+ *              NRF_ERROR_INVALID_PARAM if peer_id is PM_PEER_ID_INVALID,
+ *              NRF_ERROR_BUSY if another asynchronous operation is pending.
+ */
+ret_code_t delete_peer_by_id_async(pm_peer_id_t peer_id)
+{
+    if (peer_id == PM_PEER_ID_INVALID) return NRF_ERROR_INVALID_PARAM;
+
+    if (!async_op_start(BLE_ASYNC_OP_PEER_DELETE, BLE_PEER_DELETE_TIMEOUT_MS)) return NRF_ERROR_BUSY;
+
+#if (BLUETOOTH_DEBUG_LOG > 2)
+    NRF_LOG_INFO("BLE: Deleting paired device ID=%d from flash memory...", peer_id);
+#endif
+
+    async_peer_id = peer_id;
+    flag_peer_deleted = false;
+    ret_code_t err_code = pm_peer_delete(peer_id);
+    if (err_code != NRF_SUCCESS)
+    {
+        async_op_complete(BLE_ASYNC_OP_PEER_DELETE, BLE_ASYNC_FAILED);
+    }
+
+    return NRF_SUCCESS;
+}
+
 /**
  * @brief Function for getting the next peer id.
  *
@@ -980,7 +2143,9 @@ void ble_run(void)
         If there is no pending log operation, then sleep until the next event occurs.
     */
 
+    sched_queue_execute(&sched_queues[BLE_SCHED_PRIO_HIGH], BLE_SCHED_HIGH_QUEUE_SIZE);
     app_sched_execute();
+    sched_queue_execute(&sched_queues[BLE_SCHED_PRIO_LOW], BLE_SCHED_LOW_EVENTS_PER_RUN);
 
     if (NRF_LOG_PROCESS() == false)
     {
@@ -988,13 +2153,18 @@ void ble_run(void)
     }
 }
 
-void save_connected_device_name(uint8_t *name, uint16_t len)
+static void save_connected_device_name(ble_link_t *p_link, uint8_t *name, uint16_t len)
 {
     if (name)  // pass NULL to skip copy
     {
-        memcpy(connected_device_name, name, len);
+        memset(p_link->device_name, 0, sizeof(p_link->device_name));
+        memcpy(p_link->device_name, name, MIN(len, sizeof(p_link->device_name)));
     }
-    flag_connected_device_name_changed = true;
+
+    if (p_link->conn_handle != m_conn_handle) return;
+
+    memcpy(connected_device_name, p_link->device_name, sizeof(connected_device_name));
+    nrf_atomic_u32_or(&link_flags, LINK_FLAG_NAME_CHANGED);
 
 #if (BLUETOOTH_DEBUG_LOG > 0)
     NRF_LOG_DEBUG("BLE: New connected_device_name = %s, len = %i", connected_device_name, len);
@@ -1011,14 +2181,14 @@ pm_peer_id_t get_connected_peer_id(void)
     return m_peer_id;
 }
 
-void save_connected_device_address(ble_gap_addr_t gapAddr)
+static void save_connected_device_address(ble_link_t *p_link, ble_gap_addr_t gapAddr)
 {
-    memcpy(connected_device_address, gapAddr.addr, BLE_GAP_ADDR_LEN);
+    memcpy(p_link->device_address, gapAddr.addr, BLE_GAP_ADDR_LEN);
 #if (BLUETOOTH_DEBUG_LOG > 0)
     NRF_LOG_DEBUG("BLE: peer addr saved = %02X %02X %02X %02X %02X %02X",
-                  connected_device_address[0], connected_device_address[1],
-                  connected_device_address[2], connected_device_address[3],
-                  connected_device_address[4], connected_device_address[5]);
+                  p_link->device_address[0], p_link->device_address[1],
+                  p_link->device_address[2], p_link->device_address[3],
+                  p_link->device_address[4], p_link->device_address[5]);
 #endif
 }
 
@@ -1027,6 +2197,165 @@ uint8_t *get_connected_device_address(void)
     return connected_device_address;
 }
 
+static ble_link_t *link_get(uint16_t conn_handle)
+{
+    /*
+        Function for getting the context of a connected link, NULL if there is none.
+    */
+    uint16_t idx = ble_conn_state_conn_idx(conn_handle);
+    if ((idx >= NRF_SDH_BLE_TOTAL_LINK_COUNT) || (links[idx].conn_handle != conn_handle)) return NULL;
+
+    return &links[idx];
+}
+
+static void active_link_set(ble_link_t *p_link)
+{
+    /*
+        Function for choosing the link that receives the input reports.
+        Reports still queued for the previous link are discarded, the per link controllers
+        start again on the new one. A previous link that stays connected is sent the
+        released state of what its host holds pressed.
+    */
+    uint16_t conn_handle = (p_link != NULL) ? p_link->conn_handle : BLE_CONN_HANDLE_INVALID;
+
+    if (conn_handle != m_conn_handle)
+    {
+        if (link_get(m_conn_handle) != NULL)
+        {
+            ble_hid_keys_release();
+            if (slave_latency_disabled)
+            {
+                slave_latency_disable_set(m_conn_handle, false);
+            }
+        }
+        slave_latency_disabled = false;
+        conn_params_mode = CONN_PARAMS_MODE_NONE;
+        active_conn_interval_min = ACTIVE_CONN_INTERVAL_MIN;
+
+        m_conn_handle = conn_handle;
+        ble_hid_tx_queue_flush();
+        ble_hid_keyboard_led_select(conn_handle);
+
+        if (p_link != NULL)
+        {
+            memcpy(connected_device_name, p_link->device_name, sizeof(connected_device_name));
+            memcpy(connected_device_address, p_link->device_address, sizeof(connected_device_address));
+            nrf_atomic_u32_or(&link_flags, LINK_FLAG_NAME_CHANGED);
+        }
+
+#if (BLUETOOTH_DEBUG_LOG > 0)
+        NRF_LOG_INFO("BLE: Active output link 0x%x", m_conn_handle);
+#endif
+    }
+
+    if ((p_link != NULL) && (p_link->peer_id != PM_PEER_ID_INVALID))
+    {
+        m_peer_id = p_link->peer_id;
+    }
+    link_state_update();
+}
+
+static void active_link_update(void)
+{
+    /*
+        Function for keeping a valid active output link.
+        The current one is kept while it is connected, otherwise a secured link is preferred.
+    */
+    ble_link_t *p_active = link_get(m_conn_handle);
+
+    if (p_active == NULL)
+    {
+        for (uint8_t i = 0; i < NRF_SDH_BLE_TOTAL_LINK_COUNT; i++)
+        {
+            if (links[i].conn_handle == BLE_CONN_HANDLE_INVALID) continue;
+
+            if ((p_active == NULL) || (links[i].secured && !p_active->secured))
+            {
+                p_active = &links[i];
+            }
+        }
+    }
+
+    active_link_set(p_active);
+}
+
+/**
+ * @brief Function for selecting the link that receives the input reports.
+ *
+ * @details The other links stay connected, switching is immediate.
+ *
+ * @param[in]   conn_handle  Handle of a connected link.
+ *
+ * @return      false if there is no link with this handle.
+ */
+bool ble_active_link_set(uint16_t conn_handle)
+{
+    ble_link_t *p_link = link_get(conn_handle);
+    if (p_link == NULL) return false;
+
+    active_link_set(p_link);
+    return true;
+}
+
+/**
+ * @brief Function for selecting the link of a bonded central as the one receiving the input reports.
+ *
+ * @param[in]   peer_id  Peer ID of the central.
+ *
+ * @return      false if this central is not connected.
+ */
+bool ble_active_link_set_by_peer(pm_peer_id_t peer_id)
+{
+    for (uint8_t i = 0; i < NRF_SDH_BLE_TOTAL_LINK_COUNT; i++)
+    {
+        if ((links[i].conn_handle != BLE_CONN_HANDLE_INVALID) && (links[i].peer_id == peer_id))
+        {
+            active_link_set(&links[i]);
+            return true;
+        }
+    }
+    return false;
+}
+
+uint16_t ble_active_link_get(void)
+{
+    return m_conn_handle;
+}
+
+/**
+ * @brief Function for listing the connected links.
+ *
+ * @param[out]  p_conn_handles  Buffer for the handles, NRF_SDH_BLE_TOTAL_LINK_COUNT entries.
+ *
+ * @return      Number of connected links.
+ */
+uint8_t ble_links_get(uint16_t *p_conn_handles)
+{
+    uint8_t count = 0;
+
+    for (uint8_t i = 0; i < NRF_SDH_BLE_TOTAL_LINK_COUNT; i++)
+    {
+        if (links[i].conn_handle != BLE_CONN_HANDLE_INVALID)
+        {
+            p_conn_handles[count++] = links[i].conn_handle;
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Function for getting the bonded central of a link.
+ *
+ * @return      PM_PEER_ID_INVALID if the link does not exist or is not bonded yet.
+ */
+pm_peer_id_t ble_link_peer_id_get(uint16_t conn_handle)
+{
+    ble_link_t *p_link = link_get(conn_handle);
+    if (p_link == NULL) return PM_PEER_ID_INVALID;
+
+    return p_link->peer_id;
+}
+
 static void ble_event_handler(ble_evt_t const *ble_event, void *context)
 {
     /*
@@ -1048,14 +2377,20 @@ static void ble_event_handler(ble_evt_t const *ble_event, void *context)
             {
                 ble_gattc_handle_value_t hdl_value = {0, NULL};
 
-                if ( NRF_SUCCESS == sd_ble_gattc_evt_char_val_by_uuid_read_rsp_iter((ble_gattc_evt_t *)&ble_event->evt.gattc_evt,
-                                                                                   &hdl_value) )
+                ble_link_t *p_link = link_get(ble_event->evt.gattc_evt.conn_handle);
+
+                if ( (p_link != NULL) &&
+                     (NRF_SUCCESS == sd_ble_gattc_evt_char_val_by_uuid_read_rsp_iter((ble_gattc_evt_t *)&ble_event->evt.gattc_evt,
+                                                                                    &hdl_value)) )
                 {
-                    save_connected_device_name(hdl_value.p_value, rd_rsp->value_len);
+                    // The response is only valid in this handler, the rest is deferred to the low priority class.
+                    memset(p_link->device_name, 0, sizeof(p_link->device_name));
+                    memcpy(p_link->device_name, hdl_value.p_value, MIN(rd_rsp->value_len, sizeof(p_link->device_name)));
 
-                    if(evenHandlerDeviceName != NULL)
+                    uint16_t conn_handle = p_link->conn_handle;
+                    if (ble_sched_event_put(BLE_SCHED_PRIO_LOW, &conn_handle, sizeof(conn_handle), device_name_update_scheduled) != NRF_SUCCESS)
                     {
-                        evenHandlerDeviceName();
+                        device_name_update_scheduled(&conn_handle, sizeof(conn_handle));
                     }
                 }
             }
@@ -1099,15 +2434,71 @@ static void ble_event_handler(ble_evt_t const *ble_event, void *context)
 #if (BLUETOOTH_DEBUG_LOG > 0)
             NRF_LOG_INFO("<<< BLE connected >>>");
 #endif
-            flag_ble_is_adv_mode = false;
-            m_conn_handle = ble_event->evt.gap_evt.conn_handle;
+            adv_state = ADV_STATE_OFF;  // The link state is updated once the link is registered.
+            uint16_t conn_handle = ble_event->evt.gap_evt.conn_handle;
+            uint16_t link_idx = ble_conn_state_conn_idx(conn_handle);
+            if (link_idx >= NRF_SDH_BLE_TOTAL_LINK_COUNT) break;
+
+            ble_link_t *p_link = &links[link_idx];
+            memset(p_link, 0, sizeof(ble_link_t));
+            p_link->conn_handle = conn_handle;
+            p_link->peer_id = PM_PEER_ID_INVALID;
+            p_link->att_mtu = BLE_GATT_ATT_MTU_DEFAULT;
+            p_link->data_length = BLE_GAP_DATA_LENGTH_DEFAULT;
+
             ble_gap_evt_connected_t connected_evt = ble_event->evt.gap_evt.params.connected;
-            save_connected_device_address(connected_evt.peer_addr);
-            err_code = nrf_ble_qwr_conn_handle_assign(&m_qwr, m_conn_handle);
+            save_connected_device_address(p_link, connected_evt.peer_addr);
+            err_code = nrf_ble_qwr_conn_handle_assign(&m_qwr[link_idx], conn_handle);
             APP_ERROR_CHECK(err_code);
+            ble_hid_cccd_restore(conn_handle);
+            ble_hid_link_reset(conn_handle);
+            battery_notified = false;
+
+            if (wake_connect_pending)
+            {
+                wake_connect_pending = false;
+                reconnect_stats.wake_to_connected_us = wake_elapsed_us();
+                if (adv_directed)
+                {
+                    reconnect_stats.directed_connects++;
+                }
+#if (BLUETOOTH_DEBUG_LOG > 0)
+                NRF_LOG_INFO("BLE: Connected %d us after wake%s.", reconnect_stats.wake_to_connected_us,
+                             adv_directed ? " (directed)" : "");
+#endif
+            }
+            adv_directed = false;
 
-            err_code = sd_ble_gap_tx_power_set( BLE_GAP_TX_POWER_ROLE_CONN, m_conn_handle, BLE_TX_POWER );
+            err_code = sd_ble_gap_tx_power_set( BLE_GAP_TX_POWER_ROLE_CONN, conn_handle, BLE_TX_POWER );
             APP_ERROR_CHECK(err_code);
+
+            /* The last connected central receives the input reports, as with a single link. */
+            active_link_set(p_link);
+
+            last_activity_ticks = app_timer_cnt_get();
+            if (!conn_idle_timer_running)
+            {
+                conn_idle_timer_start(conn_idle_timeout_ticks);
+            }
+
+            if (conn_params_handler != NULL)
+            {
+                conn_params_handler(conn_handle, &connected_evt.conn_params);
+            }
+        }
+        break;
+
+        case BLE_GAP_EVT_CONN_PARAM_UPDATE:
+        {
+            ble_gap_conn_params_t const *p_conn_params = &ble_event->evt.gap_evt.params.conn_param_update.conn_params;
+#if (BLUETOOTH_DEBUG_LOG > 1)
+            NRF_LOG_DEBUG("BLE: Connection interval %d-%d units, slave latency %d", p_conn_params->min_conn_interval,
+                          p_conn_params->max_conn_interval, p_conn_params->slave_latency);
+#endif
+            if (conn_params_handler != NULL)
+            {
+                conn_params_handler(ble_event->evt.gap_evt.conn_handle, p_conn_params);
+            }
         }
         break;
 
@@ -1117,9 +2508,20 @@ static void ble_event_handler(ble_evt_t const *ble_event, void *context)
             NRF_LOG_INFO("<<< BLE disconnected >>>");
 #endif
 
-            flag_ble_connected = false;
+            ble_link_t *p_link = link_get(ble_event->evt.gap_evt.conn_handle);
+            if (p_link != NULL)
+            {
+                p_link->conn_handle = BLE_CONN_HANDLE_INVALID;
+                p_link->secured = false;
+            }
+
+            /* Another connected central, if any, takes over the input reports. */
+            active_link_update();
 
-            m_conn_handle = BLE_CONN_HANDLE_INVALID;
+            if (ble_event->evt.gap_evt.conn_handle == async_conn_handle)
+            {
+                async_op_complete(BLE_ASYNC_OP_DISCONNECT, BLE_ASYNC_DONE);
+            }
         }
         break;
 
@@ -1140,7 +2542,12 @@ static void ble_event_handler(ble_evt_t const *ble_event, void *context)
 
         case BLE_GATTS_EVT_HVN_TX_COMPLETE:
         {
-            //Here should be the call to the ble hid service
+            ble_hid_on_hvn_tx_complete(ble_event->evt.gatts_evt.conn_handle,
+                                       ble_event->evt.gatts_evt.params.hvn_tx_complete.count);
+            if (ble_event->evt.gatts_evt.conn_handle == m_conn_handle)
+            {
+                battery_pending_flush();
+            }
 #if (BLUETOOTH_DEBUG_LOG > 4)
             NRF_LOG_DEBUG("<<< BLE: Report sent >>>");
 #endif
@@ -1171,6 +2578,23 @@ static void ble_event_handler(ble_evt_t const *ble_event, void *context)
     }
 }
 
+static void device_name_update_scheduled(void *p_event_data, uint16_t event_size)
+{
+    /*
+        Function for publishing the name read from a host, if the link is still up.
+    */
+    uint16_t conn_handle = *(uint16_t *)p_event_data;
+    ble_link_t *p_link = link_get(conn_handle);
+    if (p_link == NULL) return;
+
+    save_connected_device_name(p_link, NULL, 0);
+
+    if ((evenHandlerDeviceName != NULL) && (conn_handle == m_conn_handle))
+    {
+        evenHandlerDeviceName();
+    }
+}
+
 void ble_get_device_name(EventHandlerDeviceName_t evenHandler)
 {
     evenHandlerDeviceName = evenHandler;  // Set the handler to get the host BLE device name.
@@ -1183,7 +2607,7 @@ void ble_get_device_name(EventHandlerDeviceName_t evenHandler)
 
 bool ble_connected(void)
 {
-    return flag_ble_connected;
+    return link_state == BLE_LINK_STATE_SECURED;
 }
 
 bool ble_innited(void)
@@ -1193,25 +2617,42 @@ bool ble_innited(void)
 
 bool ble_get_flag_connection_name_changed(void)
 {
-    return flag_connected_device_name_changed;
+    return (link_flags & LINK_FLAG_NAME_CHANGED) != 0;
 }
 
 void ble_set_flag_connection_name_changed(bool flag)
 {
-    flag_connected_device_name_changed = flag;
+    if (flag)
+    {
+        nrf_atomic_u32_or(&link_flags, LINK_FLAG_NAME_CHANGED);
+    }
+    else
+    {
+        nrf_atomic_u32_and(&link_flags, ~LINK_FLAG_NAME_CHANGED);
+    }
 }
 
 
-void ble_battery_level_update(uint8_t battery_level)
+static ret_code_t battery_level_send(uint8_t battery_level)
 {
-    if (!ble_connected())
-    {
-        return;
-    }
-
+    /*
+        Function for notifying a battery level.
+        The BAS records a level before notifying it and skips unchanged levels: it is given back the last level
+        notified so a level that could not go out is not taken for unchanged when sent again.
+    */
     ret_code_t err_code;
+    bool level_changed = (battery_level != battery_level_notified);
 
+    m_bas.battery_level_last = battery_level_notified;
     err_code = ble_bas_battery_level_update(&m_bas, battery_level, m_conn_handle);
+    if ((err_code == NRF_SUCCESS) && level_changed)
+    {
+        ble_hid_tx_track_external();  // Shares the TX buffers with the HID reports.
+        battery_stats.sent++;
+        battery_level_notified = battery_level;
+        battery_notified = true;
+        battery_notified_ticks = app_timer_cnt_get();
+    }
     if ( (err_code != NRF_SUCCESS) &&
         (err_code != NRF_ERROR_BUSY) &&
         (err_code != NRF_ERROR_RESOURCES) &&
@@ -1221,11 +2662,125 @@ void ble_battery_level_update(uint8_t battery_level)
     {
         APP_ERROR_HANDLER(err_code);
     }
+
+    return err_code;
+}
+
+/* Function for sending the pending battery level once the policy allows it. It stays pending until sent. */
+static void battery_pending_flush(void)
+{
+    CRITICAL_REGION_ENTER();
+    if (battery_pending && ble_connected())
+    {
+        uint32_t elapsed = app_timer_cnt_diff_compute(app_timer_cnt_get(), battery_notified_ticks);
+        bool interval_elapsed = !battery_notified || (elapsed >= APP_TIMER_TICKS(battery_policy.min_interval_ms));
+        bool hid_allows = (battery_policy.mode == BLE_BATTERY_SEND_IDLE) ? ble_hid_tx_idle() : ble_hid_tx_external_allowed();
+
+        if (interval_elapsed && hid_allows && (battery_level_send(battery_pending_level) == NRF_SUCCESS))
+        {
+            battery_pending = false;
+        }
+    }
+    CRITICAL_REGION_EXIT();
+}
+
+/**
+ * @brief Update the battery level.
+ *
+ * @details The level is notified when it moved by the policy hysteresis since the last notification, no earlier
+ *          than the policy minimum interval and only when the HID TX arbiter gives the battery a credit. A level that
+ *          has to wait is kept and sent on the next call or on the next TX complete event that allows it.
+ *          The update runs from ble_run(), in the low priority class.
+ */
+void ble_battery_level_update(uint8_t battery_level)
+{
+    if (ble_sched_event_put(BLE_SCHED_PRIO_LOW, &battery_level, sizeof(battery_level), battery_level_update_scheduled) != NRF_SUCCESS)
+    {
+        battery_level_apply(battery_level);
+    }
+}
+
+static void battery_level_update_scheduled(void *p_event_data, uint16_t event_size)
+{
+    battery_level_apply(*(uint8_t *)p_event_data);
+}
+
+/* Function for applying the battery policy to a new level. */
+static void battery_level_apply(uint8_t battery_level)
+{
+    if (!ble_connected())
+    {
+        return;
+    }
+
+    uint8_t last_level = battery_level_notified;
+    uint8_t change = (battery_level > last_level) ? (battery_level - last_level) : (last_level - battery_level);
+
+    CRITICAL_REGION_ENTER();
+    if (change < MAX(battery_policy.hysteresis, 1))
+    {
+        // Close to the notified level, a waiting level is not worth sending either.
+        battery_pending = false;
+        battery_stats.suppressed++;
+    }
+    else
+    {
+        if (battery_pending)
+        {
+            battery_stats.suppressed++;  // Never sent, replaced by the newer level.
+        }
+        battery_pending = true;
+        battery_pending_level = battery_level;
+    }
+    CRITICAL_REGION_EXIT();
+
+    battery_pending_flush();
+
+    CRITICAL_REGION_ENTER();
+    if (battery_pending && (battery_pending_level == battery_level))
+    {
+        battery_stats.deferred++;
+    }
+    CRITICAL_REGION_EXIT();
+}
+
+void ble_battery_policy_set(ble_battery_policy_t const *p_policy)
+{
+    CRITICAL_REGION_ENTER();
+    battery_policy = *p_policy;
+    CRITICAL_REGION_EXIT();
+
+    battery_pending_flush();
+}
+
+void ble_battery_stats_get(ble_battery_stats_t *p_stats)
+{
+    CRITICAL_REGION_ENTER();
+    *p_stats = battery_stats;
+    CRITICAL_REGION_EXIT();
+}
+
+void ble_battery_stats_reset(void)
+{
+    CRITICAL_REGION_ENTER();
+    memset(&battery_stats, 0, sizeof(battery_stats));
+    CRITICAL_REGION_EXIT();
 }
 
 void set_device_name(const char *device_name)
 {
     snprintf(keyb_ble_name, sizeof(keyb_ble_name), "%s - %i", device_name, current_channel + 1);
+
+    if (strncmp(keyb_ble_base_name, device_name, sizeof(keyb_ble_base_name)) != 0)
+    {
+        snprintf(keyb_ble_base_name, sizeof(keyb_ble_base_name), "%s", device_name);
+
+        // The channel names are built again on the next switch.
+        for (uint8_t channel = 0; channel < BLE_CHANNELS_COUNT; channel++)
+        {
+            channel_cache[channel].valid = false;
+        }
+    }
 }
 
 void set_current_channel(uint8_t channel)
@@ -1237,3 +2792,523 @@ void set_whitelist(bool whitelisting)
 {
     active_whitelist_flag = whitelisting;
 }
+
+static void channel_cache_build(uint8_t channel)
+{
+    /*
+        Function for building the address and name of a channel, and finding where its name is advertised.
+    */
+    ble_channel_cache_t *p_cache = &channel_cache[channel];
+    ble_advdata_t advdata;
+    uint8_t adv_data[BLE_GAP_ADV_SET_DATA_SIZE_MAX];
+    uint16_t adv_data_len = sizeof(adv_data);
+    ret_code_t err_code;
+
+    p_cache->addr = gap_addr_get();
+    p_cache->addr.addr[0] = channel;
+    snprintf(p_cache->name, sizeof(p_cache->name), "%s - %i", keyb_ble_base_name, channel + 1);
+
+    // Room left by the fields shared by every channel for the name AD structure.
+    advdata_common_set(&advdata);
+    err_code = ble_advdata_encode(&advdata, adv_data, &adv_data_len);
+    APP_ERROR_CHECK(err_code);
+
+    p_cache->name_in_scan_rsp = (adv_data_len + 2 + strlen(p_cache->name) > sizeof(adv_data));
+    p_cache->valid = true;
+}
+
+/**
+ * @brief Function for switching the device identity to another channel.
+ *
+ * @details Address and name come from the channel cache, built again only if the device name changed
+ *          since the last switch. Advertising is stopped; call
+ *          ble_goto_advertising_mode() or ble_goto_white_list_advertising_mode() afterwards.
+ *          The time spent is recorded in the channel switch statistics.
+ *
+ * @param[in]   channel  Channel number, lower than BLE_CHANNELS_COUNT.
+ *
+ * @return      false if the channel does not exist or the SoftDevice rejected the address.
+ */
+bool ble_channel_switch(uint8_t channel)
+{
+    if (channel >= BLE_CHANNELS_COUNT) return false;
+
+    uint32_t start_ticks = app_timer_cnt_get();
+    ble_channel_cache_t *p_cache = &channel_cache[channel];
+    ble_gap_conn_sec_mode_t sec_mode;
+    ret_code_t err_code;
+
+    if (!p_cache->valid)
+    {
+        channel_cache_build(channel);
+        channel_switch_stats.rebuild_count++;
+    }
+
+    if (adv_state == ADV_STATE_RUNNING)
+    {
+        ble_adv_stop();
+    }
+
+    if (!gap_addr_set(&p_cache->addr))
+    {
+#if (BLUETOOTH_DEBUG_LOG > 1)
+        NRF_LOG_DEBUG("BLE: Error changing channel.");
+#endif
+        return false;
+    }
+
+    BLE_GAP_CONN_SEC_MODE_SET_ENC_WITH_MITM(&sec_mode);
+    err_code = sd_ble_gap_device_name_set(&sec_mode, (uint8_t *)p_cache->name, strlen(p_cache->name));
+    APP_ERROR_CHECK(err_code);
+
+    // Encoded with the name just set, into the advertising module buffers: in whitelist mode the module
+    // rewrites the flags of the payload it holds.
+    ble_advdata_t advdata;
+    ble_advdata_t srdata;
+
+    advdata_common_set(&advdata);
+    advdata.name_type = BLE_ADVDATA_FULL_NAME; // Shortened to what fits when the full name is in the scan response.
+    memset(&srdata, 0, sizeof(srdata));
+    srdata.name_type = BLE_ADVDATA_FULL_NAME;
+
+    err_code = ble_advertising_advdata_update(&m_advertising, &advdata, p_cache->name_in_scan_rsp ? &srdata : NULL);
+    APP_ERROR_CHECK(err_code);
+
+    ble_adv_modes_config_t adv_modes_config = m_advertising.adv_modes_config;
+    adv_modes_config.ble_adv_whitelist_enabled = active_whitelist_flag;
+    ble_advertising_modes_config_set(&m_advertising, &adv_modes_config);
+
+    current_channel = channel;
+    memcpy(keyb_ble_name, p_cache->name, sizeof(keyb_ble_name));
+
+    uint32_t ticks = app_timer_cnt_diff_compute(app_timer_cnt_get(), start_ticks);
+    uint32_t us = (uint32_t)(((uint64_t)ticks * 1000000 * (APP_TIMER_CONFIG_RTC_FREQUENCY + 1)) / APP_TIMER_CLOCK_FREQ);
+
+    channel_switch_stats.count++;
+    channel_switch_stats.last_us = us;
+    if (us > channel_switch_stats.max_us)
+    {
+        channel_switch_stats.max_us = us;
+    }
+
+#if (BLUETOOTH_DEBUG_LOG > 0)
+    NRF_LOG_INFO("BLE: Switched to channel %i in %d us", channel + 1, us);
+#endif
+
+    return true;
+}
+
+void ble_channel_switch_stats_get(ble_channel_switch_stats_t *p_stats)
+{
+    *p_stats = channel_switch_stats;
+}
+
+/**
+ * @brief Function for getting the centrals of a channel: the ones that last connected on it, kept in flash,
+ *        and the ones bonded while on it since power up.
+ *
+ * @param[out]  p_peer_ids  Buffer for BLE_GAP_WHITELIST_ADDR_MAX_COUNT peer IDs.
+ *
+ * @return      Number of peers.
+ */
+uint8_t ble_channel_peers_get(uint8_t channel, pm_peer_id_t *p_peer_ids)
+{
+    if (channel >= BLE_CHANNELS_COUNT) return 0;
+
+    memcpy(p_peer_ids, channel_cache[channel].peers, channel_cache[channel].peer_count * sizeof(pm_peer_id_t));
+    return channel_cache[channel].peer_count;
+}
+
+static void channel_peer_add(uint8_t channel, pm_peer_id_t peer_id)
+{
+    /*
+        Function for adding a central to the peer set of a channel.
+        When the set is full the oldest central is forgotten.
+    */
+    if ((channel >= BLE_CHANNELS_COUNT) || (peer_id == PM_PEER_ID_INVALID)) return;
+
+    ble_channel_cache_t *p_cache = &channel_cache[channel];
+
+    for (uint8_t i = 0; i < p_cache->peer_count; i++)
+    {
+        if (p_cache->peers[i] == peer_id) return;
+    }
+
+    if (p_cache->peer_count == BLE_GAP_WHITELIST_ADDR_MAX_COUNT)
+    {
+        memmove(&p_cache->peers[0], &p_cache->peers[1], (BLE_GAP_WHITELIST_ADDR_MAX_COUNT - 1) * sizeof(pm_peer_id_t));
+        p_cache->peer_count--;
+    }
+    p_cache->peers[p_cache->peer_count++] = peer_id;
+}
+
+static void channel_peer_remove(pm_peer_id_t peer_id)
+{
+    for (uint8_t channel = 0; channel < BLE_CHANNELS_COUNT; channel++)
+    {
+        ble_channel_cache_t *p_cache = &channel_cache[channel];
+
+        for (uint8_t i = 0; i < p_cache->peer_count; i++)
+        {
+            if (p_cache->peers[i] == peer_id)
+            {
+                memmove(&p_cache->peers[i], &p_cache->peers[i + 1], (p_cache->peer_count - i - 1) * sizeof(pm_peer_id_t));
+                p_cache->peer_count--;
+                break;
+            }
+        }
+    }
+}
+
+static uint32_t channel_peers_filter(pm_peer_id_t *p_peer_ids, uint32_t peer_id_count)
+{
+    /*
+        Function for keeping, from a list of bonded peers, the ones of the current channel.
+        The list is left untouched if none of them is known to belong to this channel.
+    */
+    if (current_channel >= BLE_CHANNELS_COUNT) return peer_id_count;
+
+    ble_channel_cache_t *p_cache = &channel_cache[current_channel];
+    pm_peer_id_t filtered[BLE_GAP_WHITELIST_ADDR_MAX_COUNT];
+    uint32_t filtered_count = 0;
+
+    for (uint32_t i = 0; i < peer_id_count; i++)
+    {
+        for (uint8_t j = 0; j < p_cache->peer_count; j++)
+        {
+            if (p_peer_ids[i] == p_cache->peers[j])
+            {
+                filtered[filtered_count++] = p_peer_ids[i];
+                break;
+            }
+        }
+    }
+
+    if (filtered_count == 0) return peer_id_count;
+
+    memcpy(p_peer_ids, filtered, filtered_count * sizeof(pm_peer_id_t));
+    return filtered_count;
+}
+
+static void bond_cache_load(void)
+{
+    /*
+        Function for reading the keys of every bonded central, once at start up.
+    */
+    bond_cache_count = 0;
+    bond_cache_complete = true;
+
+    pm_peer_id_t peer_id = pm_next_peer_id_get(PM_PEER_ID_INVALID);
+    while (peer_id != PM_PEER_ID_INVALID)
+    {
+        bond_cache_peer_update(peer_id);
+        peer_id = pm_next_peer_id_get(peer_id);
+    }
+
+#if (BLUETOOTH_DEBUG_LOG > 1)
+    NRF_LOG_DEBUG("BLE: %d bonded centrals cached%s.", bond_cache_count, bond_cache_complete ? "" : ", cache full");
+#endif
+}
+
+static void bond_cache_peer_update(pm_peer_id_t peer_id)
+{
+    /*
+        Function for reading again the keys of a central, after the Peer Manager stored them.
+        The filters are asked to pm_peer_id_list() itself, starting the search at this peer, so the
+        lists built from the cache are the ones the Peer Manager would give.
+    */
+    pm_peer_data_bonding_t bonding_data;
+
+    if (pm_peer_data_bonding_load(peer_id, &bonding_data) != NRF_SUCCESS)
+    {
+        bond_cache_peer_remove(peer_id);
+        return;
+    }
+
+    uint8_t filters = 0;
+    for (uint8_t i = 0; i < ARRAY_SIZE(bond_cache_filters); i++)
+    {
+        pm_peer_id_t first_peer_id;
+        uint32_t count = 1;
+
+        if ((pm_peer_id_list(&first_peer_id, &count, peer_id, bond_cache_filters[i]) == NRF_SUCCESS) &&
+            (count == 1) && (first_peer_id == peer_id))
+        {
+            filters |= (uint8_t)(1U << i);
+        }
+    }
+
+    // Kept in peer ID order.
+    uint8_t i = 0;
+    while ((i < bond_cache_count) && (bond_cache[i].peer_id < peer_id))
+    {
+        i++;
+    }
+    if ((i == bond_cache_count) || (bond_cache[i].peer_id != peer_id))
+    {
+        if (bond_cache_count == BLE_BOND_CACHE_SIZE)
+        {
+            bond_cache_complete = false;
+            if (i == bond_cache_count) return;
+
+            // The highest peer ID leaves, lists keep being right as they are then read from flash.
+            bond_cache_count--;
+        }
+        memmove(&bond_cache[i + 1], &bond_cache[i], (bond_cache_count - i) * sizeof(ble_bond_cache_entry_t));
+        bond_cache_count++;
+    }
+
+    bond_cache[i].peer_id = peer_id;
+    bond_cache[i].id_key = bonding_data.peer_ble_id;
+    bond_cache[i].filters = filters;
+
+    // The Peer Manager reads the new keys only when the lists are given again.
+    whitelist_applied = false;
+    identities_applied = false;
+}
+
+static void bond_cache_peer_remove(pm_peer_id_t peer_id)
+{
+    for (uint8_t i = 0; i < bond_cache_count; i++)
+    {
+        if (bond_cache[i].peer_id == peer_id)
+        {
+            memmove(&bond_cache[i], &bond_cache[i + 1], (bond_cache_count - i - 1) * sizeof(ble_bond_cache_entry_t));
+            bond_cache_count--;
+            break;
+        }
+    }
+}
+
+static uint32_t bond_cache_peer_ids_get(pm_peer_id_t *p_peer_ids, uint32_t max_count, pm_peer_id_list_skip_t skip)
+{
+    /*
+        Function for listing, as pm_peer_id_list() does, the first max_count bonded centrals passing the filter.
+    */
+    uint8_t filter = 0;
+    while ((filter < ARRAY_SIZE(bond_cache_filters)) && (bond_cache_filters[filter] != skip))
+    {
+        filter++;
+    }
+
+    if (!bond_cache_complete || (filter == ARRAY_SIZE(bond_cache_filters)))
+    {
+        uint32_t peer_id_count = max_count;
+        ret_code_t err_code = pm_peer_id_list(p_peer_ids, &peer_id_count, PM_PEER_ID_INVALID, skip);
+        APP_ERROR_CHECK(err_code);
+        return peer_id_count;
+    }
+
+    uint32_t peer_id_count = 0;
+    for (uint8_t i = 0; (i < bond_cache_count) && (peer_id_count < max_count); i++)
+    {
+        if (bond_cache[i].filters & (1U << filter))
+        {
+            p_peer_ids[peer_id_count++] = bond_cache[i].peer_id;
+        }
+    }
+    return peer_id_count;
+}
+
+static ble_bond_cache_entry_t const *bond_cache_entry_get(pm_peer_id_t peer_id)
+{
+    for (uint8_t i = 0; i < bond_cache_count; i++)
+    {
+        if (bond_cache[i].peer_id == peer_id) return &bond_cache[i];
+    }
+    return NULL;
+}
+
+static bool bond_cache_peer_addr_get(pm_peer_id_t peer_id, ble_gap_addr_t *p_addr)
+{
+    /*
+        Function for getting the identity address of a central, from flash only when it is not cached.
+    */
+    ble_bond_cache_entry_t const *p_entry = bond_cache_entry_get(peer_id);
+    if (p_entry != NULL)
+    {
+        *p_addr = p_entry->id_key.id_addr_info;
+        return true;
+    }
+
+    pm_peer_data_bonding_t bonding_data;
+    ret_code_t err_code = pm_peer_data_bonding_load(peer_id, &bonding_data);
+    if (err_code == NRF_ERROR_NOT_FOUND) return false;
+    APP_ERROR_CHECK(err_code);
+
+    *p_addr = bonding_data.peer_ble_id.id_addr_info;
+    return true;
+}
+
+static ret_code_t bond_cache_whitelist_get(ble_gap_addr_t *p_addrs, uint32_t *p_addr_cnt, ble_gap_irk_t *p_irks, uint32_t *p_irk_cnt)
+{
+    /*
+        Function for getting the addresses and IRKs of the whitelist, as pm_whitelist_get() does.
+        The Peer Manager is only asked when the whitelist was not set by whitelist_set() or holds
+        a central that is not cached.
+    */
+    if (!whitelist_applied || (whitelist_peer_count > *p_addr_cnt) || (whitelist_peer_count > *p_irk_cnt))
+    {
+        return pm_whitelist_get(p_addrs, p_addr_cnt, p_irks, p_irk_cnt);
+    }
+
+    for (uint32_t i = 0; i < whitelist_peer_count; i++)
+    {
+        ble_bond_cache_entry_t const *p_entry = bond_cache_entry_get(whitelist_peers[i]);
+        if (p_entry == NULL)
+        {
+            return pm_whitelist_get(p_addrs, p_addr_cnt, p_irks, p_irk_cnt);
+        }
+
+        p_addrs[i] = p_entry->id_key.id_addr_info;
+        p_irks[i] = p_entry->id_key.id_info;
+    }
+
+    *p_addr_cnt = whitelist_peer_count;
+    *p_irk_cnt = whitelist_peer_count;
+    return NRF_SUCCESS;
+}
+
+static void last_peers_load(void)
+{
+    /*
+        Function for finding, from the peer records in flash, the last central connected on each channel
+        and the centrals of each channel peer set.
+    */
+    for (uint8_t channel = 0; channel < BLE_CHANNELS_COUNT; channel++)
+    {
+        channel_last_peer[channel] = PM_PEER_ID_INVALID;
+    }
+
+    uint32_t channel_seq[BLE_CHANNELS_COUNT] = {0};
+    pm_peer_id_t peer_id = pm_next_peer_id_get(PM_PEER_ID_INVALID);
+
+    while (peer_id != PM_PEER_ID_INVALID)
+    {
+        ble_last_peer_record_t record;
+        uint32_t len = sizeof(record);
+
+        if ((pm_peer_data_app_data_load(peer_id, &record, &len) == NRF_SUCCESS) &&
+            (len == sizeof(record)) && (record.channel < BLE_CHANNELS_COUNT))
+        {
+            // The channel peer sets start from the channel each central last connected on.
+            channel_peer_add(record.channel, peer_id);
+
+            if ((channel_last_peer[record.channel] == PM_PEER_ID_INVALID) || (record.seq > channel_seq[record.channel]))
+            {
+                channel_last_peer[record.channel] = peer_id;
+                channel_seq[record.channel] = record.seq;
+            }
+            if (record.seq > last_peer_seq)
+            {
+                last_peer_seq = record.seq;
+            }
+        }
+
+        peer_id = pm_next_peer_id_get(peer_id);
+    }
+}
+
+static void last_peer_store(uint8_t channel, pm_peer_id_t peer_id)
+{
+    /*
+        Function for remembering the last central connected on a channel.
+        Flash is only written when the central changes, reconnecting to the same host costs nothing.
+    */
+    if ((channel >= BLE_CHANNELS_COUNT) || (peer_id == PM_PEER_ID_INVALID)) return;
+    if (channel_last_peer[channel] == peer_id) return;
+
+    // A peer keeps a single record, it leaves the channel it was on before.
+    last_peer_forget(peer_id);
+    channel_last_peer[channel] = peer_id;
+
+    // The Peer Manager reads the record until the flash write completes, one buffer per channel.
+    ble_last_peer_record_t *p_record = &last_peer_records[channel];
+    memset(p_record, 0, sizeof(ble_last_peer_record_t));
+    p_record->seq = ++last_peer_seq;
+    p_record->channel = channel;
+
+    // Deferred to the low priority class, the flash work must not delay the first keys.
+    if (ble_sched_event_put(BLE_SCHED_PRIO_LOW, &channel, sizeof(channel), last_peer_write_scheduled) != NRF_SUCCESS)
+    {
+        last_peer_write_scheduled(&channel, sizeof(channel));
+    }
+}
+
+static void last_peer_write_scheduled(void *p_event_data, uint16_t event_size)
+{
+    /*
+        Function for writing the last peer record of a channel to flash.
+        Writes the central of the channel at the time it runs, a newer one may have replaced the one stored.
+    */
+    uint8_t channel = *(uint8_t *)p_event_data;
+    pm_peer_id_t peer_id = channel_last_peer[channel];
+    if (peer_id == PM_PEER_ID_INVALID) return;
+
+    ret_code_t err_code = pm_peer_data_app_data_store(peer_id, &last_peer_records[channel], sizeof(ble_last_peer_record_t), NULL);
+    if (err_code != NRF_SUCCESS)
+    {
+        // Kept in RAM anyway, the flash record is written again on the next change.
+#if (BLUETOOTH_DEBUG_LOG > 1)
+        NRF_LOG_DEBUG("BLE: Last peer of channel %i not stored, error %d.", channel + 1, err_code);
+#endif
+    }
+}
+
+static void last_peer_forget(pm_peer_id_t peer_id)
+{
+    for (uint8_t channel = 0; channel < BLE_CHANNELS_COUNT; channel++)
+    {
+        if (channel_last_peer[channel] == peer_id)
+        {
+            channel_last_peer[channel] = PM_PEER_ID_INVALID;
+        }
+    }
+}
+
+static pm_peer_id_t directed_peer_get(void)
+{
+    /*
+        Function for choosing the central to advertise directed to: the last one of the current
+        channel. A channel with no record has none, the central of another channel must not be woken.
+    */
+    if (current_channel >= BLE_CHANNELS_COUNT) return PM_PEER_ID_INVALID;
+
+    return channel_last_peer[current_channel];
+}
+
+static uint32_t wake_elapsed_us(void)
+{
+    uint32_t ticks = app_timer_cnt_diff_compute(app_timer_cnt_get(), wake_ticks);
+    return (uint32_t)(((uint64_t)ticks * 1000000 * (APP_TIMER_CONFIG_RTC_FREQUENCY + 1)) / APP_TIMER_CLOCK_FREQ);
+}
+
+/**
+ * @brief Function for getting the last central connected on a channel.
+ *
+ * @details The peer is kept in flash, it is the central targeted by directed advertising on wake.
+ *
+ * @return      PM_PEER_ID_INVALID if no central connected on this channel yet.
+ */
+pm_peer_id_t ble_channel_last_peer_get(uint8_t channel)
+{
+    if (channel >= BLE_CHANNELS_COUNT) return PM_PEER_ID_INVALID;
+
+    return channel_last_peer[channel];
+}
+
+/**
+ * @brief Function for getting the wake to connected and wake to encrypted timings.
+ *
+ * @details A wake is a call to ble_goto_advertising_mode(), the next connection and the next
+ *          successful security procedure are timed from it.
+ */
+void ble_reconnect_stats_get(ble_reconnect_stats_t *p_stats)
+{
+    *p_stats = reconnect_stats;
+}
+
+void ble_reconnect_stats_reset(void)
+{
+    memset(&reconnect_stats, 0, sizeof(reconnect_stats));
+}
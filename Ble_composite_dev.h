@@ -49,6 +49,7 @@ extern "C"
 #include "ble_conn_params.h"
 
 #include "app_scheduler.h"
+#include "nrf_atomic.h"
 #include "nrf_sdh.h"
 #include "nrf_sdh_soc.h"
 #include "nrf_sdh_ble.h"
@@ -107,6 +108,52 @@ extern "C"
 #define NEXT_CONN_PARAMS_UPDATE_DELAY       APP_TIMER_TICKS(30000)              /* Time between each call to sd_ble_gap_conn_param_update after the first call (30 seconds). */
 #define MAX_CONN_PARAMS_UPDATE_COUNT        3                                   /* Number of attempts before giving up the connection parameter negotiation. */
 
+/*
+    Adaptive connection parameters.
+    While keys are being sent the shortest interval accepted by the host is requested, starting at
+    ACTIVE_CONN_INTERVAL_MIN and relaxing one step each time the host rejects it.
+    After CONN_IDLE_TIMEOUT_MS without reports the relaxed IDLE_* parameters are requested.
+*/
+#define ACTIVE_CONN_INTERVAL_MIN            MSEC_TO_UNITS(7.5, UNIT_1_25_MS)    /* Shortest interval requested while typing (7.5 ms). */
+#define ACTIVE_CONN_INTERVAL_STEP           MSEC_TO_UNITS(3.75, UNIT_1_25_MS)   /* Increment applied to the minimum interval when the host rejects it (3.75 ms). */
+#define ACTIVE_CONN_INTERVAL_MAX            MSEC_TO_UNITS(15, UNIT_1_25_MS)     /* Longest interval accepted while typing (15 ms). */
+#define ACTIVE_SLAVE_LATENCY                0                                   /* Slave latency while typing. */
+#define IDLE_CONN_INTERVAL_MIN              MSEC_TO_UNITS(30, UNIT_1_25_MS)     /* Minimum interval requested when idle (30 ms). */
+#define IDLE_CONN_INTERVAL_MAX              MSEC_TO_UNITS(45, UNIT_1_25_MS)     /* Maximum interval requested when idle (45 ms). */
+#define IDLE_SLAVE_LATENCY                  SLAVE_LATENCY                       /* Slave latency when idle. */
+#ifndef SLAVE_LATENCY_QUIET_TIMEOUT_MS
+#define SLAVE_LATENCY_QUIET_TIMEOUT_MS      500                                 /* Time without reports before slave latency is enabled again (500 ms). */
+#endif
+#ifndef CONN_IDLE_TIMEOUT_MS
+#define CONN_IDLE_TIMEOUT_MS                10000                               /* Time without reports before switching to the idle parameters (10 seconds). */
+#endif
+
+#ifndef BLE_GATT_PREFERRED_ATT_MTU
+#define BLE_GATT_PREFERRED_ATT_MTU          NRF_SDH_BLE_GATT_MAX_MTU_SIZE       /* ATT MTU requested to the central, large enough for a whole raw HID report. */
+#endif
+#ifndef BLE_GAP_PREFERRED_DATA_LENGTH
+#define BLE_GAP_PREFERRED_DATA_LENGTH       NRF_SDH_BLE_GAP_DATA_LENGTH         /* Link layer data length (DLE) requested to the central, in bytes. */
+#endif
+
+#ifndef BLE_DISCONNECT_TIMEOUT_MS
+#define BLE_DISCONNECT_TIMEOUT_MS           2000                                /* Time given to ble_disconnect_async() before reporting a timeout. */
+#endif
+#ifndef BLE_PEER_DELETE_TIMEOUT_MS
+#define BLE_PEER_DELETE_TIMEOUT_MS          5000                                /* Time given to the asynchronous bond deletions, flash erase included. */
+#endif
+
+#ifndef BLE_LINK_STATE_HANDLERS_MAX
+#define BLE_LINK_STATE_HANDLERS_MAX         4                                   /* Maximum number of link state subscribers. */
+#endif
+
+#ifndef BLE_CHANNELS_COUNT
+#define BLE_CHANNELS_COUNT                  5                                   /* Number of host channels, each one with its own address and name. */
+#endif
+
+#ifndef BLE_BOND_CACHE_SIZE
+#define BLE_BOND_CACHE_SIZE                 16                                  /* Bonded centrals kept in RAM, with more the lists are read from flash. */
+#endif
+
 #define SEC_PARAM_BOND                      1                                   /* Perform bonding. */
 #define SEC_PARAM_MITM                      0                                   /* Man In The Middle protection not required. */
 #define SEC_PARAM_LESC                      0                                   /* LE Secure Connections not enabled. */
@@ -124,13 +171,98 @@ extern "C"
 #define SCHED_QUEUE_SIZE                    10                                  /* Maximum number of events in the scheduler queue. */
 #endif
 
+#ifndef BLE_BATTERY_HYSTERESIS
+#define BLE_BATTERY_HYSTERESIS              2                                   /* Battery level change (%) needed for a new notification. */
+#endif
+#ifndef BLE_BATTERY_MIN_INTERVAL_MS
+#define BLE_BATTERY_MIN_INTERVAL_MS         60000                               /* Minimum time between two battery notifications. */
+#endif
+
+#ifndef BLE_STACK_PROFILE
+#define BLE_STACK_PROFILE                   BLE_STACK_PROFILE_DEFAULT           /* SoftDevice configuration used unless ble_stack_profile_set() is called. */
+#endif
+#ifndef BLE_STACK_ATTR_TAB_SIZE
+#define BLE_STACK_ATTR_TAB_SIZE             NRF_SDH_BLE_GATTS_ATTR_TAB_SIZE     /* GATT table of the profiles, must hold every service of the SKU. */
+#endif
+
+#ifndef BLE_SCHED_EVENT_DATA_SIZE
+#define BLE_SCHED_EVENT_DATA_SIZE           8                                   /* Maximum size of the priority scheduler events. */
+#endif
+#ifndef BLE_SCHED_HIGH_QUEUE_SIZE
+#define BLE_SCHED_HIGH_QUEUE_SIZE           8                                   /* Events in the high priority class (HID, connection). */
+#endif
+#ifndef BLE_SCHED_LOW_QUEUE_SIZE
+#define BLE_SCHED_LOW_QUEUE_SIZE            8                                   /* Events in the low priority class (battery, name, whitelist, flash). */
+#endif
+#ifndef BLE_SCHED_LOW_EVENTS_PER_RUN
+#define BLE_SCHED_LOW_EVENTS_PER_RUN        1                                   /* Low priority events run by each ble_run() call. */
+#endif
+
 
     extern uint16_t m_conn_handle; /* Handle of the current connection. */
 
+    typedef enum
+    {
+        BLE_STACK_PROFILE_DEFAULT,    /* sdk_config.h values, one notification buffer. */
+        BLE_STACK_PROFILE_LOW_POWER,  /* Typing: short connection events, few notification buffers, least RAM. */
+        BLE_STACK_PROFILE_GAMING,     /* Key and pointer reports on every interval: deeper notification queue. */
+        BLE_STACK_PROFILE_BULK,       /* Raw configuration transfers: deep notification queue, long connection events. */
+        BLE_STACK_PROFILE_COUNT,
+    } ble_stack_profile_t;
+    typedef struct
+    {
+        uint8_t hvn_tx_queue_size;    /* Notifications the SoftDevice queues per link. */
+        uint16_t event_length;        /* Connection event length, 1.25 ms units. */
+        bool conn_evt_ext;            /* Extend connection events while there is data to send. */
+        uint32_t attr_tab_size;       /* GATT attribute table size, bytes. */
+    } ble_stack_config_t;
+    typedef struct
+    {
+        uint32_t app_ram_start;       /* Application RAM start given by the linker. */
+        uint32_t required_ram_start;  /* Lowest application RAM start the SoftDevice accepts with the configuration. */
+        bool fallback;                /* The configuration did not fit and the default profile was used. */
+    } ble_stack_ram_t;
+    ret_code_t ble_stack_profile_set(ble_stack_profile_t profile);
+    ret_code_t ble_stack_config_set(ble_stack_config_t const *p_config);
+    void ble_stack_config_get(ble_stack_config_t *p_config);
+    void ble_stack_ram_get(ble_stack_ram_t *p_ram);
+
     void ble_module_init(void);
     void update_current_channel(void);
     void ble_run(void);
+
+    typedef enum
+    {
+        BLE_SCHED_PRIO_HIGH,
+        BLE_SCHED_PRIO_LOW,
+        BLE_SCHED_PRIO_COUNT,
+    } ble_sched_prio_t;
+    typedef struct
+    {
+        uint8_t depth;            /* Events waiting. */
+        uint8_t high_water;       /* Maximum depth since the last reset. */
+        uint32_t overflow;        /* Events rejected because the queue was full. */
+        uint32_t executed;        /* Events run. */
+        uint32_t max_handler_us;  /* Longest handler run. */
+    } ble_sched_stats_t;
+    ret_code_t ble_sched_event_put(ble_sched_prio_t prio, void const *p_data, uint16_t size, app_sched_event_handler_t handler);
+    void ble_sched_stats_get(ble_sched_prio_t prio, ble_sched_stats_t *p_stats);
+    void ble_sched_stats_reset(void);
     bool ble_connected(void);
+
+    typedef enum
+    {
+        BLE_LINK_STATE_OFF,           /* Not connected, advertising not started or stopped. */
+        BLE_LINK_STATE_IDLE,          /* Not connected, advertising timed out. */
+        BLE_LINK_STATE_ADVERTISING,
+        BLE_LINK_STATE_CONNECTED,     /* Active link connected, not encrypted. */
+        BLE_LINK_STATE_SECURING,      /* Active link security procedure in progress. */
+        BLE_LINK_STATE_SECURED,       /* Active link encrypted, input reports can be sent. */
+    } ble_link_state_t;
+    typedef void (*BleLinkStateHandler_t)(ble_link_state_t previous, ble_link_state_t state);
+    ble_link_state_t ble_link_state_get(void);
+    bool ble_link_state_subscribe(BleLinkStateHandler_t handler);
+    void ble_link_state_unsubscribe(BleLinkStateHandler_t handler);
     bool ble_innited(void);
     void ble_disconnect(void);
     void ble_adv_stop(void);
@@ -152,7 +284,69 @@ extern "C"
     void delete_peer_by_id(pm_peer_id_t peer_id);
     pm_peer_id_t get_next_peer_id(pm_peer_id_t peer_id);
 
+    typedef enum
+    {
+        BLE_ASYNC_OP_NONE,
+        BLE_ASYNC_OP_DISCONNECT,
+        BLE_ASYNC_OP_PEERS_DELETE,
+        BLE_ASYNC_OP_PEER_DELETE,
+    } ble_async_op_t;
+    typedef enum
+    {
+        BLE_ASYNC_DONE,
+        BLE_ASYNC_FAILED,
+        BLE_ASYNC_TIMEOUT,
+    } ble_async_result_t;
+    typedef void (*AsyncOpHandler_t)(ble_async_op_t op, ble_async_result_t result);
+    void ble_async_handler_set(AsyncOpHandler_t handler);
+    bool ble_async_busy(void);
+    ret_code_t ble_disconnect_async(void);
+    ret_code_t delete_peers_async(void);
+    ret_code_t delete_peer_by_id_async(pm_peer_id_t peer_id);
+
+    typedef enum
+    {
+        BLE_BATTERY_SEND_ARBITRATED,   /* Notify when the HID TX arbiter gives a credit to the battery class. */
+        BLE_BATTERY_SEND_IDLE,         /* Notify only when the HID reports use no TX buffer at all. */
+    } ble_battery_mode_t;
+    typedef struct
+    {
+        uint8_t hysteresis;            /* Level change (%) needed for a new notification. */
+        uint32_t min_interval_ms;      /* Minimum time between two notifications. */
+        ble_battery_mode_t mode;
+    } ble_battery_policy_t;
+    typedef struct
+    {
+        uint32_t sent;                 /* Battery level notifications sent. */
+        uint32_t suppressed;           /* Levels within the hysteresis, or replaced by a newer level before being sent. */
+        uint32_t deferred;             /* Levels that had to wait for the minimum interval or for the HID reports. */
+    } ble_battery_stats_t;
     void ble_battery_level_update(uint8_t battery_level);
+    void ble_battery_policy_set(ble_battery_policy_t const *p_policy);
+    void ble_battery_stats_get(ble_battery_stats_t *p_stats);
+    void ble_battery_stats_reset(void);
+
+    typedef void (*ConnParamsHandler_t)(uint16_t conn_handle, ble_gap_conn_params_t const *p_conn_params);
+    void ble_conn_params_handler_set(ConnParamsHandler_t handler);
+    void ble_conn_idle_timeout_set(uint32_t timeout_ms);
+    void ble_conn_activity_notify(void);
+
+    typedef struct
+    {
+        uint32_t disabled_count;  /* Times slave latency was disabled on the first report after a quiet period. */
+        uint32_t enabled_count;   /* Times slave latency was enabled again after SLAVE_LATENCY_QUIET_TIMEOUT_MS. */
+    } ble_slave_latency_stats_t;
+    void ble_slave_latency_auto_set(bool enable);
+    void ble_slave_latency_stats_get(ble_slave_latency_stats_t *p_stats);
+
+    uint16_t ble_gatt_att_mtu_get(uint16_t conn_handle);
+    uint8_t ble_gatt_data_length_get(uint16_t conn_handle);
+
+    bool ble_active_link_set(uint16_t conn_handle);
+    bool ble_active_link_set_by_peer(pm_peer_id_t peer_id);
+    uint16_t ble_active_link_get(void);
+    uint8_t ble_links_get(uint16_t *p_conn_handles);
+    pm_peer_id_t ble_link_peer_id_get(uint16_t conn_handle);
 
     ble_gap_addr_t gap_addr_get(void);
     bool gap_addr_set(ble_gap_addr_t* gap_addr);
@@ -167,6 +361,30 @@ extern "C"
     void set_current_channel(uint8_t channel);
     void set_whitelist(bool active);
 
+    typedef struct
+    {
+        uint32_t count;           /* Channel switches done with ble_channel_switch(). */
+        uint32_t rebuild_count;   /* Switches that had to build the channel identity again. */
+        uint32_t last_us;         /* Duration of the last switch. */
+        uint32_t max_us;          /* Longest switch. */
+    } ble_channel_switch_stats_t;
+    bool ble_channel_switch(uint8_t channel);
+    void ble_channel_switch_stats_get(ble_channel_switch_stats_t *p_stats);
+    uint8_t ble_channel_peers_get(uint8_t channel, pm_peer_id_t *p_peer_ids);
+    pm_peer_id_t ble_channel_last_peer_get(uint8_t channel);
+
+    typedef struct
+    {
+        uint32_t wakes;                     /* Advertising started with ble_goto_advertising_mode(). */
+        uint32_t directed_wakes;            /* Wakes that started with directed advertising to the last peer. */
+        uint32_t directed_connects;         /* Connections made while advertising directed. */
+        uint32_t wake_to_connected_us;      /* Last wake to connected. */
+        uint32_t wake_to_encrypted_us;      /* Last wake to link encrypted. */
+        uint32_t max_wake_to_encrypted_us;  /* Slowest wake to link encrypted. */
+    } ble_reconnect_stats_t;
+    void ble_reconnect_stats_get(ble_reconnect_stats_t *p_stats);
+    void ble_reconnect_stats_reset(void);
+
 #ifdef __cplusplus
 }
 #endif
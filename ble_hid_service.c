@@ -15,10 +15,13 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <string.h>
 #include <strings.h>
 
 #include "app_error.h"
+#include "app_util_platform.h"
 #include "ble.h"
+#include "ble_conn_state.h"
 #include "ble_hids.h"
 
 #include "Ble_composite_dev.h"
@@ -28,57 +31,235 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #define SEC_CURRENT SEC_JUST_WORKS
 #define BASE_USB_HID_SPEC_VERSION 0x0101 /**< Version number of base USB HID Specification implemented by this application. */
 
-//Make this not hardcorded
+/*
+ * Room reserved in the service for each enabled report. The actual lengths and report IDs come from the report
+ * descriptor, parsed in hids_init(); a descriptor needing more room than the total reserved is rejected.
+ */
+#ifndef INPUT_REPORT_LEN_KEYBOARD
 #define INPUT_REPORT_LEN_KEYBOARD 29  /**< Maximum length of the Input Report characteristic. */
+#endif
+#ifndef OUTPUT_REPORT_LEN_KEYBOARD
 #define OUTPUT_REPORT_LEN_KEYBOARD 1 /**< Maximum length of Output Report. */
+#endif
+#ifndef INPUT_REPORT_LEN_MOUSE
 #define INPUT_REPORT_LEN_MOUSE 5
+#endif
+#ifndef INPUT_REPORT_LEN_SYSTEM
 #define INPUT_REPORT_LEN_SYSTEM 1
+#endif
+#ifndef INPUT_REPORT_LEN_CONSUMER
 #define INPUT_REPORT_LEN_CONSUMER 8
+#endif
+
+#if !(BLE_HID_KEYBOARD_ENABLED || BLE_HID_MOUSE_ENABLED || BLE_HID_CONSUMER_ENABLED || BLE_HID_SYSTEM_ENABLED || BLE_HID_RAW_ENABLED)
+#error "At least one HID report must be enabled"
+#endif
+
+/* Room of each report in the link context, 0 when the report is disabled. */
+#define INPUT_ROOM_KEYBOARD (BLE_HID_KEYBOARD_ENABLED ? INPUT_REPORT_LEN_KEYBOARD : 0)
+#define OUTPUT_ROOM_KEYBOARD (BLE_HID_KEYBOARD_ENABLED ? OUTPUT_REPORT_LEN_KEYBOARD : 0)
+#define INPUT_ROOM_MOUSE (BLE_HID_MOUSE_ENABLED ? INPUT_REPORT_LEN_MOUSE : 0)
+#define INPUT_ROOM_CONSUMER (BLE_HID_CONSUMER_ENABLED ? INPUT_REPORT_LEN_CONSUMER : 0)
+#define INPUT_ROOM_SYSTEM (BLE_HID_SYSTEM_ENABLED ? INPUT_REPORT_LEN_SYSTEM : 0)
+#define INPUT_ROOM_RAW (BLE_HID_RAW_ENABLED ? INPUT_REPORT_LEN_RAW : 0)
+#define OUTPUT_ROOM_RAW (BLE_HID_RAW_ENABLED ? OUTPUT_REPORT_LEN_RAW : 0)
+#define REPORTS_ROOM (INPUT_ROOM_KEYBOARD + OUTPUT_ROOM_KEYBOARD + INPUT_ROOM_MOUSE + INPUT_ROOM_CONSUMER + INPUT_ROOM_SYSTEM + \
+                      INPUT_ROOM_RAW + OUTPUT_ROOM_RAW)
+
+/* Longest input report, size of the pending queue entries. */
+#define INPUT_REPORT_LEN_MAX MAX(MAX(MAX(INPUT_ROOM_KEYBOARD, INPUT_ROOM_MOUSE), MAX(INPUT_ROOM_CONSUMER, INPUT_ROOM_SYSTEM)), INPUT_ROOM_RAW)
+/* Longest report kept before the link is encrypted, raw reports are not kept. */
+#define PRECONN_REPORT_LEN_MAX MAX(MAX(MAX(INPUT_ROOM_KEYBOARD, INPUT_ROOM_MOUSE), MAX(INPUT_ROOM_CONSUMER, INPUT_ROOM_SYSTEM)), 1)
+#define PRECONN_SLOTS MAX(BLE_HID_PRECONN_BUFFER_SIZE, 1)
+
 #define INPUT_REP_INDEX_INVALID 0xFF /** Invalid index **/
+#define INPUT_REPORT_LEN_STATE_MAX 32 /**< Longest state report (keyboard, consumer, system) that is merged and filtered. */
+#define MOUSE_REPORT_LEN_8BIT_AXES 5 /**< Buttons, X, Y, wheel and pan of one byte each, the mouse layout that is merged. */
+#define ATT_NOTIFICATION_HEADER_LEN 3 /**< Opcode and attribute handle of a Handle Value Notification. */
+#define MOUSE_AXIS_MIN (-127)
+#define MOUSE_AXIS_MAX 127
 
 
-enum input_report_index
+/**
+ * @brief Kind of report, given by the application collection holding it
+ *
+ * Input reports are registered in the service in this order.
+ */
+enum report_kind
 {
-    INPUT_REP_KBD_INDEX,
-    INPUT_REP_MOUSE_INDEX,
-    INPUT_REP_CONSUMER_INDEX,
-    INPUT_REP_SYSTEM_INDEX,
-    INPUT_REP_RAW_INDEX,
-    INPUT_REP_COUNT
+    REPORT_KIND_KEYBOARD,
+    REPORT_KIND_MOUSE,
+    REPORT_KIND_CONSUMER,
+    REPORT_KIND_SYSTEM,
+    REPORT_KIND_RAW,
+    REPORT_KIND_COUNT,
+    REPORT_KIND_INVALID = 0xFF
 };
 
-enum
-{
-    REPORT_ID_KEYBOARD = 1,
-    REPORT_ID_MOUSE,
-    REPORT_ID_CONSUMER_CONTROL,
-    REPORT_ID_SYSTEM_CONTROL,
-    REPORT_ID_RAW
-};
+/* At most one input report of each enabled kind. */
+#define INPUT_REP_COUNT (BLE_HID_KEYBOARD_ENABLED + BLE_HID_MOUSE_ENABLED + BLE_HID_CONSUMER_ENABLED + BLE_HID_SYSTEM_ENABLED + BLE_HID_RAW_ENABLED)
+/* Keyboard LEDs and raw. Arrays keep one entry when there is none. */
+#define OUTPUT_REP_COUNT (BLE_HID_KEYBOARD_ENABLED + BLE_HID_RAW_ENABLED)
+#define OUTPUT_REP_SLOTS MAX(OUTPUT_REP_COUNT, 1)
 
-enum output_report_index
-{
-    OUTPUT_REP_KBD_INDEX,
-    OUTPUT_REP_RAW_INDEX,
-    OUTPUT_REP_COUNT
-};
+/* Input room of each report kind, in enum report_kind order. */
+static const uint8_t input_room_by_kind[REPORT_KIND_COUNT] = {INPUT_ROOM_KEYBOARD, INPUT_ROOM_MOUSE, INPUT_ROOM_CONSUMER, INPUT_ROOM_SYSTEM,
+                                                               INPUT_ROOM_RAW};
 
 
 /**
  * @brief HID Report Index Lookup table
  *
- * Mapping the internal ID to HID report id
+ * Mapping the HID report id to the service input report index, built from the report descriptor.
  *
  */
-uint8_t hid_report_map_table[] = {INPUT_REP_INDEX_INVALID,  INPUT_REP_KBD_INDEX,    INPUT_REP_MOUSE_INDEX,
-                                  INPUT_REP_CONSUMER_INDEX, INPUT_REP_SYSTEM_INDEX, INPUT_REP_RAW_INDEX};
+uint8_t hid_report_map_table[BLE_HID_REPORT_ID_MAX + 1];
+
+static uint8_t input_rep_count = 0;
+static uint8_t input_rep_kind[INPUT_REP_COUNT];        /**< Kind of each service input report. */
+static uint8_t input_rep_len[INPUT_REP_COUNT];         /**< Length of each service input report. */
+static uint8_t report_id_by_kind[REPORT_KIND_COUNT];   /**< Input report ID of each kind, 0 if there is none. */
+static uint8_t output_rep_count = 0;
+static uint8_t output_rep_kind[OUTPUT_REP_SLOTS];      /**< Kind of each service output report. */
+static uint8_t output_rep_len[OUTPUT_REP_SLOTS];       /**< Length of each service output report. */
 
 static bool m_in_boot_mode = false; /**< Current protocol mode. */
 
+/*
+ * Input reports the host enabled notifications for, one bitmap per link.
+ * Bit n is the service input report n, CCCD_BIT_BOOT_KEYBOARD the boot keyboard input report.
+ */
+#define CCCD_BIT_BOOT_KEYBOARD (1U << 7)
+static uint8_t cccd_enabled[NRF_SDH_BLE_TOTAL_LINK_COUNT];
+
+/**
+ * @brief Input report waiting for a free SoftDevice TX buffer
+ */
+typedef struct
+{
+    uint8_t report_id;
+    uint8_t len;
+    uint32_t ticks; /**< app_timer time of the ble_send_report() call. */
+    uint8_t data[INPUT_REPORT_LEN_MAX];
+} pending_report_t;
+
+/**
+ * @brief Reports of one TX class waiting for a credit, in the order they were given
+ *
+ * Entries are indexes in tx_queue, shared by all the classes.
+ */
+typedef struct
+{
+    uint8_t slots[BLE_HID_TX_QUEUE_SIZE];
+    uint8_t head;
+    uint8_t count;
+} tx_fifo_t;
+
+static pending_report_t tx_queue[BLE_HID_TX_QUEUE_SIZE]; /**< Reports waiting for a TX credit. */
+static bool tx_queue_used[BLE_HID_TX_QUEUE_SIZE];
+static uint8_t tx_queue_count = 0;                        /**< Reports waiting, all classes together. */
+static ble_hid_tx_queue_stats_t tx_queue_stats;
+
+/*
+ * TX arbiter. Notification credits are given by class priority, battery notifications are not queued here but
+ * ask for a credit with ble_hid_tx_external_allowed().
+ */
+static uint8_t tx_credits = BLE_HID_TX_CREDITS;        /**< Notifications allowed in flight, the HVN TX queue size. */
+static tx_fifo_t tx_fifos[BLE_HID_TX_CLASS_BATTERY];
+static uint8_t tx_passed_over[BLE_HID_TX_CLASS_COUNT]; /**< Grants to other classes while the class had data. */
+static ble_hid_tx_class_stats_t tx_class_stats[BLE_HID_TX_CLASS_COUNT];
+
+/**
+ * @brief Input report given before the link was encrypted
+ */
+typedef struct
+{
+    uint8_t report_id;
+    uint8_t len;
+    uint32_t ticks; /**< app_timer time of the ble_send_report() call. */
+    uint8_t data[PRECONN_REPORT_LEN_MAX];
+} preconn_report_t;
+
+/*
+ * Pre-connection input buffer. Reports are kept in the order they were given, replayed once the active link is
+ * encrypted and the host subscribed to them, and dropped when older than the maximum age.
+ */
+static preconn_report_t preconn_buffer[PRECONN_SLOTS];
+static uint8_t preconn_count = 0;
+static bool preconn_replaying = false;
+static uint32_t preconn_max_age_ticks = APP_TIMER_TICKS(BLE_HID_PRECONN_MAX_AGE_MS);
+static ble_hid_preconn_stats_t preconn_stats;
+
+/* TX class of each report kind, in enum report_kind order. */
+static const uint8_t tx_class_by_kind[REPORT_KIND_COUNT] = {BLE_HID_TX_CLASS_KEY, BLE_HID_TX_CLASS_POINTER, BLE_HID_TX_CLASS_CONTROL,
+                                                            BLE_HID_TX_CLASS_CONTROL, BLE_HID_TX_CLASS_RAW};
+
+/**
+ * @brief Caller buffer written to the raw stream
+ */
+typedef struct
+{
+    const uint8_t *p_data;
+    uint32_t len;
+} stream_segment_t;
+
+/**
+ * @brief Raw report bulk transfer
+ *
+ * Every raw report carries a sequence number in its first byte followed by the payload.
+ */
+static struct
+{
+    bool open;
+    bool closing;
+    bool aborted; /**< A chunk was refused for a reason other than a full TX queue. */
+    ble_hid_stream_handler_t handler;
+    stream_segment_t segments[BLE_HID_STREAM_SEGMENTS];
+    uint8_t seg_head;
+    uint8_t seg_count;
+    uint32_t offset; /**< Bytes of the head segment already sent. */
+    uint32_t sent;
+    uint8_t seq;
+} m_stream;
+
+static uint8_t stream_chunk[MAX(INPUT_ROOM_RAW, 1)];
+
+static void preconn_replay(void);
+
+/**
+ * @brief Notification handed to the SoftDevice, waiting for its TX complete event
+ */
+typedef struct
+{
+    uint8_t report_index; /**< INPUT_REP_INDEX_INVALID for notifications of other services. */
+    uint32_t ticks;
+} inflight_report_t;
+
+/**
+ * @brief FIFO of notifications in flight
+ *
+ * When the FIFO is full, the following notifications are only counted in untracked, so completions still
+ * match the right entries.
+ */
+static inflight_report_t inflight[BLE_HID_INFLIGHT_SIZE];
+static uint8_t inflight_head = 0;
+static uint8_t inflight_count = 0;
+static uint16_t inflight_untracked = 0;
+
+static const uint16_t latency_bucket_limits_ms[BLE_HID_LATENCY_BUCKETS - 1] = BLE_HID_LATENCY_BUCKET_LIMITS_MS;
+static ble_hid_latency_histogram_t latency_histogram[INPUT_REP_COUNT];
+static uint32_t reports_submitted = 0;
+static uint8_t latency_dump_buff[INPUT_REP_COUNT * (1 + sizeof(ble_hid_latency_histogram_t))];
+
+static uint8_t sent_state[INPUT_REP_COUNT][INPUT_REPORT_LEN_STATE_MAX]; /**< Last state handed to the SoftDevice for each input report. */
+static bool duplicate_filter_enabled = true;                                /**< Drop state reports identical to the last one. */
+static uint8_t release_pending[NRF_SDH_BLE_TOTAL_LINK_COUNT];               /**< Released state each link's host has still to receive, bit n is input report n. */
+static const uint8_t released_state[INPUT_REPORT_LEN_STATE_MAX] = {0};      /**< No key nor control pressed. */
+
 
 BLE_HIDS_DEF(m_hids, /**< Structure used to identify the HID service. */
-             NRF_SDH_BLE_TOTAL_LINK_COUNT, INPUT_REPORT_LEN_KEYBOARD, INPUT_REPORT_LEN_MOUSE, INPUT_REPORT_LEN_CONSUMER, INPUT_REPORT_LEN_SYSTEM,
-             OUTPUT_REPORT_LEN_KEYBOARD, INPUT_REPORT_LEN_RAW, OUTPUT_REPORT_LEN_RAW);
+             NRF_SDH_BLE_TOTAL_LINK_COUNT, INPUT_ROOM_KEYBOARD, INPUT_ROOM_MOUSE, INPUT_ROOM_CONSUMER, INPUT_ROOM_SYSTEM,
+             OUTPUT_ROOM_KEYBOARD, INPUT_ROOM_RAW, OUTPUT_ROOM_RAW);
 
 
 void service_error_handler(uint32_t nrf_error)
@@ -86,10 +267,131 @@ void service_error_handler(uint32_t nrf_error)
     APP_ERROR_HANDLER(nrf_error);
 }
 
-uint8_t keyboard_led_val_ble;
+uint8_t keyboard_led_val_ble; /**< Keyboard LEDs set by the host of the active link. */
+
+/* Keyboard LEDs written by the host of each link, keyboard_led_val_ble shows those of the active link. */
+static uint8_t keyboard_led_link[NRF_SDH_BLE_TOTAL_LINK_COUNT];
 
 __attribute__ ((weak)) bool callBackRawHID(uint8_t *buff);
 
+/** Raw output report waiting to be handed to the application */
+typedef struct
+{
+    uint16_t len;
+    uint8_t data[MAX(OUTPUT_ROOM_RAW, 1)];
+} raw_output_slot_t;
+
+/**
+ * Received raw output reports.
+ * Slots are filled from the SoftDevice event handler and handed to the application from the scheduler.
+ * A slot is only released once the handler returns, so the handler can use the data in place.
+ */
+static raw_output_slot_t raw_output_ring[BLE_HID_RAW_OUTPUT_SLOTS];
+static uint8_t raw_output_head = 0;
+static uint8_t raw_output_count = 0;
+static bool raw_output_scheduled = false;
+static ble_hid_raw_output_handler_t raw_output_handler = NULL;
+static ble_hid_raw_output_stats_t raw_output_stats;
+
+
+/**@brief Function for handing the received raw output reports to the application.
+ *
+ * @details Runs from the high priority class of the BLE scheduler. Each report is used in place and its slot released afterwards.
+ */
+static void raw_output_deliver(void *p_event_data, uint16_t event_size)
+{
+    raw_output_slot_t *p_slot;
+
+    CRITICAL_REGION_ENTER();
+    raw_output_scheduled = false;
+    CRITICAL_REGION_EXIT();
+
+    while (true)
+    {
+        CRITICAL_REGION_ENTER();
+        p_slot = (raw_output_count > 0) ? &raw_output_ring[raw_output_head] : NULL;
+        CRITICAL_REGION_EXIT();
+
+        if (p_slot == NULL) break;
+
+        if (raw_output_handler != NULL)
+        {
+            raw_output_handler(p_slot->data, p_slot->len);
+        }
+        else if (callBackRawHID != NULL)
+        {
+            callBackRawHID(p_slot->data);
+        }
+
+        CRITICAL_REGION_ENTER();
+        raw_output_head = (raw_output_head + 1) % BLE_HID_RAW_OUTPUT_SLOTS;
+        raw_output_count--;
+        raw_output_stats.delivered++;
+        CRITICAL_REGION_EXIT();
+    }
+}
+
+/**@brief Function for storing a raw output report written by the host.
+ *
+ * @details Runs in the SoftDevice event handler, so the report is only copied into a free slot and the
+ *          delivery scheduled. When every slot is taken, or the report cannot be read, it is dropped and counted.
+ */
+static void raw_output_receive(ble_hids_evt_t *p_evt, uint8_t report_index)
+{
+    raw_output_slot_t *p_slot = NULL;
+    bool schedule = false;
+
+    CRITICAL_REGION_ENTER();
+    raw_output_stats.received++;
+    if (raw_output_count > 0)
+    {
+        raw_output_stats.backlogged++;
+    }
+    if (raw_output_count < BLE_HID_RAW_OUTPUT_SLOTS)
+    {
+        p_slot = &raw_output_ring[(raw_output_head + raw_output_count) % BLE_HID_RAW_OUTPUT_SLOTS];
+    }
+    else
+    {
+        raw_output_stats.dropped++;
+    }
+    CRITICAL_REGION_EXIT();
+
+    if (p_slot == NULL) return;
+
+    // Read straight into the slot, the whole characteristic value so long writes are complete.
+    ret_code_t err_code = ble_hids_outp_rep_get(&m_hids, report_index, output_rep_len[report_index], 0,
+                                                p_evt->p_ble_evt->evt.gatts_evt.conn_handle, p_slot->data);
+    if (err_code != NRF_SUCCESS)
+    {
+        CRITICAL_REGION_ENTER();
+        raw_output_stats.dropped++;
+        CRITICAL_REGION_EXIT();
+        return;
+    }
+    p_slot->len = MIN(p_evt->params.char_write.offset + p_evt->params.char_write.len, output_rep_len[report_index]);
+
+    CRITICAL_REGION_ENTER();
+    raw_output_count++;
+    if (raw_output_count > raw_output_stats.high_water)
+    {
+        raw_output_stats.high_water = raw_output_count;
+    }
+    if (!raw_output_scheduled)
+    {
+        raw_output_scheduled = true;
+        schedule = true;
+    }
+    CRITICAL_REGION_EXIT();
+
+    if (schedule && (ble_sched_event_put(BLE_SCHED_PRIO_HIGH, NULL, 0, raw_output_deliver) != NRF_SUCCESS))
+    {
+        // Scheduler queue full, the next report schedules the delivery again.
+        CRITICAL_REGION_ENTER();
+        raw_output_scheduled = false;
+        CRITICAL_REGION_EXIT();
+    }
+}
 
 /**@brief Function for handling the HID Report Characteristic Write event.
  *
@@ -103,27 +405,165 @@ static void on_hid_rep_char_write(ble_hids_evt_t *p_evt)
         uint8_t report_val;
         uint8_t report_index = p_evt->params.char_write.char_id.rep_index;
 
-        if (report_index == OUTPUT_REP_KBD_INDEX)
+        if (report_index >= output_rep_count) return;
+
+        if (output_rep_kind[report_index] == REPORT_KIND_KEYBOARD)
         {
-            err_code = ble_hids_outp_rep_get(&m_hids, report_index, OUTPUT_REPORT_LEN_KEYBOARD, 0, m_conn_handle, &report_val);
+            // Read from the link that was written, each host has its own LED state.
+            uint16_t conn_handle = p_evt->p_ble_evt->evt.gatts_evt.conn_handle;
+            uint16_t link_idx = ble_conn_state_conn_idx(conn_handle);
+            if (link_idx >= NRF_SDH_BLE_TOTAL_LINK_COUNT) return;
+
+            err_code = ble_hids_outp_rep_get(&m_hids, report_index, 1, 0, conn_handle, &report_val);
 
             if (err_code == NRF_SUCCESS)
             {
-                keyboard_led_val_ble = report_val;
+                keyboard_led_link[link_idx] = report_val;
+                if (conn_handle == m_conn_handle)
+                {
+                    keyboard_led_val_ble = report_val;
+                }
             }
         }
-        if (report_index == OUTPUT_REP_RAW_INDEX)
+        if (output_rep_kind[report_index] == REPORT_KIND_RAW)
         {
-            uint8_t buff[OUTPUT_REPORT_LEN_RAW];
-            err_code = ble_hids_outp_rep_get(&m_hids, report_index, OUTPUT_REPORT_LEN_RAW, 0, m_conn_handle, buff);
-            if (err_code == NRF_SUCCESS)
-            {
-                callBackRawHID(buff);
-            }
+            raw_output_receive(p_evt, report_index);
+        }
+    }
+}
+
+
+/**@brief Function for getting the CCCD bit of a characteristic.
+ *
+ * @return 0 for characteristics without notifications tracked.
+ */
+static uint8_t cccd_bit_get(ble_hids_char_id_t const *p_char_id)
+{
+    if ((p_char_id->uuid == BLE_UUID_REPORT_CHAR) && (p_char_id->rep_type == BLE_HIDS_REP_TYPE_INPUT) && (p_char_id->rep_index < INPUT_REP_COUNT))
+    {
+        return (uint8_t)(1U << p_char_id->rep_index);
+    }
+    if (p_char_id->uuid == BLE_UUID_BOOT_KEYBOARD_INPUT_REPORT_CHAR)
+    {
+        return CCCD_BIT_BOOT_KEYBOARD;
+    }
+    return 0;
+}
+
+/**@brief Function for recording a CCCD write of the host.
+ */
+static void on_hid_notif_set(ble_hids_evt_t *p_evt, bool enabled)
+{
+    uint16_t link_idx = ble_conn_state_conn_idx(p_evt->p_ble_evt->evt.gatts_evt.conn_handle);
+    if (link_idx >= NRF_SDH_BLE_TOTAL_LINK_COUNT) return;
+
+    uint8_t bit = cccd_bit_get(&p_evt->params.notification.char_id);
+
+    CRITICAL_REGION_ENTER();
+    if (enabled)
+    {
+        cccd_enabled[link_idx] |= bit;
+    }
+    else
+    {
+        cccd_enabled[link_idx] &= ~bit;
+    }
+    CRITICAL_REGION_EXIT();
+
+    if (enabled)
+    {
+        preconn_replay();
+    }
+}
+
+/**@brief Function for reading a CCCD from the SoftDevice.
+ */
+static bool cccd_notif_enabled(uint16_t conn_handle, uint16_t cccd_handle)
+{
+    uint8_t cccd[BLE_CCCD_VALUE_LEN] = {0};
+    ble_gatts_value_t gatts_value;
+
+    memset(&gatts_value, 0, sizeof(gatts_value));
+    gatts_value.len = sizeof(cccd);
+    gatts_value.p_value = cccd;
+
+    // Fails with BLE_ERROR_GATTS_SYS_ATTR_MISSING until the system attributes are set.
+    if (sd_ble_gatts_value_get(conn_handle, cccd_handle, &gatts_value) != NRF_SUCCESS) return false;
+
+    return (cccd[0] & BLE_GATT_HVX_NOTIFICATION) != 0;
+}
+
+/**@brief Function for rebuilding the CCCD bitmap of a link from the SoftDevice.
+ *
+ * @details To be called on connection, which clears the bitmap, and once the peer manager applied the stored
+ *          system attributes of a bonded host (PM_EVT_LOCAL_DB_CACHE_APPLIED), which restores its subscriptions.
+ */
+void ble_hid_cccd_restore(uint16_t conn_handle)
+{
+    uint16_t link_idx = ble_conn_state_conn_idx(conn_handle);
+    if (link_idx >= NRF_SDH_BLE_TOTAL_LINK_COUNT) return;
+
+    uint8_t bitmap = 0;
+    for (uint8_t i = 0; i < input_rep_count; i++)
+    {
+        if (cccd_notif_enabled(conn_handle, m_hids.inp_rep_array[i].char_handles.cccd_handle))
+        {
+            bitmap |= (uint8_t)(1U << i);
         }
     }
+#if BLE_HID_BOOT_KEYBOARD_ENABLED
+    if (cccd_notif_enabled(conn_handle, m_hids.boot_kb_inp_rep_handles.cccd_handle))
+    {
+        bitmap |= CCCD_BIT_BOOT_KEYBOARD;
+    }
+#endif
+
+    CRITICAL_REGION_ENTER();
+    cccd_enabled[link_idx] = bitmap;
+    CRITICAL_REGION_EXIT();
+
+    preconn_replay();
+}
+
+/**@brief Function for resetting the state kept for a link, on connection.
+ *
+ * @details The keyboard LEDs are off until its host writes them, no release is owed to it.
+ */
+void ble_hid_link_reset(uint16_t conn_handle)
+{
+    uint16_t link_idx = ble_conn_state_conn_idx(conn_handle);
+    if (link_idx >= NRF_SDH_BLE_TOTAL_LINK_COUNT) return;
+
+    keyboard_led_link[link_idx] = 0;
+    release_pending[link_idx] = 0;
+}
+
+/**@brief Function for showing the keyboard LEDs set by the host of the active link.
+ *
+ * @details To be called when the active link changes.
+ */
+void ble_hid_keyboard_led_select(uint16_t conn_handle)
+{
+    uint16_t link_idx = ble_conn_state_conn_idx(conn_handle);
+
+    keyboard_led_val_ble = (link_idx < NRF_SDH_BLE_TOTAL_LINK_COUNT) ? keyboard_led_link[link_idx] : 0;
 }
 
+/**@brief Function for checking if the host of the active link receives an input report.
+ *
+ * @details In boot protocol mode only the keyboard report is sent, through the boot keyboard characteristic.
+ */
+static bool report_subscribed(uint8_t report_index)
+{
+    uint16_t link_idx = ble_conn_state_conn_idx(m_conn_handle);
+    if (link_idx >= NRF_SDH_BLE_TOTAL_LINK_COUNT) return false;
+
+    if (m_in_boot_mode)
+    {
+        return (input_rep_kind[report_index] == REPORT_KIND_KEYBOARD) && ((cccd_enabled[link_idx] & CCCD_BIT_BOOT_KEYBOARD) != 0);
+    }
+    return (cccd_enabled[link_idx] & (1U << report_index)) != 0;
+}
 
 static void on_hids_evt(ble_hids_t *p_hids, ble_hids_evt_t *p_evt)
 {
@@ -142,6 +582,11 @@ static void on_hids_evt(ble_hids_t *p_hids, ble_hids_evt_t *p_evt)
             break;
 
         case BLE_HIDS_EVT_NOTIF_ENABLED:
+            on_hid_notif_set(p_evt, true);
+            break;
+
+        case BLE_HIDS_EVT_NOTIF_DISABLED:
+            on_hid_notif_set(p_evt, false);
             break;
 
         default:
@@ -152,128 +597,1845 @@ static void on_hids_evt(ble_hids_t *p_hids, ble_hids_evt_t *p_evt)
 
 static uint8_t *hid_desc_report;
 static uint16_t hid_desc_report_len;
-/**@brief Function for initializing HID Service.
- */
-void hids_init()
+
+#define DESC_REPORT_BITS_MAX 0xFFFF /* Far above any report a notification carries, keeps the sums from wrapping. */
+
+/** Report found in the report descriptor */
+typedef struct
 {
-    ret_code_t err_code;
-    ble_hids_init_t hids_init_obj;
+    uint8_t id;
+    uint8_t kind;
+    uint32_t input_bits;
+    uint32_t output_bits;
+} desc_report_t;
 
-    static ble_hids_inp_rep_init_t input_report_array[INPUT_REP_COUNT];
-    static ble_hids_outp_rep_init_t output_report_array[OUTPUT_REP_COUNT];
+/**@brief Function for finding the kind of report held by an application collection.
+ */
+static uint8_t desc_collection_kind(uint16_t usage_page, uint16_t usage)
+{
+    if (usage_page == 0x01) // Generic Desktop
+    {
+        if ((usage == 0x06) || (usage == 0x07)) return REPORT_KIND_KEYBOARD; // Keyboard, Keypad
+        if ((usage == 0x01) || (usage == 0x02)) return REPORT_KIND_MOUSE;    // Pointer, Mouse
+        if (usage == 0x80) return REPORT_KIND_SYSTEM;                        // System Control
+    }
+    if ((usage_page == 0x0C) && (usage == 0x01)) return REPORT_KIND_CONSUMER; // Consumer Control
+    if (usage_page >= 0xFF00) return REPORT_KIND_RAW;                          // Vendor defined
 
-    memset((void *)input_report_array, 0, sizeof(ble_hids_inp_rep_init_t) * INPUT_REP_COUNT);
-    memset((void *)output_report_array, 0, sizeof(ble_hids_outp_rep_init_t) * OUTPUT_REP_COUNT);
+    return REPORT_KIND_INVALID;
+}
 
-    // Initialize HID Service
-    HID_REP_IN_SETUP(input_report_array[INPUT_REP_KBD_INDEX], INPUT_REPORT_LEN_KEYBOARD, REPORT_ID_KEYBOARD);
+/**@brief Function for adding the bits of an Input or Output main item to its report.
+ */
+static ret_code_t desc_report_add(desc_report_t *p_reports, uint8_t *p_count, uint8_t id, uint8_t kind, uint32_t bits, bool input)
+{
+    if ((id == 0) || (id > BLE_HID_REPORT_ID_MAX) || (kind == REPORT_KIND_INVALID)) return NRF_ERROR_INVALID_DATA;
 
-    // keyboard led report
-    HID_REP_OUT_SETUP(output_report_array[OUTPUT_REP_KBD_INDEX], OUTPUT_REPORT_LEN_KEYBOARD, REPORT_ID_KEYBOARD);
+    desc_report_t *p_report = NULL;
+    for (uint8_t i = 0; i < *p_count; i++)
+    {
+        if (p_reports[i].id == id) p_report = &p_reports[i];
+    }
 
-    HID_REP_IN_SETUP(input_report_array[INPUT_REP_MOUSE_INDEX], INPUT_REPORT_LEN_MOUSE, REPORT_ID_MOUSE);
-    // system input report
-    HID_REP_IN_SETUP(input_report_array[INPUT_REP_SYSTEM_INDEX], INPUT_REPORT_LEN_SYSTEM, REPORT_ID_SYSTEM_CONTROL);
-    // consumer input report
-    HID_REP_IN_SETUP(input_report_array[INPUT_REP_CONSUMER_INDEX], INPUT_REPORT_LEN_CONSUMER, REPORT_ID_CONSUMER_CONTROL);
+    if (p_report == NULL)
+    {
+        if (*p_count == REPORT_KIND_COUNT) return NRF_ERROR_NO_MEM;
 
-    // Raw input report
-    HID_REP_IN_SETUP(input_report_array[INPUT_REP_RAW_INDEX], INPUT_REPORT_LEN_RAW, REPORT_ID_RAW);
-    // Raw output report
-    HID_REP_OUT_SETUP(output_report_array[OUTPUT_REP_RAW_INDEX], OUTPUT_REPORT_LEN_RAW, REPORT_ID_RAW);
+        p_report = &p_reports[(*p_count)++];
+        memset(p_report, 0, sizeof(desc_report_t));
+        p_report->id = id;
+        p_report->kind = kind;
+    }
 
-    memset(&hids_init_obj, 0, sizeof(hids_init_obj));
+    // The same report ID used in two different collections.
+    if (p_report->kind != kind) return NRF_ERROR_INVALID_DATA;
 
-    hids_init_obj.evt_handler = on_hids_evt;
-    hids_init_obj.error_handler = service_error_handler;
-    hids_init_obj.is_kb = true;
-    hids_init_obj.is_mouse = true;
-    hids_init_obj.inp_rep_count = INPUT_REP_COUNT;
-    hids_init_obj.p_inp_rep_array = input_report_array;
-    hids_init_obj.outp_rep_count = OUTPUT_REP_COUNT;
-    hids_init_obj.p_outp_rep_array = output_report_array;
-    hids_init_obj.feature_rep_count = 0;
-    hids_init_obj.p_feature_rep_array = NULL;
-    hids_init_obj.rep_map.data_len = hid_desc_report_len;
-    hids_init_obj.rep_map.p_data = hid_desc_report;
-    hids_init_obj.hid_information.bcd_hid = BASE_USB_HID_SPEC_VERSION;
-    hids_init_obj.hid_information.b_country_code = 0;
-    hids_init_obj.hid_information.flags = HID_INFO_FLAG_REMOTE_WAKE_MSK | HID_INFO_FLAG_NORMALLY_CONNECTABLE_MSK;
-    hids_init_obj.included_services_count = 0;
-    hids_init_obj.p_included_services_array = NULL;
+    uint32_t *p_bits = input ? &p_report->input_bits : &p_report->output_bits;
+    if (bits > DESC_REPORT_BITS_MAX - *p_bits) return NRF_ERROR_INVALID_DATA;
 
-    hids_init_obj.rep_map.rd_sec = SEC_CURRENT;
-    hids_init_obj.hid_information.rd_sec = SEC_CURRENT;
+    *p_bits += bits;
+    return NRF_SUCCESS;
+}
 
-    hids_init_obj.boot_kb_inp_rep_sec.cccd_wr = SEC_CURRENT;
-    hids_init_obj.boot_kb_inp_rep_sec.rd = SEC_CURRENT;
+/**@brief Function for listing the reports of a HID report descriptor.
+ *
+ * @details Only what the service needs is decoded: report IDs, Input and Output sizes, and the usage of the
+ *          top level collections to know the kind of each report. Feature items are ignored.
+ *
+ * @param[in]   p_desc      Report descriptor.
+ * @param[in]   len         Report descriptor length.
+ * @param[out]  p_reports   Reports found, REPORT_KIND_COUNT entries.
+ * @param[out]  p_count     Number of reports found.
+ *
+ * @return NRF_ERROR_INVALID_DATA if the descriptor is malformed or does not fit the service.
+ */
+static ret_code_t report_descriptor_parse(const uint8_t *p_desc, uint16_t len, desc_report_t *p_reports, uint8_t *p_count)
+{
+    uint16_t usage_page = 0;
+    uint32_t report_size = 0;
+    uint32_t report_count = 0;
+    uint8_t report_id = 0;
+    uint32_t usage = 0;
+    bool usage_set = false;
+    uint8_t depth = 0;
+    uint8_t kind = REPORT_KIND_INVALID;
+    uint16_t i = 0;
 
-    hids_init_obj.boot_kb_outp_rep_sec.rd = SEC_CURRENT;
-    hids_init_obj.boot_kb_outp_rep_sec.wr = SEC_CURRENT;
+    *p_count = 0;
 
-    hids_init_obj.boot_mouse_inp_rep_sec.cccd_wr = SEC_CURRENT;
-    hids_init_obj.boot_mouse_inp_rep_sec.wr = SEC_CURRENT;
-    hids_init_obj.boot_mouse_inp_rep_sec.rd = SEC_CURRENT;
+    while (i < len)
+    {
+        uint8_t prefix = p_desc[i++];
 
-    hids_init_obj.protocol_mode_rd_sec = SEC_CURRENT;
-    hids_init_obj.protocol_mode_wr_sec = SEC_CURRENT;
-    hids_init_obj.ctrl_point_wr_sec = SEC_CURRENT;
+        if (prefix == 0xFE) // Long item, never used for reports.
+        {
+            if (i + 2 > len) return NRF_ERROR_INVALID_DATA;
+            i += 2 + p_desc[i];
+            continue;
+        }
 
-    err_code = ble_hids_init(&m_hids, &hids_init_obj);
-    APP_ERROR_CHECK(err_code);
-}
+        uint8_t size = ((prefix & 0x03) == 3) ? 4 : (prefix & 0x03);
+        uint8_t type = (prefix >> 2) & 0x03;
+        uint8_t tag = prefix >> 4;
+        uint32_t value = 0;
 
-static uint32_t send_key(ble_hids_t *p_hids, uint8_t index, uint8_t *pattern, uint8_t len)
-{
-    ret_code_t err_code = NRF_SUCCESS;
-    if (m_in_boot_mode)
-    {
-        if (index == 0)
+        if (i + size > len) return NRF_ERROR_INVALID_DATA;
+        for (uint8_t b = 0; b < size; b++)
         {
-            err_code = ble_hids_boot_kb_inp_rep_send(p_hids, len, pattern, m_conn_handle);
+            value |= (uint32_t)p_desc[i + b] << (8 * b);
         }
-    }
-    else
-    {
-        err_code = ble_hids_inp_rep_send(p_hids, index, len, pattern, m_conn_handle);
-    }
-    return err_code;
-}
+        i += size;
 
+        if (type == 0) // Main
+        {
+            switch (tag)
+            {
+                case 0x08: // Input
+                case 0x09: // Output
+                {
+                    // Checked apart so the product cannot wrap either.
+                    if ((report_size > DESC_REPORT_BITS_MAX) || (report_count > DESC_REPORT_BITS_MAX)) return NRF_ERROR_INVALID_DATA;
 
-/**@brief Function for sending sample key presses to the peer.
- *
- * @param[in]   report_id         Packet report ID. 0:keyboard, 1:mouse, 2:system, 3:consumer.
- * @param[in]   key_pattern_len   Pattern length.
- * @param[in]   p_key_pattern     Pattern to be sent.
- */
-bool ble_send_report(uint8_t report_id, const uint8_t *p_key_pattern, uint8_t key_pattern_len)
-{
+                    ret_code_t err_code = desc_report_add(p_reports, p_count, report_id, kind, report_size * report_count, (tag == 0x08));
+                    if (err_code != NRF_SUCCESS) return err_code;
+                }
+                break;
+
+                case 0x0A: // Collection
+                    if (depth == 0)
+                    {
+                        kind = desc_collection_kind((usage > 0xFFFF) ? (usage >> 16) : usage_page, usage & 0xFFFF);
+                    }
+                    depth++;
+                    break;
+
+                case 0x0C: // End Collection
+                    if (depth == 0) return NRF_ERROR_INVALID_DATA;
+                    depth--;
+                    break;
+
+                default:
+                    break;
+            }
+            // Local items only apply to the next main item.
+            usage = 0;
+            usage_set = false;
+        }
+        else if (type == 1) // Global
+        {
+            switch (tag)
+            {
+                case 0x00: usage_page = value; break;
+                case 0x07: report_size = value; break;
+                case 0x08: report_id = value; break;
+                case 0x09: report_count = value; break;
+                case 0x0A: // Push
+                case 0x0B: // Pop
+                    return NRF_ERROR_NOT_SUPPORTED;
+                default: break;
+            }
+        }
+        else if ((type == 2) && (tag == 0x00) && !usage_set) // First Usage
+        {
+            // A 4 byte usage carries its own usage page.
+            usage = (size == 4) ? value : value & 0xFFFF;
+            usage_set = true;
+        }
+    }
+
+    if (depth != 0) return NRF_ERROR_INVALID_DATA;
+    return NRF_SUCCESS;
+}
+
+/**@brief Function for building the service reports and the report ID map from the report descriptor.
+ *
+ * @details Rejects descriptors with two reports of the same kind, unsupported outputs, reports longer than a
+ *          notification can carry, or needing more room than reserved by BLE_HIDS_DEF.
+ */
+static ret_code_t report_map_build(ble_hids_inp_rep_init_t *p_input_reports, ble_hids_outp_rep_init_t *p_output_reports)
+{
+    desc_report_t reports[REPORT_KIND_COUNT];
+    uint8_t count;
+    uint32_t room_needed = 0;
+
+    ret_code_t err_code = report_descriptor_parse(hid_desc_report, hid_desc_report_len, reports, &count);
+    if (err_code != NRF_SUCCESS) return err_code;
+
+    memset(hid_report_map_table, INPUT_REP_INDEX_INVALID, sizeof(hid_report_map_table));
+    memset(report_id_by_kind, 0, sizeof(report_id_by_kind));
+    input_rep_count = 0;
+    output_rep_count = 0;
+
+    for (uint8_t kind = 0; kind < REPORT_KIND_COUNT; kind++)
+    {
+        for (uint8_t i = 0; i < count; i++)
+        {
+            if (reports[i].kind != kind) continue;
+
+            uint16_t input_len = (uint16_t)((reports[i].input_bits + 7) / 8);
+            uint16_t output_len = (uint16_t)((reports[i].output_bits + 7) / 8);
+
+            // Report disabled at build time.
+            if (input_room_by_kind[kind] == 0) return NRF_ERROR_INVALID_DATA;
+            if ((input_len > INPUT_REPORT_LEN_MAX) || ((kind == REPORT_KIND_RAW) && (output_len > OUTPUT_ROOM_RAW))) return NRF_ERROR_INVALID_DATA;
+            if ((output_len > 0) && (kind != REPORT_KIND_KEYBOARD) && (kind != REPORT_KIND_RAW)) return NRF_ERROR_INVALID_DATA;
+
+            if (input_len > 0)
+            {
+                if (report_id_by_kind[kind] != 0) return NRF_ERROR_INVALID_DATA;
+
+                uint8_t index = input_rep_count++;
+                HID_REP_IN_SETUP(p_input_reports[index], input_len, reports[i].id);
+                input_rep_kind[index] = kind;
+                input_rep_len[index] = input_len;
+                hid_report_map_table[reports[i].id] = index;
+                report_id_by_kind[kind] = reports[i].id;
+                room_needed += input_len;
+            }
+            if (output_len > 0)
+            {
+                if (output_rep_count == OUTPUT_REP_COUNT) return NRF_ERROR_INVALID_DATA;
+
+                uint8_t index = output_rep_count++;
+                HID_REP_OUT_SETUP(p_output_reports[index], output_len, reports[i].id);
+                output_rep_kind[index] = kind;
+                output_rep_len[index] = output_len;
+                room_needed += output_len;
+            }
+        }
+    }
+
+    if ((input_rep_count == 0) || (room_needed > REPORTS_ROOM)) return NRF_ERROR_INVALID_DATA;
+
+    return NRF_SUCCESS;
+}
+
+/**@brief Function for following the active link, the buffered input is replayed once it is encrypted.
+ */
+static void preconn_link_state_handler(ble_link_state_t previous, ble_link_state_t state);
+
+/**@brief Function for initializing HID Service.
+ */
+void hids_init()
+{
+    ret_code_t err_code;
+    ble_hids_init_t hids_init_obj;
+
+    static ble_hids_inp_rep_init_t input_report_array[INPUT_REP_COUNT];
+    static ble_hids_outp_rep_init_t output_report_array[OUTPUT_REP_SLOTS];
+
+    memset((void *)input_report_array, 0, sizeof(ble_hids_inp_rep_init_t) * INPUT_REP_COUNT);
+    memset((void *)output_report_array, 0, sizeof(ble_hids_outp_rep_init_t) * OUTPUT_REP_SLOTS);
+
+    // Input and output reports, as described by the report descriptor.
+    err_code = report_map_build(input_report_array, output_report_array);
+    APP_ERROR_CHECK(err_code);
+
+    memset(&hids_init_obj, 0, sizeof(hids_init_obj));
+
+    hids_init_obj.evt_handler = on_hids_evt;
+    hids_init_obj.error_handler = service_error_handler;
+    hids_init_obj.is_kb = BLE_HID_BOOT_KEYBOARD_ENABLED;
+    hids_init_obj.is_mouse = BLE_HID_BOOT_MOUSE_ENABLED;
+    hids_init_obj.inp_rep_count = input_rep_count;
+    hids_init_obj.p_inp_rep_array = input_report_array;
+    hids_init_obj.outp_rep_count = output_rep_count;
+    hids_init_obj.p_outp_rep_array = output_report_array;
+    hids_init_obj.feature_rep_count = 0;
+    hids_init_obj.p_feature_rep_array = NULL;
+    hids_init_obj.rep_map.data_len = hid_desc_report_len;
+    hids_init_obj.rep_map.p_data = hid_desc_report;
+    hids_init_obj.hid_information.bcd_hid = BASE_USB_HID_SPEC_VERSION;
+    hids_init_obj.hid_information.b_country_code = 0;
+    hids_init_obj.hid_information.flags = HID_INFO_FLAG_REMOTE_WAKE_MSK | HID_INFO_FLAG_NORMALLY_CONNECTABLE_MSK;
+    hids_init_obj.included_services_count = 0;
+    hids_init_obj.p_included_services_array = NULL;
+
+    hids_init_obj.rep_map.rd_sec = SEC_CURRENT;
+    hids_init_obj.hid_information.rd_sec = SEC_CURRENT;
+
+    hids_init_obj.boot_kb_inp_rep_sec.cccd_wr = SEC_CURRENT;
+    hids_init_obj.boot_kb_inp_rep_sec.rd = SEC_CURRENT;
+
+    hids_init_obj.boot_kb_outp_rep_sec.rd = SEC_CURRENT;
+    hids_init_obj.boot_kb_outp_rep_sec.wr = SEC_CURRENT;
+
+    hids_init_obj.boot_mouse_inp_rep_sec.cccd_wr = SEC_CURRENT;
+    hids_init_obj.boot_mouse_inp_rep_sec.wr = SEC_CURRENT;
+    hids_init_obj.boot_mouse_inp_rep_sec.rd = SEC_CURRENT;
+
+    hids_init_obj.protocol_mode_rd_sec = SEC_CURRENT;
+    hids_init_obj.protocol_mode_wr_sec = SEC_CURRENT;
+    hids_init_obj.ctrl_point_wr_sec = SEC_CURRENT;
+
+    err_code = ble_hids_init(&m_hids, &hids_init_obj);
+    APP_ERROR_CHECK(err_code);
+
+    if ((BLE_HID_PRECONN_BUFFER_SIZE > 0) && !ble_link_state_subscribe(preconn_link_state_handler))
+    {
+        APP_ERROR_HANDLER(NRF_ERROR_NO_MEM);
+    }
+
+#if (BLUETOOTH_DEBUG_LOG > 0)
+    ble_hid_memory_t memory;
+    ble_hid_memory_get(&memory);
+    NRF_LOG_INFO("HID service: %u in, %u out, %u attributes", memory.input_reports, memory.output_reports, memory.gatt_attributes);
+    NRF_LOG_INFO("HID service RAM: link ctx %u, queue %u, preconn %u, raw %u", memory.link_ctx_bytes, memory.tx_queue_bytes,
+                 memory.preconn_bytes, memory.raw_buffers_bytes);
+#endif
+}
+
+static uint32_t send_key(ble_hids_t *p_hids, uint8_t index, uint8_t *pattern, uint8_t len)
+{
+    ret_code_t err_code = NRF_SUCCESS;
+    if (m_in_boot_mode)
+    {
+        if (input_rep_kind[index] == REPORT_KIND_KEYBOARD)
+        {
+            err_code = ble_hids_boot_kb_inp_rep_send(p_hids, len, pattern, m_conn_handle);
+        }
+    }
+    else
+    {
+        err_code = ble_hids_inp_rep_send(p_hids, index, len, pattern, m_conn_handle);
+    }
+    return err_code;
+}
+
+/**@brief Function for filtering the errors returned by send_key().
+ *
+ * @details Errors caused by the link state (not connected, not subscribed, busy) are not fatal.
+ */
+static void send_key_error_check(ret_code_t err_code)
+{
+    if ((err_code != NRF_SUCCESS) && (err_code != NRF_ERROR_INVALID_STATE) && (err_code != NRF_ERROR_RESOURCES) && (err_code != NRF_ERROR_BUSY) &&
+        (err_code != BLE_ERROR_GATTS_SYS_ATTR_MISSING) && (err_code != NRF_ERROR_FORBIDDEN))
+    {
+        APP_ERROR_HANDLER(err_code);
+    }
+}
+
+/**@brief Function for getting the kind of an input report.
+ */
+static uint8_t report_kind_get(uint8_t report_id)
+{
+    if (report_id > BLE_HID_REPORT_ID_MAX) return REPORT_KIND_INVALID;
+
+    uint8_t report_index = hid_report_map_table[report_id];
+    return (report_index == INPUT_REP_INDEX_INVALID) ? REPORT_KIND_INVALID : input_rep_kind[report_index];
+}
+
+/**@brief Function for checking if a report carries a state (keyboard, consumer, system) rather than deltas.
+ */
+static bool report_is_state(uint8_t report_id)
+{
+    uint8_t kind = report_kind_get(report_id);
+    return (kind == REPORT_KIND_KEYBOARD) || (kind == REPORT_KIND_CONSUMER) || (kind == REPORT_KIND_SYSTEM);
+}
+
+/**@brief Function for getting the TX class of an input report.
+ */
+static uint8_t report_tx_class(uint8_t report_id)
+{
+    uint8_t kind = report_kind_get(report_id);
+    return (kind == REPORT_KIND_INVALID) ? BLE_HID_TX_CLASS_RAW : tx_class_by_kind[kind];
+}
+
+/**@brief Function for getting a report of a TX class FIFO.
+ *
+ * @param[in]   i   Position in the FIFO, 0 is the oldest report.
+ */
+static pending_report_t *tx_fifo_entry(tx_fifo_t const *p_fifo, uint8_t i)
+{
+    return &tx_queue[p_fifo->slots[(p_fifo->head + i) % BLE_HID_TX_QUEUE_SIZE]];
+}
+
+/**@brief Function for removing the oldest report of a TX class FIFO.
+ *
+ * @note Must be called inside a critical region.
+ */
+static void tx_fifo_pop(tx_fifo_t *p_fifo)
+{
+    tx_queue_used[p_fifo->slots[p_fifo->head]] = false;
+    p_fifo->head = (p_fifo->head + 1) % BLE_HID_TX_QUEUE_SIZE;
+    p_fifo->count--;
+    tx_queue_count--;
+}
+
+/**@brief Function for remembering the state that was handed to the SoftDevice.
+ */
+static void sent_state_update(uint8_t report_id, const uint8_t *p_data, uint8_t len)
+{
+    if (report_is_state(report_id))
+    {
+        memcpy(sent_state[hid_report_map_table[report_id]], p_data, MIN(len, INPUT_REPORT_LEN_STATE_MAX));
+    }
+}
+
+/**@brief Function for comparing two reports a word at a time.
+ */
+static bool state_equal(const uint8_t *p_a, const uint8_t *p_b, uint8_t len)
+{
+    uint8_t i = 0;
+
+    for (; i + sizeof(uint32_t) <= len; i += sizeof(uint32_t))
+    {
+        uint32_t a, b;
+        memcpy(&a, &p_a[i], sizeof(uint32_t));
+        memcpy(&b, &p_b[i], sizeof(uint32_t));
+        if (a != b) return false;
+    }
+    for (; i < len; i++)
+    {
+        if (p_a[i] != p_b[i]) return false;
+    }
+    return true;
+}
+
+/**@brief Function for checking if a state report (keyboard, consumer, system) changes nothing.
+ *
+ * @details The report is compared with the newest queued report of the same type or, if there is none,
+ *          with the last one handed to the SoftDevice.
+ *
+ * @note Must be called inside a critical region.
+ */
+static bool state_duplicate(uint8_t report_id, const uint8_t *p_data, uint8_t len)
+{
+    if (!report_is_state(report_id) || (len > INPUT_REPORT_LEN_STATE_MAX)) return false;
+
+    const uint8_t *p_last = sent_state[hid_report_map_table[report_id]];
+    tx_fifo_t const *p_fifo = &tx_fifos[report_tx_class(report_id)];
+    for (uint8_t i = p_fifo->count; i > 0; i--)
+    {
+        pending_report_t *p_report = tx_fifo_entry(p_fifo, i - 1);
+        if (p_report->report_id == report_id)
+        {
+            p_last = p_report->data;
+            break;
+        }
+    }
+
+    return state_equal(p_last, p_data, len);
+}
+
+/**@brief Function for remembering a notification handed to the SoftDevice.
+ *
+ * @note Must be called inside a critical region.
+ */
+static void inflight_push(uint8_t report_index, uint32_t ticks)
+{
+    if ((inflight_untracked > 0) || (inflight_count >= BLE_HID_INFLIGHT_SIZE))
+    {
+        inflight_untracked++;
+        return;
+    }
+
+    inflight_report_t *p_inflight = &inflight[(inflight_head + inflight_count) % BLE_HID_INFLIGHT_SIZE];
+    p_inflight->report_index = report_index;
+    p_inflight->ticks = ticks;
+    inflight_count++;
+}
+
+/**@brief Function for adding a latency to the histogram of a report.
+ */
+static void latency_record(uint8_t report_index, uint32_t ticks)
+{
+    uint32_t ms = (uint32_t)(((uint64_t)ticks * 1000 * (APP_TIMER_CONFIG_RTC_FREQUENCY + 1)) / APP_TIMER_CLOCK_FREQ);
+    uint8_t bucket = 0;
+
+    while ((bucket < BLE_HID_LATENCY_BUCKETS - 1) && (ms >= latency_bucket_limits_ms[bucket]))
+    {
+        bucket++;
+    }
+
+    ble_hid_latency_histogram_t *p_histogram = &latency_histogram[report_index];
+    p_histogram->count[bucket]++;
+    p_histogram->total++;
+    p_histogram->max_ms = MAX(p_histogram->max_ms, ms);
+}
+
+/**@brief Function for matching TX complete events with the notifications in flight.
+ *
+ * @note Must be called inside a critical region.
+ */
+static void inflight_complete(uint8_t count)
+{
+    uint32_t now = app_timer_cnt_get();
+
+    while ((count > 0) && (inflight_count > 0))
+    {
+        inflight_report_t *p_inflight = &inflight[inflight_head];
+        if (p_inflight->report_index < INPUT_REP_COUNT)
+        {
+            latency_record(p_inflight->report_index, app_timer_cnt_diff_compute(now, p_inflight->ticks));
+        }
+        inflight_head = (inflight_head + 1) % BLE_HID_INFLIGHT_SIZE;
+        inflight_count--;
+        count--;
+    }
+
+    inflight_untracked -= MIN(count, inflight_untracked);
+}
+
+/**@brief Function for sending a report and keeping track of the sent state.
+ *
+ * @param[in]   ticks   app_timer time the report was given by the application.
+ */
+static ret_code_t report_send(uint8_t report_id, const uint8_t *p_data, uint8_t len, uint32_t ticks)
+{
+    uint8_t report_index = hid_report_map_table[report_id];
+
+    ret_code_t err_code = send_key(&m_hids, report_index, (uint8_t *)p_data, len);
+    if (err_code == NRF_SUCCESS)
+    {
+        sent_state_update(report_id, p_data, len);
+        if (!m_in_boot_mode || (input_rep_kind[report_index] == REPORT_KIND_KEYBOARD))
+        {
+            inflight_push(report_index, ticks);
+        }
+    }
+    return err_code;
+}
+
+/**@brief Function for appending a report to the pending queue.
+ *
+ * @note Must be called inside a critical region.
+ *
+ * @return false if the queue is full.
+ */
+static bool tx_queue_push(uint8_t report_id, const uint8_t *p_data, uint8_t len, uint32_t ticks)
+{
+    if (tx_queue_count >= BLE_HID_TX_QUEUE_SIZE)
+    {
+        tx_queue_stats.dropped++;
+        return false;
+    }
+
+    uint8_t slot = 0;
+    while (tx_queue_used[slot])
+    {
+        slot++;
+    }
+
+    uint8_t tx_class = report_tx_class(report_id);
+    tx_fifo_t *p_fifo = &tx_fifos[tx_class];
+    p_fifo->slots[(p_fifo->head + p_fifo->count) % BLE_HID_TX_QUEUE_SIZE] = slot;
+    p_fifo->count++;
+    tx_queue_used[slot] = true;
+    tx_class_stats[tx_class].queued++;
+
+    pending_report_t *p_report = &tx_queue[slot];
+    p_report->report_id = report_id;
+    p_report->len = len;
+    p_report->ticks = ticks;
+    memcpy(p_report->data, p_data, len);
+
+    tx_queue_count++;
+    tx_queue_stats.enqueued++;
+    if (tx_queue_count > tx_queue_stats.high_water)
+    {
+        tx_queue_stats.high_water = tx_queue_count;
+    }
+    return true;
+}
+
+/**@brief Function for checking if a usage is present in an array report.
+ *
+ * @param[in]   p_data   Report data.
+ * @param[in]   len      Report length.
+ * @param[in]   width    Size of every usage in bytes (1 or 2).
+ * @param[in]   usage    Usage to look for.
+ */
+static bool usage_array_contains(const uint8_t *p_data, uint8_t len, uint8_t width, uint16_t usage)
+{
+    for (uint8_t i = 0; i + width <= len; i += width)
+    {
+        uint16_t value = (width == 2) ? (uint16_t)(p_data[i] | (p_data[i + 1] << 8)) : p_data[i];
+        if (value == usage) return true;
+    }
+    return false;
+}
+
+/**@brief Function for checking if a queued state report can be replaced by a newer one.
+ *
+ * @details Replacing is allowed as long as every transition carried by the queued report (a press or a release
+ *          compared to the state before it) is still visible in the new report. A press followed by its
+ *          release is never collapsed.
+ *
+ * @param[in]   report_id   Report ID.
+ * @param[in]   p_prev      State before the queued report.
+ * @param[in]   p_queued    Queued report.
+ * @param[in]   p_new       New report.
+ * @param[in]   len         Report length.
+ */
+static bool state_merge_allowed(uint8_t report_id, const uint8_t *p_prev, const uint8_t *p_queued, const uint8_t *p_new, uint8_t len)
+{
+    uint8_t kind = report_kind_get(report_id);
+
+    if (kind == REPORT_KIND_KEYBOARD)
+    {
+        // Modifiers and NKRO bitmap: one bit per key.
+        for (uint8_t i = 0; i < len; i++)
+        {
+            uint8_t pressed = p_queued[i] & ~p_prev[i];
+            uint8_t released = p_prev[i] & ~p_queued[i];
+            if ((pressed & ~p_new[i]) || (released & p_new[i])) return false;
+        }
+        return true;
+    }
+
+    // Consumer (16 bits) and system (8 bits) control: array of usages.
+    uint8_t width = (kind == REPORT_KIND_CONSUMER) ? 2 : 1;
+    for (uint8_t i = 0; i + width <= len; i += width)
+    {
+        uint16_t queued = (width == 2) ? (uint16_t)(p_queued[i] | (p_queued[i + 1] << 8)) : p_queued[i];
+        uint16_t prev = (width == 2) ? (uint16_t)(p_prev[i] | (p_prev[i + 1] << 8)) : p_prev[i];
+
+        if (queued && !usage_array_contains(p_prev, len, width, queued) && !usage_array_contains(p_new, len, width, queued)) return false;
+        if (prev && !usage_array_contains(p_queued, len, width, prev) && usage_array_contains(p_new, len, width, prev)) return false;
+    }
+    return true;
+}
+
+/**@brief Function for merging a state report (keyboard, consumer, system) into the last queued report of its class.
+ *
+ * @note Must be called inside a critical region.
+ *
+ * @return true if the report was merged and must not be queued.
+ */
+static bool state_coalesce(uint8_t report_id, const uint8_t *p_data, uint8_t len)
+{
+    tx_fifo_t const *p_fifo = &tx_fifos[report_tx_class(report_id)];
+    if (p_fifo->count == 0) return false;
+
+    pending_report_t *p_tail = tx_fifo_entry(p_fifo, p_fifo->count - 1);
+    if ((p_tail->report_id != report_id) || (p_tail->len != len) || (len > INPUT_REPORT_LEN_STATE_MAX)) return false;
+
+    // State before the queued report: the previous queued report of the same type, or the last one sent.
+    const uint8_t *p_prev = sent_state[hid_report_map_table[report_id]];
+    for (uint8_t i = p_fifo->count - 1; i > 0; i--)
+    {
+        pending_report_t *p_report = tx_fifo_entry(p_fifo, i - 1);
+        if (p_report->report_id == report_id)
+        {
+            p_prev = p_report->data;
+            break;
+        }
+    }
+
+    if (!state_merge_allowed(report_id, p_prev, p_tail->data, p_data, len)) return false;
+
+    memcpy(p_tail->data, p_data, len);
+    return true;
+}
+
+/**@brief Function for adding two mouse deltas with saturation.
+ *
+ * @param[in,out]   p_queued   Queued delta, receives the sum.
+ * @param[in,out]   p_new      New delta, receives what did not fit.
+ */
+static void mouse_axis_add(uint8_t *p_queued, uint8_t *p_new)
+{
+    int16_t sum = (int8_t)*p_queued + (int8_t)*p_new;
+    int16_t sat = MAX(MOUSE_AXIS_MIN, MIN(MOUSE_AXIS_MAX, sum));
+
+    *p_queued = (uint8_t)(int8_t)sat;
+    *p_new = (uint8_t)(int8_t)(sum - sat);
+}
+
+/**@brief Function for merging a mouse report into the last queued report.
+ *
+ * @details Buttons must match, X/Y/wheel deltas are summed. Whatever does not fit in the queued report is
+ *          left in p_data so it can be queued.
+ *
+ * @note Must be called inside a critical region.
+ *
+ * @return true if the report was fully merged and must not be queued.
+ */
+static bool mouse_coalesce(uint8_t *p_data, uint8_t len)
+{
+    tx_fifo_t const *p_fifo = &tx_fifos[BLE_HID_TX_CLASS_POINTER];
+    if (p_fifo->count == 0) return false;
+
+    pending_report_t *p_tail = tx_fifo_entry(p_fifo, p_fifo->count - 1);
+    if ((report_kind_get(p_tail->report_id) != REPORT_KIND_MOUSE) || (p_tail->len != len) || (p_tail->data[0] != p_data[0])) return false;
+
+    bool residual = false;
+    for (uint8_t i = 1; i < len; i++)
+    {
+        mouse_axis_add(&p_tail->data[i], &p_data[i]);
+        residual |= (p_data[i] != 0);
+    }
+    return !residual;
+}
+
+/**@brief Function for queueing a report, merging it with the last queued one when possible.
+ *
+ * @note Must be called inside a critical region.
+ *
+ * @return false if the queue is full.
+ */
+static bool tx_queue_submit(uint8_t report_id, const uint8_t *p_data, uint8_t len, uint32_t ticks)
+{
+    if ((report_kind_get(report_id) == REPORT_KIND_MOUSE) && (len == MOUSE_REPORT_LEN_8BIT_AXES))
+    {
+        uint8_t residual[MOUSE_REPORT_LEN_8BIT_AXES];
+        memcpy(residual, p_data, len);
+        if (mouse_coalesce(residual, len))
+        {
+            tx_queue_stats.coalesced++;
+            return true;
+        }
+        return tx_queue_push(report_id, residual, len, ticks);
+    }
+
+    if (report_is_state(report_id) && state_coalesce(report_id, p_data, len))
+    {
+        tx_queue_stats.coalesced++;
+        return true;
+    }
+
+    return tx_queue_push(report_id, p_data, len, ticks);
+}
+
+/**@brief Function for checking if a TX class can use one more notification credit.
+ *
+ * @details The last BLE_HID_TX_KEY_RESERVE credits are kept for the key reports, so a raw transfer or a battery
+ *          notification never holds the TX buffer a keystroke needs. With no more credits than the reserve
+ *          all the classes share them.
+ */
+static bool tx_credit_available(uint8_t tx_class)
+{
+    uint16_t limit = tx_credits;
+
+    if ((tx_class != BLE_HID_TX_CLASS_KEY) && (tx_credits > BLE_HID_TX_KEY_RESERVE))
+    {
+        limit = tx_credits - BLE_HID_TX_KEY_RESERVE;
+    }
+    return (inflight_count + inflight_untracked) < limit;
+}
+
+/**@brief Function for checking if a TX class has data waiting.
+ */
+static bool tx_class_pending(uint8_t tx_class)
+{
+    if (tx_class >= BLE_HID_TX_CLASS_BATTERY) return false;
+    if (tx_fifos[tx_class].count > 0) return true;
+
+    return (tx_class == BLE_HID_TX_CLASS_RAW) && m_stream.open && !m_stream.aborted && (m_stream.seg_count > 0);
+}
+
+/**@brief Function for choosing the class of the next notification.
+ *
+ * @details Classes are served in priority order. A class passed over BLE_HID_TX_STARVATION_LIMIT times while it
+ *          had data goes first once, unless it has no credit left and a key report can still go.
+ *
+ * @note Must be called inside a critical region.
+ *
+ * @param[out]  p_starved   Set if the class was chosen by the anti-starvation rule.
+ *
+ * @return BLE_HID_TX_CLASS_COUNT if nothing can be sent.
+ */
+static uint8_t tx_arbiter_pick(bool *p_starved)
+{
+    uint8_t pick = BLE_HID_TX_CLASS_COUNT;
+
+    *p_starved = false;
+    for (uint8_t tx_class = BLE_HID_TX_CLASS_POINTER; tx_class < BLE_HID_TX_CLASS_BATTERY; tx_class++)
+    {
+        if (tx_class_pending(tx_class) && (tx_passed_over[tx_class] >= BLE_HID_TX_STARVATION_LIMIT))
+        {
+            pick = tx_class;
+            *p_starved = true;
+            break;
+        }
+    }
+
+    if (pick == BLE_HID_TX_CLASS_COUNT)
+    {
+        for (uint8_t tx_class = 0; tx_class < BLE_HID_TX_CLASS_BATTERY; tx_class++)
+        {
+            if (tx_class_pending(tx_class))
+            {
+                pick = tx_class;
+                break;
+            }
+        }
+    }
+
+    if ((pick != BLE_HID_TX_CLASS_COUNT) && !tx_credit_available(pick))
+    {
+        *p_starved = false;
+        pick = (tx_class_pending(BLE_HID_TX_CLASS_KEY) && tx_credit_available(BLE_HID_TX_CLASS_KEY)) ? BLE_HID_TX_CLASS_KEY : BLE_HID_TX_CLASS_COUNT;
+    }
+    return pick;
+}
+
+/**@brief Function for accounting a notification handed to the SoftDevice.
+ *
+ * @note Must be called inside a critical region.
+ */
+static void tx_arbiter_grant(uint8_t tx_class, bool starved)
+{
+    for (uint8_t other = 0; other < BLE_HID_TX_CLASS_COUNT; other++)
+    {
+        if ((other != tx_class) && tx_class_pending(other))
+        {
+            tx_passed_over[other]++;
+            tx_class_stats[other].passed_over++;
+        }
+    }
+
+    tx_passed_over[tx_class] = 0;
+    tx_class_stats[tx_class].sent++;
+    if (starved)
+    {
+        tx_class_stats[tx_class].starved++;
+    }
+}
+
+/**@brief Function for checking if a new report can skip the queue.
+ *
+ * @details Nothing of its class or of a higher class waits, and its class has a credit.
+ *
+ * @note Must be called inside a critical region.
+ */
+static bool tx_send_now_allowed(uint8_t tx_class)
+{
+    for (uint8_t higher = 0; higher <= tx_class; higher++)
+    {
+        if (tx_fifos[higher].count > 0) return false;
+    }
+    return tx_credit_available(tx_class);
+}
+
+static ret_code_t stream_chunk_send(void);
+
+/**@brief Function for sending the waiting reports and raw stream data while the arbiter gives credits.
+ *
+ * @note Must be called inside a critical region.
+ */
+static void tx_queue_drain(void)
+{
+    bool starved;
+    uint8_t tx_class;
+
+    while ((tx_class = tx_arbiter_pick(&starved)) != BLE_HID_TX_CLASS_COUNT)
+    {
+        ret_code_t err_code;
+        tx_fifo_t *p_fifo = &tx_fifos[tx_class];
+
+        if (p_fifo->count > 0)
+        {
+            pending_report_t *p_report = tx_fifo_entry(p_fifo, 0);
+
+            err_code = report_send(p_report->report_id, p_report->data, p_report->len, p_report->ticks);
+            if (err_code == NRF_ERROR_RESOURCES)
+            {
+                break;
+            }
+            send_key_error_check(err_code);
+            tx_fifo_pop(p_fifo);
+        }
+        else
+        {
+            // Raw stream, after the raw reports already waiting.
+            err_code = stream_chunk_send();
+            if (err_code == NRF_ERROR_RESOURCES)
+            {
+                break;
+            }
+        }
+
+        if (err_code == NRF_SUCCESS)
+        {
+            tx_arbiter_grant(tx_class, starved);
+        }
+    }
+}
+
+
+/**@brief Function for handing a checked report to the SoftDevice, or to the pending queue.
+ *
+ * @details The report ID is valid and the host of the active link subscribed to it.
+ */
+static ble_hid_send_status_t report_submit(uint8_t report_id, const uint8_t *p_data, uint8_t len)
+{
     ret_code_t err_code;
+    ble_hid_send_status_t status = BLE_HID_SEND_OK;
+
+    if (duplicate_filter_enabled)
+    {
+        bool duplicate;
+
+        CRITICAL_REGION_ENTER();
+        duplicate = state_duplicate(report_id, p_data, len);
+        if (duplicate)
+        {
+            tx_queue_stats.duplicates++;
+        }
+        CRITICAL_REGION_EXIT();
+
+        // Nothing changed for the host, it is not activity either.
+        if (duplicate) return BLE_HID_SEND_DUPLICATE;
+    }
+
+    uint32_t ticks = app_timer_cnt_get();
+    ble_conn_activity_notify();
+
+    CRITICAL_REGION_ENTER();
+    reports_submitted++;
+    uint8_t tx_class = report_tx_class(report_id);
+    // Reports of the same or a higher class already waiting go first.
+    if (!tx_send_now_allowed(tx_class))
+    {
+        status = tx_queue_submit(report_id, p_data, len, ticks) ? BLE_HID_SEND_QUEUED : BLE_HID_SEND_QUEUE_FULL;
+    }
+    else
+    {
+        err_code = report_send(report_id, p_data, len, ticks);
+        // check if send success, otherwise enqueue this.
+        if (err_code == NRF_SUCCESS)
+        {
+            tx_arbiter_grant(tx_class, false);
+        }
+        else if (err_code == NRF_ERROR_RESOURCES)
+        {
+            status = tx_queue_submit(report_id, p_data, len, ticks) ? BLE_HID_SEND_QUEUED : BLE_HID_SEND_QUEUE_FULL;
+        }
+        else
+        {
+            send_key_error_check(err_code);
+            status = BLE_HID_SEND_REJECTED;
+        }
+    }
+    tx_queue_stats.depth = tx_queue_count;
+    CRITICAL_REGION_EXIT();
+
+    return status;
+}
+
+/**@brief Function for dropping the buffered reports older than the maximum age.
+ *
+ * @note Must be called inside a critical region.
+ */
+static void preconn_expire(void)
+{
+    uint32_t now = app_timer_cnt_get();
+    uint8_t expired = 0;
+
+    // Reports are kept in order, the expired ones are at the front.
+    while ((expired < preconn_count) && (app_timer_cnt_diff_compute(now, preconn_buffer[expired].ticks) > preconn_max_age_ticks))
+    {
+        expired++;
+    }
+    if (expired == 0) return;
+
+    memmove(&preconn_buffer[0], &preconn_buffer[expired], (preconn_count - expired) * sizeof(preconn_report_t));
+    preconn_count -= expired;
+    preconn_stats.expired += expired;
+}
+
+/**@brief Function for checking if a report goes through the pre-connection buffer.
+ *
+ * @return false for raw reports, reports too long to be kept, or when the buffer is disabled.
+ */
+static bool preconn_accepts(uint8_t report_index, uint8_t len)
+{
+    return (BLE_HID_PRECONN_BUFFER_SIZE > 0) && (input_rep_kind[report_index] != REPORT_KIND_RAW) && (len <= PRECONN_REPORT_LEN_MAX);
+}
+
+/**@brief Function for keeping a report until the link is encrypted.
+ *
+ * @param[in]   evict   Make room by dropping the oldest report when the buffer is full.
+ *
+ * @return false if the buffer is full and evict is not set.
+ */
+static bool preconn_push(uint8_t report_id, const uint8_t *p_data, uint8_t len, bool evict)
+{
+    bool pushed = true;
+
+    CRITICAL_REGION_ENTER();
+    preconn_expire();
+
+    // The oldest report goes, the last state of each report is the one the host must end up with.
+    if ((preconn_count == BLE_HID_PRECONN_BUFFER_SIZE) && evict)
+    {
+        memmove(&preconn_buffer[0], &preconn_buffer[1], (preconn_count - 1) * sizeof(preconn_report_t));
+        preconn_count--;
+        preconn_stats.dropped++;
+    }
+
+    if (preconn_count < BLE_HID_PRECONN_BUFFER_SIZE)
+    {
+        preconn_report_t *p_report = &preconn_buffer[preconn_count++];
+        p_report->report_id = report_id;
+        p_report->len = len;
+        p_report->ticks = app_timer_cnt_get();
+        memcpy(p_report->data, p_data, len);
+
+        preconn_stats.buffered++;
+        if (preconn_count > preconn_stats.high_water)
+        {
+            preconn_stats.high_water = preconn_count;
+        }
+    }
+    else
+    {
+        pushed = false;
+    }
+    CRITICAL_REGION_EXIT();
+
+    return pushed;
+}
+
+/**@brief Function for sending the buffered reports, in order, once the active link is encrypted.
+ *
+ * @details Reports the host of the encrypted link has not subscribed to are discarded, as a report sent
+ *          directly would be refused. The replay stops while the pending queue is full and goes on from the
+ *          TX complete event.
+ */
+static void preconn_replay(void)
+{
+    if (ble_link_state_get() != BLE_LINK_STATE_SECURED) return;
+
+    bool replaying;
+    CRITICAL_REGION_ENTER();
+    replaying = preconn_replaying;
+    preconn_replaying = true;
+    CRITICAL_REGION_EXIT();
+
+    // Replayed from the main loop and the BLE events, only one of them sends so the order is kept.
+    if (replaying) return;
+
+    preconn_report_t report;
+    bool found;
+    do
+    {
+        found = false;
+
+        CRITICAL_REGION_ENTER();
+        preconn_expire();
+        while ((preconn_count > 0) && !report_subscribed(hid_report_map_table[preconn_buffer[0].report_id]))
+        {
+            memmove(&preconn_buffer[0], &preconn_buffer[1], (preconn_count - 1) * sizeof(preconn_report_t));
+            preconn_count--;
+            preconn_stats.discarded++;
+        }
+        if ((preconn_count > 0) && (tx_queue_count < BLE_HID_TX_QUEUE_SIZE))
+        {
+            report = preconn_buffer[0];
+            memmove(&preconn_buffer[0], &preconn_buffer[1], (preconn_count - 1) * sizeof(preconn_report_t));
+            preconn_count--;
+            found = true;
+        }
+        else
+        {
+            preconn_replaying = false;
+        }
+        CRITICAL_REGION_EXIT();
+
+        if (found)
+        {
+            ble_hid_send_status_t status = report_submit(report.report_id, report.data, report.len);
+
+            CRITICAL_REGION_ENTER();
+            if ((status == BLE_HID_SEND_OK) || (status == BLE_HID_SEND_QUEUED))
+            {
+                preconn_stats.replayed++;
+            }
+            else if (status != BLE_HID_SEND_DUPLICATE) // Duplicates are counted by the pending queue.
+            {
+                preconn_stats.discarded++;
+            }
+            CRITICAL_REGION_EXIT();
+        }
+    } while (found);
+}
+
+/**@brief Function for discarding the buffered reports, no host will take them.
+ *
+ * @details Called when advertising is stopped or times out. A dropped link or a restarted advertising keep
+ *          them, the next encrypted link may still take them before they expire.
+ */
+void ble_hid_preconn_flush(void)
+{
+    CRITICAL_REGION_ENTER();
+    preconn_stats.discarded += preconn_count;
+    preconn_count = 0;
+    CRITICAL_REGION_EXIT();
+}
+
+static void preconn_link_state_handler(ble_link_state_t previous, ble_link_state_t state)
+{
+    UNUSED_PARAMETER(previous);
+
+    if (state == BLE_LINK_STATE_SECURED)
+    {
+        preconn_replay();
+    }
+}
+
+/**@brief Function for sending an input report to the host of the active link.
+ *
+ * @details When the TX arbiter has no credit for the report class, or the SoftDevice no free TX buffer, the
+ *          report is kept in the pending queue of its class and sent from ble_hid_on_hvn_tx_complete().
+ *          Reports of one class are always delivered in the order they were given, classes go by priority:
+ *          keyboard, mouse, consumer and system, raw.
+ *          While reports are waiting, a new report of the same type is merged into the last queued one:
+ *          keyboard, consumer and system reports keep the newest state, mouse deltas are summed.
+ *          Keyboard, consumer and system reports identical to the last one are dropped, see
+ *          ble_hid_duplicate_filter_set().
+ *          Reports the host did not subscribe to are refused before reaching the SoftDevice, so the
+ *          application knows when the host has not finished enumerating the service.
+ *          Until the active link is encrypted, reports other than raw are kept with their time and
+ *          replayed in order afterwards, see ble_hid_preconn_max_age_set(). Reports given during the
+ *          replay go behind the kept ones, and are refused when the buffer is full.
+ *
+ * @param[in]   report_id   Report ID, as in the report descriptor.
+ * @param[in]   p_data      Report data, without the report ID.
+ * @param[in]   len         Report length.
+ */
+ble_hid_send_status_t ble_hid_report_send(uint8_t report_id, const uint8_t *p_data, uint8_t len)
+{
     // check if report id overflow
+    if (report_id >= sizeof(hid_report_map_table)) return BLE_HID_SEND_INVALID;
+    // convert report id to index
+    uint8_t report_index = hid_report_map_table[report_id];
+    // check if this function is disable
+    if (report_index == INPUT_REP_INDEX_INVALID) return BLE_HID_SEND_INVALID;
+    if (len > input_rep_len[report_index]) return BLE_HID_SEND_INVALID;
+
+    // Kept until the link is encrypted, and behind the reports kept before once it is.
+    bool secured = (ble_link_state_get() == BLE_LINK_STATE_SECURED);
+    if ((!secured || (preconn_count > 0)) && preconn_accepts(report_index, len))
+    {
+        if (secured && !report_subscribed(report_index)) return BLE_HID_SEND_NOT_SUBSCRIBED;
+
+        // Once encrypted the kept reports go first, a newer report does not push them out.
+        bool buffered = preconn_push(report_id, p_data, len, !secured);
+        preconn_replay();
+        return buffered ? BLE_HID_SEND_BUFFERED : BLE_HID_SEND_QUEUE_FULL;
+    }
+
+    if (m_conn_handle == BLE_CONN_HANDLE_INVALID) return BLE_HID_SEND_NOT_CONNECTED;
+    if (!report_subscribed(report_index)) return BLE_HID_SEND_NOT_SUBSCRIBED;
+
+    return report_submit(report_id, p_data, len);
+}
+
+/**@brief Function for sending sample key presses to the peer.
+ *
+ * @return false if the report was not sent nor queued, see ble_hid_report_send() for the reason.
+ */
+bool ble_send_report(uint8_t report_id, const uint8_t *p_key_pattern, uint8_t key_pattern_len)
+{
+    ble_hid_send_status_t status = ble_hid_report_send(report_id, p_key_pattern, key_pattern_len);
+
+    return (status == BLE_HID_SEND_OK) || (status == BLE_HID_SEND_QUEUED) || (status == BLE_HID_SEND_BUFFERED) ||
+           (status == BLE_HID_SEND_DUPLICATE);
+}
+
+/**@brief Function for checking if the host of the active link enabled the notifications of a report.
+ */
+bool ble_hid_report_subscribed(uint8_t report_id)
+{
+    if (report_id >= sizeof(hid_report_map_table)) return false;
+
+    uint8_t report_index = hid_report_map_table[report_id];
+    if (report_index == INPUT_REP_INDEX_INVALID) return false;
+
+    return report_subscribed(report_index);
+}
+
+/**@brief Function for enabling or disabling the duplicate report filter.
+ *
+ * @details Enabled by default. Disable it for hosts that rely on repeated reports as keep-alive.
+ */
+void ble_hid_duplicate_filter_set(bool enable)
+{
+    duplicate_filter_enabled = enable;
+}
+
+/**@brief Function for getting the largest raw input report that fits in a single notification.
+ *
+ * @details The raw report characteristic accepts any length up to its descriptor size, but only ATT MTU - 3
+ *          bytes fit in a notification. Bulk senders should split their data in chunks of this size.
+ */
+uint8_t ble_hid_raw_report_len_get(void)
+{
+    uint8_t report_index = hid_report_map_table[report_id_by_kind[REPORT_KIND_RAW]];
+    if (report_index == INPUT_REP_INDEX_INVALID) return 0;
+
+    uint16_t payload = ble_gatt_att_mtu_get(m_conn_handle) - ATT_NOTIFICATION_HEADER_LEN;
+    return (uint8_t)MIN(payload, input_rep_len[report_index]);
+}
+
+/**@brief Function for sending the next chunk of the raw stream.
+ *
+ * @details The TX arbiter only calls it when no report of a higher class waits, so it never delays a key report.
+ *
+ * @note Must be called inside a critical region.
+ */
+static ret_code_t stream_chunk_send(void)
+{
+    uint8_t max_len = ble_hid_raw_report_len_get();
+    uint8_t len = 1;
+    uint8_t seg = m_stream.seg_head;
+    uint8_t seg_count = m_stream.seg_count;
+    uint32_t offset = m_stream.offset;
+
+    // Fill the chunk, spanning segments if needed.
+    stream_chunk[0] = m_stream.seq;
+    while ((len < max_len) && (seg_count > 0))
+    {
+        stream_segment_t *p_seg = &m_stream.segments[seg];
+        uint32_t copy = MIN((uint32_t)(max_len - len), p_seg->len - offset);
+
+        memcpy(&stream_chunk[len], &p_seg->p_data[offset], copy);
+        len += copy;
+        offset += copy;
+        if (offset == p_seg->len)
+        {
+            seg = (seg + 1) % BLE_HID_STREAM_SEGMENTS;
+            seg_count--;
+            offset = 0;
+        }
+    }
+
+    ret_code_t err_code = report_send(report_id_by_kind[REPORT_KIND_RAW], stream_chunk, len, app_timer_cnt_get());
+    if (err_code == NRF_ERROR_RESOURCES)
+    {
+        return err_code;
+    }
+    if (err_code != NRF_SUCCESS)
+    {
+        // The chunk was not sent and the next ones would not be either (not subscribed, link going down):
+        // stop here so the receiver never sees a gap, stream_service() reports the abort.
+        send_key_error_check(err_code);
+        m_stream.aborted = true;
+        return err_code;
+    }
+
+    m_stream.seg_head = seg;
+    m_stream.seg_count = seg_count;
+    m_stream.offset = offset;
+    m_stream.sent += len - 1;
+    m_stream.seq++;
+
+    return err_code;
+}
+
+/**@brief Function for sending what the TX arbiter allows and calling the raw stream completion handler when
+ *        the stream is done or was aborted.
+ */
+static void stream_service(void)
+{
+    bool done;
+    bool aborted;
+    ble_hid_stream_handler_t handler;
+    uint32_t sent;
+
+    CRITICAL_REGION_ENTER();
+    tx_queue_drain();
+    tx_queue_stats.depth = tx_queue_count;
+    aborted = m_stream.open && m_stream.aborted;
+    done = m_stream.open && m_stream.closing && (m_stream.seg_count == 0);
+    handler = m_stream.handler;
+    sent = m_stream.sent;
+    if (done || aborted)
+    {
+        memset(&m_stream, 0, sizeof(m_stream));
+    }
+    CRITICAL_REGION_EXIT();
+
+    if ((done || aborted) && (handler != NULL))
+    {
+        handler(aborted ? BLE_HID_STREAM_ABORTED : BLE_HID_STREAM_DONE, sent);
+    }
+}
+
+/**@brief Function for opening a bulk transfer over the raw report.
+ *
+ * @param[in]   handler   Called once all the data written before ble_hid_stream_close() was sent. Can be NULL.
+ *
+ * @return false if a stream is already open.
+ */
+bool ble_hid_stream_open(ble_hid_stream_handler_t handler)
+{
+    bool result = false;
+
+    if (!ble_hid_report_subscribed(report_id_by_kind[REPORT_KIND_RAW])) return false;
+
+    CRITICAL_REGION_ENTER();
+    if (!m_stream.open)
+    {
+        memset(&m_stream, 0, sizeof(m_stream));
+        m_stream.open = true;
+        m_stream.handler = handler;
+        result = true;
+    }
+    CRITICAL_REGION_EXIT();
+
+    return result;
+}
+
+/**@brief Function for writing data to the raw stream.
+ *
+ * @details The data is not copied, the buffer must stay valid until the completion handler is called.
+ *          It is split in raw reports of ble_hid_raw_report_len_get() bytes, the first byte of each one
+ *          being a sequence number, and sent as fast as the SoftDevice TX buffers allow.
+ *
+ * @param[in]   p_data   Data to send.
+ * @param[in]   len      Data length.
+ *
+ * @return false if the stream is not open, is closing or already has BLE_HID_STREAM_SEGMENTS buffers waiting.
+ */
+bool ble_hid_stream_write(const uint8_t *p_data, uint32_t len)
+{
+    bool result = false;
+
+    CRITICAL_REGION_ENTER();
+    if (m_stream.open && !m_stream.closing && (m_stream.seg_count < BLE_HID_STREAM_SEGMENTS))
+    {
+        if (len > 0)
+        {
+            stream_segment_t *p_seg = &m_stream.segments[(m_stream.seg_head + m_stream.seg_count) % BLE_HID_STREAM_SEGMENTS];
+            p_seg->p_data = p_data;
+            p_seg->len = len;
+            m_stream.seg_count++;
+        }
+        result = true;
+    }
+    CRITICAL_REGION_EXIT();
+
+    if (result)
+    {
+        stream_service();
+    }
+    return result;
+}
+
+/**@brief Function for closing the raw stream.
+ *
+ * @details The completion handler is called once all the written data was sent.
+ *
+ * @return false if the stream is not open.
+ */
+bool ble_hid_stream_close(void)
+{
+    bool result = false;
+
+    CRITICAL_REGION_ENTER();
+    if (m_stream.open && !m_stream.closing)
+    {
+        m_stream.closing = true;
+        result = true;
+    }
+    CRITICAL_REGION_EXIT();
+
+    if (result)
+    {
+        stream_service();
+    }
+    return result;
+}
+
+bool ble_hid_stream_busy(void)
+{
+    return m_stream.open;
+}
+
+/**@brief Function for sending the released state of the reports a link's host still holds pressed.
+ *
+ * @details Stops when the SoftDevice has no free TX buffer on the link, the rest is sent on its next TX complete.
+ */
+static void release_send(uint16_t conn_handle)
+{
+    uint16_t link_idx = ble_conn_state_conn_idx(conn_handle);
+    if (link_idx >= NRF_SDH_BLE_TOTAL_LINK_COUNT) return;
+
+    for (uint8_t i = 0; (i < input_rep_count) && (release_pending[link_idx] != 0); i++)
+    {
+        if ((release_pending[link_idx] & (1U << i)) == 0) continue;
+
+        ret_code_t err_code;
+        if (m_in_boot_mode)
+        {
+            err_code = ble_hids_boot_kb_inp_rep_send(&m_hids, BOOT_KB_INPUT_REPORT_MAX_SIZE, (uint8_t *)released_state, conn_handle);
+        }
+        else
+        {
+            err_code = ble_hids_inp_rep_send(&m_hids, i, input_rep_len[i], (uint8_t *)released_state, conn_handle);
+        }
+        if (err_code == NRF_ERROR_RESOURCES) return;
+
+        send_key_error_check(err_code);
+        release_pending[link_idx] &= (uint8_t)~(1U << i);
+    }
+}
+
+/**@brief Function for releasing the keys, consumer and system controls held on the host of the active link.
+ *
+ * @details To be called before the active link changes while the previous one stays connected: the reports still
+ *          queued for it are discarded, including the releases, and its host would keep the keys pressed.
+ */
+void ble_hid_keys_release(void)
+{
+    uint16_t link_idx = ble_conn_state_conn_idx(m_conn_handle);
+    if (link_idx >= NRF_SDH_BLE_TOTAL_LINK_COUNT) return;
+
+    uint8_t pending = 0;
+    CRITICAL_REGION_ENTER();
+    for (uint8_t i = 0; i < input_rep_count; i++)
+    {
+        uint8_t kind = input_rep_kind[i];
+        bool state = (kind == REPORT_KIND_KEYBOARD) || (kind == REPORT_KIND_CONSUMER) || (kind == REPORT_KIND_SYSTEM);
+        if (!state || !report_subscribed(i)) continue;
+        if (!state_equal(sent_state[i], released_state, MIN(input_rep_len[i], INPUT_REPORT_LEN_STATE_MAX)))
+        {
+            pending |= (uint8_t)(1U << i);
+        }
+    }
+    release_pending[link_idx] |= pending;
+    CRITICAL_REGION_EXIT();
+
+    release_send(m_conn_handle);
+}
+
+/**@brief Function for handling the BLE_GATTS_EVT_HVN_TX_COMPLETE event.
+ *
+ * @param[in]   conn_handle   Connection the notifications were sent on.
+ * @param[in]   count         Number of notifications that freed their TX buffer.
+ */
+void ble_hid_on_hvn_tx_complete(uint16_t conn_handle, uint8_t count)
+{
+    if (conn_handle != m_conn_handle)
+    {
+        release_send(conn_handle);
+        return;
+    }
+
+    CRITICAL_REGION_ENTER();
+    inflight_complete(count);
+    CRITICAL_REGION_EXIT();
+
+    stream_service();
+    preconn_replay();
+}
+
+/**@brief Function for discarding all the pending reports, i.e. when the link is lost.
+ *
+ * @details An open raw stream is aborted.
+ */
+void ble_hid_tx_queue_flush(void)
+{
+    ble_hid_stream_handler_t handler = NULL;
+    uint32_t sent = 0;
+
+    CRITICAL_REGION_ENTER();
+    memset(tx_queue_used, 0, sizeof(tx_queue_used));
+    memset(tx_fifos, 0, sizeof(tx_fifos));
+    memset(tx_passed_over, 0, sizeof(tx_passed_over));
+    tx_queue_count = 0;
+    tx_queue_stats.depth = 0;
+    memset(sent_state, 0, sizeof(sent_state));
+    inflight_head = 0;
+    inflight_count = 0;
+    inflight_untracked = 0;
+
+    if (m_stream.open)
+    {
+        handler = m_stream.handler;
+        sent = m_stream.sent;
+        memset(&m_stream, 0, sizeof(m_stream));
+    }
+    CRITICAL_REGION_EXIT();
+
+    if (handler != NULL)
+    {
+        handler(BLE_HID_STREAM_ABORTED, sent);
+    }
+}
+
+void ble_hid_tx_queue_stats_get(ble_hid_tx_queue_stats_t *p_stats)
+{
+    CRITICAL_REGION_ENTER();
+    *p_stats = tx_queue_stats;
+    CRITICAL_REGION_EXIT();
+}
+
+void ble_hid_tx_queue_stats_reset(void)
+{
+    CRITICAL_REGION_ENTER();
+    memset(&tx_queue_stats, 0, sizeof(tx_queue_stats));
+    tx_queue_stats.depth = tx_queue_count;
+    tx_queue_stats.high_water = tx_queue_count;
+    CRITICAL_REGION_EXIT();
+}
+
+/**@brief Function for setting how long input given before the link is encrypted is kept.
+ *
+ * @details Reports older than this when the link gets encrypted are dropped rather than typed late.
+ *
+ * @param[in]   max_age_ms  Maximum age, limited to BLE_HID_PRECONN_MAX_AGE_LIMIT_MS.
+ */
+void ble_hid_preconn_max_age_set(uint32_t max_age_ms)
+{
+    uint32_t ticks = APP_TIMER_TICKS(MIN(max_age_ms, BLE_HID_PRECONN_MAX_AGE_LIMIT_MS));
+
+    CRITICAL_REGION_ENTER();
+    preconn_max_age_ticks = ticks;
+    CRITICAL_REGION_EXIT();
+}
+
+void ble_hid_preconn_stats_get(ble_hid_preconn_stats_t *p_stats)
+{
+    CRITICAL_REGION_ENTER();
+    *p_stats = preconn_stats;
+    CRITICAL_REGION_EXIT();
+}
+
+void ble_hid_preconn_stats_reset(void)
+{
+    CRITICAL_REGION_ENTER();
+    memset(&preconn_stats, 0, sizeof(preconn_stats));
+    preconn_stats.high_water = preconn_count;
+    CRITICAL_REGION_EXIT();
+}
+
+/**@brief Function for signaling a notification sent by another service on the same link.
+ *
+ * @details It shares the SoftDevice TX buffers, so its TX complete event must not be matched with a report.
+ */
+void ble_hid_tx_track_external(void)
+{
+    CRITICAL_REGION_ENTER();
+    inflight_push(INPUT_REP_INDEX_INVALID, 0);
+    if (tx_passed_over[BLE_HID_TX_CLASS_BATTERY] >= BLE_HID_TX_STARVATION_LIMIT)
+    {
+        tx_class_stats[BLE_HID_TX_CLASS_BATTERY].starved++;
+    }
+    tx_passed_over[BLE_HID_TX_CLASS_BATTERY] = 0;
+    tx_class_stats[BLE_HID_TX_CLASS_BATTERY].sent++;
+    CRITICAL_REGION_EXIT();
+}
+
+void ble_hid_tx_class_stats_get(ble_hid_tx_class_t tx_class, ble_hid_tx_class_stats_t *p_stats)
+{
+    if (tx_class >= BLE_HID_TX_CLASS_COUNT) return;
+
+    CRITICAL_REGION_ENTER();
+    *p_stats = tx_class_stats[tx_class];
+    CRITICAL_REGION_EXIT();
+}
+
+void ble_hid_tx_class_stats_reset(void)
+{
+    CRITICAL_REGION_ENTER();
+    memset(tx_class_stats, 0, sizeof(tx_class_stats));
+    CRITICAL_REGION_EXIT();
+}
+
+/**@brief Function for setting the number of notifications the TX arbiter lets in flight.
+ *
+ * @param[in]   credits   HVN TX queue size the SoftDevice was configured with.
+ */
+void ble_hid_tx_credits_set(uint8_t credits)
+{
+    CRITICAL_REGION_ENTER();
+    tx_credits = MAX(credits, 1);
+    CRITICAL_REGION_EXIT();
+}
+
+/**@brief Function for asking the TX arbiter a credit for a battery notification.
+ *
+ * @details Battery notifications are the lowest class: allowed when no HID report nor raw stream data waits,
+ *          or when the battery was passed over BLE_HID_TX_STARVATION_LIMIT times, and a credit is left outside
+ *          the key reserve. Call ble_hid_tx_track_external() once the notification is sent.
+ */
+bool ble_hid_tx_external_allowed(void)
+{
+    bool allowed;
+    bool higher_pending = false;
+
+    CRITICAL_REGION_ENTER();
+    for (uint8_t tx_class = 0; tx_class < BLE_HID_TX_CLASS_BATTERY; tx_class++)
+    {
+        higher_pending |= tx_class_pending(tx_class);
+    }
+
+    allowed = (!higher_pending || (tx_passed_over[BLE_HID_TX_CLASS_BATTERY] >= BLE_HID_TX_STARVATION_LIMIT)) &&
+              tx_credit_available(BLE_HID_TX_CLASS_BATTERY);
+    if (!allowed && higher_pending)
+    {
+        tx_passed_over[BLE_HID_TX_CLASS_BATTERY]++;
+        tx_class_stats[BLE_HID_TX_CLASS_BATTERY].passed_over++;
+    }
+    CRITICAL_REGION_EXIT();
+
+    return allowed;
+}
+
+/**@brief Function for checking that the HID reports use no TX buffer at all.
+ *
+ * @details Nothing is waiting and every notification was acknowledged by BLE_GATTS_EVT_HVN_TX_COMPLETE.
+ */
+bool ble_hid_tx_idle(void)
+{
+    bool idle;
+
+    CRITICAL_REGION_ENTER();
+    idle = (tx_queue_count == 0) && !m_stream.open && (inflight_count == 0) && (inflight_untracked == 0);
+    CRITICAL_REGION_EXIT();
+
+    return idle;
+}
+
+/**@brief Function for getting the latency histogram of a report.
+ *
+ * @param[in]   report_id     Report ID.
+ * @param[out]  p_histogram   Copy of the histogram.
+ *
+ * @return false if the report id is not valid.
+ */
+bool ble_hid_latency_snapshot(uint8_t report_id, ble_hid_latency_histogram_t *p_histogram)
+{
     if (report_id >= sizeof(hid_report_map_table)) return false;
-    // convert report id to index
     uint8_t report_index = hid_report_map_table[report_id];
-    // check if this function is disable
     if (report_index == INPUT_REP_INDEX_INVALID) return false;
 
-    err_code = send_key(&m_hids, report_index, p_key_pattern, key_pattern_len);
-    // check if send success, otherwise enqueue this.
-    if (err_code == NRF_ERROR_RESOURCES)
+    CRITICAL_REGION_ENTER();
+    *p_histogram = latency_histogram[report_index];
+    CRITICAL_REGION_EXIT();
+    return true;
+}
+
+void ble_hid_latency_reset(void)
+{
+    CRITICAL_REGION_ENTER();
+    memset(latency_histogram, 0, sizeof(latency_histogram));
+    CRITICAL_REGION_EXIT();
+}
+
+/**@brief Function for sending all the latency histograms over the raw stream.
+ *
+ * @details For every input report: the report id followed by its ble_hid_latency_histogram_t (little endian).
+ *
+ * @return false if the raw stream is busy.
+ */
+bool ble_hid_latency_dump(void)
+{
+    if (!ble_hid_stream_open(NULL)) return false;
+
+    uint16_t len = 0;
+    CRITICAL_REGION_ENTER();
+    for (uint8_t report_id = 0; report_id < sizeof(hid_report_map_table); report_id++)
     {
-        return false;
+        uint8_t report_index = hid_report_map_table[report_id];
+        if (report_index == INPUT_REP_INDEX_INVALID) continue;
+
+        latency_dump_buff[len++] = report_id;
+        memcpy(&latency_dump_buff[len], &latency_histogram[report_index], sizeof(ble_hid_latency_histogram_t));
+        len += sizeof(ble_hid_latency_histogram_t);
     }
+    CRITICAL_REGION_EXIT();
 
-    if ((err_code != NRF_SUCCESS) && (err_code != NRF_ERROR_INVALID_STATE) && (err_code != NRF_ERROR_RESOURCES) && (err_code != NRF_ERROR_BUSY) &&
-        (err_code != BLE_ERROR_GATTS_SYS_ATTR_MISSING) && (err_code != NRF_ERROR_FORBIDDEN))
+    ble_hid_stream_write(latency_dump_buff, len);
+    ble_hid_stream_close();
+    return true;
+}
+
+/**@brief Function for getting a latency percentile from a histogram.
+ *
+ * @details The result is the upper limit of the bucket holding the percentile, or the longest latency
+ *          measured for the last bucket.
+ */
+static uint32_t latency_histogram_percentile(const ble_hid_latency_histogram_t *p_histogram, uint8_t percent)
+{
+    if (p_histogram->total == 0) return 0;
+
+    uint32_t rank = (uint32_t)(((uint64_t)p_histogram->total * percent + 99) / 100);
+    uint32_t cumulated = 0;
+
+    for (uint8_t bucket = 0; bucket < BLE_HID_LATENCY_BUCKETS - 1; bucket++)
     {
-        APP_ERROR_HANDLER(err_code);
+        cumulated += p_histogram->count[bucket];
+        if (cumulated >= rank)
+        {
+            return MIN(latency_bucket_limits_ms[bucket], p_histogram->max_ms);
+        }
     }
+    return p_histogram->max_ms;
+}
+
+/**@brief Function for getting a latency percentile of a report.
+ *
+ * @param[in]   report_id   Report ID.
+ * @param[in]   percent     Percentile, 1 to 100.
+ * @param[out]  p_ms        Latency in ms.
+ *
+ * @return false if the report id is not valid.
+ */
+bool ble_hid_latency_percentile(uint8_t report_id, uint8_t percent, uint32_t *p_ms)
+{
+    ble_hid_latency_histogram_t histogram;
+
+    if (!ble_hid_latency_snapshot(report_id, &histogram)) return false;
+
+    *p_ms = latency_histogram_percentile(&histogram, MIN(percent, 100));
     return true;
 }
 
+/**@brief Function for getting the send path figures since the last ble_hid_perf_reset().
+ *
+ * @details Used to compare firmware builds on a repeatable workload (typing, mouse, macro or raw dump).
+ *
+ * @param[in]   elapsed_ms   Length of the measurement window, used for the rates.
+ * @param[out]  p_perf       Figures.
+ */
+void ble_hid_perf_get(uint32_t elapsed_ms, ble_hid_perf_t *p_perf)
+{
+    ble_hid_latency_histogram_t all;
+
+    memset(&all, 0, sizeof(all));
+    memset(p_perf, 0, sizeof(ble_hid_perf_t));
+
+    CRITICAL_REGION_ENTER();
+    for (uint8_t i = 0; i < INPUT_REP_COUNT; i++)
+    {
+        for (uint8_t bucket = 0; bucket < BLE_HID_LATENCY_BUCKETS; bucket++)
+        {
+            all.count[bucket] += latency_histogram[i].count[bucket];
+        }
+        all.total += latency_histogram[i].total;
+        all.max_ms = MAX(all.max_ms, latency_histogram[i].max_ms);
+    }
+    p_perf->submitted = reports_submitted;
+    p_perf->queue_high_water = tx_queue_stats.high_water;
+    if (reports_submitted > 0)
+    {
+        p_perf->drop_permille = (uint16_t)(((uint64_t)tx_queue_stats.dropped * 1000) / reports_submitted);
+    }
+    CRITICAL_REGION_EXIT();
+
+    p_perf->completed = all.total;
+    if (elapsed_ms > 0)
+    {
+        p_perf->reports_per_sec = (uint32_t)(((uint64_t)all.total * 1000) / elapsed_ms);
+    }
+    p_perf->p50_ms = latency_histogram_percentile(&all, 50);
+    p_perf->p99_ms = latency_histogram_percentile(&all, 99);
+}
+
+/**@brief Function for starting a new measurement window.
+ *
+ * @details Clears the latency histograms and the pending queue counters.
+ */
+void ble_hid_perf_reset(void)
+{
+    ble_hid_latency_reset();
+    ble_hid_tx_queue_stats_reset();
+
+    CRITICAL_REGION_ENTER();
+    reports_submitted = 0;
+    CRITICAL_REGION_EXIT();
+}
+
 void ble_set_report_descriptor(const uint8_t *desc_report, uint16_t len)
 {
     hid_desc_report = desc_report;
     hid_desc_report_len = len;
 }
+
+/**@brief Function for registering the raw output report handler.
+ *
+ * @details The handler runs from the high priority scheduler class, in ble_run(), and gets
+ *          the report in place; the data is only valid until it returns. Without a handler the weak
+ *          callBackRawHID() is called.
+ *
+ * @param[in]   handler   Handler, NULL to go back to callBackRawHID().
+ */
+void ble_hid_raw_output_handler_set(ble_hid_raw_output_handler_t handler)
+{
+    raw_output_handler = handler;
+}
+
+/**@brief Function for getting how many raw output reports can still be received before dropping.
+ *
+ * @details Protocols sending large uploads from the host can use it to pace their acknowledgements.
+ */
+uint8_t ble_hid_raw_output_free_get(void)
+{
+    return BLE_HID_RAW_OUTPUT_SLOTS - raw_output_count;
+}
+
+void ble_hid_raw_output_stats_get(ble_hid_raw_output_stats_t *p_stats)
+{
+    CRITICAL_REGION_ENTER();
+    *p_stats = raw_output_stats;
+    CRITICAL_REGION_EXIT();
+}
+
+void ble_hid_raw_output_stats_reset(void)
+{
+    CRITICAL_REGION_ENTER();
+    memset(&raw_output_stats, 0, sizeof(raw_output_stats));
+    raw_output_stats.high_water = raw_output_count;
+    CRITICAL_REGION_EXIT();
+}
+
+/**@brief Function for getting the memory and GATT attributes used by the configured service.
+ *
+ * @details Report counts and attributes follow the parsed report descriptor once hids_init() has run, the
+ *          build time configuration before. Link context bytes do not include the SDK boot report buffers.
+ */
+void ble_hid_memory_get(ble_hid_memory_t *p_memory)
+{
+    memset(p_memory, 0, sizeof(ble_hid_memory_t));
+
+    p_memory->input_reports = (input_rep_count != 0) ? input_rep_count : INPUT_REP_COUNT;
+    p_memory->output_reports = (input_rep_count != 0) ? output_rep_count : OUTPUT_REP_COUNT;
+
+    // Service declaration, HID Information, Control Point and Report Map (declaration and value each).
+    p_memory->gatt_attributes = 1 + 2 + 2 + 2;
+    // Input reports: declaration, value, CCCD and report reference. Output reports have no CCCD.
+    p_memory->gatt_attributes += 4 * p_memory->input_reports + 3 * p_memory->output_reports;
+    if (BLE_HID_BOOT_KEYBOARD_ENABLED || BLE_HID_BOOT_MOUSE_ENABLED)
+    {
+        p_memory->gatt_attributes += 2; // Protocol Mode
+    }
+    if (BLE_HID_BOOT_KEYBOARD_ENABLED)
+    {
+        p_memory->gatt_attributes += 3 + 2; // Boot keyboard input and output
+    }
+    if (BLE_HID_BOOT_MOUSE_ENABLED)
+    {
+        p_memory->gatt_attributes += 3; // Boot mouse input
+    }
+
+    p_memory->link_ctx_bytes = NRF_SDH_BLE_TOTAL_LINK_COUNT * REPORTS_ROOM;
+    p_memory->tx_queue_bytes = sizeof(tx_queue) + sizeof(tx_fifos);
+    p_memory->preconn_bytes = (BLE_HID_PRECONN_BUFFER_SIZE > 0) ? sizeof(preconn_buffer) : 0;
+    p_memory->raw_buffers_bytes = sizeof(stream_chunk) + sizeof(raw_output_ring);
+}
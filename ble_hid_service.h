@@ -7,12 +7,253 @@ extern "C"
 #include <stdbool.h>
 #include <stdint.h>
 
+/*
+ * Reports built into the service. A disabled report takes no room in the link context and no GATT attributes,
+ * and a report descriptor describing it is rejected.
+ */
+#ifndef BLE_HID_KEYBOARD_ENABLED
+#define BLE_HID_KEYBOARD_ENABLED 1
+#endif
+
+#ifndef BLE_HID_MOUSE_ENABLED
+#define BLE_HID_MOUSE_ENABLED 1
+#endif
+
+#ifndef BLE_HID_CONSUMER_ENABLED
+#define BLE_HID_CONSUMER_ENABLED 1
+#endif
+
+#ifndef BLE_HID_SYSTEM_ENABLED
+#define BLE_HID_SYSTEM_ENABLED 1
+#endif
+
+#ifndef BLE_HID_RAW_ENABLED
+#define BLE_HID_RAW_ENABLED 1
+#endif
+
+#ifndef BLE_HID_BOOT_KEYBOARD_ENABLED
+#define BLE_HID_BOOT_KEYBOARD_ENABLED BLE_HID_KEYBOARD_ENABLED /**< Boot keyboard input and output characteristics. */
+#endif
+
+#ifndef BLE_HID_BOOT_MOUSE_ENABLED
+#define BLE_HID_BOOT_MOUSE_ENABLED BLE_HID_MOUSE_ENABLED /**< Boot mouse input characteristic. */
+#endif
+
+#ifndef INPUT_REPORT_LEN_RAW
 #define INPUT_REPORT_LEN_RAW 200  /**< Maximum length of the Input Report characteristic. */
+#endif
+#ifndef OUTPUT_REPORT_LEN_RAW
 #define OUTPUT_REPORT_LEN_RAW 200 /**< Maximum length of Output Report. */
+#endif
+
+#ifndef BLE_HID_REPORT_ID_MAX
+#define BLE_HID_REPORT_ID_MAX 15 /**< Highest report ID accepted in the report descriptor. */
+#endif
+
+#ifndef BLE_HID_TX_QUEUE_SIZE
+#define BLE_HID_TX_QUEUE_SIZE 8 /**< Number of input reports that can wait for a free SoftDevice TX buffer. */
+#endif
+
+#ifndef BLE_HID_STREAM_SEGMENTS
+#define BLE_HID_STREAM_SEGMENTS 4 /**< Number of buffers that can be written to the raw stream before they are sent. */
+#endif
+
+#ifndef BLE_HID_INFLIGHT_SIZE
+#define BLE_HID_INFLIGHT_SIZE 16 /**< Notifications waiting for BLE_GATTS_EVT_HVN_TX_COMPLETE that are timed. */
+#endif
+
+#ifndef BLE_HID_TX_CREDITS
+#define BLE_HID_TX_CREDITS 1 /**< SoftDevice HVN TX queue size of a link until ble_hid_tx_credits_set() is called. */
+#endif
+
+#ifndef BLE_HID_TX_KEY_RESERVE
+#define BLE_HID_TX_KEY_RESERVE 1 /**< Credits only key reports can use, when there are more credits than this. */
+#endif
+
+#ifndef BLE_HID_TX_STARVATION_LIMIT
+#define BLE_HID_TX_STARVATION_LIMIT 8 /**< Times a class with data is passed over before it is served first once. */
+#endif
+
+#ifndef BLE_HID_PRECONN_BUFFER_SIZE
+#define BLE_HID_PRECONN_BUFFER_SIZE 16 /**< Input reports kept while the link is not encrypted, 0 to disable. */
+#endif
+
+#ifndef BLE_HID_PRECONN_MAX_AGE_MS
+#define BLE_HID_PRECONN_MAX_AGE_MS 2000 /**< Reports kept longer are not replayed, see ble_hid_preconn_max_age_set(). */
+#endif
+#define BLE_HID_PRECONN_MAX_AGE_LIMIT_MS 60000 /**< Highest maximum age, well below the app_timer counter wrap. */
+
+#ifndef BLE_HID_RAW_OUTPUT_SLOTS
+#define BLE_HID_RAW_OUTPUT_SLOTS 4 /**< Raw output reports that can wait for the application. */
+#endif
+
+/** Upper limits of the report latency histogram buckets, in ms. The last bucket has no upper limit. */
+#define BLE_HID_LATENCY_BUCKET_LIMITS_MS {5, 10, 15, 20, 30, 45, 60, 90, 120, 250}
+#define BLE_HID_LATENCY_BUCKETS 11
+
+/** Latency between ble_send_report() and BLE_GATTS_EVT_HVN_TX_COMPLETE for one report type */
+typedef struct
+{
+    uint32_t count[BLE_HID_LATENCY_BUCKETS]; /**< Reports per bucket. */
+    uint32_t total;                          /**< Reports measured. */
+    uint32_t max_ms;                         /**< Longest latency measured. */
+} ble_hid_latency_histogram_t;
+
+/** Send path figures over a measurement window, all report types together */
+typedef struct
+{
+    uint32_t submitted;         /**< Reports accepted by ble_send_report(). */
+    uint32_t completed;         /**< Reports whose notification was acknowledged by the TX complete event. */
+    uint32_t reports_per_sec;   /**< Completed reports per second. */
+    uint16_t drop_permille;     /**< Reports rejected because the pending queue was full, per thousand given. */
+    uint8_t queue_high_water;   /**< Pending queue high-water mark. */
+    uint32_t p50_ms;            /**< Median latency, upper limit of its histogram bucket. */
+    uint32_t p99_ms;            /**< 99th percentile latency, upper limit of its histogram bucket. */
+} ble_hid_perf_t;
+
+/** Raw stream completion result */
+typedef enum
+{
+    BLE_HID_STREAM_DONE,    /**< All the data was handed to the SoftDevice. */
+    BLE_HID_STREAM_ABORTED, /**< The link was lost, or a chunk refused by the SoftDevice, before all the data was sent. */
+} ble_hid_stream_result_t;
+
+/** Raw stream completion handler
+ *
+ * @param result: how the stream ended
+ * @param bytes_sent: payload bytes handed to the SoftDevice, sequence numbers excluded
+ */
+typedef void (*ble_hid_stream_handler_t)(ble_hid_stream_result_t result, uint32_t bytes_sent);
+
+/** Pending input report queue counters */
+typedef struct
+{
+    uint8_t depth;       /**< Reports currently waiting for a TX buffer. */
+    uint8_t high_water;  /**< Maximum depth reached since the last reset. */
+    uint32_t enqueued;   /**< Reports that could not be sent right away and were queued. */
+    uint32_t dropped;    /**< Reports rejected because the queue was full. */
+    uint32_t coalesced;  /**< Reports merged into a queued report of the same type. */
+    uint32_t duplicates; /**< State reports dropped because they matched the last one. */
+} ble_hid_tx_queue_stats_t;
+
+/** Pre-connection input buffer counters */
+typedef struct
+{
+    uint32_t buffered;  /**< Reports kept because the link was not encrypted yet. */
+    uint32_t replayed;  /**< Kept reports sent or queued once the link was encrypted. */
+    uint32_t expired;   /**< Kept reports older than the maximum age. */
+    uint32_t dropped;   /**< Oldest reports discarded because the buffer was full. */
+    uint32_t discarded; /**< Kept reports no host took: advertising stopped, not subscribed or refused once encrypted. */
+    uint8_t high_water; /**< Maximum number of reports kept since the last reset. */
+} ble_hid_preconn_stats_t;
+
+/** Notification traffic classes, in priority order */
+typedef enum
+{
+    BLE_HID_TX_CLASS_KEY,     /**< Keyboard reports. */
+    BLE_HID_TX_CLASS_POINTER, /**< Mouse reports. */
+    BLE_HID_TX_CLASS_CONTROL, /**< Consumer and system control reports. */
+    BLE_HID_TX_CLASS_RAW,     /**< Raw reports and the raw stream. */
+    BLE_HID_TX_CLASS_BATTERY, /**< Notifications of the battery service. */
+    BLE_HID_TX_CLASS_COUNT
+} ble_hid_tx_class_t;
+
+/** TX arbiter counters of one class */
+typedef struct
+{
+    uint32_t sent;        /**< Notifications handed to the SoftDevice. */
+    uint32_t queued;      /**< Reports that had to wait for a credit. */
+    uint32_t passed_over; /**< Times the class had data while a higher class was served. */
+    uint32_t starved;     /**< Times the class went first after being passed over BLE_HID_TX_STARVATION_LIMIT times. */
+} ble_hid_tx_class_stats_t;
+
+/** Raw output report counters */
+typedef struct
+{
+    uint32_t received;   /**< Raw output reports written by the host. */
+    uint32_t delivered;  /**< Reports handed to the application. */
+    uint32_t dropped;    /**< Reports lost because every slot was taken or the report could not be read. */
+    uint32_t backlogged; /**< Reports received while others were still waiting for the application. */
+    uint8_t high_water;  /**< Maximum number of slots used since the last reset. */
+} ble_hid_raw_output_stats_t;
+
+/** Result of ble_hid_report_send() */
+typedef enum
+{
+    BLE_HID_SEND_OK,             /**< Handed to the SoftDevice. */
+    BLE_HID_SEND_QUEUED,         /**< Waiting for a free TX buffer, or merged into a waiting report. */
+    BLE_HID_SEND_BUFFERED,       /**< Kept until the link is encrypted, or behind reports kept before. */
+    BLE_HID_SEND_DUPLICATE,      /**< Same state as the last report, nothing to send. */
+    BLE_HID_SEND_INVALID,        /**< Unknown report ID or report too long. */
+    BLE_HID_SEND_NOT_CONNECTED,  /**< No active link. */
+    BLE_HID_SEND_NOT_SUBSCRIBED, /**< The host has not enabled notifications of this report (yet). */
+    BLE_HID_SEND_QUEUE_FULL,     /**< No free TX buffer and the pending queue is full, or the replay buffer is full. */
+    BLE_HID_SEND_REJECTED,       /**< Refused by the SoftDevice, the link state changed. */
+} ble_hid_send_status_t;
+
+/** Memory and GATT attributes used by the configured service */
+typedef struct
+{
+    uint8_t input_reports;      /**< Input report characteristics. */
+    uint8_t output_reports;     /**< Output report characteristics. */
+    uint16_t gatt_attributes;   /**< Attributes added to the SoftDevice GATT table. */
+    uint32_t link_ctx_bytes;    /**< Report values stored for all the links. */
+    uint32_t tx_queue_bytes;    /**< Pending input report queue. */
+    uint32_t preconn_bytes;     /**< Pre-connection input buffer. */
+    uint32_t raw_buffers_bytes; /**< Raw stream chunk and raw output slots. */
+} ble_hid_memory_t;
+
+/**
+ * Raw output report handler.
+ * p_data is only valid until the handler returns.
+ */
+typedef void (*ble_hid_raw_output_handler_t)(uint8_t const *p_data, uint16_t len);
 
 void hids_init();
 void ble_set_report_descriptor(const uint8_t *desc_report, uint16_t len);
 bool ble_send_report(uint8_t report_id, const uint8_t *p_key_pattern,uint8_t key_pattern_len);
+ble_hid_send_status_t ble_hid_report_send(uint8_t report_id, const uint8_t *p_data, uint8_t len);
+bool ble_hid_report_subscribed(uint8_t report_id);
+void ble_hid_cccd_restore(uint16_t conn_handle);
+void ble_hid_link_reset(uint16_t conn_handle);
+void ble_hid_keyboard_led_select(uint16_t conn_handle);
+void ble_hid_keys_release(void);
+
+uint8_t ble_hid_raw_report_len_get(void);
+bool ble_hid_stream_open(ble_hid_stream_handler_t handler);
+bool ble_hid_stream_write(const uint8_t *p_data, uint32_t len);
+bool ble_hid_stream_close(void);
+bool ble_hid_stream_busy(void);
+
+bool ble_hid_latency_snapshot(uint8_t report_id, ble_hid_latency_histogram_t *p_histogram);
+void ble_hid_latency_reset(void);
+bool ble_hid_latency_dump(void);
+bool ble_hid_latency_percentile(uint8_t report_id, uint8_t percent, uint32_t *p_ms);
+void ble_hid_perf_get(uint32_t elapsed_ms, ble_hid_perf_t *p_perf);
+void ble_hid_perf_reset(void);
+void ble_hid_tx_track_external(void);
+void ble_hid_tx_credits_set(uint8_t credits);
+bool ble_hid_tx_external_allowed(void);
+bool ble_hid_tx_idle(void);
+void ble_hid_tx_class_stats_get(ble_hid_tx_class_t tx_class, ble_hid_tx_class_stats_t *p_stats);
+void ble_hid_tx_class_stats_reset(void);
+
+void ble_hid_on_hvn_tx_complete(uint16_t conn_handle, uint8_t count);
+void ble_hid_tx_queue_flush(void);
+void ble_hid_tx_queue_stats_get(ble_hid_tx_queue_stats_t *p_stats);
+void ble_hid_tx_queue_stats_reset(void);
+void ble_hid_duplicate_filter_set(bool enable);
+void ble_hid_preconn_max_age_set(uint32_t max_age_ms);
+void ble_hid_preconn_flush(void);
+void ble_hid_preconn_stats_get(ble_hid_preconn_stats_t *p_stats);
+void ble_hid_preconn_stats_reset(void);
+
+void ble_hid_raw_output_handler_set(ble_hid_raw_output_handler_t handler);
+uint8_t ble_hid_raw_output_free_get(void);
+void ble_hid_raw_output_stats_get(ble_hid_raw_output_stats_t *p_stats);
+void ble_hid_raw_output_stats_reset(void);
+
+void ble_hid_memory_get(ble_hid_memory_t *p_memory);
 
 /** Quick HID param setup macro
  * 
@@ -0,0 +1,137 @@
+/*
+ * Duplicate filter on a typing trace: the firmware sends its keyboard, consumer and system reports on every key
+ * event, mostly unchanged. Prints the notifications the filter saves and the host CPU time of a send with the
+ * filter on and off. The trace follows that send pattern, it is not a capture.
+ */
+#include <time.h>
+
+#include "test.h"
+
+#define TRACE_TEXT "the quick brown fox jumps over the lazy dog"
+#define TRACE_REPEATS 20
+#define KEY_HOLD_MS 60
+#define KEY_PERIOD_MS 110
+
+typedef struct
+{
+    uint32_t calls;
+    uint32_t notifications;
+    uint32_t duplicates;
+    uint64_t send_ns;
+} trace_result_t;
+
+static uint8_t keyboard[DESC_REPORT_LEN_KEYBOARD];
+static uint8_t const consumer[DESC_REPORT_LEN_CONSUMER];
+static uint8_t const system_control[DESC_REPORT_LEN_SYSTEM];
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* Usage of a letter or the space bar. */
+static uint8_t key_usage(char c)
+{
+    return (c == ' ') ? 0x2C : (uint8_t)(0x04 + (c - 'a'));
+}
+
+/* Sends the three state reports of a key event, as the firmware's report loop does. */
+static void key_event_send(uint8_t key, bool pressed, trace_result_t *p_result)
+{
+    uint8_t const byte = 1 + key / 8;
+    uint8_t const bit = (uint8_t)(1U << (key % 8));
+
+    keyboard[byte] = pressed ? (keyboard[byte] | bit) : (keyboard[byte] & ~bit);
+
+    uint64_t const start_ns = now_ns();
+    ble_hid_report_send(DESC_REPORT_ID_KEYBOARD, keyboard, sizeof(keyboard));
+    ble_hid_report_send(DESC_REPORT_ID_CONSUMER, consumer, sizeof(consumer));
+    ble_hid_report_send(DESC_REPORT_ID_SYSTEM, system_control, sizeof(system_control));
+    p_result->send_ns += now_ns() - start_ns;
+    p_result->calls += 3;
+}
+
+/* Runs the trace TRACE_REPEATS times, a millisecond at a time with a connection event every interval. */
+static void trace_run(bool filter, trace_result_t *p_result)
+{
+    uint32_t const chars = sizeof(TRACE_TEXT) - 1;
+    uint32_t const run_ms = TRACE_REPEATS * chars * KEY_PERIOD_MS;
+    uint32_t const interval_us = 7500;
+    ble_hid_tx_class_stats_t key_stats;
+    ble_hid_tx_class_stats_t control_stats;
+    ble_hid_tx_queue_stats_t queue_stats;
+
+    memset(p_result, 0, sizeof(*p_result));
+    memset(keyboard, 0, sizeof(keyboard));
+    ble_hid_duplicate_filter_set(filter);
+    fixture_drain(0);
+    ble_hid_tx_class_stats_reset();
+    ble_hid_tx_queue_stats_reset();
+
+    uint64_t next_event_us = sim_time_us() + interval_us;
+    for (uint32_t ms = 0; ms < run_ms; ms++)
+    {
+        uint32_t const phase = ms % KEY_PERIOD_MS;
+        uint8_t const key = key_usage(TRACE_TEXT[(ms / KEY_PERIOD_MS) % chars]);
+
+        if ((phase == 0) || (phase == KEY_HOLD_MS))
+        {
+            key_event_send(key, phase == 0, p_result);
+        }
+        ble_run();
+
+        sim_time_advance_us(1000);
+        if (sim_time_us() >= next_event_us)
+        {
+            sim_conn_event_run();
+            next_event_us += interval_us;
+        }
+    }
+    fixture_drain(0);
+
+    ble_hid_tx_class_stats_get(BLE_HID_TX_CLASS_KEY, &key_stats);
+    ble_hid_tx_class_stats_get(BLE_HID_TX_CLASS_CONTROL, &control_stats);
+    ble_hid_tx_queue_stats_get(&queue_stats);
+    p_result->notifications = key_stats.sent + control_stats.sent;
+    p_result->duplicates = queue_stats.duplicates;
+}
+
+static void result_print(char const *p_name, trace_result_t const *p_result)
+{
+    printf("%-8s %7u %13u %10u %8.1f\n", p_name, p_result->calls, p_result->notifications, p_result->duplicates,
+           (double)p_result->send_ns / p_result->calls);
+}
+
+int main(void)
+{
+    sim_config_t const config = {.hvn_tx_queue_size = 1, .tx_per_conn_event = 1, .conn_interval_us = 7500};
+    trace_result_t off;
+    trace_result_t on;
+
+    fixture_init(&config);
+    fixture_link_up(0);
+
+    // First run only warms the caches.
+    trace_run(true, &on);
+    trace_run(false, &off);
+    trace_run(true, &on);
+
+    printf("%-8s %7s %13s %10s %8s\n", "filter", "calls", "notifications", "duplicates", "ns/call");
+    result_print("off", &off);
+    result_print("on", &on);
+    printf("notifications saved: %u (%.1f%%), cost: %+.1f ns/call\n", off.notifications - on.notifications,
+           100.0 * (off.notifications - on.notifications) / off.notifications,
+           ((double)on.send_ns / on.calls) - ((double)off.send_ns / off.calls));
+
+    // Every key event changes the keyboard report only: two thirds of the calls repeat the host's state.
+    CHECK_EQ(off.notifications, off.calls);
+    CHECK_EQ(on.duplicates, off.calls - on.notifications);
+    CHECK(on.notifications <= off.calls / 3 + 2);
+
+    ble_hid_duplicate_filter_set(true);
+    CHECK_EQ(sim_app_error_count(), 0);
+    return TEST_RESULT();
+}
@@ -0,0 +1,121 @@
+/*
+ * Raw HID throughput on a simulated link: the configurator's bulk stream with the default ATT MTU and data length,
+ * then with what a central negotiates. Prints the bytes per second of each.
+ */
+#include "test.h"
+
+#define BULK_LEN 16384
+#define BULK_WRITE_LEN 1024
+#define RAW_REPORT_LEN 200 /* Raw report of the configurator, INPUT_REPORT_LEN_RAW. */
+
+/* Raw HID only, 200 bytes each way. */
+static uint8_t const desc_raw_bulk[] = {
+    0x06, 0x00, 0xFF, 0x09, 0x01, 0xA1, 0x01, 0x85, DESC_REPORT_ID_RAW,
+    0x15, 0x00, 0x26, 0xFF, 0x00, 0x75, 0x08,
+    0x95, RAW_REPORT_LEN, 0x09, 0x02, 0x81, 0x02,
+    0x95, RAW_REPORT_LEN, 0x09, 0x03, 0x91, 0x02,
+    0xC0,
+};
+
+typedef struct
+{
+    char const *name;
+    uint16_t att_mtu;
+    uint8_t data_length;
+} link_case_t;
+
+static link_case_t const link_cases[] = {
+    {"default", BLE_GATT_ATT_MTU_DEFAULT, BLE_GAP_DATA_LENGTH_DEFAULT},
+    {"mtu only", BLE_GATT_PREFERRED_ATT_MTU, BLE_GAP_DATA_LENGTH_DEFAULT},
+    {"negotiated", BLE_GATT_PREFERRED_ATT_MTU, BLE_GAP_PREFERRED_DATA_LENGTH},
+};
+
+static uint8_t bulk_data[BULK_LEN];
+static bool bulk_done;
+static uint32_t bulk_sent;
+
+static void bulk_handler(ble_hid_stream_result_t result, uint32_t bytes_sent)
+{
+    CHECK_EQ(result, BLE_HID_STREAM_DONE);
+    bulk_done = true;
+    bulk_sent = bytes_sent;
+}
+
+/* Streams BULK_LEN bytes, writing them as the stream takes them, and returns the bytes per second. */
+static uint32_t bulk_bytes_per_s(void)
+{
+    uint64_t const start_us = sim_time_us();
+    uint32_t written = 0;
+
+    bulk_done = false;
+    CHECK(ble_hid_stream_open(bulk_handler));
+    for (uint32_t i = 0; (i < 100000) && !bulk_done; i++)
+    {
+        while ((written < BULK_LEN) && ble_hid_stream_write(&bulk_data[written], BULK_WRITE_LEN))
+        {
+            written += BULK_WRITE_LEN;
+            if (written == BULK_LEN)
+            {
+                CHECK(ble_hid_stream_close());
+            }
+        }
+        ble_run();
+        sim_conn_event();
+    }
+    CHECK(bulk_done);
+    CHECK_EQ(bulk_sent, BULK_LEN);
+
+    return (uint32_t)(((uint64_t)bulk_sent * 1000000) / (sim_time_us() - start_us));
+}
+
+static uint32_t bench_link(link_case_t const *p_case)
+{
+    uint16_t const conn_handle = 0;
+
+    fixture_link_up(conn_handle);
+    if ((p_case->att_mtu != BLE_GATT_ATT_MTU_DEFAULT) || (p_case->data_length != BLE_GAP_DATA_LENGTH_DEFAULT))
+    {
+        sim_gatt_negotiate(conn_handle, p_case->att_mtu, p_case->data_length);
+    }
+    CHECK_EQ(ble_gatt_att_mtu_get(conn_handle), p_case->att_mtu);
+    CHECK_EQ(ble_gatt_data_length_get(conn_handle), p_case->data_length);
+
+    uint8_t const chunk = ble_hid_raw_report_len_get();
+    CHECK_EQ(chunk, MIN(p_case->att_mtu - 3, RAW_REPORT_LEN));
+
+    uint32_t const bytes_per_s = bulk_bytes_per_s();
+    printf("%-12s %7u %8u %6u %10u\n", p_case->name, p_case->att_mtu, p_case->data_length, chunk, bytes_per_s);
+
+    sim_disconnect(conn_handle);
+    return bytes_per_s;
+}
+
+int main(void)
+{
+    // Bulk stack profile: 8 TX buffers, connection events extended over the whole interval.
+    sim_config_t const config = {.hvn_tx_queue_size = 8, .tx_per_conn_event = UINT8_MAX, .conn_interval_us = 7500,
+                                 .conn_event_length_us = 7500};
+    uint32_t bytes_per_s[ARRAY_SIZE(link_cases)];
+
+    for (uint32_t i = 0; i < BULK_LEN; i++)
+    {
+        bulk_data[i] = (uint8_t)i;
+    }
+
+    sim_reset(&config);
+    CHECK_EQ(ble_stack_profile_set(BLE_STACK_PROFILE_BULK), NRF_SUCCESS);
+    ble_set_report_descriptor(desc_raw_bulk, sizeof(desc_raw_bulk));
+    ble_module_init();
+
+    printf("%-12s %7s %8s %6s %10s\n", "link", "att_mtu", "data_len", "chunk", "bytes/s");
+    for (uint8_t i = 0; i < ARRAY_SIZE(link_cases); i++)
+    {
+        bytes_per_s[i] = bench_link(&link_cases[i]);
+    }
+    printf("negotiated / default: %.1fx\n", (double)bytes_per_s[2] / bytes_per_s[0]);
+
+    CHECK(bytes_per_s[1] > bytes_per_s[0]);
+    CHECK(bytes_per_s[2] > bytes_per_s[1]);
+    CHECK_EQ(sim_app_error_count(), 0);
+    return TEST_RESULT();
+}
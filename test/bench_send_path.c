@@ -0,0 +1,174 @@
+/*
+ * Send path benchmark: typing bursts, 1 kHz mouse motion, macro playback and a raw dump, each over a sweep of
+ * connection interval, slave latency and SoftDevice TX queue depth. Prints the ble_hid_perf_get() figures of every
+ * run, and the connection events the link woke up for as the power cost. The simulation is deterministic, so the
+ * numbers only change with the firmware.
+ */
+#include "test.h"
+
+#define RUN_MS 2000
+
+typedef void (*workload_tick_t)(uint32_t ms);
+
+typedef struct
+{
+    char const *name;
+    workload_tick_t tick; /* Called once per millisecond of the run. */
+} workload_t;
+
+static uint8_t keyboard[DESC_REPORT_LEN_KEYBOARD];
+
+static void key_set(uint8_t key, bool pressed)
+{
+    uint8_t const byte = 1 + key / 8;
+    uint8_t const bit = (uint8_t)(1U << (key % 8));
+
+    keyboard[byte] = pressed ? (keyboard[byte] | bit) : (keyboard[byte] & ~bit);
+    ble_hid_report_send(DESC_REPORT_ID_KEYBOARD, keyboard, sizeof(keyboard));
+}
+
+/* Bursts of 12 keys 25 ms apart, each held 40 ms so they roll over, then 400 ms of reading. */
+static void typing_tick(uint32_t ms)
+{
+    uint32_t const phase = ms % 700;
+    if (phase >= 340) return;
+
+    uint8_t const key = (uint8_t)(4 + (ms / 700 * 12 + phase / 25) % 26);
+    if ((phase % 25 == 0) && (phase < 300))
+    {
+        key_set(key, true);
+    }
+    if ((phase >= 40) && ((phase - 40) % 25 == 0))
+    {
+        key_set((uint8_t)(4 + (ms / 700 * 12 + (phase - 40) / 25) % 26), false);
+    }
+}
+
+/* Gaming mouse: a motion report every millisecond. */
+static void mouse_tick(uint32_t ms)
+{
+    int8_t const dx = (int8_t)(((ms / 100) % 2 == 0) ? 3 : -3);
+    uint8_t report[DESC_REPORT_LEN_MOUSE] = {0x00, (uint8_t)dx, 0xFE, 0x00, 0x00};
+
+    ble_hid_report_send(DESC_REPORT_ID_MOUSE, report, sizeof(report));
+}
+
+/* Macro playback: 16 keys pressed and released back to back, every 250 ms. */
+static void macro_tick(uint32_t ms)
+{
+    if (ms % 250 != 0) return;
+
+    for (uint8_t i = 0; i < 16; i++)
+    {
+        key_set((uint8_t)(4 + i), true);
+        key_set((uint8_t)(4 + i), false);
+    }
+}
+
+/* Raw dump: a full raw report every millisecond. */
+static void raw_tick(uint32_t ms)
+{
+    uint8_t report[DESC_REPORT_LEN_RAW];
+
+    memset(report, (uint8_t)ms, sizeof(report));
+    ble_hid_report_send(DESC_REPORT_ID_RAW, report, ble_hid_raw_report_len_get());
+}
+
+static workload_t const workloads[] = {
+    {"typing", typing_tick},
+    {"mouse_1khz", mouse_tick},
+    {"macro", macro_tick},
+    {"raw_dump", raw_tick},
+};
+
+static uint32_t const conn_intervals_us[] = {7500, 15000, 30000};
+static uint8_t const queue_depths[] = {1, 4, 8};
+
+typedef struct
+{
+    uint16_t slave_latency;
+    bool auto_disable; /* ble_slave_latency_auto_set(), off to keep the latency while typing. */
+} latency_case_t;
+
+static latency_case_t const latency_cases[] = {{0, true}, {4, true}, {4, false}};
+
+/* Runs a workload for RUN_MS on its own timeline: a tick every millisecond, a connection event every interval. */
+static void bench_run(workload_t const *p_workload, sim_config_t const *p_config, bool latency_auto)
+{
+    ble_hid_perf_t perf;
+
+    sim_reset(p_config);
+    ble_slave_latency_auto_set(latency_auto);
+    ble_hid_tx_credits_set(p_config->hvn_tx_queue_size);
+    memset(keyboard, 0, sizeof(keyboard));
+    fixture_drain(0);
+    ble_hid_perf_reset();
+
+    uint64_t const start_us = sim_time_us();
+    uint64_t next_tick_us = 0;
+    uint64_t next_event_us = p_config->conn_interval_us;
+    while (next_tick_us < RUN_MS * 1000ULL)
+    {
+        uint64_t const now_us = MIN(next_tick_us, next_event_us);
+        sim_time_advance_us((uint32_t)(start_us + now_us - sim_time_us()));
+
+        if (now_us == next_tick_us)
+        {
+            p_workload->tick((uint32_t)(next_tick_us / 1000));
+            next_tick_us += 1000;
+        }
+        if (now_us == next_event_us)
+        {
+            sim_conn_event_run();
+            next_event_us += p_config->conn_interval_us;
+        }
+        ble_run();
+    }
+    ble_hid_perf_get(RUN_MS, &perf);
+    uint32_t const wakeups_per_s = sim_conn_events_attended(0) * 1000 / RUN_MS;
+
+    // Release what the workload left pressed so the next run starts from an idle host.
+    memset(keyboard, 0, sizeof(keyboard));
+    ble_hid_report_send(DESC_REPORT_ID_KEYBOARD, keyboard, sizeof(keyboard));
+    fixture_drain(0);
+
+    printf("%-10s %6.2f %7u %4s %5u %9u %7u.%u %4u %5u %5u %9u\n", p_workload->name, p_config->conn_interval_us / 1000.0,
+           p_config->slave_latency, latency_auto ? "on" : "off", p_config->hvn_tx_queue_size, perf.reports_per_sec,
+           perf.drop_permille / 10, perf.drop_permille % 10, perf.queue_high_water, perf.p50_ms, perf.p99_ms, wakeups_per_s);
+
+    CHECK(perf.completed > 0);
+    CHECK(perf.p50_ms <= perf.p99_ms);
+}
+
+int main(void)
+{
+    sim_config_t config = {.hvn_tx_queue_size = 1, .tx_per_conn_event = UINT8_MAX, .conn_interval_us = 7500,
+                           .conn_event_length_us = 7500};
+
+    fixture_init(&config);
+    fixture_link_up(0);
+
+    printf("%-10s %6s %7s %4s %5s %9s %8s %4s %5s %5s %9s\n", "workload", "ci_ms", "latency", "auto", "depth", "reports/s",
+           "drop_%", "hwm", "p50", "p99", "wakeups/s");
+    for (uint8_t w = 0; w < ARRAY_SIZE(workloads); w++)
+    {
+        for (uint8_t c = 0; c < ARRAY_SIZE(conn_intervals_us); c++)
+        {
+            for (uint8_t l = 0; l < ARRAY_SIZE(latency_cases); l++)
+            {
+                for (uint8_t d = 0; d < ARRAY_SIZE(queue_depths); d++)
+                {
+                    config.conn_interval_us = conn_intervals_us[c];
+                    config.conn_event_length_us = conn_intervals_us[c];
+                    config.slave_latency = latency_cases[l].slave_latency;
+                    config.hvn_tx_queue_size = queue_depths[d];
+                    bench_run(&workloads[w], &config, latency_cases[l].auto_disable);
+                }
+            }
+        }
+    }
+
+    ble_slave_latency_auto_set(true);
+    CHECK_EQ(sim_app_error_count(), 0);
+    return TEST_RESULT();
+}
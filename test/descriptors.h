@@ -0,0 +1,48 @@
+/*
+ * Report descriptor of the keyboard firmware: NKRO keyboard with LEDs, mouse, consumer, system control and raw HID.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#define DESC_REPORT_ID_KEYBOARD 1
+#define DESC_REPORT_ID_MOUSE 2
+#define DESC_REPORT_ID_CONSUMER 3
+#define DESC_REPORT_ID_SYSTEM 4
+#define DESC_REPORT_ID_RAW 5
+
+#define DESC_REPORT_LEN_KEYBOARD 29
+#define DESC_REPORT_LEN_MOUSE 5
+#define DESC_REPORT_LEN_CONSUMER 8
+#define DESC_REPORT_LEN_SYSTEM 1
+#define DESC_REPORT_LEN_RAW 32
+
+static uint8_t const desc_defy[] = {
+    // Keyboard: modifiers, 224 key bitmap, 5 LEDs.
+    0x05, 0x01, 0x09, 0x06, 0xA1, 0x01, 0x85, DESC_REPORT_ID_KEYBOARD,
+    0x05, 0x07, 0x19, 0xE0, 0x29, 0xE7, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x08, 0x81, 0x02,
+    0x19, 0x00, 0x29, 0xDF, 0x95, 0xE0, 0x81, 0x02,
+    0x05, 0x08, 0x19, 0x01, 0x29, 0x05, 0x95, 0x05, 0x91, 0x02, 0x75, 0x03, 0x95, 0x01, 0x91, 0x03,
+    0xC0,
+    // Mouse: 8 buttons, X, Y, wheel, pan.
+    0x05, 0x01, 0x09, 0x02, 0xA1, 0x01, 0x85, DESC_REPORT_ID_MOUSE,
+    0x09, 0x01, 0xA1, 0x00,
+    0x05, 0x09, 0x19, 0x01, 0x29, 0x08, 0x15, 0x00, 0x25, 0x01, 0x95, 0x08, 0x75, 0x01, 0x81, 0x02,
+    0x05, 0x01, 0x09, 0x30, 0x09, 0x31, 0x09, 0x38, 0x15, 0x81, 0x25, 0x7F, 0x75, 0x08, 0x95, 0x03, 0x81, 0x06,
+    0x05, 0x0C, 0x0A, 0x38, 0x02, 0x95, 0x01, 0x81, 0x06,
+    0xC0, 0xC0,
+    // Consumer control: 4 usages of 16 bits.
+    0x05, 0x0C, 0x09, 0x01, 0xA1, 0x01, 0x85, DESC_REPORT_ID_CONSUMER,
+    0x15, 0x00, 0x26, 0xFF, 0x03, 0x19, 0x00, 0x2A, 0xFF, 0x03, 0x95, 0x04, 0x75, 0x10, 0x81, 0x00,
+    0xC0,
+    // System control.
+    0x05, 0x01, 0x09, 0x80, 0xA1, 0x01, 0x85, DESC_REPORT_ID_SYSTEM,
+    0x15, 0x00, 0x26, 0xFF, 0x00, 0x19, 0x00, 0x29, 0xFF, 0x95, 0x01, 0x75, 0x08, 0x81, 0x00,
+    0xC0,
+    // Raw HID of the configurator, 32 bytes each way.
+    0x06, 0x00, 0xFF, 0x09, 0x01, 0xA1, 0x01, 0x85, DESC_REPORT_ID_RAW,
+    0x15, 0x00, 0x26, 0xFF, 0x00, 0x75, 0x08,
+    0x95, DESC_REPORT_LEN_RAW, 0x09, 0x02, 0x81, 0x02,
+    0x95, DESC_REPORT_LEN_RAW, 0x09, 0x03, 0x91, 0x02,
+    0xC0,
+};
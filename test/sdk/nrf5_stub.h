@@ -0,0 +1,336 @@
+/*
+ * Host stand-in for the nRF5 SDK 17.1 and S140 SoftDevice declarations used by the library.
+ *
+ * Only what Ble_composite_dev.c and ble_hid_service.c use is declared, with the SDK names and layouts
+ * simplified. The functions are implemented by the simulator in test/sim.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "sdk_config.h"
+
+typedef uint32_t ret_code_t;
+
+#define NRF_SUCCESS 0
+#define NRF_ERROR_NOT_FOUND 5
+#define NRF_ERROR_NOT_SUPPORTED 6
+#define NRF_ERROR_INVALID_PARAM 7
+#define NRF_ERROR_INVALID_STATE 8
+#define NRF_ERROR_INVALID_LENGTH 9
+#define NRF_ERROR_INVALID_DATA 11
+#define NRF_ERROR_DATA_SIZE 12
+#define NRF_ERROR_TIMEOUT 13
+#define NRF_ERROR_NULL 14
+#define NRF_ERROR_FORBIDDEN 15
+#define NRF_ERROR_BUSY 17
+#define NRF_ERROR_CONN_COUNT 18
+#define NRF_ERROR_RESOURCES 19
+#define NRF_ERROR_NO_MEM 4
+#define BLE_ERROR_INVALID_CONN_HANDLE 0x3002
+#define BLE_ERROR_INVALID_ADV_HANDLE 0x3005
+#define BLE_ERROR_GATTS_SYS_ATTR_MISSING 0x3401
+
+/* Errors given to APP_ERROR_CHECK are recorded by the simulator, tests check there was none. */
+void sim_app_error(uint32_t err_code, const char *file, int line);
+#define APP_ERROR_HANDLER(err_code) sim_app_error((err_code), __FILE__, __LINE__)
+#define APP_ERROR_CHECK(err_code)                             \
+    do                                                        \
+    {                                                         \
+        uint32_t const _err = (err_code);                     \
+        if (_err != NRF_SUCCESS)                              \
+        {                                                     \
+            sim_app_error(_err, __FILE__, __LINE__);          \
+        }                                                     \
+    } while (0)
+
+#define UNUSED_PARAMETER(x) (void)(x)
+#define UNUSED_VARIABLE(x) (void)(x)
+#define CRITICAL_REGION_ENTER() {
+#define CRITICAL_REGION_EXIT() }
+#ifndef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define STRINGIFY(x) #x
+#define MSEC_TO_UNITS(t, u) (((t) * 1000) / (u))
+#define UNIT_0_625_MS 625
+#define UNIT_1_25_MS 1250
+#define UNIT_10_MS 10000
+
+#define BLE_GATTS_ATTR_TAB_SIZE_DEFAULT 1408
+#define BLE_GATTS_HVN_TX_QUEUE_SIZE_DEFAULT 1
+#define BLE_CONN_HANDLE_INVALID 0xFFFF
+#define BLE_GATT_HANDLE_INVALID 0
+#define BLE_GAP_ADDR_LEN 6
+#define BLE_GAP_WHITELIST_ADDR_MAX_COUNT 8
+#define BLE_GAP_DEVICE_IDENTITIES_MAX_COUNT 8
+#define BLE_GAP_SEC_KEY_LEN 16
+#define BLE_GAP_ADV_SET_DATA_SIZE_MAX 31
+
+/* app_scheduler */
+typedef void (*app_sched_event_handler_t)(void *p_event_data, uint16_t event_size);
+uint32_t app_sched_event_put(void const *p_event_data, uint16_t event_size, app_sched_event_handler_t handler);
+void app_sched_execute(void);
+#define APP_SCHED_INIT(max_event_size, queue_size) do {} while (0)
+
+/* app_timer, a 24 bit RTC counter at 32768 Hz */
+#define APP_TIMER_CLOCK_FREQ 32768
+#define APP_TIMER_MIN_TIMEOUT_TICKS 5
+#define APP_TIMER_SCHED_EVENT_DATA_SIZE 8
+#define APP_TIMER_TICKS(ms) ((uint32_t)((((uint64_t)(ms) * APP_TIMER_CLOCK_FREQ) + 500) / (1000 * (APP_TIMER_CONFIG_RTC_FREQUENCY + 1))))
+typedef void (*app_timer_timeout_handler_t)(void *p_context);
+typedef enum { APP_TIMER_MODE_SINGLE_SHOT, APP_TIMER_MODE_REPEATED } app_timer_mode_t;
+typedef struct app_timer_s
+{
+    app_timer_timeout_handler_t handler;
+    app_timer_mode_t mode;
+    bool running;
+    uint64_t expiry;
+    uint32_t period;
+    void *p_context;
+} app_timer_t;
+typedef app_timer_t *app_timer_id_t;
+#define APP_TIMER_DEF(timer_id)              \
+    static app_timer_t timer_id##_data;      \
+    static const app_timer_id_t timer_id = &timer_id##_data
+ret_code_t app_timer_create(app_timer_id_t const *p_timer_id, app_timer_mode_t mode, app_timer_timeout_handler_t timeout_handler);
+ret_code_t app_timer_start(app_timer_id_t timer_id, uint32_t timeout_ticks, void *p_context);
+ret_code_t app_timer_stop(app_timer_id_t timer_id);
+uint32_t app_timer_cnt_get(void);
+uint32_t app_timer_cnt_diff_compute(uint32_t ticks_to, uint32_t ticks_from);
+
+/* nrf_log */
+#define NRF_LOG_INFO(...)
+#define NRF_LOG_DEBUG(...)
+#define NRF_LOG_WARNING(...)
+#define NRF_LOG_ERROR(...)
+#define NRF_LOG_FLUSH()
+#define NRF_LOG_FINAL_FLUSH()
+#define NRF_LOG_PROCESS() false
+
+/* nrf_pwr_mgmt */
+ret_code_t nrf_pwr_mgmt_init(void);
+void nrf_pwr_mgmt_run(void);
+
+typedef struct { uint8_t addr_id_peer:1; uint8_t addr_type:7; uint8_t addr[BLE_GAP_ADDR_LEN]; } ble_gap_addr_t;
+#define BLE_GAP_ADDR_TYPE_PUBLIC 0
+#define BLE_GAP_ADDR_TYPE_RANDOM_STATIC 1
+typedef struct { uint8_t irk[BLE_GAP_SEC_KEY_LEN]; } ble_gap_irk_t;
+typedef struct { ble_gap_irk_t id_info; ble_gap_addr_t id_addr_info; } ble_gap_id_key_t;
+typedef struct { uint16_t min_conn_interval, max_conn_interval, slave_latency, conn_sup_timeout; } ble_gap_conn_params_t;
+typedef struct { uint8_t sm:4; uint8_t lv:4; } ble_gap_conn_sec_mode_t;
+#define BLE_GAP_CONN_SEC_MODE_SET_ENC_WITH_MITM(p) ((p)->sm=1)
+typedef struct { uint8_t tx_phys, rx_phys; } ble_gap_phys_t;
+#define BLE_GAP_PHY_AUTO 0
+typedef struct { uint16_t uuid; uint8_t type; } ble_uuid_t;
+#define BLE_UUID_TYPE_BLE 1
+#define BLE_UUID_HUMAN_INTERFACE_DEVICE_SERVICE 0x1812
+#define BLE_UUID_GAP_CHARACTERISTIC_DEVICE_NAME 0x2A00
+typedef struct { uint16_t start_handle, end_handle; } ble_gattc_handle_range_t;
+typedef struct { uint16_t handle; uint8_t *p_value; } ble_gattc_handle_value_t;
+typedef struct { uint16_t count; uint16_t value_len; uint8_t handle_value[1]; } ble_gattc_evt_char_val_by_uuid_read_rsp_t;
+typedef struct { uint16_t conn_handle; uint16_t gatt_status; uint16_t error_handle; union { ble_gattc_evt_char_val_by_uuid_read_rsp_t char_val_by_uuid_read_rsp; } params; } ble_gattc_evt_t;
+typedef struct { ble_gap_addr_t peer_addr; uint8_t role; ble_gap_conn_params_t conn_params; } ble_gap_evt_connected_t;
+typedef struct { uint8_t reason; } ble_gap_evt_disconnected_t;
+typedef struct { uint8_t auth_status; } ble_gap_evt_auth_status_t;
+typedef struct { ble_gap_conn_params_t conn_params; } ble_gap_evt_conn_param_update_t;
+typedef struct { uint16_t conn_handle; union { ble_gap_evt_connected_t connected; ble_gap_evt_disconnected_t disconnected; ble_gap_evt_auth_status_t auth_status; ble_gap_evt_conn_param_update_t conn_param_update; } params; } ble_gap_evt_t;
+typedef struct { uint8_t count; } ble_gatts_evt_hvn_tx_complete_t;
+typedef struct { uint16_t handle; uint16_t len; uint8_t data[1]; } ble_gatts_evt_write_t;
+typedef struct { uint16_t conn_handle; union { ble_gatts_evt_hvn_tx_complete_t hvn_tx_complete; ble_gatts_evt_write_t write; } params; } ble_gatts_evt_t;
+typedef struct { uint16_t evt_id; uint16_t evt_len; } ble_evt_hdr_t;
+typedef struct { ble_evt_hdr_t header; union { ble_gap_evt_t gap_evt; ble_gattc_evt_t gattc_evt; ble_gatts_evt_t gatts_evt; } evt; } ble_evt_t;
+enum { BLE_GAP_EVT_CONNECTED=0x10, BLE_GAP_EVT_DISCONNECTED, BLE_GAP_EVT_CONN_PARAM_UPDATE, BLE_GAP_EVT_AUTH_KEY_REQUEST, BLE_GAP_EVT_AUTH_STATUS, BLE_GAP_EVT_PHY_UPDATE_REQUEST,
+ BLE_GATTC_EVT_CHAR_VAL_BY_UUID_READ_RSP, BLE_GATTC_EVT_TIMEOUT, BLE_GATTS_EVT_HVN_TX_COMPLETE, BLE_GATTS_EVT_TIMEOUT, BLE_GATTS_EVT_WRITE, BLE_GATTS_EVT_SYS_ATTR_MISSING };
+#define BLE_GAP_SEC_STATUS_TIMEOUT 1
+#define BLE_GAP_AUTH_KEY_TYPE_PASSKEY 1
+#define BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION 0x13
+#define BLE_HCI_LOCAL_HOST_TERMINATED_CONNECTION 0x16
+#define BLE_APPEARANCE_HID_KEYBOARD 961
+#define BLE_GAP_TX_POWER_ROLE_ADV 1
+#define BLE_GAP_TX_POWER_ROLE_CONN 2
+#define BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE 6
+uint32_t sd_ble_gap_device_name_set(ble_gap_conn_sec_mode_t const*, uint8_t const*, uint16_t);
+uint32_t sd_ble_gap_appearance_set(uint16_t);
+uint32_t sd_ble_gap_ppcp_set(ble_gap_conn_params_t const*);
+uint32_t sd_ble_gap_auth_key_reply(uint16_t, uint8_t, uint8_t const*);
+uint32_t sd_ble_gap_tx_power_set(uint8_t, uint16_t, int8_t);
+uint32_t sd_ble_gap_adv_stop(uint8_t);
+uint32_t sd_ble_gap_disconnect(uint16_t, uint8_t);
+uint32_t sd_ble_gap_addr_get(ble_gap_addr_t*);
+uint32_t sd_ble_gap_addr_set(ble_gap_addr_t const*);
+uint32_t sd_ble_gap_phy_update(uint16_t, ble_gap_phys_t const*);
+uint32_t sd_ble_gattc_evt_char_val_by_uuid_read_rsp_iter(ble_gattc_evt_t*, ble_gattc_handle_value_t*);
+uint32_t sd_ble_gattc_char_value_by_uuid_read(uint16_t, ble_uuid_t const*, ble_gattc_handle_range_t const*);
+typedef struct { uint16_t conn_handle; uint8_t disable; } ble_gap_opt_slave_latency_disable_t;
+typedef struct { uint8_t enable:1; } ble_common_opt_conn_evt_ext_t;
+typedef union { struct { ble_gap_opt_slave_latency_disable_t slave_latency_disable; } gap_opt; struct { ble_common_opt_conn_evt_ext_t conn_evt_ext; } common_opt; } ble_opt_t;
+#define BLE_GAP_OPT_SLAVE_LATENCY_DISABLE 0xA0
+#define BLE_COMMON_OPT_CONN_EVT_EXT 0x01
+uint32_t sd_ble_opt_set(uint32_t, ble_opt_t const*);
+typedef struct { uint8_t conn_count; uint16_t event_length; } ble_gap_conn_cfg_t;
+typedef struct { uint8_t hvn_tx_queue_size; } ble_gatts_conn_cfg_t;
+typedef struct { uint16_t att_mtu; } ble_gatt_conn_cfg_t;
+typedef struct { uint32_t attr_tab_size; } ble_gatts_cfg_attr_tab_size_t;
+typedef union { struct { uint8_t conn_cfg_tag; union { ble_gap_conn_cfg_t gap_conn_cfg; ble_gatts_conn_cfg_t gatts_conn_cfg; ble_gatt_conn_cfg_t gatt_conn_cfg; } params; } conn_cfg; union { ble_gatts_cfg_attr_tab_size_t attr_tab_size; } gatts_cfg; } ble_cfg_t;
+#define BLE_CONN_CFG_GAP 0x20
+#define BLE_CONN_CFG_GATTS 0x21
+#define BLE_GATTS_CFG_ATTR_TAB_SIZE 0xA1
+uint32_t sd_ble_cfg_set(uint32_t, ble_cfg_t const*, uint32_t);
+typedef struct { uint16_t len; uint16_t offset; uint8_t *p_value; } ble_gatts_value_t;
+uint32_t sd_ble_gatts_value_get(uint16_t, uint16_t, ble_gatts_value_t*);
+#define BLE_GATT_HVX_NOTIFICATION 1
+typedef struct { uint8_t *p_data; uint16_t len; } ble_data_t;
+typedef struct { ble_data_t adv_data; ble_data_t scan_rsp_data; } ble_gap_adv_data_t;
+uint32_t sd_ble_gap_device_identities_set(ble_gap_id_key_t const* const*, void const* const*, uint8_t);
+uint32_t sd_ble_gap_whitelist_set(ble_gap_addr_t const* const*, uint8_t);
+/* security */
+typedef enum { SEC_NO_ACCESS, SEC_OPEN, SEC_JUST_WORKS, SEC_MITM } security_req_t;
+/* hids */
+#define BLE_HIDS_REP_TYPE_INPUT 1
+#define BLE_HIDS_REP_TYPE_OUTPUT 2
+#define BLE_HIDS_REP_TYPE_FEATURE 3
+#define HID_INFO_FLAG_REMOTE_WAKE_MSK 1
+#define HID_INFO_FLAG_NORMALLY_CONNECTABLE_MSK 2
+typedef struct { uint8_t report_id; uint8_t report_type; } ble_srv_report_ref_t;
+typedef struct { security_req_t rd, wr, cccd_wr; } ble_hids_rep_sec_t;
+typedef struct { uint16_t max_len; ble_srv_report_ref_t rep_ref; ble_hids_rep_sec_t sec; } ble_hids_inp_rep_init_t;
+typedef ble_hids_inp_rep_init_t ble_hids_outp_rep_init_t;
+typedef struct { uint16_t value_handle, cccd_handle; } ble_gatts_char_handles_t;
+typedef struct { ble_gatts_char_handles_t char_handles; uint16_t ref_handle; } ble_hids_rep_char_t;
+typedef struct { uint16_t uuid; uint8_t rep_type; uint8_t rep_index; } ble_hids_char_id_t;
+typedef enum { BLE_HIDS_EVT_HOST_SUSP, BLE_HIDS_EVT_HOST_EXIT_SUSP, BLE_HIDS_EVT_NOTIF_ENABLED, BLE_HIDS_EVT_NOTIF_DISABLED, BLE_HIDS_EVT_REP_CHAR_WRITE, BLE_HIDS_EVT_BOOT_MODE_ENTERED, BLE_HIDS_EVT_REPORT_MODE_ENTERED, BLE_HIDS_EVT_REPORT_READ } ble_hids_evt_type_t;
+typedef struct { ble_hids_evt_type_t evt_type; union { struct { ble_hids_char_id_t char_id; } notification; struct { ble_hids_char_id_t char_id; uint16_t offset; uint16_t len; uint8_t const *data; } char_write; } params; ble_evt_t const *p_ble_evt; } ble_hids_evt_t;
+struct ble_hids_s;
+typedef void (*ble_hids_evt_handler_t)(struct ble_hids_s*, ble_hids_evt_t*);
+typedef void (*ble_srv_error_handler_t)(uint32_t);
+typedef struct { uint16_t data_len; uint8_t *p_data; security_req_t rd_sec; } ble_hids_rep_map_init_t;
+typedef struct { uint16_t bcd_hid; uint8_t b_country_code; uint8_t flags; security_req_t rd_sec; } ble_hids_hid_information_t;
+typedef struct { ble_hids_evt_handler_t evt_handler; ble_srv_error_handler_t error_handler; bool is_kb, is_mouse; uint8_t inp_rep_count; ble_hids_inp_rep_init_t *p_inp_rep_array; uint8_t outp_rep_count; ble_hids_outp_rep_init_t *p_outp_rep_array; uint8_t feature_rep_count; void *p_feature_rep_array; ble_hids_rep_map_init_t rep_map; ble_hids_hid_information_t hid_information; uint8_t included_services_count; void *p_included_services_array; ble_hids_rep_sec_t boot_kb_inp_rep_sec, boot_kb_outp_rep_sec, boot_mouse_inp_rep_sec; security_req_t protocol_mode_rd_sec, protocol_mode_wr_sec, ctrl_point_wr_sec; } ble_hids_init_t;
+typedef struct ble_hids_s { uint8_t inp_rep_count; ble_hids_rep_char_t inp_rep_array[8]; ble_gatts_char_handles_t boot_kb_inp_rep_handles; ble_gatts_char_handles_t boot_mouse_inp_rep_handles; } ble_hids_t;
+#define BLE_HIDS_DEF(_name, _cnt, ...) static ble_hids_t _name
+#define BLE_HIDS_LINK_CTX_SIZE_CALC(...) (8 + sizeof((int[]){__VA_ARGS__}))
+uint32_t ble_hids_init(ble_hids_t*, ble_hids_init_t const*);
+uint32_t ble_hids_inp_rep_send(ble_hids_t*, uint8_t, uint16_t, uint8_t*, uint16_t);
+uint32_t ble_hids_boot_kb_inp_rep_send(ble_hids_t*, uint16_t, uint8_t*, uint16_t);
+#define BOOT_KB_INPUT_REPORT_MAX_SIZE 8
+uint32_t ble_hids_outp_rep_get(ble_hids_t*, uint8_t, uint16_t, uint8_t, uint16_t, uint8_t*);
+/* bas */
+typedef struct { uint8_t battery_level_last; } ble_bas_t;
+typedef struct { void *evt_handler; bool support_notification; void *p_report_ref; uint8_t initial_batt_level; security_req_t bl_rd_sec, bl_cccd_wr_sec, bl_report_rd_sec; } ble_bas_init_t;
+#define BLE_BAS_DEF(x) static ble_bas_t x
+uint32_t ble_bas_init(ble_bas_t*, ble_bas_init_t const*);
+uint32_t ble_bas_battery_level_update(ble_bas_t*, uint8_t, uint16_t);
+/* dis */
+typedef struct { uint16_t length; uint8_t *p_str; } ble_srv_utf8_str_t;
+typedef struct { uint8_t vendor_id_source; uint16_t vendor_id, product_id, product_version; } ble_dis_pnp_id_t;
+typedef struct { ble_srv_utf8_str_t manufact_name_str; ble_dis_pnp_id_t *p_pnp_id; security_req_t dis_char_rd_sec; } ble_dis_init_t;
+void ble_srv_ascii_to_utf8(ble_srv_utf8_str_t*, char*);
+uint32_t ble_dis_init(ble_dis_init_t const*);
+/* gatt */
+typedef enum { NRF_BLE_GATT_EVT_ATT_MTU_UPDATED, NRF_BLE_GATT_EVT_DATA_LENGTH_UPDATED } nrf_ble_gatt_evt_id_t;
+typedef struct { nrf_ble_gatt_evt_id_t evt_id; uint16_t conn_handle; union { uint16_t att_mtu_effective; uint8_t data_length; } params; } nrf_ble_gatt_evt_t;
+typedef struct { int d; } nrf_ble_gatt_t;
+typedef void (*nrf_ble_gatt_evt_handler_t)(nrf_ble_gatt_t*, nrf_ble_gatt_evt_t const*);
+#define NRF_BLE_GATT_DEF(x) static nrf_ble_gatt_t x
+ret_code_t nrf_ble_gatt_init(nrf_ble_gatt_t*, nrf_ble_gatt_evt_handler_t);
+ret_code_t nrf_ble_gatt_att_mtu_periph_set(nrf_ble_gatt_t*, uint16_t);
+ret_code_t nrf_ble_gatt_data_length_set(nrf_ble_gatt_t*, uint16_t, uint8_t);
+uint16_t nrf_ble_gatt_eff_mtu_get(nrf_ble_gatt_t const*, uint16_t);
+#define BLE_GATT_ATT_MTU_DEFAULT 23
+#define NRF_BLE_GATT_ATT_MTU_DEFAULT 23
+/* qwr */
+typedef struct { int d; } nrf_ble_qwr_t;
+typedef struct { void (*error_handler)(uint32_t); } nrf_ble_qwr_init_t;
+#define NRF_BLE_QWR_DEF(x) static nrf_ble_qwr_t x
+#define NRF_BLE_QWRS_DEF(x, n) static nrf_ble_qwr_t x[n]
+ret_code_t nrf_ble_qwr_init(nrf_ble_qwr_t*, nrf_ble_qwr_init_t const*);
+ret_code_t nrf_ble_qwr_conn_handle_assign(nrf_ble_qwr_t*, uint16_t);
+/* conn params */
+typedef enum { BLE_CONN_PARAMS_EVT_FAILED, BLE_CONN_PARAMS_EVT_SUCCEEDED } ble_conn_params_evt_type_t;
+typedef struct { ble_conn_params_evt_type_t evt_type; uint16_t conn_handle; } ble_conn_params_evt_t;
+typedef void (*ble_conn_params_evt_handler_t)(ble_conn_params_evt_t*);
+typedef struct { ble_gap_conn_params_t *p_conn_params; uint32_t first_conn_params_update_delay, next_conn_params_update_delay; uint8_t max_conn_params_update_count; uint16_t start_on_notify_cccd_handle; bool disconnect_on_fail; ble_conn_params_evt_handler_t evt_handler; void (*error_handler)(uint32_t); } ble_conn_params_init_t;
+ret_code_t ble_conn_params_init(ble_conn_params_init_t const*);
+ret_code_t ble_conn_params_change_conn_params(uint16_t, ble_gap_conn_params_t*);
+/* conn state */
+uint16_t ble_conn_state_conn_idx(uint16_t);
+#define BLE_CONN_STATE_MAX_CONNECTIONS NRF_SDH_BLE_TOTAL_LINK_COUNT
+/* sdh */
+ret_code_t nrf_sdh_enable_request(void);
+ret_code_t nrf_sdh_ble_default_cfg_set(uint8_t, uint32_t*);
+ret_code_t nrf_sdh_ble_enable(uint32_t*);
+ret_code_t nrf_sdh_ble_app_ram_start_get(uint32_t*);
+typedef void (*nrf_sdh_ble_evt_handler_t)(ble_evt_t const *p_ble_evt, void *p_context);
+void sim_ble_observer_register(nrf_sdh_ble_evt_handler_t handler, void *p_context);
+/* The simulator dispatches its BLE events to the registered observers. Only used inside functions here. */
+#define NRF_SDH_BLE_OBSERVER(name, prio, handler, context) sim_ble_observer_register((handler), (context))
+/* advertising */
+typedef enum { BLE_ADV_MODE_IDLE, BLE_ADV_MODE_DIRECTED_HIGH_DUTY, BLE_ADV_MODE_DIRECTED, BLE_ADV_MODE_FAST, BLE_ADV_MODE_SLOW } ble_adv_mode_t;
+typedef enum { BLE_ADV_EVT_IDLE, BLE_ADV_EVT_DIRECTED_HIGH_DUTY, BLE_ADV_EVT_DIRECTED, BLE_ADV_EVT_FAST, BLE_ADV_EVT_SLOW, BLE_ADV_EVT_FAST_WHITELIST, BLE_ADV_EVT_SLOW_WHITELIST, BLE_ADV_EVT_WHITELIST_REQUEST, BLE_ADV_EVT_PEER_ADDR_REQUEST } ble_adv_evt_t;
+typedef enum { BLE_ADVDATA_NO_NAME, BLE_ADVDATA_SHORT_NAME, BLE_ADVDATA_FULL_NAME } ble_advdata_name_type_t;
+typedef struct { uint16_t uuid_cnt; ble_uuid_t *p_uuids; } ble_advdata_uuid_list_t;
+typedef struct { ble_advdata_name_type_t name_type; bool include_appearance; uint8_t flags; ble_advdata_uuid_list_t uuids_complete; } ble_advdata_t;
+typedef struct { bool ble_adv_on_disconnect_disabled, ble_adv_whitelist_enabled, ble_adv_directed_high_duty_enabled, ble_adv_directed_enabled, ble_adv_fast_enabled, ble_adv_slow_enabled; uint32_t ble_adv_directed_interval, ble_adv_directed_timeout, ble_adv_fast_interval, ble_adv_fast_timeout, ble_adv_slow_interval, ble_adv_slow_timeout; } ble_adv_modes_config_t;
+typedef struct { ble_advdata_t advdata; ble_advdata_t srdata; ble_adv_modes_config_t config; void (*evt_handler)(ble_adv_evt_t); void (*error_handler)(uint32_t); } ble_advertising_init_t;
+typedef struct { uint8_t adv_handle; ble_gap_adv_data_t adv_data; ble_adv_mode_t adv_mode_current; ble_adv_modes_config_t adv_modes_config; } ble_advertising_t;
+#define BLE_ADVERTISING_DEF(x) static ble_advertising_t x
+uint32_t ble_advertising_init(ble_advertising_t*, ble_advertising_init_t const*);
+void ble_advertising_conn_cfg_tag_set(ble_advertising_t*, uint8_t);
+uint32_t ble_advertising_start(ble_advertising_t*, ble_adv_mode_t);
+uint32_t ble_advertising_whitelist_reply(ble_advertising_t*, ble_gap_addr_t const*, uint32_t, ble_gap_irk_t const*, uint32_t);
+uint32_t ble_advertising_peer_addr_reply(ble_advertising_t*, ble_gap_addr_t*);
+void ble_advertising_modes_config_set(ble_advertising_t*, ble_adv_modes_config_t const*);
+ret_code_t ble_advertising_advdata_update(ble_advertising_t*, ble_advdata_t const*, ble_advdata_t const*);
+ret_code_t ble_advdata_encode(ble_advdata_t const*, uint8_t*, uint16_t*);
+/* peer manager */
+typedef uint16_t pm_peer_id_t;
+#define PM_PEER_ID_INVALID 0xFFFF
+typedef enum { PM_PEER_ID_LIST_ALL_ID=0, PM_PEER_ID_LIST_SKIP_NO_ID_ADDR=1, PM_PEER_ID_LIST_SKIP_NO_IRK=2, PM_PEER_ID_LIST_SKIP_NO_CAR=4, PM_PEER_ID_LIST_SKIP_ALL=7 } pm_peer_id_list_skip_t;
+typedef enum { PM_PEER_DATA_ID_BONDING, PM_PEER_DATA_ID_APPLICATION, PM_PEER_DATA_ID_CENTRAL_ADDR_RES, PM_PEER_DATA_ID_GATT_LOCAL } pm_peer_data_id_t;
+typedef struct { ble_gap_id_key_t peer_ble_id; } pm_peer_data_bonding_t;
+typedef enum { PM_EVT_BONDED_PEER_CONNECTED, PM_EVT_CONN_SEC_START, PM_EVT_CONN_SEC_SUCCEEDED, PM_EVT_CONN_SEC_FAILED, PM_EVT_PEER_DATA_UPDATE_SUCCEEDED, PM_EVT_PEER_DATA_UPDATE_FAILED, PM_EVT_PEER_DELETE_SUCCEEDED, PM_EVT_PEER_DELETE_FAILED, PM_EVT_PEERS_DELETE_SUCCEEDED, PM_EVT_PEERS_DELETE_FAILED, PM_EVT_LOCAL_DB_CACHE_APPLIED, PM_EVT_STORAGE_FULL } pm_evt_id_t;
+typedef enum { PM_PEER_DATA_OP_UPDATE, PM_PEER_DATA_OP_DELETE } pm_peer_data_op_t;
+typedef struct { pm_peer_data_id_t data_id; pm_peer_data_op_t action; uint32_t token; uint8_t flash_changed:1; } pm_peer_data_update_succeeded_evt_t;
+typedef struct { pm_evt_id_t evt_id; uint16_t conn_handle; pm_peer_id_t peer_id; union { pm_peer_data_update_succeeded_evt_t peer_data_update_succeeded; } params; } pm_evt_t;
+typedef struct { uint8_t bond, mitm, lesc, keypress, io_caps, oob, min_key_size, max_key_size; struct { uint8_t enc, id; } kdist_own, kdist_peer; } ble_gap_sec_params_t;
+#define BLE_GAP_IO_CAPS_KEYBOARD_ONLY 2
+typedef void (*pm_evt_handler_t)(pm_evt_t const*);
+ret_code_t pm_init(void);
+ret_code_t pm_sec_params_set(ble_gap_sec_params_t*);
+ret_code_t pm_register(pm_evt_handler_t);
+void pm_handler_on_pm_evt(pm_evt_t const*);
+void pm_handler_disconnect_on_sec_failure(pm_evt_t const*);
+void pm_handler_flash_clean(pm_evt_t const*);
+ret_code_t pm_whitelist_get(ble_gap_addr_t*, uint32_t*, ble_gap_irk_t*, uint32_t*);
+ret_code_t pm_whitelist_set(pm_peer_id_t const*, uint32_t);
+ret_code_t pm_peer_data_bonding_load(pm_peer_id_t, pm_peer_data_bonding_t*);
+ret_code_t pm_peer_id_list(pm_peer_id_t*, uint32_t*, pm_peer_id_t, pm_peer_id_list_skip_t);
+ret_code_t pm_device_identities_list_set(pm_peer_id_t const*, uint32_t);
+ret_code_t pm_peers_delete(void);
+ret_code_t pm_peer_delete(pm_peer_id_t);
+pm_peer_id_t pm_next_peer_id_get(pm_peer_id_t);
+ret_code_t pm_peer_data_app_data_load(pm_peer_id_t, void*, uint32_t*);
+ret_code_t pm_peer_data_app_data_store(pm_peer_id_t, void const*, uint32_t, uint32_t*);
+ret_code_t pm_peer_data_load(pm_peer_id_t, pm_peer_data_id_t, void*, uint32_t*);
+ret_code_t pm_peer_id_get(uint16_t, pm_peer_id_t*);
+/* atomic */
+typedef volatile uint32_t nrf_atomic_u32_t;
+uint32_t nrf_atomic_u32_store(nrf_atomic_u32_t*, uint32_t);
+uint32_t nrf_atomic_u32_fetch_store(nrf_atomic_u32_t*, uint32_t);
+#define BLE_GAP_DATA_LENGTH_DEFAULT 27
+uint32_t nrf_atomic_u32_or(nrf_atomic_u32_t*, uint32_t);
+uint32_t nrf_atomic_u32_and(nrf_atomic_u32_t*, uint32_t);
+uint32_t nrf_atomic_u32_fetch_or(nrf_atomic_u32_t*, uint32_t);
+uint32_t nrf_atomic_u32_fetch_and(nrf_atomic_u32_t*, uint32_t);
+#define BLE_UUID_REPORT_CHAR 0x2A4D
+#define BLE_UUID_BOOT_KEYBOARD_INPUT_REPORT_CHAR 0x2A22
+#define BLE_CCCD_VALUE_LEN 2
@@ -0,0 +1,2 @@
+#pragma once
+#include "nrf5_stub.h"
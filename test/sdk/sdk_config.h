@@ -0,0 +1,16 @@
+/*
+ * sdk_config.h values of the keyboard firmware that the library sources depend on.
+ */
+#pragma once
+
+#define NRF_SDH_BLE_TOTAL_LINK_COUNT 2
+#define NRF_SDH_BLE_PERIPHERAL_LINK_COUNT 2
+#define NRF_SDH_BLE_GATT_MAX_MTU_SIZE 247
+#define NRF_SDH_BLE_GAP_DATA_LENGTH 251
+#define NRF_SDH_BLE_GAP_EVENT_LENGTH 6
+#define NRF_SDH_BLE_GATTS_ATTR_TAB_SIZE 1408
+#define APP_TIMER_CONFIG_RTC_FREQUENCY 0
+
+#define BOARD_VENDORID 0x35EF
+#define BOARD_PRODUCTID 0x0012
+#define BLE_DEVICE_NAME "Defy"
@@ -0,0 +1,1390 @@
+/*
+ * Host simulator of the SoftDevice, the peer manager and the SDK libraries used by the BLE module.
+ */
+#include "sim.h"
+
+#include <stdlib.h>
+
+#define SIM_LINKS NRF_SDH_BLE_TOTAL_LINK_COUNT
+#define SIM_OBSERVERS 4
+#define SIM_TIMERS 32
+#define SIM_SCHED_QUEUE_SIZE 32
+#define SIM_SCHED_EVENT_SIZE 64
+#define SIM_INPUT_REPORTS 8
+#define SIM_OUTPUT_REPORTS 4
+#define SIM_OUTPUT_REPORT_SIZE 256
+#define SIM_CCCD_HANDLE_BASE 0x100
+#define SIM_CCCD_HANDLE_BOOT_KEYBOARD 0x1FF
+#define SIM_HVN_TX_BUFFER_RAM 0x40 /* Application RAM a notification buffer of the link takes, bytes. */
+#define SIM_CONN_PARAMS_LOG_SIZE 32
+#define SIM_ATT_NOTIFICATION_HEADER 3 /* Opcode and attribute handle. */
+#define SIM_L2CAP_HEADER 4
+#define SIM_LL_PACKET_OVERHEAD 14     /* Preamble, access address, header, MIC and CRC bytes of an encrypted packet. */
+#define SIM_LL_ACK_US 80              /* Empty packet of the central. */
+#define SIM_LL_IFS_US 150
+
+static sim_config_t config = {.hvn_tx_queue_size = 1, .tx_per_conn_event = 1, .conn_interval_us = 7500};
+static uint64_t time_us;
+static uint32_t app_errors;
+
+/* SoftDevice notification queue and the notifications that went over the air. */
+static sim_notification_t hvn_queue[SIM_LINKS][256];
+static uint8_t hvn_count[SIM_LINKS];
+static sim_notification_t notification_log[SIM_NOTIFICATION_LOG_SIZE];
+static uint32_t notification_count;
+static uint32_t hvx_error;
+static uint32_t hvx_error_count;
+
+static bool connected[SIM_LINKS];
+static uint32_t cccd[SIM_LINKS];
+#define CCCD_BIT_BATTERY (1UL << 30)
+static uint8_t data_length[SIM_LINKS];
+static bool slave_latency_disabled[SIM_LINKS];
+static uint16_t events_skipped[SIM_LINKS];
+static uint32_t events_attended[SIM_LINKS];
+static nrf_ble_gatt_t *p_gatt_instance;
+static nrf_ble_gatt_evt_handler_t gatt_evt_handler;
+
+static ble_conn_params_evt_handler_t conn_params_evt_handler;
+static uint16_t central_conn_interval_min;
+static ble_gap_conn_params_t conn_params_requests[SIM_CONN_PARAMS_LOG_SIZE];
+static uint32_t conn_params_request_count;
+static bool conn_params_pending[SIM_LINKS];
+static ble_gap_conn_params_t conn_params_pending_request[SIM_LINKS];
+
+static struct
+{
+    nrf_sdh_ble_evt_handler_t handler;
+    void *p_context;
+} observers[SIM_OBSERVERS];
+static uint8_t observer_count;
+
+static ble_hids_t *p_hids_instance;
+static ble_hids_inp_rep_init_t hids_input[SIM_INPUT_REPORTS];
+static ble_hids_outp_rep_init_t hids_output[SIM_OUTPUT_REPORTS];
+static uint8_t hids_input_count;
+static uint8_t hids_output_count;
+static ble_hids_evt_handler_t hids_evt_handler;
+static uint8_t output_report[SIM_LINKS][SIM_OUTPUT_REPORTS][SIM_OUTPUT_REPORT_SIZE];
+static uint32_t output_report_error;
+
+static uint8_t stack_hvn_tx_queue_size; /* Per link, given to sd_ble_cfg_set(). */
+static uint8_t stack_hvn_tx_queue_max;  /* Fits in the application RAM start, 0 for no limit. */
+static bool stack_conn_evt_ext;
+
+static uint32_t bas_error;
+static uint32_t bas_notification_count;
+static uint8_t bas_level_notified;
+
+static pm_evt_handler_t pm_evt_handlers[4];
+static uint8_t pm_evt_handler_count;
+
+static struct
+{
+    bool used;
+    ble_gap_id_key_t id_key;
+    uint8_t app_data[SIM_PEER_APP_DATA_SIZE];
+    uint32_t app_data_len;
+} peers[SIM_PEERS_MAX];
+static pm_peer_id_t conn_peer[SIM_LINKS];
+static uint32_t pm_whitelist_set_count;
+static uint32_t pm_identities_set_count;
+static uint32_t pm_keys_read_count;
+
+static void (*adv_evt_handler)(ble_adv_evt_t);
+static ble_adv_mode_t adv_mode = BLE_ADV_MODE_IDLE;
+static uint32_t adv_start_count;
+static uint32_t advdata_update_count;
+static uint32_t whitelist_reply_addr_count;
+static bool advdata_scan_rsp;
+static uint8_t advdata_buffers[2][BLE_GAP_ADV_SET_DATA_SIZE_MAX]; /* Owned by the advertising module. */
+
+static app_timer_t *timers[SIM_TIMERS];
+static uint8_t timer_count;
+
+static struct
+{
+    app_sched_event_handler_t handler;
+    uint16_t size;
+    uint8_t data[SIM_SCHED_EVENT_SIZE];
+} sched_queue[SIM_SCHED_QUEUE_SIZE];
+static uint8_t sched_head;
+static uint8_t sched_count;
+
+static uint16_t link_idx_get(uint16_t conn_handle)
+{
+    return (conn_handle < SIM_LINKS) ? conn_handle : SIM_LINKS;
+}
+
+void sim_reset(sim_config_t const *p_config)
+{
+    if (p_config != NULL)
+    {
+        config = *p_config;
+    }
+    memset(hvn_count, 0, sizeof(hvn_count));
+    memset(events_attended, 0, sizeof(events_attended));
+    notification_count = 0;
+    hvx_error = NRF_SUCCESS;
+    hvx_error_count = 0;
+    conn_params_request_count = 0;
+    memset(conn_params_pending, 0, sizeof(conn_params_pending));
+    output_report_error = NRF_SUCCESS;
+    bas_error = NRF_SUCCESS;
+    bas_notification_count = 0;
+    app_errors = 0;
+}
+
+void sim_app_error(uint32_t err_code, const char *file, int line)
+{
+    fprintf(stderr, "app error 0x%x at %s:%d\n", (unsigned)err_code, file, line);
+    app_errors++;
+}
+
+uint32_t sim_app_error_count(void)
+{
+    return app_errors;
+}
+
+/* Time and timers */
+
+static uint64_t ticks_get(void)
+{
+    return (time_us * APP_TIMER_CLOCK_FREQ) / 1000000;
+}
+
+static void timers_run(void)
+{
+    bool fired = true;
+    while (fired)
+    {
+        fired = false;
+        for (uint8_t i = 0; i < timer_count; i++)
+        {
+            app_timer_t *p_timer = timers[i];
+            if (p_timer->running && (p_timer->expiry <= ticks_get()))
+            {
+                if (p_timer->mode == APP_TIMER_MODE_REPEATED)
+                {
+                    p_timer->expiry += p_timer->period;
+                }
+                else
+                {
+                    p_timer->running = false;
+                }
+                p_timer->handler(p_timer->p_context);
+                fired = true;
+            }
+        }
+    }
+}
+
+void sim_time_advance_us(uint32_t us)
+{
+    // Step by 1 ms so the timers fire close to their expiry.
+    while (us > 0)
+    {
+        uint32_t step = MIN(us, 1000);
+        time_us += step;
+        us -= step;
+        timers_run();
+    }
+}
+
+uint64_t sim_time_us(void)
+{
+    return time_us;
+}
+
+ret_code_t app_timer_create(app_timer_id_t const *p_timer_id, app_timer_mode_t mode, app_timer_timeout_handler_t timeout_handler)
+{
+    app_timer_t *p_timer = *p_timer_id;
+    p_timer->handler = timeout_handler;
+    p_timer->mode = mode;
+    p_timer->running = false;
+
+    for (uint8_t i = 0; i < timer_count; i++)
+    {
+        if (timers[i] == p_timer) return NRF_SUCCESS;
+    }
+    if (timer_count >= SIM_TIMERS) return NRF_ERROR_NO_MEM;
+    timers[timer_count++] = p_timer;
+    return NRF_SUCCESS;
+}
+
+ret_code_t app_timer_start(app_timer_id_t timer_id, uint32_t timeout_ticks, void *p_context)
+{
+    if (timeout_ticks < APP_TIMER_MIN_TIMEOUT_TICKS) return NRF_ERROR_INVALID_PARAM;
+    timer_id->running = true;
+    timer_id->expiry = ticks_get() + timeout_ticks;
+    timer_id->period = timeout_ticks;
+    timer_id->p_context = p_context;
+    return NRF_SUCCESS;
+}
+
+ret_code_t app_timer_stop(app_timer_id_t timer_id)
+{
+    timer_id->running = false;
+    return NRF_SUCCESS;
+}
+
+uint32_t app_timer_cnt_get(void)
+{
+    return (uint32_t)(ticks_get() & 0xFFFFFF);
+}
+
+uint32_t app_timer_cnt_diff_compute(uint32_t ticks_to, uint32_t ticks_from)
+{
+    return (ticks_to - ticks_from) & 0xFFFFFF;
+}
+
+/* Scheduler */
+
+uint32_t app_sched_event_put(void const *p_event_data, uint16_t event_size, app_sched_event_handler_t handler)
+{
+    if (event_size > SIM_SCHED_EVENT_SIZE) return NRF_ERROR_INVALID_LENGTH;
+    if (sched_count >= SIM_SCHED_QUEUE_SIZE) return NRF_ERROR_NO_MEM;
+
+    uint8_t slot = (sched_head + sched_count) % SIM_SCHED_QUEUE_SIZE;
+    sched_queue[slot].handler = handler;
+    sched_queue[slot].size = event_size;
+    if ((p_event_data != NULL) && (event_size > 0))
+    {
+        memcpy(sched_queue[slot].data, p_event_data, event_size);
+    }
+    sched_count++;
+    return NRF_SUCCESS;
+}
+
+void app_sched_execute(void)
+{
+    while (sched_count > 0)
+    {
+        uint8_t slot = sched_head;
+        sched_head = (sched_head + 1) % SIM_SCHED_QUEUE_SIZE;
+        sched_count--;
+        sched_queue[slot].handler((sched_queue[slot].size > 0) ? sched_queue[slot].data : NULL, sched_queue[slot].size);
+    }
+}
+
+ret_code_t nrf_pwr_mgmt_init(void)
+{
+    return NRF_SUCCESS;
+}
+
+void nrf_pwr_mgmt_run(void)
+{
+}
+
+/* BLE events */
+
+void sim_ble_observer_register(nrf_sdh_ble_evt_handler_t handler, void *p_context)
+{
+    if (observer_count >= SIM_OBSERVERS) abort();
+    observers[observer_count].handler = handler;
+    observers[observer_count].p_context = p_context;
+    observer_count++;
+}
+
+void sim_ble_evt_dispatch(ble_evt_t const *p_evt)
+{
+    for (uint8_t i = 0; i < observer_count; i++)
+    {
+        observers[i].handler(p_evt, observers[i].p_context);
+    }
+}
+
+void sim_connect(uint16_t conn_handle)
+{
+    uint16_t link_idx = link_idx_get(conn_handle);
+    if (link_idx >= SIM_LINKS) abort();
+
+    connected[link_idx] = true;
+    cccd[link_idx] = 0;
+    data_length[link_idx] = BLE_GAP_DATA_LENGTH_DEFAULT;
+    slave_latency_disabled[link_idx] = false;
+    events_skipped[link_idx] = 0;
+    hvn_count[link_idx] = 0;
+    conn_peer[link_idx] = PM_PEER_ID_INVALID;
+    adv_mode = BLE_ADV_MODE_IDLE;
+
+    ble_evt_t evt;
+    memset(&evt, 0, sizeof(evt));
+    evt.header.evt_id = BLE_GAP_EVT_CONNECTED;
+    evt.evt.gap_evt.conn_handle = conn_handle;
+    evt.evt.gap_evt.params.connected.peer_addr.addr[0] = (uint8_t)(0xC0 + conn_handle);
+    evt.evt.gap_evt.params.connected.conn_params.min_conn_interval = (uint16_t)(config.conn_interval_us / 1250);
+    evt.evt.gap_evt.params.connected.conn_params.max_conn_interval = (uint16_t)(config.conn_interval_us / 1250);
+    sim_ble_evt_dispatch(&evt);
+}
+
+void sim_disconnect(uint16_t conn_handle)
+{
+    uint16_t link_idx = link_idx_get(conn_handle);
+    if (link_idx >= SIM_LINKS) abort();
+
+    connected[link_idx] = false;
+    hvn_count[link_idx] = 0;
+    conn_params_pending[link_idx] = false;
+
+    ble_evt_t evt;
+    memset(&evt, 0, sizeof(evt));
+    evt.header.evt_id = BLE_GAP_EVT_DISCONNECTED;
+    evt.evt.gap_evt.conn_handle = conn_handle;
+    evt.evt.gap_evt.params.disconnected.reason = BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION;
+    sim_ble_evt_dispatch(&evt);
+}
+
+void sim_secure(uint16_t conn_handle, pm_peer_id_t peer_id)
+{
+    uint16_t link_idx = link_idx_get(conn_handle);
+    if (link_idx >= SIM_LINKS) abort();
+    conn_peer[link_idx] = peer_id;
+
+    pm_evt_t evt;
+    memset(&evt, 0, sizeof(evt));
+    evt.conn_handle = conn_handle;
+    evt.peer_id = peer_id;
+    evt.evt_id = PM_EVT_CONN_SEC_START;
+    sim_pm_evt(&evt);
+    evt.evt_id = PM_EVT_CONN_SEC_SUCCEEDED;
+    sim_pm_evt(&evt);
+}
+
+static void cccd_evt_send(uint16_t conn_handle, uint8_t report_index, bool enable)
+{
+    ble_evt_t ble_evt;
+    memset(&ble_evt, 0, sizeof(ble_evt));
+    ble_evt.header.evt_id = BLE_GATTS_EVT_WRITE;
+    ble_evt.evt.gatts_evt.conn_handle = conn_handle;
+
+    ble_hids_evt_t evt;
+    memset(&evt, 0, sizeof(evt));
+    evt.evt_type = enable ? BLE_HIDS_EVT_NOTIF_ENABLED : BLE_HIDS_EVT_NOTIF_DISABLED;
+    if (report_index == SIM_REPORT_BOOT_KEYBOARD)
+    {
+        evt.params.notification.char_id.uuid = BLE_UUID_BOOT_KEYBOARD_INPUT_REPORT_CHAR;
+    }
+    else
+    {
+        evt.params.notification.char_id.uuid = BLE_UUID_REPORT_CHAR;
+        evt.params.notification.char_id.rep_type = BLE_HIDS_REP_TYPE_INPUT;
+        evt.params.notification.char_id.rep_index = report_index;
+    }
+    evt.p_ble_evt = &ble_evt;
+    sim_hids_evt(&evt);
+}
+
+void sim_cccd_set(uint16_t conn_handle, uint8_t report_index, bool enable)
+{
+    uint16_t link_idx = link_idx_get(conn_handle);
+    if (link_idx >= SIM_LINKS) abort();
+
+    uint32_t bit = (report_index == SIM_REPORT_BOOT_KEYBOARD) ? (1UL << 31) : (1UL << report_index);
+    if (enable)
+    {
+        cccd[link_idx] |= bit;
+    }
+    else
+    {
+        cccd[link_idx] &= ~bit;
+    }
+    cccd_evt_send(conn_handle, report_index, enable);
+}
+
+void sim_cccd_set_all(uint16_t conn_handle, bool enable)
+{
+    uint8_t count = (p_hids_instance != NULL) ? p_hids_instance->inp_rep_count : 0;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        sim_cccd_set(conn_handle, i, enable);
+    }
+    sim_cccd_set(conn_handle, SIM_REPORT_BOOT_KEYBOARD, enable);
+
+    // The battery service handles its own CCCD, there is no HID event.
+    uint16_t link_idx = link_idx_get(conn_handle);
+    cccd[link_idx] = enable ? (cccd[link_idx] | CCCD_BIT_BATTERY) : (cccd[link_idx] & ~CCCD_BIT_BATTERY);
+}
+
+void sim_gatt_negotiate(uint16_t conn_handle, uint16_t mtu, uint8_t length)
+{
+    uint16_t link_idx = link_idx_get(conn_handle);
+    if ((link_idx >= SIM_LINKS) || !connected[link_idx]) abort();
+
+    data_length[link_idx] = length;
+    if (gatt_evt_handler == NULL) return;
+
+    nrf_ble_gatt_evt_t evt;
+    memset(&evt, 0, sizeof(evt));
+    evt.conn_handle = conn_handle;
+    evt.evt_id = NRF_BLE_GATT_EVT_ATT_MTU_UPDATED;
+    evt.params.att_mtu_effective = mtu;
+    gatt_evt_handler(p_gatt_instance, &evt);
+    evt.evt_id = NRF_BLE_GATT_EVT_DATA_LENGTH_UPDATED;
+    evt.params.data_length = length;
+    gatt_evt_handler(p_gatt_instance, &evt);
+}
+
+/* Notifications */
+
+static uint32_t hvx(uint16_t conn_handle, uint8_t report_index, uint32_t cccd_bit, uint8_t const *p_data, uint16_t len)
+{
+    uint16_t link_idx = link_idx_get(conn_handle);
+    if ((link_idx >= SIM_LINKS) || !connected[link_idx]) return BLE_ERROR_INVALID_CONN_HANDLE;
+
+    if (hvx_error_count > 0)
+    {
+        hvx_error_count--;
+        return hvx_error;
+    }
+    if ((cccd[link_idx] & cccd_bit) == 0) return NRF_ERROR_INVALID_STATE;
+    if (hvn_count[link_idx] >= config.hvn_tx_queue_size) return NRF_ERROR_RESOURCES;
+    if (len > SIM_NOTIFICATION_MAX_LEN) return NRF_ERROR_DATA_SIZE;
+
+    sim_notification_t *p_notification = &hvn_queue[link_idx][hvn_count[link_idx]++];
+    p_notification->conn_handle = conn_handle;
+    p_notification->report_index = report_index;
+    p_notification->len = len;
+    memcpy(p_notification->data, p_data, len);
+    return NRF_SUCCESS;
+}
+
+uint32_t ble_hids_inp_rep_send(ble_hids_t *p_hids, uint8_t rep_index, uint16_t len, uint8_t *p_data, uint16_t conn_handle)
+{
+    (void)p_hids;
+    return hvx(conn_handle, rep_index, 1UL << rep_index, p_data, len);
+}
+
+uint32_t ble_hids_boot_kb_inp_rep_send(ble_hids_t *p_hids, uint16_t len, uint8_t *p_data, uint16_t conn_handle)
+{
+    (void)p_hids;
+    return hvx(conn_handle, SIM_REPORT_BOOT_KEYBOARD, 1UL << 31, p_data, len);
+}
+
+void sim_hvx_error_set(uint32_t err_code, uint32_t count)
+{
+    hvx_error = err_code;
+    hvx_error_count = count;
+}
+
+uint8_t sim_hvn_queued(uint16_t conn_handle)
+{
+    uint16_t link_idx = link_idx_get(conn_handle);
+    return (link_idx < SIM_LINKS) ? hvn_count[link_idx] : 0;
+}
+
+/* Airtime of a notification on the 1M PHY: each link layer packet, its acknowledgement and the inter frame spaces. */
+static uint32_t notification_airtime_us(uint16_t link_idx, uint16_t len)
+{
+    uint32_t l2cap_len = len + SIM_ATT_NOTIFICATION_HEADER + SIM_L2CAP_HEADER;
+    uint32_t airtime = 0;
+
+    while (l2cap_len > 0)
+    {
+        uint32_t payload = MIN(l2cap_len, data_length[link_idx]);
+        airtime += (SIM_LL_PACKET_OVERHEAD + payload) * 8 + SIM_LL_ACK_US + 2 * SIM_LL_IFS_US;
+        l2cap_len -= payload;
+    }
+    return airtime;
+}
+
+/* Notifications sent in one connection event, the first one always goes. */
+static uint8_t conn_event_count(uint16_t link_idx)
+{
+    uint8_t count = MIN(hvn_count[link_idx], config.tx_per_conn_event);
+    if (config.conn_event_length_us == 0) return count;
+
+    uint32_t airtime = 0;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        airtime += notification_airtime_us(link_idx, hvn_queue[link_idx][i].len);
+        if ((i > 0) && (airtime > config.conn_event_length_us)) return i;
+    }
+    return count;
+}
+
+/* The central answers a connection parameter request, as the Connection Parameters module reports it. */
+static void conn_params_answer(uint16_t link_idx)
+{
+    ble_gap_conn_params_t const *p_request = &conn_params_pending_request[link_idx];
+    conn_params_pending[link_idx] = false;
+
+    ble_conn_params_evt_t cp_evt;
+    memset(&cp_evt, 0, sizeof(cp_evt));
+    cp_evt.conn_handle = link_idx;
+    cp_evt.evt_type = BLE_CONN_PARAMS_EVT_FAILED;
+
+    if (p_request->min_conn_interval >= central_conn_interval_min)
+    {
+        ble_evt_t evt;
+        memset(&evt, 0, sizeof(evt));
+        evt.header.evt_id = BLE_GAP_EVT_CONN_PARAM_UPDATE;
+        evt.evt.gap_evt.conn_handle = link_idx;
+        evt.evt.gap_evt.params.conn_param_update.conn_params = *p_request;
+        evt.evt.gap_evt.params.conn_param_update.conn_params.max_conn_interval = p_request->min_conn_interval;
+        sim_ble_evt_dispatch(&evt);
+        cp_evt.evt_type = BLE_CONN_PARAMS_EVT_SUCCEEDED;
+    }
+    if (conn_params_evt_handler != NULL)
+    {
+        conn_params_evt_handler(&cp_evt);
+    }
+}
+
+/* A link with nothing to send sleeps through the connection events its slave latency allows. */
+static bool conn_event_skipped(uint16_t link_idx)
+{
+    if ((hvn_count[link_idx] > 0) || slave_latency_disabled[link_idx] || (events_skipped[link_idx] >= config.slave_latency))
+    {
+        events_skipped[link_idx] = 0;
+        events_attended[link_idx]++;
+        return false;
+    }
+    events_skipped[link_idx]++;
+    return true;
+}
+
+void sim_conn_event(void)
+{
+    sim_time_advance_us(config.conn_interval_us);
+    sim_conn_event_run();
+}
+
+uint32_t sim_conn_events_attended(uint16_t conn_handle)
+{
+    uint16_t link_idx = link_idx_get(conn_handle);
+    return (link_idx < SIM_LINKS) ? events_attended[link_idx] : 0;
+}
+
+void sim_conn_event_run(void)
+{
+    for (uint16_t link_idx = 0; link_idx < SIM_LINKS; link_idx++)
+    {
+        if (!connected[link_idx] || conn_event_skipped(link_idx)) continue;
+
+        if (conn_params_pending[link_idx])
+        {
+            conn_params_answer(link_idx);
+        }
+
+        uint8_t count = conn_event_count(link_idx);
+        if (!connected[link_idx] || (count == 0)) continue;
+
+        for (uint8_t i = 0; i < count; i++)
+        {
+            if (notification_count < SIM_NOTIFICATION_LOG_SIZE)
+            {
+                notification_log[notification_count++] = hvn_queue[link_idx][i];
+            }
+        }
+        memmove(&hvn_queue[link_idx][0], &hvn_queue[link_idx][count], (hvn_count[link_idx] - count) * sizeof(sim_notification_t));
+        hvn_count[link_idx] -= count;
+
+        ble_evt_t evt;
+        memset(&evt, 0, sizeof(evt));
+        evt.header.evt_id = BLE_GATTS_EVT_HVN_TX_COMPLETE;
+        evt.evt.gatts_evt.conn_handle = link_idx;
+        evt.evt.gatts_evt.params.hvn_tx_complete.count = count;
+        sim_ble_evt_dispatch(&evt);
+    }
+}
+
+uint32_t sim_notification_count(void)
+{
+    return notification_count;
+}
+
+sim_notification_t const *sim_notification_get(uint32_t index)
+{
+    return (index < notification_count) ? &notification_log[index] : NULL;
+}
+
+void sim_notification_clear(void)
+{
+    notification_count = 0;
+}
+
+uint32_t sd_ble_gatts_value_get(uint16_t conn_handle, uint16_t handle, ble_gatts_value_t *p_value)
+{
+    uint16_t link_idx = link_idx_get(conn_handle);
+    if ((link_idx >= SIM_LINKS) || !connected[link_idx]) return BLE_ERROR_INVALID_CONN_HANDLE;
+    if ((handle < SIM_CCCD_HANDLE_BASE) || (handle > SIM_CCCD_HANDLE_BOOT_KEYBOARD)) return NRF_ERROR_NOT_FOUND;
+
+    uint32_t bit = (handle == SIM_CCCD_HANDLE_BOOT_KEYBOARD) ? (1UL << 31) : (1UL << (handle - SIM_CCCD_HANDLE_BASE));
+    memset(p_value->p_value, 0, p_value->len);
+    p_value->p_value[0] = (cccd[link_idx] & bit) ? BLE_GATT_HVX_NOTIFICATION : 0;
+    return NRF_SUCCESS;
+}
+
+/* HID service */
+
+uint32_t ble_hids_init(ble_hids_t *p_hids, ble_hids_init_t const *p_init)
+{
+    if ((p_init->inp_rep_count > SIM_INPUT_REPORTS) || (p_init->outp_rep_count > SIM_OUTPUT_REPORTS)) return NRF_ERROR_NO_MEM;
+
+    hids_input_count = p_init->inp_rep_count;
+    memcpy(hids_input, p_init->p_inp_rep_array, hids_input_count * sizeof(ble_hids_inp_rep_init_t));
+    hids_output_count = p_init->outp_rep_count;
+    memcpy(hids_output, p_init->p_outp_rep_array, hids_output_count * sizeof(ble_hids_outp_rep_init_t));
+
+    memset(p_hids, 0, sizeof(*p_hids));
+    p_hids->inp_rep_count = p_init->inp_rep_count;
+    for (uint8_t i = 0; i < p_init->inp_rep_count; i++)
+    {
+        p_hids->inp_rep_array[i].char_handles.cccd_handle = (uint16_t)(SIM_CCCD_HANDLE_BASE + i);
+    }
+    p_hids->boot_kb_inp_rep_handles.cccd_handle = SIM_CCCD_HANDLE_BOOT_KEYBOARD;
+
+    p_hids_instance = p_hids;
+    hids_evt_handler = p_init->evt_handler;
+    return NRF_SUCCESS;
+}
+
+uint8_t sim_hids_input_count(void)
+{
+    return hids_input_count;
+}
+
+ble_hids_inp_rep_init_t const *sim_hids_input_get(uint8_t index)
+{
+    return (index < hids_input_count) ? &hids_input[index] : NULL;
+}
+
+uint8_t sim_hids_output_count(void)
+{
+    return hids_output_count;
+}
+
+ble_hids_outp_rep_init_t const *sim_hids_output_get(uint8_t index)
+{
+    return (index < hids_output_count) ? &hids_output[index] : NULL;
+}
+
+void sim_hids_evt(ble_hids_evt_t *p_evt)
+{
+    if (hids_evt_handler != NULL)
+    {
+        hids_evt_handler(p_hids_instance, p_evt);
+    }
+}
+
+void sim_output_report_set(uint16_t conn_handle, uint8_t report_index, uint8_t const *p_data, uint16_t len)
+{
+    uint16_t link_idx = link_idx_get(conn_handle);
+    if ((link_idx >= SIM_LINKS) || (report_index >= SIM_OUTPUT_REPORTS) || (len > SIM_OUTPUT_REPORT_SIZE)) abort();
+    memcpy(output_report[link_idx][report_index], p_data, len);
+}
+
+void sim_output_report_write(uint16_t conn_handle, uint8_t report_index, uint8_t const *p_data, uint16_t len)
+{
+    sim_output_report_set(conn_handle, report_index, p_data, len);
+
+    ble_evt_t ble_evt;
+    memset(&ble_evt, 0, sizeof(ble_evt));
+    ble_evt.header.evt_id = BLE_GATTS_EVT_WRITE;
+    ble_evt.evt.gatts_evt.conn_handle = conn_handle;
+
+    ble_hids_evt_t evt;
+    memset(&evt, 0, sizeof(evt));
+    evt.evt_type = BLE_HIDS_EVT_REP_CHAR_WRITE;
+    evt.params.char_write.char_id.uuid = BLE_UUID_REPORT_CHAR;
+    evt.params.char_write.char_id.rep_type = BLE_HIDS_REP_TYPE_OUTPUT;
+    evt.params.char_write.char_id.rep_index = report_index;
+    evt.params.char_write.len = len;
+    evt.params.char_write.data = p_data;
+    evt.p_ble_evt = &ble_evt;
+    sim_hids_evt(&evt);
+}
+
+void sim_output_report_error_set(uint32_t err_code)
+{
+    output_report_error = err_code;
+}
+
+uint32_t ble_hids_outp_rep_get(ble_hids_t *p_hids, uint8_t rep_index, uint16_t len, uint8_t offset, uint16_t conn_handle, uint8_t *p_outp_rep)
+{
+    (void)p_hids;
+    uint16_t link_idx = link_idx_get(conn_handle);
+    if (link_idx >= SIM_LINKS) return BLE_ERROR_INVALID_CONN_HANDLE;
+    if (output_report_error != NRF_SUCCESS) return output_report_error;
+    if ((rep_index >= SIM_OUTPUT_REPORTS) || (offset + len > SIM_OUTPUT_REPORT_SIZE)) return NRF_ERROR_INVALID_PARAM;
+
+    memcpy(p_outp_rep, &output_report[link_idx][rep_index][offset], len);
+    return NRF_SUCCESS;
+}
+
+/* Peer manager */
+
+ret_code_t pm_init(void)
+{
+    return NRF_SUCCESS;
+}
+
+ret_code_t pm_sec_params_set(ble_gap_sec_params_t *p_sec_params)
+{
+    (void)p_sec_params;
+    return NRF_SUCCESS;
+}
+
+ret_code_t pm_register(pm_evt_handler_t event_handler)
+{
+    if (pm_evt_handler_count >= ARRAY_SIZE(pm_evt_handlers)) return NRF_ERROR_NO_MEM;
+    pm_evt_handlers[pm_evt_handler_count++] = event_handler;
+    return NRF_SUCCESS;
+}
+
+void sim_pm_evt(pm_evt_t const *p_evt)
+{
+    for (uint8_t i = 0; i < pm_evt_handler_count; i++)
+    {
+        pm_evt_handlers[i](p_evt);
+    }
+}
+
+void pm_handler_on_pm_evt(pm_evt_t const *p_evt)
+{
+    (void)p_evt;
+}
+
+void pm_handler_disconnect_on_sec_failure(pm_evt_t const *p_evt)
+{
+    (void)p_evt;
+}
+
+void pm_handler_flash_clean(pm_evt_t const *p_evt)
+{
+    (void)p_evt;
+}
+
+pm_peer_id_t sim_peer_add(uint8_t addr_last_byte)
+{
+    for (pm_peer_id_t peer_id = 0; peer_id < SIM_PEERS_MAX; peer_id++)
+    {
+        if (peers[peer_id].used) continue;
+
+        memset(&peers[peer_id], 0, sizeof(peers[peer_id]));
+        peers[peer_id].used = true;
+        peers[peer_id].id_key.id_addr_info.addr_type = BLE_GAP_ADDR_TYPE_RANDOM_STATIC;
+        peers[peer_id].id_key.id_addr_info.addr[0] = addr_last_byte;
+        peers[peer_id].id_key.id_info.irk[0] = addr_last_byte;
+        return peer_id;
+    }
+    return PM_PEER_ID_INVALID;
+}
+
+void sim_peer_app_data_set(pm_peer_id_t peer_id, void const *p_data, uint32_t len)
+{
+    if ((peer_id >= SIM_PEERS_MAX) || !peers[peer_id].used || (len > SIM_PEER_APP_DATA_SIZE)) abort();
+    memcpy(peers[peer_id].app_data, p_data, len);
+    peers[peer_id].app_data_len = len;
+}
+
+uint32_t sim_pm_whitelist_set_count(void)
+{
+    return pm_whitelist_set_count;
+}
+
+uint32_t sim_pm_identities_set_count(void)
+{
+    return pm_identities_set_count;
+}
+
+uint32_t sim_pm_keys_read_count(void)
+{
+    return pm_keys_read_count;
+}
+
+static bool peer_valid(pm_peer_id_t peer_id)
+{
+    return (peer_id < SIM_PEERS_MAX) && peers[peer_id].used;
+}
+
+pm_peer_id_t pm_next_peer_id_get(pm_peer_id_t prev_peer_id)
+{
+    pm_peer_id_t peer_id = (prev_peer_id == PM_PEER_ID_INVALID) ? 0 : (pm_peer_id_t)(prev_peer_id + 1);
+    for (; peer_id < SIM_PEERS_MAX; peer_id++)
+    {
+        if (peers[peer_id].used) return peer_id;
+    }
+    return PM_PEER_ID_INVALID;
+}
+
+ret_code_t pm_peer_id_list(pm_peer_id_t *p_peer_list, uint32_t *const p_list_size, pm_peer_id_t first_peer_id, pm_peer_id_list_skip_t skip_id)
+{
+    (void)skip_id;
+    uint32_t count = 0;
+    pm_peer_id_t peer_id = (first_peer_id == PM_PEER_ID_INVALID) ? pm_next_peer_id_get(PM_PEER_ID_INVALID) : first_peer_id;
+    while ((peer_id != PM_PEER_ID_INVALID) && (count < *p_list_size))
+    {
+        if (peer_valid(peer_id))
+        {
+            p_peer_list[count++] = peer_id;
+        }
+        peer_id = pm_next_peer_id_get(peer_id);
+    }
+    *p_list_size = count;
+    return NRF_SUCCESS;
+}
+
+ret_code_t pm_peer_data_bonding_load(pm_peer_id_t peer_id, pm_peer_data_bonding_t *p_data)
+{
+    pm_keys_read_count++;
+    if (!peer_valid(peer_id)) return NRF_ERROR_NOT_FOUND;
+    p_data->peer_ble_id = peers[peer_id].id_key;
+    return NRF_SUCCESS;
+}
+
+ret_code_t pm_peer_data_load(pm_peer_id_t peer_id, pm_peer_data_id_t data_id, void *p_data, uint32_t *p_len)
+{
+    if (!peer_valid(peer_id)) return NRF_ERROR_NOT_FOUND;
+    if (data_id == PM_PEER_DATA_ID_BONDING)
+    {
+        if (*p_len < sizeof(pm_peer_data_bonding_t)) return NRF_ERROR_DATA_SIZE;
+        ((pm_peer_data_bonding_t *)p_data)->peer_ble_id = peers[peer_id].id_key;
+        *p_len = sizeof(pm_peer_data_bonding_t);
+        return NRF_SUCCESS;
+    }
+    if (data_id == PM_PEER_DATA_ID_APPLICATION)
+    {
+        return pm_peer_data_app_data_load(peer_id, p_data, p_len);
+    }
+    return NRF_ERROR_NOT_FOUND;
+}
+
+ret_code_t pm_peer_data_app_data_load(pm_peer_id_t peer_id, void *p_data, uint32_t *p_len)
+{
+    if (!peer_valid(peer_id) || (peers[peer_id].app_data_len == 0)) return NRF_ERROR_NOT_FOUND;
+    if (*p_len < peers[peer_id].app_data_len) return NRF_ERROR_DATA_SIZE;
+    memcpy(p_data, peers[peer_id].app_data, peers[peer_id].app_data_len);
+    *p_len = peers[peer_id].app_data_len;
+    return NRF_SUCCESS;
+}
+
+ret_code_t pm_peer_data_app_data_store(pm_peer_id_t peer_id, void const *p_data, uint32_t len, uint32_t *p_token)
+{
+    if (!peer_valid(peer_id)) return NRF_ERROR_INVALID_PARAM;
+    if (len > SIM_PEER_APP_DATA_SIZE) return NRF_ERROR_DATA_SIZE;
+    memcpy(peers[peer_id].app_data, p_data, len);
+    peers[peer_id].app_data_len = len;
+    if (p_token != NULL)
+    {
+        *p_token = 0;
+    }
+    return NRF_SUCCESS;
+}
+
+ret_code_t pm_peers_delete(void)
+{
+    memset(peers, 0, sizeof(peers));
+    return NRF_SUCCESS;
+}
+
+ret_code_t pm_peer_delete(pm_peer_id_t peer_id)
+{
+    if (!peer_valid(peer_id)) return NRF_ERROR_INVALID_PARAM;
+    peers[peer_id].used = false;
+    return NRF_SUCCESS;
+}
+
+ret_code_t pm_peer_id_get(uint16_t conn_handle, pm_peer_id_t *p_peer_id)
+{
+    uint16_t link_idx = link_idx_get(conn_handle);
+    *p_peer_id = (link_idx < SIM_LINKS) ? conn_peer[link_idx] : PM_PEER_ID_INVALID;
+    return NRF_SUCCESS;
+}
+
+ret_code_t pm_whitelist_set(pm_peer_id_t const *p_peers, uint32_t peer_cnt)
+{
+    (void)p_peers;
+    pm_whitelist_set_count++;
+    return (peer_cnt > BLE_GAP_WHITELIST_ADDR_MAX_COUNT) ? NRF_ERROR_INVALID_PARAM : NRF_SUCCESS;
+}
+
+ret_code_t pm_whitelist_get(ble_gap_addr_t *p_addrs, uint32_t *p_addr_cnt, ble_gap_irk_t *p_irks, uint32_t *p_irk_cnt)
+{
+    (void)p_addrs;
+    (void)p_irks;
+    pm_keys_read_count++;
+    *p_addr_cnt = 0;
+    if (p_irk_cnt != NULL)
+    {
+        *p_irk_cnt = 0;
+    }
+    return NRF_SUCCESS;
+}
+
+ret_code_t pm_device_identities_list_set(pm_peer_id_t const *p_peers, uint32_t peer_cnt)
+{
+    (void)p_peers;
+    pm_identities_set_count++;
+    return (peer_cnt > BLE_GAP_DEVICE_IDENTITIES_MAX_COUNT) ? NRF_ERROR_INVALID_PARAM : NRF_SUCCESS;
+}
+
+/* Advertising */
+
+uint32_t ble_advertising_init(ble_advertising_t *p_advertising, ble_advertising_init_t const *p_init)
+{
+    memset(p_advertising, 0, sizeof(*p_advertising));
+    p_advertising->adv_modes_config = p_init->config;
+    adv_evt_handler = p_init->evt_handler;
+    return NRF_SUCCESS;
+}
+
+void ble_advertising_conn_cfg_tag_set(ble_advertising_t *p_advertising, uint8_t ble_cfg_tag)
+{
+    (void)p_advertising;
+    (void)ble_cfg_tag;
+}
+
+uint32_t ble_advertising_start(ble_advertising_t *p_advertising, ble_adv_mode_t advertising_mode)
+{
+    p_advertising->adv_mode_current = advertising_mode;
+    adv_mode = advertising_mode;
+    adv_start_count++;
+    return NRF_SUCCESS;
+}
+
+uint32_t ble_advertising_whitelist_reply(ble_advertising_t *p_advertising, ble_gap_addr_t const *p_gap_addrs, uint32_t addr_cnt,
+                                         ble_gap_irk_t const *p_gap_irks, uint32_t irk_cnt)
+{
+    (void)p_advertising;
+    (void)p_gap_addrs;
+    (void)p_gap_irks;
+    (void)irk_cnt;
+    whitelist_reply_addr_count = addr_cnt;
+    return NRF_SUCCESS;
+}
+
+uint32_t ble_advertising_peer_addr_reply(ble_advertising_t *p_advertising, ble_gap_addr_t *p_peer_addr)
+{
+    (void)p_advertising;
+    (void)p_peer_addr;
+    return NRF_SUCCESS;
+}
+
+void ble_advertising_modes_config_set(ble_advertising_t *p_advertising, ble_adv_modes_config_t const *p_adv_modes_config)
+{
+    p_advertising->adv_modes_config = *p_adv_modes_config;
+}
+
+ret_code_t ble_advdata_encode(ble_advdata_t const *p_advdata, uint8_t *p_encoded_data, uint16_t *p_len)
+{
+    (void)p_advdata;
+    if (*p_len < 3) return NRF_ERROR_DATA_SIZE;
+    p_encoded_data[0] = 2;
+    p_encoded_data[1] = 0x01;
+    p_encoded_data[2] = p_advdata->flags;
+    *p_len = 3;
+    return NRF_SUCCESS;
+}
+
+ret_code_t ble_advertising_advdata_update(ble_advertising_t *p_advertising, ble_advdata_t const *p_advdata, ble_advdata_t const *p_srdata)
+{
+    if ((p_advdata == NULL) && (p_srdata == NULL)) return NRF_ERROR_NULL;
+
+    memset(&p_advertising->adv_data, 0, sizeof(p_advertising->adv_data));
+    if (p_advdata != NULL)
+    {
+        uint16_t len = sizeof(advdata_buffers[0]);
+        ret_code_t err_code = ble_advdata_encode(p_advdata, advdata_buffers[0], &len);
+        if (err_code != NRF_SUCCESS) return err_code;
+        p_advertising->adv_data.adv_data.p_data = advdata_buffers[0];
+        p_advertising->adv_data.adv_data.len = len;
+    }
+    if (p_srdata != NULL)
+    {
+        uint16_t len = sizeof(advdata_buffers[1]);
+        ret_code_t err_code = ble_advdata_encode(p_srdata, advdata_buffers[1], &len);
+        if (err_code != NRF_SUCCESS) return err_code;
+        p_advertising->adv_data.scan_rsp_data.p_data = advdata_buffers[1];
+        p_advertising->adv_data.scan_rsp_data.len = len;
+    }
+    advdata_scan_rsp = (p_srdata != NULL);
+    advdata_update_count++;
+    return NRF_SUCCESS;
+}
+
+uint32_t sim_advdata_update_count(void)
+{
+    return advdata_update_count;
+}
+
+bool sim_advdata_scan_rsp(void)
+{
+    return advdata_scan_rsp;
+}
+
+uint32_t sim_whitelist_reply_addr_count(void)
+{
+    return whitelist_reply_addr_count;
+}
+
+void sim_adv_evt(ble_adv_evt_t evt)
+{
+    if (evt == BLE_ADV_EVT_IDLE)
+    {
+        adv_mode = BLE_ADV_MODE_IDLE;
+    }
+    if (adv_evt_handler != NULL)
+    {
+        adv_evt_handler(evt);
+    }
+}
+
+ble_adv_mode_t sim_adv_mode(void)
+{
+    return adv_mode;
+}
+
+uint32_t sim_adv_start_count(void)
+{
+    return adv_start_count;
+}
+
+uint32_t sd_ble_gap_adv_stop(uint8_t adv_handle)
+{
+    (void)adv_handle;
+    if (adv_mode == BLE_ADV_MODE_IDLE) return NRF_ERROR_INVALID_STATE;
+    adv_mode = BLE_ADV_MODE_IDLE;
+    return NRF_SUCCESS;
+}
+
+/* SoftDevice calls without an effect on the tests */
+
+uint32_t sd_ble_gap_device_name_set(ble_gap_conn_sec_mode_t const *p_write_perm, uint8_t const *p_dev_name, uint16_t len)
+{
+    (void)p_write_perm;
+    (void)p_dev_name;
+    (void)len;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_appearance_set(uint16_t appearance)
+{
+    (void)appearance;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_ppcp_set(ble_gap_conn_params_t const *p_conn_params)
+{
+    (void)p_conn_params;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_auth_key_reply(uint16_t conn_handle, uint8_t key_type, uint8_t const *p_key)
+{
+    (void)conn_handle;
+    (void)key_type;
+    (void)p_key;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_tx_power_set(uint8_t role, uint16_t handle, int8_t tx_power)
+{
+    (void)role;
+    (void)handle;
+    (void)tx_power;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_disconnect(uint16_t conn_handle, uint8_t hci_status_code)
+{
+    (void)hci_status_code;
+    uint16_t link_idx = link_idx_get(conn_handle);
+    if ((link_idx >= SIM_LINKS) || !connected[link_idx]) return BLE_ERROR_INVALID_CONN_HANDLE;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_addr_get(ble_gap_addr_t *p_addr)
+{
+    memset(p_addr, 0, sizeof(*p_addr));
+    p_addr->addr_type = BLE_GAP_ADDR_TYPE_RANDOM_STATIC;
+    p_addr->addr[5] = 0xC0;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_addr_set(ble_gap_addr_t const *p_addr)
+{
+    (void)p_addr;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_phy_update(uint16_t conn_handle, ble_gap_phys_t const *p_gap_phys)
+{
+    (void)conn_handle;
+    (void)p_gap_phys;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gattc_evt_char_val_by_uuid_read_rsp_iter(ble_gattc_evt_t *p_gattc_evt, ble_gattc_handle_value_t *p_attr)
+{
+    (void)p_gattc_evt;
+    (void)p_attr;
+    return NRF_ERROR_NOT_FOUND;
+}
+
+uint32_t sd_ble_gattc_char_value_by_uuid_read(uint16_t conn_handle, ble_uuid_t const *p_uuid, ble_gattc_handle_range_t const *p_handle_range)
+{
+    (void)conn_handle;
+    (void)p_uuid;
+    (void)p_handle_range;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_opt_set(uint32_t opt_id, ble_opt_t const *p_opt)
+{
+    if (opt_id == BLE_GAP_OPT_SLAVE_LATENCY_DISABLE)
+    {
+        uint16_t link_idx = link_idx_get(p_opt->gap_opt.slave_latency_disable.conn_handle);
+        if ((link_idx >= SIM_LINKS) || !connected[link_idx]) return BLE_ERROR_INVALID_CONN_HANDLE;
+        slave_latency_disabled[link_idx] = (p_opt->gap_opt.slave_latency_disable.disable != 0);
+    }
+    else if (opt_id == BLE_COMMON_OPT_CONN_EVT_EXT)
+    {
+        stack_conn_evt_ext = (p_opt->common_opt.conn_evt_ext.enable != 0);
+    }
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_cfg_set(uint32_t cfg_id, ble_cfg_t const *p_cfg, uint32_t app_ram_base)
+{
+    (void)app_ram_base;
+    if (cfg_id == BLE_CONN_CFG_GATTS)
+    {
+        stack_hvn_tx_queue_size = p_cfg->conn_cfg.params.gatts_conn_cfg.hvn_tx_queue_size;
+    }
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_device_identities_set(ble_gap_id_key_t const *const *pp_id_keys, void const *const *pp_local_irks, uint8_t len)
+{
+    (void)pp_id_keys;
+    (void)pp_local_irks;
+    (void)len;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_whitelist_set(ble_gap_addr_t const *const *pp_wl_addrs, uint8_t len)
+{
+    (void)pp_wl_addrs;
+    (void)len;
+    return NRF_SUCCESS;
+}
+
+ret_code_t nrf_sdh_enable_request(void)
+{
+    return NRF_SUCCESS;
+}
+
+ret_code_t nrf_sdh_ble_default_cfg_set(uint8_t conn_cfg_tag, uint32_t *p_ram_start)
+{
+    (void)conn_cfg_tag;
+    *p_ram_start = 0x20002000;
+    return NRF_SUCCESS;
+}
+
+ret_code_t nrf_sdh_ble_enable(uint32_t *p_app_ram_start)
+{
+    if ((stack_hvn_tx_queue_max > 0) && (stack_hvn_tx_queue_size > stack_hvn_tx_queue_max))
+    {
+        // Each notification buffer of the link takes a few words more from the application RAM.
+        *p_app_ram_start += (stack_hvn_tx_queue_size - stack_hvn_tx_queue_max) * SIM_HVN_TX_BUFFER_RAM;
+        return NRF_ERROR_NO_MEM;
+    }
+    return NRF_SUCCESS;
+}
+
+void sim_stack_hvn_tx_queue_max_set(uint8_t max)
+{
+    stack_hvn_tx_queue_max = max;
+}
+
+uint8_t sim_stack_hvn_tx_queue_size(void)
+{
+    return stack_hvn_tx_queue_size;
+}
+
+bool sim_stack_conn_evt_ext(void)
+{
+    return stack_conn_evt_ext;
+}
+
+ret_code_t nrf_sdh_ble_app_ram_start_get(uint32_t *p_app_ram_start)
+{
+    *p_app_ram_start = 0x20002000;
+    return NRF_SUCCESS;
+}
+
+uint16_t ble_conn_state_conn_idx(uint16_t conn_handle)
+{
+    return link_idx_get(conn_handle);
+}
+
+ret_code_t ble_conn_params_init(ble_conn_params_init_t const *p_init)
+{
+    conn_params_evt_handler = p_init->evt_handler;
+    return NRF_SUCCESS;
+}
+
+ret_code_t ble_conn_params_change_conn_params(uint16_t conn_handle, ble_gap_conn_params_t *p_new_params)
+{
+    uint16_t link_idx = link_idx_get(conn_handle);
+    if ((link_idx >= SIM_LINKS) || !connected[link_idx]) return BLE_ERROR_INVALID_CONN_HANDLE;
+    if (conn_params_pending[link_idx]) return NRF_ERROR_BUSY;
+
+    conn_params_pending[link_idx] = true;
+    conn_params_pending_request[link_idx] = *p_new_params;
+    if (conn_params_request_count < SIM_CONN_PARAMS_LOG_SIZE)
+    {
+        conn_params_requests[conn_params_request_count++] = *p_new_params;
+    }
+    return NRF_SUCCESS;
+}
+
+void sim_central_conn_interval_min_set(uint16_t min_interval)
+{
+    central_conn_interval_min = min_interval;
+}
+
+uint32_t sim_conn_params_request_count(void)
+{
+    return conn_params_request_count;
+}
+
+ble_gap_conn_params_t const *sim_conn_params_request_get(uint32_t index)
+{
+    return (index < conn_params_request_count) ? &conn_params_requests[index] : NULL;
+}
+
+ret_code_t nrf_ble_gatt_init(nrf_ble_gatt_t *p_gatt, nrf_ble_gatt_evt_handler_t evt_handler)
+{
+    p_gatt_instance = p_gatt;
+    gatt_evt_handler = evt_handler;
+    return NRF_SUCCESS;
+}
+
+ret_code_t nrf_ble_gatt_att_mtu_periph_set(nrf_ble_gatt_t *p_gatt, uint16_t desired_mtu)
+{
+    (void)p_gatt;
+    (void)desired_mtu;
+    return NRF_SUCCESS;
+}
+
+ret_code_t nrf_ble_gatt_data_length_set(nrf_ble_gatt_t *p_gatt, uint16_t conn_handle, uint8_t data_length)
+{
+    (void)p_gatt;
+    (void)conn_handle;
+    (void)data_length;
+    return NRF_SUCCESS;
+}
+
+uint16_t nrf_ble_gatt_eff_mtu_get(nrf_ble_gatt_t const *p_gatt, uint16_t conn_handle)
+{
+    (void)p_gatt;
+    (void)conn_handle;
+    return NRF_SDH_BLE_GATT_MAX_MTU_SIZE;
+}
+
+ret_code_t nrf_ble_qwr_init(nrf_ble_qwr_t *p_qwr, nrf_ble_qwr_init_t const *p_qwr_init)
+{
+    (void)p_qwr;
+    (void)p_qwr_init;
+    return NRF_SUCCESS;
+}
+
+ret_code_t nrf_ble_qwr_conn_handle_assign(nrf_ble_qwr_t *p_qwr, uint16_t conn_handle)
+{
+    (void)p_qwr;
+    (void)conn_handle;
+    return NRF_SUCCESS;
+}
+
+uint32_t ble_bas_init(ble_bas_t *p_bas, ble_bas_init_t const *p_bas_init)
+{
+    p_bas->battery_level_last = p_bas_init->initial_batt_level;
+    return NRF_SUCCESS;
+}
+
+uint32_t ble_bas_battery_level_update(ble_bas_t *p_bas, uint8_t battery_level, uint16_t conn_handle)
+{
+    if (battery_level == p_bas->battery_level_last) return NRF_SUCCESS;
+
+    p_bas->battery_level_last = battery_level;
+    if (bas_error != NRF_SUCCESS) return bas_error;
+
+    uint32_t err_code = hvx(conn_handle, SIM_REPORT_BATTERY, CCCD_BIT_BATTERY, &battery_level, sizeof(battery_level));
+    if (err_code == NRF_SUCCESS)
+    {
+        bas_notification_count++;
+        bas_level_notified = battery_level;
+    }
+    return err_code;
+}
+
+void sim_bas_error_set(uint32_t err_code)
+{
+    bas_error = err_code;
+}
+
+uint32_t sim_bas_notification_count(void)
+{
+    return bas_notification_count;
+}
+
+uint8_t sim_bas_level_notified(void)
+{
+    return bas_level_notified;
+}
+
+void ble_srv_ascii_to_utf8(ble_srv_utf8_str_t *p_utf8, char *p_ascii)
+{
+    p_utf8->length = (uint16_t)strlen(p_ascii);
+    p_utf8->p_str = (uint8_t *)p_ascii;
+}
+
+uint32_t ble_dis_init(ble_dis_init_t const *p_dis_init)
+{
+    (void)p_dis_init;
+    return NRF_SUCCESS;
+}
+
+/* Atomics, the tests run on a single thread. */
+
+uint32_t nrf_atomic_u32_store(nrf_atomic_u32_t *p_data, uint32_t value)
+{
+    *p_data = value;
+    return value;
+}
+
+uint32_t nrf_atomic_u32_fetch_store(nrf_atomic_u32_t *p_data, uint32_t value)
+{
+    uint32_t old = *p_data;
+    *p_data = value;
+    return old;
+}
+
+uint32_t nrf_atomic_u32_or(nrf_atomic_u32_t *p_data, uint32_t value)
+{
+    *p_data |= value;
+    return *p_data;
+}
+
+uint32_t nrf_atomic_u32_and(nrf_atomic_u32_t *p_data, uint32_t value)
+{
+    *p_data &= value;
+    return *p_data;
+}
+
+uint32_t nrf_atomic_u32_fetch_or(nrf_atomic_u32_t *p_data, uint32_t value)
+{
+    uint32_t old = *p_data;
+    *p_data |= value;
+    return old;
+}
+
+uint32_t nrf_atomic_u32_fetch_and(nrf_atomic_u32_t *p_data, uint32_t value)
+{
+    uint32_t old = *p_data;
+    *p_data &= value;
+    return old;
+}
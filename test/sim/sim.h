@@ -0,0 +1,116 @@
+/*
+ * Host simulator of the SoftDevice, the peer manager and the SDK libraries used by the BLE module.
+ *
+ * Time only moves when a test asks for it. The SoftDevice keeps hvn_tx_queue_size notifications per link, a
+ * connection event sends up to tx_per_conn_event of them and reports them with BLE_GATTS_EVT_HVN_TX_COMPLETE.
+ * With conn_event_length_us set, a connection event also only sends the notifications whose link layer packets
+ * fit in that much 1M PHY airtime, the packets carrying the data length negotiated on the link.
+ * With slave_latency set, a link with nothing queued skips up to that many connection events, unless the module
+ * disabled it with BLE_GAP_OPT_SLAVE_LATENCY_DISABLE. A link with notifications queued never skips one.
+ */
+#pragma once
+
+#include "nrf5_stub.h"
+
+#define SIM_NOTIFICATION_LOG_SIZE 1024
+#define SIM_NOTIFICATION_MAX_LEN 244
+#define SIM_PEERS_MAX 8
+#define SIM_PEER_APP_DATA_SIZE 32
+
+#define SIM_REPORT_BOOT_KEYBOARD 0xFF /* report_index of a boot keyboard notification. */
+#define SIM_REPORT_BATTERY 0xFE       /* report_index of a battery level notification. */
+
+typedef struct
+{
+    uint8_t hvn_tx_queue_size;  /* Notifications the SoftDevice holds per link. */
+    uint8_t tx_per_conn_event;  /* Notifications sent in one connection event. */
+    uint32_t conn_interval_us;  /* Time between two connection events. */
+    uint32_t conn_event_length_us; /* Radio time of a connection event, 0 for no limit. */
+    uint16_t slave_latency;        /* Connection events a link may skip, granted by the central. */
+} sim_config_t;
+
+typedef struct
+{
+    uint16_t conn_handle;
+    uint8_t report_index;
+    uint16_t len;
+    uint8_t data[SIM_NOTIFICATION_MAX_LEN];
+} sim_notification_t;
+
+/* Applies the configuration and empties the SoftDevice queues, the logs and the error count. The handlers the
+ * module registered, the timers and the bonds are kept, so it can be called between the steps of a test. */
+void sim_reset(sim_config_t const *p_config);
+
+/* Stack configuration: what the module gave the SoftDevice before enabling it. With a limit set before
+ * ble_module_init(), more notification buffers per link than the application RAM start leaves room for make
+ * nrf_sdh_ble_enable() fail with NRF_ERROR_NO_MEM and return the RAM start they need. */
+void sim_stack_hvn_tx_queue_max_set(uint8_t max); /* 0 for no limit. */
+uint8_t sim_stack_hvn_tx_queue_size(void);
+bool sim_stack_conn_evt_ext(void);
+
+/* Time */
+void sim_time_advance_us(uint32_t us);
+uint64_t sim_time_us(void);
+
+/* Connection events: sends queued notifications and dispatches BLE_GATTS_EVT_HVN_TX_COMPLETE. */
+void sim_conn_event(void);
+void sim_conn_event_run(void); /* Without moving time, for callers keeping their own timeline. */
+uint32_t sim_conn_events_attended(uint16_t conn_handle); /* Connection events the link woke up for. */
+uint8_t sim_hvn_queued(uint16_t conn_handle);
+void sim_hvx_error_set(uint32_t err_code, uint32_t count);
+
+/* Notifications sent over the air, in order. */
+uint32_t sim_notification_count(void);
+sim_notification_t const *sim_notification_get(uint32_t index);
+void sim_notification_clear(void);
+
+/* Links */
+void sim_ble_evt_dispatch(ble_evt_t const *p_evt);
+void sim_connect(uint16_t conn_handle);
+void sim_disconnect(uint16_t conn_handle);
+void sim_secure(uint16_t conn_handle, pm_peer_id_t peer_id);
+void sim_cccd_set(uint16_t conn_handle, uint8_t report_index, bool enable);
+void sim_cccd_set_all(uint16_t conn_handle, bool enable);
+/* The central agrees on an ATT MTU and a data length, reported through the GATT module events. */
+void sim_gatt_negotiate(uint16_t conn_handle, uint16_t att_mtu, uint8_t data_length);
+
+/* Central: answers the connection parameter requests at the next connection event. A request with a minimum
+ * interval below min_interval (1.25 ms units, 0 accepts all) is rejected, the others are granted their minimum. */
+void sim_central_conn_interval_min_set(uint16_t min_interval);
+uint32_t sim_conn_params_request_count(void);
+ble_gap_conn_params_t const *sim_conn_params_request_get(uint32_t index);
+
+/* HID service */
+uint8_t sim_hids_input_count(void); /* Report characteristics given to the last ble_hids_init(). */
+ble_hids_inp_rep_init_t const *sim_hids_input_get(uint8_t index);
+uint8_t sim_hids_output_count(void);
+ble_hids_outp_rep_init_t const *sim_hids_output_get(uint8_t index);
+void sim_hids_evt(ble_hids_evt_t *p_evt);
+void sim_output_report_set(uint16_t conn_handle, uint8_t report_index, uint8_t const *p_data, uint16_t len);
+void sim_output_report_write(uint16_t conn_handle, uint8_t report_index, uint8_t const *p_data, uint16_t len);
+void sim_output_report_error_set(uint32_t err_code);
+
+/* Battery service: like the SDK module, a new level is recorded before it is notified, and an unchanged level
+ * is not notified again. Its notifications share the SoftDevice queue, sim_cccd_set_all() subscribes to them. */
+void sim_bas_error_set(uint32_t err_code); /* Returned by the notifications until set back to NRF_SUCCESS. */
+uint32_t sim_bas_notification_count(void);
+uint8_t sim_bas_level_notified(void);
+
+/* Peer manager */
+void sim_pm_evt(pm_evt_t const *p_evt);
+pm_peer_id_t sim_peer_add(uint8_t addr_last_byte);
+void sim_peer_app_data_set(pm_peer_id_t peer_id, void const *p_data, uint32_t len);
+uint32_t sim_pm_whitelist_set_count(void);  /* Calls to pm_whitelist_set(), each one reads the keys from flash. */
+uint32_t sim_pm_identities_set_count(void); /* Calls to pm_device_identities_list_set(), same. */
+uint32_t sim_pm_keys_read_count(void);      /* Calls to pm_whitelist_get() and pm_peer_data_bonding_load(). */
+
+/* Advertising */
+void sim_adv_evt(ble_adv_evt_t evt);
+ble_adv_mode_t sim_adv_mode(void);
+uint32_t sim_adv_start_count(void);
+uint32_t sim_advdata_update_count(void); /* Calls to ble_advertising_advdata_update(). */
+bool sim_advdata_scan_rsp(void);         /* The last update had a scan response. */
+uint32_t sim_whitelist_reply_addr_count(void); /* Addresses given to the last ble_advertising_whitelist_reply(). */
+
+/* Errors reported through APP_ERROR_CHECK since the last sim_reset(). */
+uint32_t sim_app_error_count(void);
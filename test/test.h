@@ -0,0 +1,74 @@
+/*
+ * Minimal assertions for the host tests. A test program returns the number of failed checks.
+ */
+#pragma once
+
+#include <stdio.h>
+
+static unsigned test_failures;
+
+#define CHECK(cond)                                                          \
+    do                                                                       \
+    {                                                                        \
+        if (!(cond))                                                         \
+        {                                                                    \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            test_failures++;                                                 \
+        }                                                                    \
+    } while (0)
+
+#define CHECK_EQ(actual, expected)                                                                               \
+    do                                                                                                           \
+    {                                                                                                            \
+        long long const _a = (long long)(actual);                                                                \
+        long long const _e = (long long)(expected);                                                              \
+        if (_a != _e)                                                                                            \
+        {                                                                                                        \
+            fprintf(stderr, "%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, _a, _e);          \
+            test_failures++;                                                                                     \
+        }                                                                                                        \
+    } while (0)
+
+#define TEST_RUN(test)                            \
+    do                                            \
+    {                                             \
+        unsigned const _before = test_failures;   \
+        test();                                   \
+        printf("%s %s\n", (test_failures == _before) ? "PASS" : "FAIL", #test); \
+    } while (0)
+
+#define TEST_RESULT() ((test_failures == 0) ? 0 : 1)
+
+#include "Ble_composite_dev.h"
+#include "ble_hid_service.h"
+#include "descriptors.h"
+#include "sim.h"
+
+/* Starts the module with the keyboard firmware descriptor, once per test program. */
+static inline void fixture_init(sim_config_t const *p_config)
+{
+    sim_reset(p_config);
+    ble_set_report_descriptor(desc_defy, sizeof(desc_defy));
+    ble_module_init();
+}
+
+/* Connects a bonded host on a link, encrypts it and subscribes to every input report. */
+static inline pm_peer_id_t fixture_link_up(uint16_t conn_handle)
+{
+    pm_peer_id_t peer_id = sim_peer_add((uint8_t)(0x10 + conn_handle));
+    sim_connect(conn_handle);
+    sim_secure(conn_handle, peer_id);
+    sim_cccd_set_all(conn_handle, true);
+    return peer_id;
+}
+
+/* Runs connection events and the main loop until the SoftDevice and the module have nothing left to send. */
+static inline void fixture_drain(uint16_t conn_handle)
+{
+    for (uint32_t i = 0; i < 10000; i++)
+    {
+        ble_run();
+        if ((sim_hvn_queued(conn_handle) == 0) && ble_hid_tx_idle()) break;
+        sim_conn_event();
+    }
+}
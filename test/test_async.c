@@ -0,0 +1,127 @@
+/*
+ * Asynchronous disconnection and bond deletion: one operation at a time, ended by the SoftDevice or Peer Manager
+ * event of its own link or peer, or by its timeout when that event never comes.
+ */
+#include "test.h"
+
+static uint32_t handler_calls;
+static ble_async_op_t handler_op;
+static ble_async_result_t handler_result;
+
+static void async_handler(ble_async_op_t op, ble_async_result_t result)
+{
+    handler_calls++;
+    handler_op = op;
+    handler_result = result;
+}
+
+/* The Peer Manager reports a deletion once the flash is erased, the simulation leaves it to the test. */
+static void peer_delete_evt(pm_evt_id_t evt_id, pm_peer_id_t peer_id)
+{
+    pm_evt_t evt;
+
+    memset(&evt, 0, sizeof(evt));
+    evt.evt_id = evt_id;
+    evt.conn_handle = BLE_CONN_HANDLE_INVALID;
+    evt.peer_id = peer_id;
+    sim_pm_evt(&evt);
+}
+
+static void check_handler(uint32_t calls, ble_async_op_t op, ble_async_result_t result)
+{
+    CHECK_EQ(handler_calls, calls);
+    CHECK_EQ(handler_op, op);
+    CHECK_EQ(handler_result, result);
+}
+
+static void test_disconnect_done(void)
+{
+    handler_calls = 0;
+    CHECK_EQ(ble_disconnect_async(), NRF_ERROR_INVALID_STATE);
+
+    fixture_link_up(0);
+    CHECK_EQ(ble_disconnect_async(), NRF_SUCCESS);
+    CHECK(ble_async_busy());
+    CHECK_EQ(delete_peers_async(), NRF_ERROR_BUSY);
+    CHECK_EQ(handler_calls, 0);
+
+    sim_disconnect(0);
+    check_handler(1, BLE_ASYNC_OP_DISCONNECT, BLE_ASYNC_DONE);
+    CHECK(!ble_async_busy());
+
+    // The timeout was stopped.
+    sim_time_advance_us(2 * BLE_DISCONNECT_TIMEOUT_MS * 1000);
+    CHECK_EQ(handler_calls, 1);
+}
+
+static void test_disconnect_timeout(void)
+{
+    handler_calls = 0;
+    fixture_link_up(0);
+    CHECK_EQ(ble_disconnect_async(), NRF_SUCCESS);
+
+    // The central never confirms.
+    sim_time_advance_us((BLE_DISCONNECT_TIMEOUT_MS - 100) * 1000);
+    CHECK_EQ(handler_calls, 0);
+    sim_time_advance_us(200 * 1000);
+    check_handler(1, BLE_ASYNC_OP_DISCONNECT, BLE_ASYNC_TIMEOUT);
+    CHECK(!ble_async_busy());
+
+    // A late event is not reported again.
+    sim_disconnect(0);
+    CHECK_EQ(handler_calls, 1);
+}
+
+static void test_peer_delete_waits_for_its_peer(void)
+{
+    handler_calls = 0;
+    pm_peer_id_t const peer_a = sim_peer_add(0x40);
+    pm_peer_id_t const peer_b = sim_peer_add(0x41);
+
+    CHECK_EQ(delete_peer_by_id_async(PM_PEER_ID_INVALID), NRF_ERROR_INVALID_PARAM);
+    CHECK_EQ(delete_peer_by_id_async(peer_a), NRF_SUCCESS);
+    CHECK_EQ(delete_peer_by_id_async(peer_b), NRF_ERROR_BUSY);
+
+    // Another peer deleted meanwhile does not end the operation.
+    peer_delete_evt(PM_EVT_PEER_DELETE_SUCCEEDED, peer_b);
+    CHECK_EQ(handler_calls, 0);
+    CHECK(ble_async_busy());
+
+    peer_delete_evt(PM_EVT_PEER_DELETE_SUCCEEDED, peer_a);
+    check_handler(1, BLE_ASYNC_OP_PEER_DELETE, BLE_ASYNC_DONE);
+    CHECK(!ble_async_busy());
+}
+
+static void test_peer_delete_failed_and_timeout(void)
+{
+    handler_calls = 0;
+    pm_peer_id_t const peer = sim_peer_add(0x42);
+
+    CHECK_EQ(delete_peer_by_id_async(peer), NRF_SUCCESS);
+    peer_delete_evt(PM_EVT_PEER_DELETE_FAILED, peer);
+    check_handler(1, BLE_ASYNC_OP_PEER_DELETE, BLE_ASYNC_FAILED);
+
+    // The flash never reports back.
+    CHECK_EQ(delete_peer_by_id_async(sim_peer_add(0x43)), NRF_SUCCESS);
+    sim_time_advance_us((BLE_PEER_DELETE_TIMEOUT_MS + 100) * 1000);
+    check_handler(2, BLE_ASYNC_OP_PEER_DELETE, BLE_ASYNC_TIMEOUT);
+
+    CHECK_EQ(delete_peers_async(), NRF_SUCCESS);
+    peer_delete_evt(PM_EVT_PEERS_DELETE_SUCCEEDED, PM_PEER_ID_INVALID);
+    check_handler(3, BLE_ASYNC_OP_PEERS_DELETE, BLE_ASYNC_DONE);
+}
+
+int main(void)
+{
+    sim_config_t const config = {.hvn_tx_queue_size = 1, .tx_per_conn_event = 1, .conn_interval_us = 7500};
+
+    fixture_init(&config);
+    ble_async_handler_set(async_handler);
+
+    TEST_RUN(test_disconnect_done);
+    TEST_RUN(test_disconnect_timeout);
+    TEST_RUN(test_peer_delete_waits_for_its_peer);
+    TEST_RUN(test_peer_delete_failed_and_timeout);
+    CHECK_EQ(sim_app_error_count(), 0);
+    return TEST_RESULT();
+}
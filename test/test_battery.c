@@ -0,0 +1,69 @@
+/*
+ * Battery level: a level the SoftDevice could not take stays pending until it is notified, and the hysteresis
+ * applies against the last level the host actually received.
+ */
+#include "test.h"
+
+static void key_send(uint8_t key)
+{
+    uint8_t report[DESC_REPORT_LEN_KEYBOARD] = {0};
+    report[1] = key;
+
+    CHECK(ble_hid_report_send(DESC_REPORT_ID_KEYBOARD, report, sizeof(report)) <= BLE_HID_SEND_QUEUED);
+}
+
+static void test_level_kept_until_notified(void)
+{
+    ble_battery_policy_t const policy = {.hysteresis = 2, .min_interval_ms = 0, .mode = BLE_BATTERY_SEND_IDLE};
+    ble_battery_stats_t stats;
+
+    ble_battery_policy_set(&policy);
+    ble_battery_stats_reset();
+
+    // The TX buffers are full, the level cannot go out.
+    sim_bas_error_set(NRF_ERROR_RESOURCES);
+    ble_battery_level_update(50);
+    ble_run();
+    CHECK_EQ(sim_bas_notification_count(), 0);
+
+    // The host still shows 100%, 51% is a change worth sending even if the BAS recorded 50%.
+    ble_battery_level_update(51);
+    ble_run();
+    CHECK_EQ(sim_bas_notification_count(), 0);
+
+    // It goes out on the next TX complete that leaves the HID reports idle.
+    sim_bas_error_set(NRF_SUCCESS);
+    key_send(0x01);
+    fixture_drain(0);
+    CHECK_EQ(sim_bas_notification_count(), 1);
+    CHECK_EQ(sim_bas_level_notified(), 51);
+
+    ble_battery_stats_get(&stats);
+    CHECK_EQ(stats.sent, 1);
+    CHECK_EQ(stats.suppressed, 1);
+
+    // Within the hysteresis of 51%, then outside of it.
+    ble_battery_level_update(50);
+    ble_run();
+    CHECK_EQ(sim_bas_notification_count(), 1);
+    ble_battery_level_update(49);
+    ble_run();
+    CHECK_EQ(sim_bas_notification_count(), 2);
+    CHECK_EQ(sim_bas_level_notified(), 49);
+
+    key_send(0x00);
+    fixture_drain(0);
+}
+
+int main(void)
+{
+    sim_config_t const config = {.hvn_tx_queue_size = 1, .tx_per_conn_event = 1, .conn_interval_us = 7500};
+
+    fixture_init(&config);
+    fixture_link_up(0);
+    fixture_drain(0);
+
+    TEST_RUN(test_level_kept_until_notified);
+    CHECK_EQ(sim_app_error_count(), 0);
+    return TEST_RESULT();
+}
@@ -0,0 +1,108 @@
+/*
+ * Bond cache: the whitelist and the device identities are built from the keys read at start up. The Peer Manager,
+ * which reads the keys from flash, only gets the lists again when the set of peers or a listed peer's keys changed.
+ */
+#include "test.h"
+
+static pm_peer_id_t peer_a;
+static pm_peer_id_t peer_b;
+
+/* The Peer Manager reports keys stored in flash. */
+static void peer_data_evt(pm_peer_id_t peer_id, pm_peer_data_id_t data_id, pm_peer_data_op_t action)
+{
+    pm_evt_t evt;
+
+    memset(&evt, 0, sizeof(evt));
+    evt.evt_id = PM_EVT_PEER_DATA_UPDATE_SUCCEEDED;
+    evt.conn_handle = BLE_CONN_HANDLE_INVALID;
+    evt.peer_id = peer_id;
+    evt.params.peer_data_update_succeeded.data_id = data_id;
+    evt.params.peer_data_update_succeeded.action = action;
+    evt.params.peer_data_update_succeeded.flash_changed = true;
+    sim_pm_evt(&evt);
+}
+
+static void test_unchanged_lists_skipped(void)
+{
+    uint32_t const keys_read = sim_pm_keys_read_count();
+
+    ble_goto_white_list_advertising_mode();
+    CHECK_EQ(sim_pm_whitelist_set_count(), 1);
+    sim_adv_evt(BLE_ADV_EVT_WHITELIST_REQUEST);
+    CHECK_EQ(sim_pm_identities_set_count(), 1);
+    CHECK_EQ(sim_whitelist_reply_addr_count(), 2);
+
+    // Same peers: nothing given again, and the whitelist reply comes from RAM.
+    ble_goto_white_list_advertising_mode();
+    sim_adv_evt(BLE_ADV_EVT_WHITELIST_REQUEST);
+    sim_adv_evt(BLE_ADV_EVT_WHITELIST_REQUEST);
+    CHECK_EQ(sim_pm_whitelist_set_count(), 1);
+    CHECK_EQ(sim_pm_identities_set_count(), 1);
+    CHECK_EQ(sim_whitelist_reply_addr_count(), 2);
+    CHECK_EQ(sim_pm_keys_read_count(), keys_read);
+}
+
+static void test_new_bond_applied(void)
+{
+    pm_peer_id_t const peer_c = sim_peer_add(0x32);
+
+    // The whitelist is updated from the low priority class.
+    peer_data_evt(peer_c, PM_PEER_DATA_ID_BONDING, PM_PEER_DATA_OP_UPDATE);
+    CHECK_EQ(sim_pm_whitelist_set_count(), 1);
+    ble_run();
+    CHECK_EQ(sim_pm_whitelist_set_count(), 2);
+
+    sim_adv_evt(BLE_ADV_EVT_WHITELIST_REQUEST);
+    CHECK_EQ(sim_pm_identities_set_count(), 2);
+    CHECK_EQ(sim_whitelist_reply_addr_count(), 3);
+}
+
+static void test_new_keys_applied(void)
+{
+    // Same peers, but the Peer Manager has to read peer A's new Central Address Resolution.
+    peer_data_evt(peer_a, PM_PEER_DATA_ID_CENTRAL_ADDR_RES, PM_PEER_DATA_OP_UPDATE);
+    ble_goto_white_list_advertising_mode();
+    CHECK_EQ(sim_pm_whitelist_set_count(), 3);
+    sim_adv_evt(BLE_ADV_EVT_WHITELIST_REQUEST);
+    CHECK_EQ(sim_pm_identities_set_count(), 3);
+
+    ble_goto_white_list_advertising_mode();
+    sim_adv_evt(BLE_ADV_EVT_WHITELIST_REQUEST);
+    CHECK_EQ(sim_pm_whitelist_set_count(), 3);
+    CHECK_EQ(sim_pm_identities_set_count(), 3);
+}
+
+static void test_deleted_bond_applied(void)
+{
+    pm_evt_t evt;
+
+    CHECK_EQ(pm_peer_delete(peer_b), NRF_SUCCESS);
+    memset(&evt, 0, sizeof(evt));
+    evt.evt_id = PM_EVT_PEER_DELETE_SUCCEEDED;
+    evt.conn_handle = BLE_CONN_HANDLE_INVALID;
+    evt.peer_id = peer_b;
+    sim_pm_evt(&evt);
+
+    ble_goto_white_list_advertising_mode();
+    CHECK_EQ(sim_pm_whitelist_set_count(), 4);
+    sim_adv_evt(BLE_ADV_EVT_WHITELIST_REQUEST);
+    CHECK_EQ(sim_pm_identities_set_count(), 4);
+    CHECK_EQ(sim_whitelist_reply_addr_count(), 2);
+}
+
+int main(void)
+{
+    sim_config_t const config = {.hvn_tx_queue_size = 1, .tx_per_conn_event = 1, .conn_interval_us = 7500};
+
+    // Bonded before start up.
+    peer_a = sim_peer_add(0x30);
+    peer_b = sim_peer_add(0x31);
+    fixture_init(&config);
+
+    TEST_RUN(test_unchanged_lists_skipped);
+    TEST_RUN(test_new_bond_applied);
+    TEST_RUN(test_new_keys_applied);
+    TEST_RUN(test_deleted_bond_applied);
+    CHECK_EQ(sim_app_error_count(), 0);
+    return TEST_RESULT();
+}
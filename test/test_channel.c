@@ -0,0 +1,105 @@
+/*
+ * Channels: peer sets and last centrals read back from flash, identity switch through the advertising module,
+ * directed advertising only to the last central of the channel.
+ */
+#include "test.h"
+
+/* Application data of a peer record, as stored by the module. */
+typedef struct
+{
+    uint32_t seq;
+    uint8_t channel;
+    uint8_t reserved[3];
+} last_peer_record_t;
+
+static pm_peer_id_t peer_on_channel_0;
+static pm_peer_id_t peer_on_channel_2;
+static pm_peer_id_t peer_moved;
+
+/* Bonds made before the power cycle, each with the channel it last connected on. */
+static void bonds_add(void)
+{
+    last_peer_record_t record;
+
+    memset(&record, 0, sizeof(record));
+    peer_on_channel_0 = sim_peer_add(0x20);
+    record.seq = 1;
+    record.channel = 0;
+    sim_peer_app_data_set(peer_on_channel_0, &record, sizeof(record));
+
+    peer_on_channel_2 = sim_peer_add(0x22);
+    record.seq = 2;
+    record.channel = 2;
+    sim_peer_app_data_set(peer_on_channel_2, &record, sizeof(record));
+
+    // Connected on channel 2 before, then on channel 0.
+    peer_moved = sim_peer_add(0x23);
+    record.seq = 3;
+    record.channel = 0;
+    sim_peer_app_data_set(peer_moved, &record, sizeof(record));
+
+    // Bonded, never recorded.
+    sim_peer_add(0x24);
+}
+
+static void test_peer_sets_from_flash(void)
+{
+    pm_peer_id_t peers[BLE_GAP_WHITELIST_ADDR_MAX_COUNT];
+
+    CHECK_EQ(ble_channel_peers_get(0, peers), 2);
+    CHECK_EQ(peers[0], peer_on_channel_0);
+    CHECK_EQ(peers[1], peer_moved);
+
+    CHECK_EQ(ble_channel_peers_get(2, peers), 1);
+    CHECK_EQ(peers[0], peer_on_channel_2);
+
+    CHECK_EQ(ble_channel_peers_get(1, peers), 0);
+
+    CHECK_EQ(ble_channel_last_peer_get(0), peer_moved);
+    CHECK_EQ(ble_channel_last_peer_get(2), peer_on_channel_2);
+    CHECK_EQ(ble_channel_last_peer_get(1), PM_PEER_ID_INVALID);
+}
+
+static void test_switch_updates_advertising_data(void)
+{
+    uint32_t updates = sim_advdata_update_count();
+
+    CHECK(ble_channel_switch(2));
+    CHECK_EQ(sim_advdata_update_count(), updates + 1);
+    CHECK(ble_channel_switch(0));
+    CHECK_EQ(sim_advdata_update_count(), updates + 2);
+    CHECK(!ble_channel_switch(BLE_CHANNELS_COUNT));
+    CHECK_EQ(sim_advdata_update_count(), updates + 2);
+}
+
+static void test_directed_only_to_channel_central(void)
+{
+    // The central of channel 0 connects, then the keyboard moves to channel 1 that has no record.
+    CHECK(ble_channel_switch(0));
+    sim_connect(0);
+    sim_secure(0, peer_on_channel_0);
+    sim_disconnect(0);
+    ble_run();
+
+    CHECK(ble_channel_switch(1));
+    ble_goto_advertising_mode();
+    CHECK_EQ(sim_adv_mode(), BLE_ADV_MODE_FAST);
+
+    CHECK(ble_channel_switch(0));
+    ble_goto_advertising_mode();
+    CHECK_EQ(sim_adv_mode(), BLE_ADV_MODE_DIRECTED_HIGH_DUTY);
+}
+
+int main(void)
+{
+    sim_config_t const config = {.hvn_tx_queue_size = 1, .tx_per_conn_event = 1, .conn_interval_us = 7500};
+
+    bonds_add();
+    fixture_init(&config);
+
+    TEST_RUN(test_peer_sets_from_flash);
+    TEST_RUN(test_switch_updates_advertising_data);
+    TEST_RUN(test_directed_only_to_channel_central);
+    CHECK_EQ(sim_app_error_count(), 0);
+    return TEST_RESULT();
+}
@@ -0,0 +1,152 @@
+/*
+ * Connection parameters: typing asks for the shortest interval and relaxes it one step each time the central
+ * rejects it, a link without reports switches to the idle parameters. The handler gets every set in use.
+ */
+#include "test.h"
+
+#define HANDLER_LOG_SIZE 16
+
+static ble_gap_conn_params_t handler_log[HANDLER_LOG_SIZE];
+static uint32_t handler_calls;
+
+static void conn_params_handler(uint16_t conn_handle, ble_gap_conn_params_t const *p_conn_params)
+{
+    CHECK_EQ(conn_handle, 0);
+    if (handler_calls < HANDLER_LOG_SIZE)
+    {
+        handler_log[handler_calls] = *p_conn_params;
+    }
+    handler_calls++;
+}
+
+static void key_send(uint8_t key)
+{
+    uint8_t report[DESC_REPORT_LEN_KEYBOARD] = {0};
+    report[1] = key;
+
+    CHECK(ble_hid_report_send(DESC_REPORT_ID_KEYBOARD, report, sizeof(report)) <= BLE_HID_SEND_QUEUED);
+}
+
+static void conn_events(uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        ble_run();
+        sim_conn_event();
+    }
+}
+
+static void check_request(uint32_t index, uint16_t min_interval, uint16_t max_interval, uint16_t slave_latency)
+{
+    ble_gap_conn_params_t const *p_request = sim_conn_params_request_get(index);
+
+    CHECK(p_request != NULL);
+    if (p_request == NULL) return;
+
+    CHECK_EQ(p_request->min_conn_interval, min_interval);
+    CHECK_EQ(p_request->max_conn_interval, max_interval);
+    CHECK_EQ(p_request->slave_latency, slave_latency);
+}
+
+/* Starts a link and its handler log, with a central rejecting intervals shorter than min_interval. */
+static void link_start(uint16_t min_interval)
+{
+    sim_reset(NULL);
+    sim_central_conn_interval_min_set(min_interval);
+    handler_calls = 0;
+
+    fixture_link_up(0);
+    CHECK_EQ(handler_calls, 1);
+}
+
+static void test_rejections_relax_min_interval(void)
+{
+    // The central only takes the longest active interval: two steps of 3.75 ms from 7.5 ms.
+    link_start(ACTIVE_CONN_INTERVAL_MAX);
+    key_send(0x10);
+    conn_events(10);
+
+    CHECK_EQ(sim_conn_params_request_count(), 3);
+    check_request(0, ACTIVE_CONN_INTERVAL_MIN, ACTIVE_CONN_INTERVAL_MAX, ACTIVE_SLAVE_LATENCY);
+    check_request(1, ACTIVE_CONN_INTERVAL_MIN + ACTIVE_CONN_INTERVAL_STEP, ACTIVE_CONN_INTERVAL_MAX, ACTIVE_SLAVE_LATENCY);
+    check_request(2, ACTIVE_CONN_INTERVAL_MAX, ACTIVE_CONN_INTERVAL_MAX, ACTIVE_SLAVE_LATENCY);
+
+    // Only the granted set reached the handler.
+    CHECK_EQ(handler_calls, 2);
+    CHECK_EQ(handler_log[1].min_conn_interval, ACTIVE_CONN_INTERVAL_MAX);
+    CHECK_EQ(handler_log[1].slave_latency, ACTIVE_SLAVE_LATENCY);
+
+    sim_disconnect(0);
+}
+
+static void test_min_interval_capped(void)
+{
+    // The central rejects every active interval, the requests stop at 15 ms.
+    link_start(ACTIVE_CONN_INTERVAL_MAX + 1);
+    key_send(0x10);
+    conn_events(10);
+    key_send(0x00);
+    conn_events(10);
+
+    CHECK_EQ(sim_conn_params_request_count(), 3);
+    check_request(2, ACTIVE_CONN_INTERVAL_MAX, ACTIVE_CONN_INTERVAL_MAX, ACTIVE_SLAVE_LATENCY);
+    CHECK_EQ(handler_calls, 1);
+
+    // A new link starts over from the shortest interval.
+    sim_disconnect(0);
+    link_start(0);
+    key_send(0x10);
+    conn_events(2);
+    CHECK_EQ(sim_conn_params_request_count(), 1);
+    check_request(0, ACTIVE_CONN_INTERVAL_MIN, ACTIVE_CONN_INTERVAL_MAX, ACTIVE_SLAVE_LATENCY);
+
+    sim_disconnect(0);
+}
+
+static void test_idle_after_timeout(void)
+{
+    link_start(0);
+    key_send(0x10);
+    uint64_t const activity_us = sim_time_us();
+    conn_events(2);
+    CHECK_EQ(sim_conn_params_request_count(), 1);
+    CHECK_EQ(handler_calls, 2);
+
+    // Nothing changes until CONN_IDLE_TIMEOUT_MS after the last report.
+    sim_time_advance_us((uint32_t)(activity_us + (CONN_IDLE_TIMEOUT_MS - 50) * 1000ULL - sim_time_us()));
+    CHECK_EQ(sim_conn_params_request_count(), 1);
+
+    sim_time_advance_us(100 * 1000);
+    CHECK_EQ(sim_conn_params_request_count(), 2);
+    check_request(1, IDLE_CONN_INTERVAL_MIN, IDLE_CONN_INTERVAL_MAX, IDLE_SLAVE_LATENCY);
+    conn_events(1);
+
+    // Typing again goes back to the active parameters.
+    key_send(0x00);
+    conn_events(2);
+    CHECK_EQ(sim_conn_params_request_count(), 3);
+    check_request(2, ACTIVE_CONN_INTERVAL_MIN, ACTIVE_CONN_INTERVAL_MAX, ACTIVE_SLAVE_LATENCY);
+
+    // Connection, active, idle, active: the handler got every set the central granted.
+    CHECK_EQ(handler_calls, 4);
+    CHECK_EQ(handler_log[1].min_conn_interval, ACTIVE_CONN_INTERVAL_MIN);
+    CHECK_EQ(handler_log[2].min_conn_interval, IDLE_CONN_INTERVAL_MIN);
+    CHECK_EQ(handler_log[2].slave_latency, IDLE_SLAVE_LATENCY);
+    CHECK_EQ(handler_log[3].min_conn_interval, ACTIVE_CONN_INTERVAL_MIN);
+
+    sim_disconnect(0);
+}
+
+int main(void)
+{
+    sim_config_t const config = {.hvn_tx_queue_size = 1, .tx_per_conn_event = 1, .conn_interval_us = 7500};
+
+    fixture_init(&config);
+    ble_conn_params_handler_set(conn_params_handler);
+
+    TEST_RUN(test_rejections_relax_min_interval);
+    TEST_RUN(test_min_interval_capped);
+    TEST_RUN(test_idle_after_timeout);
+    CHECK_EQ(sim_app_error_count(), 0);
+    return TEST_RESULT();
+}
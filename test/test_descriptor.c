@@ -0,0 +1,85 @@
+/*
+ * Report descriptor parsing: the service reports come from the descriptor, sizes that cannot fit are rejected
+ * instead of wrapping to a small report.
+ */
+#include "test.h"
+
+/* Raw HID report of 8 bit fields: Input items of 0x1000, 0x1000 and 1 fields, 65544 bits in all. */
+static uint8_t const desc_raw_sum_over_16_bits[] = {
+    0x06, 0x00, 0xFF, 0x09, 0x01, 0xA1, 0x01, 0x85, DESC_REPORT_ID_RAW, 0x75, 0x08,
+    0x96, 0x00, 0x10, 0x81, 0x02,
+    0x81, 0x02,
+    0x95, 0x01, 0x81, 0x02,
+    0xC0,
+};
+
+/* Raw HID report with a single Input item of 0x2001 8 bit fields, 65544 bits. */
+static uint8_t const desc_raw_item_over_16_bits[] = {
+    0x06, 0x00, 0xFF, 0x09, 0x01, 0xA1, 0x01, 0x85, DESC_REPORT_ID_RAW, 0x75, 0x08,
+    0x96, 0x01, 0x20, 0x81, 0x02,
+    0xC0,
+};
+
+/* Raw HID report with 0x10000 fields of 0x10000 bits, the product wraps to 0 in 32 bits, then one byte. */
+static uint8_t const desc_raw_product_over_32_bits[] = {
+    0x06, 0x00, 0xFF, 0x09, 0x01, 0xA1, 0x01, 0x85, DESC_REPORT_ID_RAW,
+    0x77, 0x00, 0x00, 0x01, 0x00, 0x97, 0x00, 0x00, 0x01, 0x00, 0x81, 0x02,
+    0x75, 0x08, 0x95, 0x01, 0x81, 0x02,
+    0xC0,
+};
+
+/* Builds the service from a descriptor, returns the errors it reported. */
+static uint32_t descriptor_load(uint8_t const *p_desc, uint16_t len)
+{
+    uint32_t const errors = sim_app_error_count();
+
+    ble_set_report_descriptor(p_desc, len);
+    hids_init();
+    return sim_app_error_count() - errors;
+}
+
+static void check_report(ble_hids_inp_rep_init_t const *p_report, uint8_t id, uint16_t len)
+{
+    CHECK(p_report != NULL);
+    if (p_report == NULL) return;
+
+    CHECK_EQ(p_report->rep_ref.report_id, id);
+    CHECK_EQ(p_report->max_len, len);
+}
+
+static void test_defy_reports(void)
+{
+    CHECK_EQ(descriptor_load(desc_defy, sizeof(desc_defy)), 0);
+
+    CHECK_EQ(sim_hids_input_count(), 5);
+    check_report(sim_hids_input_get(0), DESC_REPORT_ID_KEYBOARD, DESC_REPORT_LEN_KEYBOARD);
+    check_report(sim_hids_input_get(1), DESC_REPORT_ID_MOUSE, DESC_REPORT_LEN_MOUSE);
+    check_report(sim_hids_input_get(2), DESC_REPORT_ID_CONSUMER, DESC_REPORT_LEN_CONSUMER);
+    check_report(sim_hids_input_get(3), DESC_REPORT_ID_SYSTEM, DESC_REPORT_LEN_SYSTEM);
+    check_report(sim_hids_input_get(4), DESC_REPORT_ID_RAW, DESC_REPORT_LEN_RAW);
+
+    CHECK_EQ(sim_hids_output_count(), 2);
+    check_report(sim_hids_output_get(0), DESC_REPORT_ID_KEYBOARD, 1);
+    check_report(sim_hids_output_get(1), DESC_REPORT_ID_RAW, DESC_REPORT_LEN_RAW);
+}
+
+static void test_report_over_16_bits_rejected(void)
+{
+    CHECK_EQ(descriptor_load(desc_raw_sum_over_16_bits, sizeof(desc_raw_sum_over_16_bits)), 1);
+    CHECK_EQ(descriptor_load(desc_raw_item_over_16_bits, sizeof(desc_raw_item_over_16_bits)), 1);
+    CHECK_EQ(descriptor_load(desc_raw_product_over_32_bits, sizeof(desc_raw_product_over_32_bits)), 1);
+
+    // A rejected descriptor leaves nothing behind.
+    test_defy_reports();
+}
+
+int main(void)
+{
+    sim_config_t const config = {.hvn_tx_queue_size = 1, .tx_per_conn_event = 1, .conn_interval_us = 7500};
+
+    sim_reset(&config);
+
+    TEST_RUN(test_defy_reports);
+    TEST_RUN(test_report_over_16_bits_rejected);
+    return TEST_RESULT();
+}
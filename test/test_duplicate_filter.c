@@ -0,0 +1,153 @@
+/*
+ * Duplicate filter: a state report identical to what the host will have last received is dropped and counted,
+ * unless the filter is off for hosts that need the repeats.
+ */
+#include "test.h"
+
+#define KEY_A 4
+#define KEY_B 5
+
+static uint8_t keyboard[DESC_REPORT_LEN_KEYBOARD];
+
+static ble_hid_send_status_t keys_send(int key_1, int key_2)
+{
+    memset(keyboard, 0, sizeof(keyboard));
+    if (key_1 >= 0) keyboard[1 + key_1 / 8] |= (uint8_t)(1U << (key_1 % 8));
+    if (key_2 >= 0) keyboard[1 + key_2 / 8] |= (uint8_t)(1U << (key_2 % 8));
+    return ble_hid_report_send(DESC_REPORT_ID_KEYBOARD, keyboard, sizeof(keyboard));
+}
+
+static uint32_t duplicates_get(void)
+{
+    ble_hid_tx_queue_stats_t stats;
+
+    ble_hid_tx_queue_stats_get(&stats);
+    return stats.duplicates;
+}
+
+/* Checks the keyboard notifications the host of a link received, -1 ending the list of keys of each. */
+static void check_keys_received(uint16_t conn_handle, int const *p_keys, uint32_t count)
+{
+    uint32_t received = 0;
+
+    for (uint32_t n = 0; n < sim_notification_count(); n++)
+    {
+        sim_notification_t const *p_notification = sim_notification_get(n);
+        if ((p_notification->conn_handle != conn_handle) || (p_notification->len != DESC_REPORT_LEN_KEYBOARD)) continue;
+
+        CHECK(received < count);
+        if (received >= count) return;
+        CHECK_EQ(p_notification->data[1 + KEY_A / 8] & (1U << (KEY_A % 8)) ? KEY_A : -1, p_keys[2 * received]);
+        CHECK_EQ(p_notification->data[1 + KEY_B / 8] & (1U << (KEY_B % 8)) ? KEY_B : -1, p_keys[2 * received + 1]);
+        received++;
+    }
+    CHECK_EQ(received, count);
+}
+
+static void test_identical_report_dropped(void)
+{
+    static int const expected[] = {KEY_A, -1, -1, -1};
+
+    ble_hid_tx_queue_stats_reset();
+    sim_notification_clear();
+
+    CHECK_EQ(keys_send(KEY_A, -1), BLE_HID_SEND_OK);
+    fixture_drain(0);
+    CHECK_EQ(keys_send(KEY_A, -1), BLE_HID_SEND_DUPLICATE);
+    CHECK_EQ(duplicates_get(), 1);
+
+    CHECK_EQ(keys_send(-1, -1), BLE_HID_SEND_OK);
+    CHECK_EQ(keys_send(-1, -1), BLE_HID_SEND_DUPLICATE);
+    CHECK_EQ(duplicates_get(), 2);
+
+    fixture_drain(0);
+    check_keys_received(0, expected, 2);
+}
+
+static void test_compared_with_newest_queued(void)
+{
+    static int const expected[] = {KEY_A, -1, KEY_A, KEY_B, -1, -1};
+
+    ble_hid_tx_queue_stats_reset();
+    sim_notification_clear();
+
+    // A takes the SoftDevice buffer, A+B waits.
+    CHECK_EQ(keys_send(KEY_A, -1), BLE_HID_SEND_OK);
+    CHECK_EQ(keys_send(KEY_A, KEY_B), BLE_HID_SEND_QUEUED);
+
+    // Same as the queued report, not as the one sent.
+    CHECK_EQ(keys_send(KEY_A, KEY_B), BLE_HID_SEND_DUPLICATE);
+
+    // Same as the one sent, but not as the queued report: B is released.
+    CHECK_EQ(keys_send(KEY_A, -1), BLE_HID_SEND_QUEUED);
+    CHECK_EQ(keys_send(KEY_A, -1), BLE_HID_SEND_DUPLICATE);
+    CHECK_EQ(duplicates_get(), 2);
+
+    // Releasing A as well merges with the queued release of B.
+    CHECK_EQ(keys_send(-1, -1), BLE_HID_SEND_QUEUED);
+    fixture_drain(0);
+    check_keys_received(0, expected, 3);
+}
+
+static void test_filter_off_lets_repeats_through(void)
+{
+    static int const expected[] = {KEY_A, -1, KEY_A, -1, -1, -1};
+
+    ble_hid_tx_queue_stats_reset();
+    sim_notification_clear();
+    ble_hid_duplicate_filter_set(false);
+
+    CHECK_EQ(keys_send(KEY_A, -1), BLE_HID_SEND_OK);
+    fixture_drain(0);
+    CHECK_EQ(keys_send(KEY_A, -1), BLE_HID_SEND_OK);
+    fixture_drain(0);
+    CHECK_EQ(duplicates_get(), 0);
+
+    ble_hid_duplicate_filter_set(true);
+    CHECK_EQ(keys_send(-1, -1), BLE_HID_SEND_OK);
+    fixture_drain(0);
+    check_keys_received(0, expected, 3);
+}
+
+static void test_first_report_after_link_switch(void)
+{
+    static int const expected_1[] = {KEY_A, -1};
+
+    fixture_link_up(1);
+    CHECK(ble_active_link_set(0));
+    CHECK_EQ(keys_send(KEY_A, -1), BLE_HID_SEND_OK);
+    fixture_drain(0);
+
+    // The host of link 1 never saw A pressed: the same state is new to it.
+    sim_notification_clear();
+    CHECK(ble_active_link_set(1));
+    CHECK_EQ(keys_send(KEY_A, -1), BLE_HID_SEND_OK);
+    fixture_drain(1);
+    check_keys_received(1, expected_1, 1);
+
+    // Back on link 0, whose host was sent the release on the switch: a release is nothing new to it.
+    fixture_drain(0);
+    CHECK(ble_active_link_set(0));
+    fixture_drain(0);
+    CHECK_EQ(keys_send(-1, -1), BLE_HID_SEND_DUPLICATE);
+    CHECK_EQ(keys_send(KEY_B, -1), BLE_HID_SEND_OK);
+    CHECK_EQ(keys_send(-1, -1), BLE_HID_SEND_QUEUED);
+    fixture_drain(0);
+
+    sim_disconnect(1);
+}
+
+int main(void)
+{
+    sim_config_t const config = {.hvn_tx_queue_size = 1, .tx_per_conn_event = 1, .conn_interval_us = 7500};
+
+    fixture_init(&config);
+    fixture_link_up(0);
+
+    TEST_RUN(test_identical_report_dropped);
+    TEST_RUN(test_compared_with_newest_queued);
+    TEST_RUN(test_filter_off_lets_repeats_through);
+    TEST_RUN(test_first_report_after_link_switch);
+    CHECK_EQ(sim_app_error_count(), 0);
+    return TEST_RESULT();
+}
@@ -0,0 +1,96 @@
+/*
+ * Key reserve: with more TX credits than BLE_HID_TX_KEY_RESERVE, the last ones are left to the keyboard, so a raw
+ * transfer or a battery notification never takes the buffer a keystroke needs.
+ */
+#include "test.h"
+
+#define CREDITS 4
+
+static ble_hid_send_status_t key_send(uint8_t key)
+{
+    uint8_t report[DESC_REPORT_LEN_KEYBOARD] = {0};
+    report[1] = key;
+
+    return ble_hid_report_send(DESC_REPORT_ID_KEYBOARD, report, sizeof(report));
+}
+
+static void test_raw_leaves_reserve(void)
+{
+    uint8_t raw[DESC_REPORT_LEN_RAW];
+    uint8_t const len = ble_hid_raw_report_len_get();
+
+    // Raw reports take the credits outside the reserve and wait for the others.
+    for (uint8_t i = 0; i < CREDITS + 2; i++)
+    {
+        memset(raw, i, sizeof(raw));
+        ble_hid_send_status_t const status = ble_hid_report_send(DESC_REPORT_ID_RAW, raw, len);
+        CHECK_EQ(status, (i < CREDITS - BLE_HID_TX_KEY_RESERVE) ? BLE_HID_SEND_OK : BLE_HID_SEND_QUEUED);
+    }
+    CHECK_EQ(sim_hvn_queued(0), CREDITS - BLE_HID_TX_KEY_RESERVE);
+
+    // Battery waits behind them.
+    CHECK(!ble_hid_tx_external_allowed());
+
+    // A keystroke goes straight to the SoftDevice.
+    CHECK_EQ(key_send(0x10), BLE_HID_SEND_OK);
+    CHECK_EQ(sim_hvn_queued(0), CREDITS);
+
+    CHECK_EQ(key_send(0x00), BLE_HID_SEND_QUEUED);
+    fixture_drain(0);
+}
+
+static void test_battery_leaves_reserve(void)
+{
+    ble_battery_policy_t const policy = {.hysteresis = 1, .min_interval_ms = 0, .mode = BLE_BATTERY_SEND_ARBITRATED};
+    uint8_t mouse[DESC_REPORT_LEN_MOUSE] = {0, 1, 0, 0, 0};
+
+    ble_battery_policy_set(&policy);
+    uint32_t const notified = sim_bas_notification_count();
+
+    // Nothing waits, but only the reserve is left.
+    for (uint8_t i = 0; i < CREDITS - BLE_HID_TX_KEY_RESERVE; i++)
+    {
+        mouse[1] = (uint8_t)(i + 1);
+        CHECK_EQ(ble_hid_report_send(DESC_REPORT_ID_MOUSE, mouse, sizeof(mouse)), BLE_HID_SEND_OK);
+    }
+    CHECK(!ble_hid_tx_external_allowed());
+    ble_battery_level_update(42);
+    ble_run();
+    CHECK_EQ(sim_bas_notification_count(), notified);
+
+    CHECK_EQ(key_send(0x10), BLE_HID_SEND_OK);
+    CHECK_EQ(sim_hvn_queued(0), CREDITS);
+
+    // The level goes out once a credit outside the reserve is free.
+    CHECK_EQ(key_send(0x00), BLE_HID_SEND_QUEUED);
+    fixture_drain(0);
+    CHECK_EQ(sim_bas_notification_count(), notified + 1);
+    CHECK_EQ(sim_bas_level_notified(), 42);
+}
+
+static void test_single_credit_shared(void)
+{
+    uint8_t raw[DESC_REPORT_LEN_RAW] = {0x55};
+
+    // No more credits than the reserve: every class may use it.
+    ble_hid_tx_credits_set(BLE_HID_TX_KEY_RESERVE);
+    CHECK_EQ(ble_hid_report_send(DESC_REPORT_ID_RAW, raw, ble_hid_raw_report_len_get()), BLE_HID_SEND_OK);
+    fixture_drain(0);
+    ble_hid_tx_credits_set(CREDITS);
+}
+
+int main(void)
+{
+    sim_config_t const config = {.hvn_tx_queue_size = CREDITS, .tx_per_conn_event = 1, .conn_interval_us = 7500};
+
+    fixture_init(&config);
+    ble_hid_tx_credits_set(CREDITS);
+    fixture_link_up(0);
+    fixture_drain(0);
+
+    TEST_RUN(test_raw_leaves_reserve);
+    TEST_RUN(test_battery_leaves_reserve);
+    TEST_RUN(test_single_credit_shared);
+    CHECK_EQ(sim_app_error_count(), 0);
+    return TEST_RESULT();
+}
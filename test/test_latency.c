@@ -0,0 +1,79 @@
+/*
+ * Latency histogram: the time from a report given to its TX complete event lands in the bucket of its range,
+ * per report type, and the percentiles read the bucket upper limits.
+ */
+#include "test.h"
+
+/* Sends a keyboard report and acknowledges it latency_ms later. */
+static void key_sent_after(uint32_t latency_ms)
+{
+    static uint8_t key;
+    uint8_t report[DESC_REPORT_LEN_KEYBOARD] = {0};
+
+    key ^= 0x01;
+    report[1] = key;
+    CHECK_EQ(ble_hid_report_send(DESC_REPORT_ID_KEYBOARD, report, sizeof(report)), BLE_HID_SEND_OK);
+    sim_time_advance_us(latency_ms * 1000);
+    sim_conn_event_run();
+    ble_run();
+}
+
+static void test_buckets(void)
+{
+    ble_hid_latency_histogram_t histogram;
+
+    ble_hid_latency_reset();
+
+    // Buckets below 5 ms, 5-10 ms, 30-45 ms and above 250 ms.
+    key_sent_after(2);
+    key_sent_after(7);
+    key_sent_after(7);
+    key_sent_after(35);
+    key_sent_after(300);
+
+    CHECK(ble_hid_latency_snapshot(DESC_REPORT_ID_KEYBOARD, &histogram));
+    CHECK_EQ(histogram.total, 5);
+    CHECK_EQ(histogram.count[0], 1);
+    CHECK_EQ(histogram.count[1], 2);
+    CHECK_EQ(histogram.count[5], 1);
+    CHECK_EQ(histogram.count[BLE_HID_LATENCY_BUCKETS - 1], 1);
+    CHECK((histogram.max_ms >= 299) && (histogram.max_ms <= 300)); // RTC ticks, rounded down to the ms.
+
+    // Only the keyboard report was measured.
+    CHECK(ble_hid_latency_snapshot(DESC_REPORT_ID_MOUSE, &histogram));
+    CHECK_EQ(histogram.total, 0);
+    CHECK(!ble_hid_latency_snapshot(0xFF, &histogram));
+}
+
+static void test_percentiles(void)
+{
+    uint32_t ms = 0;
+
+    // Same samples as test_buckets().
+    CHECK(ble_hid_latency_percentile(DESC_REPORT_ID_KEYBOARD, 20, &ms));
+    CHECK_EQ(ms, 5);
+    CHECK(ble_hid_latency_percentile(DESC_REPORT_ID_KEYBOARD, 50, &ms));
+    CHECK_EQ(ms, 10);
+    CHECK(ble_hid_latency_percentile(DESC_REPORT_ID_KEYBOARD, 80, &ms));
+    CHECK_EQ(ms, 45);
+    CHECK(ble_hid_latency_percentile(DESC_REPORT_ID_KEYBOARD, 99, &ms));
+    CHECK((ms >= 299) && (ms <= 300)); // The longest latency for the last bucket.
+
+    ble_hid_latency_reset();
+    CHECK(ble_hid_latency_percentile(DESC_REPORT_ID_KEYBOARD, 99, &ms));
+    CHECK_EQ(ms, 0);
+}
+
+int main(void)
+{
+    sim_config_t const config = {.hvn_tx_queue_size = 1, .tx_per_conn_event = 1, .conn_interval_us = 7500};
+
+    fixture_init(&config);
+    fixture_link_up(0);
+    fixture_drain(0);
+
+    TEST_RUN(test_buckets);
+    TEST_RUN(test_percentiles);
+    CHECK_EQ(sim_app_error_count(), 0);
+    return TEST_RESULT();
+}
@@ -0,0 +1,161 @@
+/*
+ * The simulated host connects, encrypts and subscribes, then receives input reports.
+ */
+#include <string.h>
+
+#include "test.h"
+
+#define OUTPUT_INDEX_KEYBOARD 0 /* Output reports are registered keyboard first. */
+#define INPUT_INDEX_KEYBOARD 0 /* Input reports are registered keyboard, mouse, consumer, system, raw. */
+#define INPUT_INDEX_CONSUMER 2
+
+extern uint8_t keyboard_led_val_ble;
+
+static void test_report_reaches_host(void)
+{
+    uint8_t report[DESC_REPORT_LEN_KEYBOARD] = {0};
+    report[1] = 0x10;
+
+    CHECK_EQ(ble_link_state_get(), BLE_LINK_STATE_SECURED);
+    CHECK(ble_hid_report_subscribed(DESC_REPORT_ID_KEYBOARD));
+    CHECK(ble_hid_report_send(DESC_REPORT_ID_KEYBOARD, report, sizeof(report)) <= BLE_HID_SEND_QUEUED);
+    fixture_drain(0);
+
+    CHECK_EQ(sim_notification_count(), 1);
+    sim_notification_t const *p_notification = sim_notification_get(0);
+    CHECK(p_notification != NULL);
+    if (p_notification != NULL)
+    {
+        CHECK_EQ(p_notification->len, DESC_REPORT_LEN_KEYBOARD);
+        CHECK_EQ(p_notification->data[1], 0x10);
+    }
+}
+
+static void test_disconnect(void)
+{
+    uint8_t report[DESC_REPORT_LEN_SYSTEM] = {0x81};
+
+    sim_disconnect(0);
+    CHECK(ble_link_state_get() != BLE_LINK_STATE_SECURED);
+    CHECK(ble_hid_report_send(DESC_REPORT_ID_SYSTEM, report, sizeof(report)) != BLE_HID_SEND_OK);
+}
+
+static void test_keyboard_leds_per_link(void)
+{
+    uint8_t const caps_lock = 0x02;
+    uint8_t const num_lock = 0x01;
+
+    // Link 1 connects last and becomes the active one.
+    fixture_link_up(0);
+    fixture_link_up(1);
+    CHECK_EQ(keyboard_led_val_ble, 0);
+
+    // The host of the other link does not change the LEDs shown.
+    sim_output_report_write(0, OUTPUT_INDEX_KEYBOARD, &caps_lock, 1);
+    CHECK_EQ(keyboard_led_val_ble, 0);
+
+    sim_output_report_write(1, OUTPUT_INDEX_KEYBOARD, &num_lock, 1);
+    CHECK_EQ(keyboard_led_val_ble, num_lock);
+
+    // Link 0 takes over and shows what its host wrote.
+    sim_disconnect(1);
+    CHECK_EQ(keyboard_led_val_ble, caps_lock);
+
+    // A new connection starts with the LEDs off.
+    sim_disconnect(0);
+    sim_connect(0);
+    CHECK_EQ(keyboard_led_val_ble, 0);
+    sim_disconnect(0);
+}
+
+/* Last notification of an input report a link's host received, NULL if there is none. */
+static sim_notification_t const *last_notification(uint16_t conn_handle, uint8_t report_index)
+{
+    for (uint32_t n = sim_notification_count(); n > 0; n--)
+    {
+        sim_notification_t const *p_notification = sim_notification_get(n - 1);
+        if ((p_notification->conn_handle == conn_handle) && (p_notification->report_index == report_index)) return p_notification;
+    }
+    return NULL;
+}
+
+/* Checks the last report of an input report received by a link's host is the released state. */
+static void check_released(uint16_t conn_handle, uint8_t report_index, uint8_t len)
+{
+    static uint8_t const released[DESC_REPORT_LEN_KEYBOARD] = {0};
+    sim_notification_t const *p_notification = last_notification(conn_handle, report_index);
+
+    CHECK(p_notification != NULL);
+    if (p_notification == NULL) return;
+
+    CHECK_EQ(p_notification->len, len);
+    CHECK(memcmp(p_notification->data, released, len) == 0);
+}
+
+static void test_keys_released_on_switch(void)
+{
+    uint8_t key[DESC_REPORT_LEN_KEYBOARD] = {0};
+    uint8_t consumer[DESC_REPORT_LEN_CONSUMER] = {0xE9};
+    key[1] = 0x10;
+
+    fixture_link_up(0);
+    fixture_link_up(1);
+    CHECK(ble_active_link_set(0));
+    sim_notification_clear();
+
+    // Keys held on the host of link 0 when the user switches to link 1.
+    CHECK(ble_hid_report_send(DESC_REPORT_ID_KEYBOARD, key, sizeof(key)) <= BLE_HID_SEND_QUEUED);
+    CHECK(ble_hid_report_send(DESC_REPORT_ID_CONSUMER, consumer, sizeof(consumer)) <= BLE_HID_SEND_QUEUED);
+    fixture_drain(0);
+    CHECK(ble_active_link_set(1));
+    fixture_drain(0);
+
+    check_released(0, INPUT_INDEX_KEYBOARD, DESC_REPORT_LEN_KEYBOARD);
+    check_released(0, INPUT_INDEX_CONSUMER, DESC_REPORT_LEN_CONSUMER);
+    CHECK(last_notification(1, INPUT_INDEX_KEYBOARD) == NULL);
+
+    sim_disconnect(0);
+    sim_disconnect(1);
+}
+
+static void test_keys_released_on_takeover(void)
+{
+    uint8_t key[DESC_REPORT_LEN_KEYBOARD] = {0};
+    uint8_t consumer[DESC_REPORT_LEN_CONSUMER] = {0xE9};
+    key[1] = 0x10;
+
+    fixture_link_up(0);
+    sim_notification_clear();
+
+    // The press fills the TX buffer of link 0, the consumer report waits in the module.
+    CHECK_EQ(ble_hid_report_send(DESC_REPORT_ID_KEYBOARD, key, sizeof(key)), BLE_HID_SEND_OK);
+    CHECK_EQ(ble_hid_report_send(DESC_REPORT_ID_CONSUMER, consumer, sizeof(consumer)), BLE_HID_SEND_QUEUED);
+
+    // Another central connects and takes over, the release goes out once link 0 has room.
+    fixture_link_up(1);
+    CHECK_EQ(ble_active_link_get(), 1);
+    fixture_drain(0);
+
+    check_released(0, INPUT_INDEX_KEYBOARD, DESC_REPORT_LEN_KEYBOARD);
+    CHECK(last_notification(0, INPUT_INDEX_CONSUMER) == NULL);
+
+    sim_disconnect(0);
+    sim_disconnect(1);
+}
+
+int main(void)
+{
+    sim_config_t const config = {.hvn_tx_queue_size = 1, .tx_per_conn_event = 1, .conn_interval_us = 7500};
+
+    fixture_init(&config);
+    fixture_link_up(0);
+    sim_notification_clear();
+
+    TEST_RUN(test_report_reaches_host);
+    TEST_RUN(test_disconnect);
+    TEST_RUN(test_keyboard_leds_per_link);
+    TEST_RUN(test_keys_released_on_switch);
+    TEST_RUN(test_keys_released_on_takeover);
+    CHECK_EQ(sim_app_error_count(), 0);
+    return TEST_RESULT();
+}
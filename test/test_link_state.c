@@ -0,0 +1,110 @@
+/*
+ * Link state: the subscribers see every transition once, from advertising through the security procedure to
+ * the disconnection, and the active link alone decides the state while there is one.
+ */
+#include "test.h"
+
+#define LOG_SIZE 16
+
+static ble_link_state_t log_previous[LOG_SIZE];
+static ble_link_state_t log_state[LOG_SIZE];
+static uint32_t log_count;
+
+static void state_handler(ble_link_state_t previous, ble_link_state_t state)
+{
+    if (log_count < LOG_SIZE)
+    {
+        log_previous[log_count] = previous;
+        log_state[log_count] = state;
+    }
+    log_count++;
+}
+
+static void check_transitions(ble_link_state_t const *p_states, uint32_t count)
+{
+    CHECK_EQ(log_count, count - 1);
+    for (uint32_t i = 0; (i + 1 < count) && (i < log_count); i++)
+    {
+        CHECK_EQ(log_previous[i], p_states[i]);
+        CHECK_EQ(log_state[i], p_states[i + 1]);
+    }
+    CHECK_EQ(ble_link_state_get(), p_states[count - 1]);
+}
+
+static void test_connection_lifecycle(void)
+{
+    static ble_link_state_t const expected[] = {
+        BLE_LINK_STATE_ADVERTISING, BLE_LINK_STATE_CONNECTED, BLE_LINK_STATE_SECURING, BLE_LINK_STATE_SECURED,
+        BLE_LINK_STATE_OFF,         BLE_LINK_STATE_ADVERTISING, BLE_LINK_STATE_IDLE,
+    };
+
+    // ble_module_init() started advertising.
+    log_count = 0;
+    CHECK_EQ(ble_link_state_get(), BLE_LINK_STATE_ADVERTISING);
+
+    sim_adv_evt(BLE_ADV_EVT_FAST);
+    sim_connect(0);
+    sim_secure(0, sim_peer_add(0x20));
+
+    // Nothing new for the subscribers.
+    sim_cccd_set_all(0, true);
+    sim_adv_evt(BLE_ADV_EVT_WHITELIST_REQUEST);
+
+    sim_disconnect(0);
+    sim_adv_evt(BLE_ADV_EVT_FAST);
+    sim_adv_evt(BLE_ADV_EVT_IDLE);
+
+    check_transitions(expected, ARRAY_SIZE(expected));
+}
+
+static void test_active_link_decides(void)
+{
+    static ble_link_state_t const expected[] = {
+        BLE_LINK_STATE_SECURED, BLE_LINK_STATE_CONNECTED, BLE_LINK_STATE_SECURING, BLE_LINK_STATE_SECURED,
+        BLE_LINK_STATE_OFF,
+    };
+
+    fixture_link_up(0);
+    log_count = 0;
+
+    // A new central takes the input reports over, the state follows its security procedure.
+    fixture_link_up(1);
+    CHECK_EQ(log_count, 3);
+
+    // Switching between two secured links, or losing one of them, is not a transition.
+    CHECK(ble_active_link_set(0));
+    sim_disconnect(0);
+    CHECK_EQ(log_count, 3);
+
+    sim_disconnect(1);
+    check_transitions(expected, ARRAY_SIZE(expected));
+}
+
+static void test_subscribers(void)
+{
+    log_count = 0;
+
+    // Already subscribed: not called twice.
+    CHECK(ble_link_state_subscribe(state_handler));
+    sim_adv_evt(BLE_ADV_EVT_FAST);
+    CHECK_EQ(log_count, 1);
+
+    ble_link_state_unsubscribe(state_handler);
+    sim_adv_evt(BLE_ADV_EVT_IDLE);
+    CHECK_EQ(log_count, 1);
+    CHECK_EQ(ble_link_state_get(), BLE_LINK_STATE_IDLE);
+}
+
+int main(void)
+{
+    sim_config_t const config = {.hvn_tx_queue_size = 1, .tx_per_conn_event = 1, .conn_interval_us = 7500};
+
+    fixture_init(&config);
+    CHECK(ble_link_state_subscribe(state_handler));
+
+    TEST_RUN(test_connection_lifecycle);
+    TEST_RUN(test_active_link_decides);
+    TEST_RUN(test_subscribers);
+    CHECK_EQ(sim_app_error_count(), 0);
+    return TEST_RESULT();
+}
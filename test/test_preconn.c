@@ -0,0 +1,151 @@
+/*
+ * Pre-connection buffer: reports given before the link is encrypted are replayed in order, kept across the
+ * advertising requests, and discarded only when advertising stops.
+ */
+#include "test.h"
+
+#define INPUT_INDEX_KEYBOARD 0 /* Input reports are registered keyboard, mouse, consumer, system, raw. */
+#define INPUT_INDEX_CONSUMER 2
+
+/* Report i of a press and release sequence of one key: never merged nor filtered as a duplicate. */
+static ble_hid_send_status_t key_send(uint32_t i)
+{
+    uint8_t report[DESC_REPORT_LEN_KEYBOARD] = {0};
+
+    report[1] = (i % 2 == 0) ? 0x01 : 0x00;
+    return ble_hid_report_send(DESC_REPORT_ID_KEYBOARD, report, sizeof(report));
+}
+
+/* Checks the host received the sequence from its first report, count reports long. */
+static void check_keys_received(uint32_t count)
+{
+    uint32_t received = 0;
+
+    for (uint32_t n = 0; n < sim_notification_count(); n++)
+    {
+        sim_notification_t const *p_notification = sim_notification_get(n);
+        if (p_notification->len != DESC_REPORT_LEN_KEYBOARD) continue;
+
+        CHECK_EQ(p_notification->data[1], (received % 2 == 0) ? 0x01 : 0x00);
+        received++;
+    }
+    CHECK_EQ(received, count);
+}
+
+static void test_advertising_requests_keep_buffer(void)
+{
+    ble_hid_preconn_stats_t stats;
+
+    ble_hid_preconn_stats_reset();
+    sim_adv_evt(BLE_ADV_EVT_FAST);
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        CHECK_EQ(key_send(i), BLE_HID_SEND_BUFFERED);
+    }
+
+    // Asked by the advertising module before it starts a mode.
+    sim_adv_evt(BLE_ADV_EVT_WHITELIST_REQUEST);
+    sim_adv_evt(BLE_ADV_EVT_PEER_ADDR_REQUEST);
+    CHECK_EQ(ble_link_state_get(), BLE_LINK_STATE_ADVERTISING);
+
+    ble_hid_preconn_stats_get(&stats);
+    CHECK_EQ(stats.buffered, 3);
+    CHECK_EQ(stats.discarded, 0);
+
+    // Advertising timed out, no host will take them.
+    sim_adv_evt(BLE_ADV_EVT_IDLE);
+    ble_hid_preconn_stats_get(&stats);
+    CHECK_EQ(stats.discarded, 3);
+    CHECK_EQ(stats.expired, 0);
+    CHECK_EQ(stats.replayed, 0);
+}
+
+static void test_backlog_kept_whole_once_secured(void)
+{
+    ble_hid_preconn_stats_t stats;
+    ble_hid_send_status_t status = BLE_HID_SEND_BUFFERED;
+    uint32_t sent = 0;
+
+    ble_hid_preconn_stats_reset();
+    sim_notification_clear();
+    sim_adv_evt(BLE_ADV_EVT_FAST);
+
+    // A bonded host: its subscriptions are back before the link is encrypted.
+    pm_peer_id_t peer_id = sim_peer_add(0x30);
+    sim_connect(0);
+    sim_cccd_set_all(0, true);
+    for (; sent < BLE_HID_PRECONN_BUFFER_SIZE; sent++)
+    {
+        CHECK_EQ(key_send(sent), BLE_HID_SEND_BUFFERED);
+    }
+
+    // The replay stops once the SoftDevice and the pending queue are full.
+    sim_secure(0, peer_id);
+    ble_hid_preconn_stats_get(&stats);
+    CHECK(stats.replayed > 0);
+    CHECK(stats.replayed < BLE_HID_PRECONN_BUFFER_SIZE);
+
+    // Newer reports go behind the backlog until it is full, then are refused instead of pushing it out.
+    for (uint32_t i = 0; (i < 2 * BLE_HID_PRECONN_BUFFER_SIZE) && (status == BLE_HID_SEND_BUFFERED); i++)
+    {
+        status = key_send(sent);
+        if (status == BLE_HID_SEND_BUFFERED) sent++;
+    }
+    CHECK_EQ(status, BLE_HID_SEND_QUEUE_FULL);
+
+    // A report the host did not subscribe to is refused, not kept.
+    uint8_t consumer[DESC_REPORT_LEN_CONSUMER] = {0xE9};
+    sim_cccd_set(0, INPUT_INDEX_CONSUMER, false);
+    CHECK_EQ(ble_hid_report_send(DESC_REPORT_ID_CONSUMER, consumer, sizeof(consumer)), BLE_HID_SEND_NOT_SUBSCRIBED);
+
+    fixture_drain(0);
+    check_keys_received(sent);
+
+    ble_hid_preconn_stats_get(&stats);
+    CHECK_EQ(stats.buffered, sent);
+    CHECK_EQ(stats.replayed, sent);
+    CHECK_EQ(stats.dropped, 0);
+    CHECK_EQ(stats.discarded, 0);
+
+    sim_disconnect(0);
+}
+
+static void test_unsubscribed_discarded_once_secured(void)
+{
+    ble_hid_preconn_stats_t stats;
+    uint8_t consumer[DESC_REPORT_LEN_CONSUMER] = {0xE9};
+
+    ble_hid_preconn_stats_reset();
+    sim_notification_clear();
+    sim_adv_evt(BLE_ADV_EVT_FAST);
+
+    // The host only subscribed to the keyboard report.
+    pm_peer_id_t peer_id = sim_peer_add(0x31);
+    sim_connect(0);
+    sim_cccd_set(0, INPUT_INDEX_KEYBOARD, true);
+    CHECK_EQ(ble_hid_report_send(DESC_REPORT_ID_CONSUMER, consumer, sizeof(consumer)), BLE_HID_SEND_BUFFERED);
+    CHECK_EQ(key_send(0), BLE_HID_SEND_BUFFERED);
+
+    sim_secure(0, peer_id);
+    fixture_drain(0);
+    check_keys_received(1);
+
+    ble_hid_preconn_stats_get(&stats);
+    CHECK_EQ(stats.replayed, 1);
+    CHECK_EQ(stats.discarded, 1);
+
+    sim_disconnect(0);
+}
+
+int main(void)
+{
+    sim_config_t const config = {.hvn_tx_queue_size = 1, .tx_per_conn_event = 1, .conn_interval_us = 7500};
+
+    fixture_init(&config);
+
+    TEST_RUN(test_advertising_requests_keep_buffer);
+    TEST_RUN(test_backlog_kept_whole_once_secured);
+    TEST_RUN(test_unsubscribed_discarded_once_secured);
+    CHECK_EQ(sim_app_error_count(), 0);
+    return TEST_RESULT();
+}
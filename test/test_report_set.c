@@ -0,0 +1,90 @@
+/*
+ * Build-time report set: built without the mouse and raw reports (see the Makefile), the service registers the
+ * keyboard, consumer and system reports only, rejects a descriptor with the others, and sizes its memory for them.
+ */
+#include "test.h"
+
+#if BLE_HID_MOUSE_ENABLED || BLE_HID_RAW_ENABLED
+#error "Build with BLE_HID_MOUSE_ENABLED=0 and BLE_HID_RAW_ENABLED=0"
+#endif
+
+/* The firmware descriptor without its mouse and raw collections. */
+static uint8_t const desc_keys_only[] = {
+    0x05, 0x01, 0x09, 0x06, 0xA1, 0x01, 0x85, DESC_REPORT_ID_KEYBOARD,
+    0x05, 0x07, 0x19, 0xE0, 0x29, 0xE7, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x08, 0x81, 0x02,
+    0x19, 0x00, 0x29, 0xDF, 0x95, 0xE0, 0x81, 0x02,
+    0x05, 0x08, 0x19, 0x01, 0x29, 0x05, 0x95, 0x05, 0x91, 0x02, 0x75, 0x03, 0x95, 0x01, 0x91, 0x03,
+    0xC0,
+    0x05, 0x0C, 0x09, 0x01, 0xA1, 0x01, 0x85, DESC_REPORT_ID_CONSUMER,
+    0x15, 0x00, 0x26, 0xFF, 0x03, 0x19, 0x00, 0x2A, 0xFF, 0x03, 0x95, 0x04, 0x75, 0x10, 0x81, 0x00,
+    0xC0,
+    0x05, 0x01, 0x09, 0x80, 0xA1, 0x01, 0x85, DESC_REPORT_ID_SYSTEM,
+    0x15, 0x00, 0x26, 0xFF, 0x00, 0x19, 0x00, 0x29, 0xFF, 0x95, 0x01, 0x75, 0x08, 0x81, 0x00,
+    0xC0,
+};
+
+static void test_disabled_reports_rejected(void)
+{
+    uint32_t const errors = sim_app_error_count();
+
+    ble_set_report_descriptor(desc_defy, sizeof(desc_defy));
+    hids_init();
+    CHECK(sim_app_error_count() > errors);
+}
+
+static void test_enabled_reports_registered(void)
+{
+    uint32_t const errors = sim_app_error_count();
+
+    ble_set_report_descriptor(desc_keys_only, sizeof(desc_keys_only));
+    hids_init();
+    CHECK_EQ(sim_app_error_count(), errors);
+
+    CHECK_EQ(sim_hids_input_count(), 3);
+    CHECK_EQ(sim_hids_input_get(0)->rep_ref.report_id, DESC_REPORT_ID_KEYBOARD);
+    CHECK_EQ(sim_hids_input_get(1)->rep_ref.report_id, DESC_REPORT_ID_CONSUMER);
+    CHECK_EQ(sim_hids_input_get(2)->rep_ref.report_id, DESC_REPORT_ID_SYSTEM);
+    CHECK_EQ(sim_hids_output_count(), 1);
+
+    // Keys still reach the host, a mouse report has nowhere to go.
+    uint8_t keyboard[DESC_REPORT_LEN_KEYBOARD] = {0, 0x10};
+    uint8_t const mouse[DESC_REPORT_LEN_MOUSE] = {0, 1, 1, 0, 0};
+    fixture_link_up(0);
+    CHECK_EQ(ble_hid_report_send(DESC_REPORT_ID_KEYBOARD, keyboard, sizeof(keyboard)), BLE_HID_SEND_OK);
+    CHECK_EQ(ble_hid_report_send(DESC_REPORT_ID_MOUSE, mouse, sizeof(mouse)), BLE_HID_SEND_INVALID);
+    keyboard[1] = 0;
+    CHECK(ble_hid_report_send(DESC_REPORT_ID_KEYBOARD, keyboard, sizeof(keyboard)) <= BLE_HID_SEND_QUEUED);
+    fixture_drain(0);
+    sim_disconnect(0);
+}
+
+static void test_memory(void)
+{
+    ble_hid_memory_t memory;
+
+    ble_hid_memory_get(&memory);
+    CHECK_EQ(memory.input_reports, 3);
+    CHECK_EQ(memory.output_reports, 1);
+
+    // Service, HID Information, Control Point, Report Map, 3 inputs, 1 output, Protocol Mode, boot keyboard only.
+    CHECK_EQ(memory.gatt_attributes, 7 + 4 * 3 + 3 * 1 + 2 + 5);
+
+    // Keyboard input and LEDs, consumer and system for each link; no raw report room.
+    CHECK_EQ(memory.link_ctx_bytes, NRF_SDH_BLE_TOTAL_LINK_COUNT *
+                                        (DESC_REPORT_LEN_KEYBOARD + 1 + DESC_REPORT_LEN_CONSUMER + DESC_REPORT_LEN_SYSTEM));
+    CHECK(memory.raw_buffers_bytes < DESC_REPORT_LEN_RAW);
+}
+
+int main(void)
+{
+    sim_config_t const config = {.hvn_tx_queue_size = 1, .tx_per_conn_event = 1, .conn_interval_us = 7500};
+
+    sim_reset(&config);
+    ble_set_report_descriptor(desc_keys_only, sizeof(desc_keys_only));
+    ble_module_init();
+
+    TEST_RUN(test_disabled_reports_rejected);
+    TEST_RUN(test_enabled_reports_registered);
+    TEST_RUN(test_memory);
+    return TEST_RESULT();
+}
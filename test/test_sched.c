@@ -0,0 +1,136 @@
+/*
+ * Priority scheduler: every high priority event runs before any low priority one, one low priority event per
+ * ble_run() call. A full class rejects and counts what does not fit. Battery updates wait in the low class.
+ */
+#include "test.h"
+
+#define RUN_LOG_SIZE 32
+
+static uint8_t run_log[RUN_LOG_SIZE];
+static uint32_t run_count;
+
+static void event_log(void *p_event_data, uint16_t event_size)
+{
+    CHECK_EQ(event_size, 1);
+    if (run_count < RUN_LOG_SIZE)
+    {
+        run_log[run_count] = *(uint8_t *)p_event_data;
+    }
+    run_count++;
+}
+
+static void event_put(ble_sched_prio_t prio, uint8_t id)
+{
+    CHECK_EQ(ble_sched_event_put(prio, &id, sizeof(id), event_log), NRF_SUCCESS);
+}
+
+static void test_high_class_first(void)
+{
+    run_count = 0;
+
+    // Low events given first still wait for every high one.
+    event_put(BLE_SCHED_PRIO_LOW, 10);
+    event_put(BLE_SCHED_PRIO_LOW, 11);
+    event_put(BLE_SCHED_PRIO_HIGH, 1);
+    event_put(BLE_SCHED_PRIO_LOW, 12);
+    event_put(BLE_SCHED_PRIO_HIGH, 2);
+
+    ble_run();
+    CHECK_EQ(run_count, 2 + BLE_SCHED_LOW_EVENTS_PER_RUN);
+    CHECK_EQ(run_log[0], 1);
+    CHECK_EQ(run_log[1], 2);
+    CHECK_EQ(run_log[2], 10);
+
+    // A high event given in between overtakes the low ones left.
+    event_put(BLE_SCHED_PRIO_HIGH, 3);
+    ble_run();
+    ble_run();
+    CHECK_EQ(run_count, 6);
+    CHECK_EQ(run_log[3], 3);
+    CHECK_EQ(run_log[4], 11);
+    CHECK_EQ(run_log[5], 12);
+}
+
+static void test_counters(void)
+{
+    ble_sched_stats_t stats;
+
+    run_count = 0;
+    ble_sched_stats_reset();
+
+    for (uint8_t i = 0; i < BLE_SCHED_LOW_QUEUE_SIZE; i++)
+    {
+        event_put(BLE_SCHED_PRIO_LOW, i);
+    }
+    uint8_t const id = 0xFF;
+    CHECK_EQ(ble_sched_event_put(BLE_SCHED_PRIO_LOW, &id, sizeof(id), event_log), NRF_ERROR_NO_MEM);
+
+    ble_sched_stats_get(BLE_SCHED_PRIO_LOW, &stats);
+    CHECK_EQ(stats.depth, BLE_SCHED_LOW_QUEUE_SIZE);
+    CHECK_EQ(stats.high_water, BLE_SCHED_LOW_QUEUE_SIZE);
+    CHECK_EQ(stats.overflow, 1);
+    CHECK_EQ(stats.executed, 0);
+
+    // The high class has its own queue and counters.
+    event_put(BLE_SCHED_PRIO_HIGH, 0x80);
+    ble_sched_stats_get(BLE_SCHED_PRIO_HIGH, &stats);
+    CHECK_EQ(stats.high_water, 1);
+    CHECK_EQ(stats.overflow, 0);
+
+    ble_run();
+    ble_run();
+    ble_sched_stats_get(BLE_SCHED_PRIO_LOW, &stats);
+    CHECK_EQ(stats.depth, BLE_SCHED_LOW_QUEUE_SIZE - 2);
+    CHECK_EQ(stats.executed, 2);
+    CHECK_EQ(stats.high_water, BLE_SCHED_LOW_QUEUE_SIZE);
+
+    // After a reset the high water mark starts from the events still waiting.
+    ble_sched_stats_reset();
+    ble_sched_stats_get(BLE_SCHED_PRIO_LOW, &stats);
+    CHECK_EQ(stats.high_water, BLE_SCHED_LOW_QUEUE_SIZE - 2);
+    CHECK_EQ(stats.overflow, 0);
+
+    for (uint8_t i = 0; i < BLE_SCHED_LOW_QUEUE_SIZE; i++)
+    {
+        ble_run();
+    }
+    CHECK_EQ(run_count, 1 + BLE_SCHED_LOW_QUEUE_SIZE);
+    ble_sched_stats_get(BLE_SCHED_PRIO_LOW, &stats);
+    CHECK_EQ(stats.depth, 0);
+}
+
+static void test_battery_update_low_class(void)
+{
+    ble_battery_stats_t battery;
+    ble_sched_stats_t stats;
+
+    ble_battery_stats_reset();
+    ble_sched_stats_reset();
+    fixture_link_up(0);
+    fixture_drain(0);
+
+    ble_battery_level_update(50);
+    ble_battery_stats_get(&battery);
+    CHECK_EQ(battery.sent, 0);
+    ble_sched_stats_get(BLE_SCHED_PRIO_LOW, &stats);
+    CHECK_EQ(stats.depth, 1);
+
+    ble_run();
+    ble_battery_stats_get(&battery);
+    CHECK_EQ(battery.sent, 1);
+
+    sim_disconnect(0);
+}
+
+int main(void)
+{
+    sim_config_t const config = {.hvn_tx_queue_size = 1, .tx_per_conn_event = 1, .conn_interval_us = 7500};
+
+    fixture_init(&config);
+
+    TEST_RUN(test_high_class_first);
+    TEST_RUN(test_counters);
+    TEST_RUN(test_battery_update_low_class);
+    CHECK_EQ(sim_app_error_count(), 0);
+    return TEST_RESULT();
+}
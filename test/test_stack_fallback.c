@@ -0,0 +1,59 @@
+/*
+ * Stack profile fallback: a profile whose notification buffers do not fit in the RAM the application leaves to
+ * the SoftDevice is replaced by the default configuration, reported by ble_stack_ram_get(), and the HID TX
+ * arbiter only hands out the credits of the buffers the SoftDevice really has.
+ */
+#include "test.h"
+
+static void key_send(uint8_t key, ble_hid_send_status_t expected)
+{
+    uint8_t report[DESC_REPORT_LEN_KEYBOARD] = {0};
+    report[1] = key;
+
+    CHECK_EQ(ble_hid_report_send(DESC_REPORT_ID_KEYBOARD, report, sizeof(report)), expected);
+}
+
+static void test_default_used(void)
+{
+    ble_stack_config_t config;
+    ble_stack_ram_t ram;
+
+    ble_stack_ram_get(&ram);
+    CHECK(ram.fallback);
+    CHECK_EQ(ram.required_ram_start, ram.app_ram_start);
+
+    ble_stack_config_get(&config);
+    CHECK_EQ(config.hvn_tx_queue_size, BLE_GATTS_HVN_TX_QUEUE_SIZE_DEFAULT);
+    CHECK(!config.conn_evt_ext);
+    CHECK_EQ(sim_stack_hvn_tx_queue_size(), BLE_GATTS_HVN_TX_QUEUE_SIZE_DEFAULT);
+    CHECK(!sim_stack_conn_evt_ext());
+}
+
+static void test_tx_credits_of_default(void)
+{
+    fixture_link_up(0);
+    fixture_drain(0);
+
+    key_send(0x04, BLE_HID_SEND_OK);
+    key_send(0x05, BLE_HID_SEND_QUEUED);
+    CHECK_EQ(sim_hvn_queued(0), 1);
+
+    key_send(0x00, BLE_HID_SEND_QUEUED);
+    fixture_drain(0);
+    sim_disconnect(0);
+}
+
+int main(void)
+{
+    sim_config_t const config = {.hvn_tx_queue_size = 1, .tx_per_conn_event = 1, .conn_interval_us = 7500};
+
+    // The bulk profile asks for 8 notification buffers, the RAM has room for 2.
+    sim_stack_hvn_tx_queue_max_set(2);
+    CHECK_EQ(ble_stack_profile_set(BLE_STACK_PROFILE_BULK), NRF_SUCCESS);
+    fixture_init(&config);
+
+    TEST_RUN(test_default_used);
+    TEST_RUN(test_tx_credits_of_default);
+    CHECK_EQ(sim_app_error_count(), 0);
+    return TEST_RESULT();
+}
@@ -0,0 +1,101 @@
+/*
+ * Stack profiles: the profile or the configuration of its own chosen before ble_module_init() is what the
+ * SoftDevice gets, and the HID TX arbiter hands out one credit per notification buffer of the profile.
+ */
+#include "test.h"
+
+static void key_send(uint8_t key, ble_hid_send_status_t expected)
+{
+    uint8_t report[DESC_REPORT_LEN_KEYBOARD] = {0};
+    report[1] = key;
+
+    CHECK_EQ(ble_hid_report_send(DESC_REPORT_ID_KEYBOARD, report, sizeof(report)), expected);
+}
+
+static void test_selection_before_init(void)
+{
+    ble_stack_config_t const custom = {.hvn_tx_queue_size = 3, .event_length = 4, .conn_evt_ext = false,
+                                       .attr_tab_size = 0x800};
+    ble_stack_config_t config;
+
+    ble_stack_config_get(&config);
+    CHECK_EQ(config.hvn_tx_queue_size, BLE_GATTS_HVN_TX_QUEUE_SIZE_DEFAULT);
+    CHECK_EQ(config.event_length, NRF_SDH_BLE_GAP_EVENT_LENGTH);
+
+    CHECK_EQ(ble_stack_profile_set(BLE_STACK_PROFILE_COUNT), NRF_ERROR_INVALID_PARAM);
+    CHECK_EQ(ble_stack_profile_set(BLE_STACK_PROFILE_GAMING), NRF_SUCCESS);
+    ble_stack_config_get(&config);
+    CHECK_EQ(config.hvn_tx_queue_size, 4);
+    CHECK_EQ(config.event_length, 6);
+    CHECK(config.conn_evt_ext);
+
+    // A configuration without TX buffers or connection event time is refused and changes nothing.
+    ble_stack_config_t invalid = custom;
+    invalid.hvn_tx_queue_size = 0;
+    CHECK_EQ(ble_stack_config_set(&invalid), NRF_ERROR_INVALID_PARAM);
+    invalid = custom;
+    invalid.event_length = 0;
+    CHECK_EQ(ble_stack_config_set(&invalid), NRF_ERROR_INVALID_PARAM);
+    ble_stack_config_get(&config);
+    CHECK_EQ(config.hvn_tx_queue_size, 4);
+
+    // A configuration of its own, then a profile again.
+    CHECK_EQ(ble_stack_config_set(&custom), NRF_SUCCESS);
+    ble_stack_config_get(&config);
+    CHECK_EQ(config.hvn_tx_queue_size, 3);
+    CHECK_EQ(config.attr_tab_size, 0x800);
+    CHECK_EQ(ble_stack_profile_set(BLE_STACK_PROFILE_GAMING), NRF_SUCCESS);
+    ble_stack_config_get(&config);
+    CHECK_EQ(config.hvn_tx_queue_size, 4);
+}
+
+static void test_applied_at_init(void)
+{
+    ble_stack_config_t const custom = {.hvn_tx_queue_size = 3, .event_length = 4, .conn_evt_ext = false,
+                                       .attr_tab_size = 0x800};
+    ble_stack_config_t config;
+    ble_stack_ram_t ram;
+
+    CHECK_EQ(sim_stack_hvn_tx_queue_size(), 4);
+    CHECK(sim_stack_conn_evt_ext());
+
+    ble_stack_ram_get(&ram);
+    CHECK(!ram.fallback);
+    CHECK_EQ(ram.required_ram_start, ram.app_ram_start);
+
+    // Too late to change the SoftDevice configuration.
+    CHECK_EQ(ble_stack_profile_set(BLE_STACK_PROFILE_BULK), NRF_ERROR_INVALID_STATE);
+    CHECK_EQ(ble_stack_config_set(&custom), NRF_ERROR_INVALID_STATE);
+    ble_stack_config_get(&config);
+    CHECK_EQ(config.hvn_tx_queue_size, 4);
+}
+
+static void test_tx_credits_follow_profile(void)
+{
+    fixture_link_up(0);
+    fixture_drain(0);
+
+    // Four notification buffers: four key reports go straight to the SoftDevice, the fifth one waits.
+    key_send(0x04, BLE_HID_SEND_OK);
+    key_send(0x05, BLE_HID_SEND_OK);
+    key_send(0x06, BLE_HID_SEND_OK);
+    key_send(0x07, BLE_HID_SEND_OK);
+    CHECK_EQ(sim_hvn_queued(0), 4);
+    key_send(0x08, BLE_HID_SEND_QUEUED);
+
+    key_send(0x00, BLE_HID_SEND_QUEUED);
+    fixture_drain(0);
+    sim_disconnect(0);
+}
+
+int main(void)
+{
+    sim_config_t const config = {.hvn_tx_queue_size = 4, .tx_per_conn_event = 1, .conn_interval_us = 7500};
+
+    TEST_RUN(test_selection_before_init);
+    fixture_init(&config);
+    TEST_RUN(test_applied_at_init);
+    TEST_RUN(test_tx_credits_follow_profile);
+    CHECK_EQ(sim_app_error_count(), 0);
+    return TEST_RESULT();
+}
@@ -0,0 +1,144 @@
+/*
+ * Raw stream: chunks carry a sequence number and the data in order, a chunk refused by the SoftDevice aborts it.
+ * Raw output: reports written by the host reach the application, the ones that cannot be read are counted.
+ */
+#include "test.h"
+
+#define STREAM_LEN 200
+#define OUTPUT_INDEX_RAW 1 /* Output reports are registered keyboard first. */
+
+static uint8_t stream_data[STREAM_LEN];
+static uint32_t handler_calls;
+static ble_hid_stream_result_t handler_result;
+static uint32_t handler_bytes;
+
+static void stream_handler(ble_hid_stream_result_t result, uint32_t bytes_sent)
+{
+    handler_calls++;
+    handler_result = result;
+    handler_bytes = bytes_sent;
+}
+
+static void stream_start(void)
+{
+    handler_calls = 0;
+    sim_notification_clear();
+
+    for (uint32_t i = 0; i < STREAM_LEN; i++)
+    {
+        stream_data[i] = (uint8_t)i;
+    }
+    CHECK(ble_hid_stream_open(stream_handler));
+    CHECK(ble_hid_stream_write(stream_data, STREAM_LEN));
+    CHECK(ble_hid_stream_close());
+}
+
+/* Checks the chunks received are numbered from 0 and carry the start of the stream data. */
+static uint32_t check_chunks_received(void)
+{
+    uint32_t const chunk_len = ble_hid_raw_report_len_get();
+    uint32_t offset = 0;
+
+    for (uint32_t i = 0; i < sim_notification_count(); i++)
+    {
+        sim_notification_t const *p_notification = sim_notification_get(i);
+        CHECK_EQ(p_notification->len, MIN(chunk_len, 1 + STREAM_LEN - offset));
+        CHECK_EQ(p_notification->data[0], i);
+        CHECK(memcmp(&p_notification->data[1], &stream_data[offset], p_notification->len - 1) == 0);
+        offset += p_notification->len - 1;
+    }
+    return offset;
+}
+
+static void test_stream_done(void)
+{
+    stream_start();
+    fixture_drain(0);
+
+    CHECK_EQ(handler_calls, 1);
+    CHECK_EQ(handler_result, BLE_HID_STREAM_DONE);
+    CHECK_EQ(handler_bytes, STREAM_LEN);
+    CHECK_EQ(check_chunks_received(), STREAM_LEN);
+    CHECK(!ble_hid_stream_busy());
+}
+
+static void test_stream_aborted_on_refused_chunk(void)
+{
+    static uint32_t const errors[] = {NRF_ERROR_INVALID_STATE, BLE_ERROR_GATTS_SYS_ATTR_MISSING, NRF_ERROR_BUSY, NRF_ERROR_FORBIDDEN};
+
+    for (uint8_t e = 0; e < ARRAY_SIZE(errors); e++)
+    {
+        // The first chunk takes the SoftDevice buffer, the second one is refused.
+        stream_start();
+        CHECK_EQ(sim_hvn_queued(0), 1);
+        sim_hvx_error_set(errors[e], 1);
+        fixture_drain(0);
+
+        CHECK_EQ(handler_calls, 1);
+        CHECK_EQ(handler_result, BLE_HID_STREAM_ABORTED);
+        CHECK_EQ(handler_bytes, ble_hid_raw_report_len_get() - 1);
+        CHECK_EQ(sim_notification_count(), 1);
+        CHECK_EQ(check_chunks_received(), handler_bytes);
+        CHECK(!ble_hid_stream_busy());
+        CHECK(ble_hid_tx_idle());
+    }
+
+    // The next stream starts over from sequence number 0.
+    test_stream_done();
+}
+
+static uint32_t output_calls;
+
+static void raw_output_handler(uint8_t const *p_data, uint16_t len)
+{
+    (void)p_data;
+    (void)len;
+    output_calls++;
+}
+
+static void test_raw_output_read_error_counted(void)
+{
+    uint8_t report[DESC_REPORT_LEN_RAW] = {0x5A};
+    ble_hid_raw_output_stats_t stats;
+
+    output_calls = 0;
+    ble_hid_raw_output_handler_set(raw_output_handler);
+    ble_hid_raw_output_stats_reset();
+
+    sim_output_report_error_set(NRF_ERROR_INVALID_PARAM);
+    sim_output_report_write(0, OUTPUT_INDEX_RAW, report, sizeof(report));
+    sim_output_report_error_set(NRF_SUCCESS);
+    fixture_drain(0);
+
+    ble_hid_raw_output_stats_get(&stats);
+    CHECK_EQ(stats.received, 1);
+    CHECK_EQ(stats.dropped, 1);
+    CHECK_EQ(stats.delivered, 0);
+    CHECK_EQ(output_calls, 0);
+    CHECK_EQ(ble_hid_raw_output_free_get(), BLE_HID_RAW_OUTPUT_SLOTS);
+
+    // The slot was not kept, the next report is delivered.
+    sim_output_report_write(0, OUTPUT_INDEX_RAW, report, sizeof(report));
+    fixture_drain(0);
+
+    ble_hid_raw_output_stats_get(&stats);
+    CHECK_EQ(stats.received, 2);
+    CHECK_EQ(stats.dropped, 1);
+    CHECK_EQ(stats.delivered, 1);
+    CHECK_EQ(output_calls, 1);
+    ble_hid_raw_output_handler_set(NULL);
+}
+
+int main(void)
+{
+    sim_config_t const config = {.hvn_tx_queue_size = 1, .tx_per_conn_event = 1, .conn_interval_us = 7500};
+
+    fixture_init(&config);
+    fixture_link_up(0);
+
+    TEST_RUN(test_stream_done);
+    TEST_RUN(test_stream_aborted_on_refused_chunk);
+    TEST_RUN(test_raw_output_read_error_counted);
+    CHECK_EQ(sim_app_error_count(), 0);
+    return TEST_RESULT();
+}
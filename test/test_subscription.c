@@ -0,0 +1,84 @@
+/*
+ * Subscriptions: a report the host of the active link has not enabled notifications for is refused at once,
+ * without reaching the SoftDevice, the pending queue or the connection activity. Each link has its own.
+ */
+#include "test.h"
+
+#define INPUT_INDEX_KEYBOARD 0 /* Input reports are registered keyboard, mouse, consumer, system, raw. */
+#define INPUT_INDEX_CONSUMER 2
+
+static uint8_t const consumer[DESC_REPORT_LEN_CONSUMER] = {0xE9};
+
+static ble_hid_send_status_t key_send(uint8_t key)
+{
+    uint8_t report[DESC_REPORT_LEN_KEYBOARD] = {0};
+    report[1] = key;
+
+    return ble_hid_report_send(DESC_REPORT_ID_KEYBOARD, report, sizeof(report));
+}
+
+static void test_unsubscribed_refused(void)
+{
+    ble_hid_perf_t perf;
+
+    // The host enabled the keyboard report only.
+    sim_notification_clear();
+    sim_connect(0);
+    sim_secure(0, sim_peer_add(0x50));
+    sim_cccd_set(0, INPUT_INDEX_KEYBOARD, true);
+    fixture_drain(0);
+    ble_hid_perf_reset();
+    uint32_t const requests = sim_conn_params_request_count();
+
+    CHECK(ble_hid_report_subscribed(DESC_REPORT_ID_KEYBOARD));
+    CHECK(!ble_hid_report_subscribed(DESC_REPORT_ID_CONSUMER));
+    CHECK(!ble_hid_stream_open(NULL));
+
+    CHECK_EQ(ble_hid_report_send(DESC_REPORT_ID_CONSUMER, consumer, sizeof(consumer)), BLE_HID_SEND_NOT_SUBSCRIBED);
+    CHECK_EQ(sim_hvn_queued(0), 0);
+    CHECK(ble_hid_tx_idle());
+    ble_hid_perf_get(1000, &perf);
+    CHECK_EQ(perf.submitted, 0);
+    sim_conn_event();
+    CHECK_EQ(sim_conn_params_request_count(), requests);
+
+    // Once enabled, the same report goes out.
+    sim_cccd_set(0, INPUT_INDEX_CONSUMER, true);
+    CHECK_EQ(ble_hid_report_send(DESC_REPORT_ID_CONSUMER, consumer, sizeof(consumer)), BLE_HID_SEND_OK);
+    fixture_drain(0);
+    CHECK_EQ(sim_notification_count(), 1);
+
+    // And is refused again when the host disables it.
+    sim_cccd_set(0, INPUT_INDEX_KEYBOARD, false);
+    CHECK_EQ(key_send(0x10), BLE_HID_SEND_NOT_SUBSCRIBED);
+}
+
+static void test_subscriptions_per_link(void)
+{
+    // A second host that has not enabled anything yet.
+    sim_connect(1);
+    sim_secure(1, sim_peer_add(0x51));
+    CHECK(ble_active_link_set(1));
+    CHECK_EQ(key_send(0x10), BLE_HID_SEND_NOT_SUBSCRIBED);
+    CHECK_EQ(ble_hid_report_send(DESC_REPORT_ID_CONSUMER, consumer, sizeof(consumer)), BLE_HID_SEND_NOT_SUBSCRIBED);
+
+    // The first host kept its own.
+    CHECK(ble_active_link_set(0));
+    CHECK(!ble_hid_report_subscribed(DESC_REPORT_ID_KEYBOARD));
+    CHECK(ble_hid_report_subscribed(DESC_REPORT_ID_CONSUMER));
+
+    sim_disconnect(1);
+    sim_disconnect(0);
+}
+
+int main(void)
+{
+    sim_config_t const config = {.hvn_tx_queue_size = 1, .tx_per_conn_event = 1, .conn_interval_us = 7500};
+
+    fixture_init(&config);
+
+    TEST_RUN(test_unsubscribed_refused);
+    TEST_RUN(test_subscriptions_per_link);
+    CHECK_EQ(sim_app_error_count(), 0);
+    return TEST_RESULT();
+}
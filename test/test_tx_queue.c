@@ -0,0 +1,252 @@
+/*
+ * Reports given while the SoftDevice queue is full wait in the pending queue and reach the host in order.
+ */
+#include "test.h"
+
+#define KEYS 40
+
+/* Press of key k, or the release of every key, as an NKRO report. */
+static void key_report(uint8_t *p_report, int key)
+{
+    memset(p_report, 0, DESC_REPORT_LEN_KEYBOARD);
+    if (key >= 0)
+    {
+        p_report[1 + key / 8] = (uint8_t)(1U << (key % 8));
+    }
+}
+
+/*
+ * Checks the host saw the press and the release of keys first to first + count - 1, in that order.
+ *
+ * A release and the next press can share a notification, the pending queue merges them as long as no transition
+ * is lost, so the key events are rebuilt from the successive states.
+ */
+static void check_typing_received(int first, int count)
+{
+    uint8_t state[DESC_REPORT_LEN_KEYBOARD] = {0};
+    int events = 0;
+
+    for (uint32_t n = 0; n < sim_notification_count(); n++)
+    {
+        sim_notification_t const *p_notification = sim_notification_get(n);
+        if (p_notification->len != DESC_REPORT_LEN_KEYBOARD) continue;
+
+        // Releases before presses, as the merged report replaces the release.
+        for (int pass = 0; pass < 2; pass++)
+        {
+            for (int key = 0; key < 8 * (DESC_REPORT_LEN_KEYBOARD - 1); key++)
+            {
+                uint8_t bit = (uint8_t)(1U << (key % 8));
+                bool was = (state[1 + key / 8] & bit) != 0;
+                bool is = (p_notification->data[1 + key / 8] & bit) != 0;
+                if ((was == is) || (is != (pass == 1))) continue;
+
+                // Even events are presses, odd ones releases, of key first + events / 2.
+                CHECK_EQ(key, first + events / 2);
+                CHECK_EQ(is, (events % 2) == 0);
+                events++;
+            }
+        }
+        memcpy(state, p_notification->data, sizeof(state));
+    }
+    CHECK_EQ(events, 2 * count);
+}
+
+static void test_burst_fills_softdevice_queue(void)
+{
+    uint8_t report[DESC_REPORT_LEN_KEYBOARD];
+    ble_hid_tx_queue_stats_t stats;
+    int const presses = (BLE_HID_TX_QUEUE_SIZE + 1) / 2;
+
+    ble_hid_tx_queue_stats_reset();
+    sim_notification_clear();
+
+    // No connection event in between: the first report takes the only SoftDevice buffer, the others wait.
+    for (int i = 0; i < 2 * presses; i++)
+    {
+        key_report(report, (i % 2 == 0) ? i / 2 : -1);
+        ble_hid_send_status_t status = ble_hid_report_send(DESC_REPORT_ID_KEYBOARD, report, sizeof(report));
+        CHECK_EQ(status, (i == 0) ? BLE_HID_SEND_OK : BLE_HID_SEND_QUEUED);
+    }
+    CHECK_EQ(sim_hvn_queued(0), 1);
+
+    ble_hid_tx_queue_stats_get(&stats);
+    CHECK(stats.depth > 0);
+    CHECK_EQ(stats.dropped, 0);
+
+    fixture_drain(0);
+    check_typing_received(0, presses);
+
+    ble_hid_tx_queue_stats_get(&stats);
+    CHECK_EQ(stats.depth, 0);
+    CHECK_EQ(stats.dropped, 0);
+}
+
+static void test_typing_faster_than_link(void)
+{
+    uint8_t report[DESC_REPORT_LEN_KEYBOARD];
+    ble_hid_tx_queue_stats_t stats;
+    int next = 0;
+
+    ble_hid_tx_queue_stats_reset();
+    sim_notification_clear();
+
+    // Three reports per connection event, the link sends one. A report refused with QUEUE_FULL is given again.
+    while (next < 2 * KEYS)
+    {
+        for (int i = 0; (i < 3) && (next < 2 * KEYS); i++)
+        {
+            key_report(report, (next % 2 == 0) ? next / 2 : -1);
+            ble_hid_send_status_t status = ble_hid_report_send(DESC_REPORT_ID_KEYBOARD, report, sizeof(report));
+            CHECK((status == BLE_HID_SEND_OK) || (status == BLE_HID_SEND_QUEUED) || (status == BLE_HID_SEND_QUEUE_FULL));
+            if (status == BLE_HID_SEND_QUEUE_FULL) break;
+            next++;
+        }
+        sim_conn_event();
+        ble_run();
+    }
+    fixture_drain(0);
+
+    check_typing_received(0, KEYS);
+
+    ble_hid_tx_queue_stats_get(&stats);
+    CHECK_EQ(stats.depth, 0);
+    CHECK(stats.high_water <= BLE_HID_TX_QUEUE_SIZE);
+}
+
+static void test_classes_keep_their_order(void)
+{
+    uint8_t key[DESC_REPORT_LEN_KEYBOARD];
+    uint8_t consumer[DESC_REPORT_LEN_CONSUMER] = {0};
+    uint8_t consumer_received = 0;
+
+    sim_notification_clear();
+
+    // Volume up presses interleaved with typing, both waiting behind a full SoftDevice queue.
+    for (int i = 0; i < 4; i++)
+    {
+        key_report(key, (i % 2 == 0) ? i / 2 : -1);
+        CHECK(ble_hid_report_send(DESC_REPORT_ID_KEYBOARD, key, sizeof(key)) <= BLE_HID_SEND_QUEUED);
+
+        consumer[0] = (i % 2 == 0) ? 0xE9 : 0x00;
+        CHECK(ble_hid_report_send(DESC_REPORT_ID_CONSUMER, consumer, sizeof(consumer)) <= BLE_HID_SEND_QUEUED);
+    }
+    fixture_drain(0);
+
+    check_typing_received(0, 2);
+    for (uint32_t i = 0; i < sim_notification_count(); i++)
+    {
+        sim_notification_t const *p_notification = sim_notification_get(i);
+        if (p_notification->len != DESC_REPORT_LEN_CONSUMER) continue;
+
+        // A press and its release are never merged.
+        CHECK_EQ(p_notification->data[0], (consumer_received % 2 == 0) ? 0xE9 : 0x00);
+        consumer_received++;
+    }
+    CHECK_EQ(consumer_received, 4);
+}
+
+static void check_mouse_received(int8_t const (*p_expected)[DESC_REPORT_LEN_MOUSE], uint32_t count)
+{
+    uint32_t received = 0;
+
+    for (uint32_t n = 0; n < sim_notification_count(); n++)
+    {
+        sim_notification_t const *p_notification = sim_notification_get(n);
+        if (p_notification->len != DESC_REPORT_LEN_MOUSE) continue;
+
+        CHECK(received < count);
+        if (received >= count) return;
+        CHECK_EQ(memcmp(p_notification->data, p_expected[received], DESC_REPORT_LEN_MOUSE), 0);
+        received++;
+    }
+    CHECK_EQ(received, count);
+}
+
+static void test_mouse_motion_coalesced(void)
+{
+    static int8_t const expected[][DESC_REPORT_LEN_MOUSE] = {
+        {0, 10, -5, 0, 0},
+        {0, 127, -20, 4, 0}, // Four reports summed, X saturated.
+        {0, 3, 0, 0, 0},     // What did not fit.
+        {1, 0, 0, 0, 0},
+    };
+    int8_t report[DESC_REPORT_LEN_MOUSE] = {0, 10, -5, 0, 0};
+    ble_hid_tx_queue_stats_t stats;
+
+    ble_hid_tx_queue_stats_reset();
+    sim_notification_clear();
+
+    CHECK_EQ(ble_hid_report_send(DESC_REPORT_ID_MOUSE, (uint8_t *)report, sizeof(report)), BLE_HID_SEND_OK);
+    report[3] = 1;
+    for (int i = 0; i < 3; i++)
+    {
+        CHECK_EQ(ble_hid_report_send(DESC_REPORT_ID_MOUSE, (uint8_t *)report, sizeof(report)), BLE_HID_SEND_QUEUED);
+    }
+    ble_hid_tx_queue_stats_get(&stats);
+    CHECK_EQ(stats.depth, 1);
+    CHECK_EQ(stats.coalesced, 2);
+
+    // Summed up to the axis limit, the rest waits in a report of its own.
+    int8_t const big_move[DESC_REPORT_LEN_MOUSE] = {0, 100, -5, 1, 0};
+    CHECK_EQ(ble_hid_report_send(DESC_REPORT_ID_MOUSE, (uint8_t const *)big_move, sizeof(big_move)), BLE_HID_SEND_QUEUED);
+
+    // A button change is never merged into motion.
+    int8_t const click[DESC_REPORT_LEN_MOUSE] = {1, 0, 0, 0, 0};
+    CHECK_EQ(ble_hid_report_send(DESC_REPORT_ID_MOUSE, (uint8_t const *)click, sizeof(click)), BLE_HID_SEND_QUEUED);
+
+    ble_hid_tx_queue_stats_get(&stats);
+    CHECK_EQ(stats.depth, 3);
+    CHECK_EQ(stats.coalesced, 2);
+
+    fixture_drain(0);
+    check_mouse_received(expected, ARRAY_SIZE(expected));
+
+    int8_t const release[DESC_REPORT_LEN_MOUSE] = {0};
+    CHECK_EQ(ble_hid_report_send(DESC_REPORT_ID_MOUSE, (uint8_t const *)release, sizeof(release)), BLE_HID_SEND_OK);
+    fixture_drain(0);
+}
+
+static void test_key_release_merged_with_next_press(void)
+{
+    uint8_t report[DESC_REPORT_LEN_KEYBOARD];
+    ble_hid_tx_queue_stats_t stats;
+
+    ble_hid_tx_queue_stats_reset();
+    sim_notification_clear();
+
+    // The release of key 0 and the press of key 1 share a report, a press and its own release never do.
+    key_report(report, 0);
+    CHECK_EQ(ble_hid_report_send(DESC_REPORT_ID_KEYBOARD, report, sizeof(report)), BLE_HID_SEND_OK);
+    key_report(report, -1);
+    CHECK_EQ(ble_hid_report_send(DESC_REPORT_ID_KEYBOARD, report, sizeof(report)), BLE_HID_SEND_QUEUED);
+    key_report(report, 1);
+    CHECK_EQ(ble_hid_report_send(DESC_REPORT_ID_KEYBOARD, report, sizeof(report)), BLE_HID_SEND_QUEUED);
+    key_report(report, -1);
+    CHECK_EQ(ble_hid_report_send(DESC_REPORT_ID_KEYBOARD, report, sizeof(report)), BLE_HID_SEND_QUEUED);
+
+    ble_hid_tx_queue_stats_get(&stats);
+    CHECK_EQ(stats.coalesced, 1);
+    CHECK_EQ(stats.depth, 2);
+
+    fixture_drain(0);
+    check_typing_received(0, 2);
+    CHECK_EQ(sim_notification_count(), 3);
+}
+
+int main(void)
+{
+    // One SoftDevice TX buffer, as with the default stack profile, and one notification per connection event.
+    sim_config_t const config = {.hvn_tx_queue_size = 1, .tx_per_conn_event = 1, .conn_interval_us = 7500};
+
+    fixture_init(&config);
+    fixture_link_up(0);
+
+    TEST_RUN(test_burst_fills_softdevice_queue);
+    TEST_RUN(test_typing_faster_than_link);
+    TEST_RUN(test_classes_keep_their_order);
+    TEST_RUN(test_mouse_motion_coalesced);
+    TEST_RUN(test_key_release_merged_with_next_press);
+    CHECK_EQ(sim_app_error_count(), 0);
+    return TEST_RESULT();
+}